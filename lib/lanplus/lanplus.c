@@ -111,6 +111,14 @@ char lan2_nodename[80] = {0};     /*SZGNOE = 80*/
 static int lan2_timeout = IPMI_LAN_TIMEOUT;  /*lanplus.h, usu =1*/
 static int slow_link = 0;     /* flag, =1 if slow link, latency > 100ms */
 static int recv_delay = 100;  /* delay before recv, usually 100us */
+static int sol_ack_defer = 0;   /* next SOL ACK rides on outbound data */
+static int sol_ack_pending = 0; /* deferred ACK not yet sent */
+static uint8_t sol_ack_seq = 0;
+static uint8_t sol_ack_count = 0;
+/* SOL stats: 0=rx retransmits, 1=rx seq gaps, 2=tx chars resent,
+ *            3=tx chars dropped, 4=ACKs sent with data */
+#define SOL_NSTATS  5
+static unsigned long sol_stats[SOL_NSTATS] = {0,0,0,0,0};
 static struct ipmi_rq_entry * ipmi_req_entries;
 static struct ipmi_rq_entry * ipmi_req_entries_tail;
 
@@ -383,6 +391,19 @@ void lanplus_set_recvdelay( int delay)
     }
 }
 
+void lanplus_set_sol_ackdefer( int on)
+{
+    /* hold the ACK for the next SOL packet received, to be sent along
+     * with the caller's next SOL data instead of in its own packet */
+    sol_ack_defer = on;
+}
+
+void lanplus_get_sol_stats( unsigned long *stats, int n)
+{
+    int i;
+    for (i = 0; i < n && i < SOL_NSTATS; i++) stats[i] = sol_stats[i];
+}
+
 
 static const struct valstr plus_payload_types_vals[] = {
     { IPMI_PAYLOAD_TYPE_IPMI,              "IPMI (0)" },	// IPMI Message
@@ -2705,12 +2726,18 @@ ipmi_lanplus_send_sol(
 	 */
 	v2_payload->payload_length = v2_payload->payload.sol_packet.character_count;
 
-	v2_payload->payload.sol_packet.acked_packet_number = 0; /* NA */
+	if (sol_ack_pending) {  /* ACK deferred by ipmi_lanplus_recv_sol */
+		v2_payload->payload.sol_packet.acked_packet_number = sol_ack_seq;
+		v2_payload->payload.sol_packet.accepted_character_count = sol_ack_count;
+		sol_ack_pending = 0;
+		sol_stats[4]++;
+	} else {
+		v2_payload->payload.sol_packet.acked_packet_number = 0; /* NA */
+		v2_payload->payload.sol_packet.accepted_character_count = 0; /* NA */
+	}
 
 	set_sol_packet_sequence_number(intf, v2_payload);
 
-	v2_payload->payload.sol_packet.accepted_character_count = 0; /* NA */
-
 	rs = ipmi_lanplus_send_payload(intf, v2_payload);
 
 	/* Determine if we need to resend some of our data */
@@ -2738,6 +2765,9 @@ ipmi_lanplus_send_sol(
 			intf->session->sol_data.sol_input_handler(rs);
 
 		set_sol_packet_sequence_number(intf, v2_payload);
+		v2_payload->payload.sol_packet.acked_packet_number = 0;
+		v2_payload->payload.sol_packet.accepted_character_count = 0;
+		sol_stats[2] += chars_to_resend;
 
 		/* Just send the required data */
 		memmove(v2_payload->payload.sol_packet.data,
@@ -2753,6 +2783,8 @@ ipmi_lanplus_send_sol(
 
 		chars_to_resend = is_sol_partial_ack(intf, v2_payload, rs);
 	}
+	if (chars_to_resend > 0)  /* NACK or transfer unavailable */
+		sol_stats[3] += chars_to_resend;
 
 	return rs;
 }
@@ -2793,9 +2825,17 @@ check_sol_packet_for_new_data(
 			"rsp dlen=%d rs_seq=%d sol_rseq=%d",
 			rsp->data_len, rsp->session.seq,
 			rsp->payload.sol_packet.packet_sequence_number);
+		if (rsp->payload.sol_packet.packet_sequence_number &&
+		    last_received_sequence_number &&
+		    (rsp->payload.sol_packet.packet_sequence_number !=
+			last_received_sequence_number) &&
+		    (rsp->payload.sol_packet.packet_sequence_number !=
+			(last_received_sequence_number % 0x0F) + 1))
+			sol_stats[1]++;  /* BMC gave up on some packet(s) */
 		if (rsp->payload.sol_packet.packet_sequence_number ==
 			last_received_sequence_number)
 		{
+			if (last_received_sequence_number) sol_stats[0]++;
 			if (verbose > 2) 
 			   lprintf(LOG_INFO,"check_sol: seq=%x retry match len=%d nlast=%d",
 				rsp->payload.sol_packet.packet_sequence_number,
@@ -2879,6 +2919,13 @@ ack_sol_packet(
 
 		ack.payload.sol_packet.accepted_character_count = (uint8_t)rsp->data_len;
 
+		if (sol_ack_defer) {
+			/* the caller sends SOL data next, which carries this ACK */
+			sol_ack_seq   = rsp->payload.sol_packet.packet_sequence_number;
+			sol_ack_count = (uint8_t)rsp->data_len;
+			sol_ack_pending = 1;
+			return;
+		}
 		if (verbose > 2)
 	           lprintf(LOG_INFO,"ack of seq_num 0x%x",rsp->payload.sol_packet.packet_sequence_number);  
 		ipmi_lanplus_send_payload(intf, &ack);
@@ -2908,6 +2955,7 @@ ipmi_lanplus_recv_sol(struct ipmi_intf * intf)
 		 */
 		check_sol_packet_for_new_data(intf, rsp);
 	}
+	sol_ack_defer = 0;  /* only applies to one receive */
 	return rsp;
 }
 
@@ -10,6 +10,8 @@
  *
  * ----------- Change History -----------------------------------------------
  * 08/18/08 Andy Cress - created from pefconfig.c
+ * 10/19/26 - added -u to restore only the params that changed
+ * 10/19/26 - read the list/save params in bulk with ipmi_cfg_read
  */
 /*M*
  *---------------------------------------------------------------------------
@@ -244,6 +246,8 @@ static uchar  gcm_ch        = 0;
 static uchar  SessInfo[16];
 static uchar  chan_type[MAXCHAN]; 
 static int    nlans = 0;
+static IPMI_CFGSNAP cfgsnap = {0, 0, NULL};  /* bulk read for list/save */
+static IPMI_CFGSNAP *psnap = NULL;  /* set while cfgsnap is valid */
 #define MAX_PEFPARAMS  14	/* max pef params = 14 */
 static char **pefdesc;
 static char *pefdesc1[MAXPEF] = {    /* for Sahalee BMC */
@@ -439,7 +443,7 @@ static int GetChanAcc(uchar chan, uchar parm, uchar *pLanRecord)
 	inputData[0] = chan;
 	inputData[1] = parm;  /* 0x80 = active, 0x40 = non-volatile */
 	responseLength = sizeof(responseData);
-        status = ipmi_cmd(GET_CHANNEL_ACC, inputData, 2, responseData,
+        status = ipmi_cmd_cfg(psnap, GET_CHANNEL_ACC, inputData, 2, responseData,
                         &responseLength, &completionCode, fdebug); 
 
 	if (status == ACCESS_OK) {
@@ -500,7 +504,7 @@ static int GetUser(int user_num)
          inputData[0] = lan_ch;
          inputData[1] = (uchar)user_num;  /* usually = 1 for BMC LAN */
 	 responseLength = sizeof(responseData);
-         status = ipmi_cmd(GET_USER_ACCESS, inputData, 2, responseData,
+         status = ipmi_cmd_cfg(psnap, GET_USER_ACCESS, inputData, 2, responseData,
                         &responseLength, &completionCode, fdebug);
 	 if (status == 0 && completionCode == 0) {
 	    uchar c;
@@ -515,7 +519,7 @@ static int GetUser(int user_num)
 	    c = responseData[3];
             inputData[0] = (uchar)user_num;  /* usually = 1 for BMC LAN */
 	    responseLength = sizeof(responseData);
-            status = ipmi_cmd(GET_USER_NAME, inputData, 1, responseData, 
+            status = ipmi_cmd_cfg(psnap, GET_USER_NAME, inputData, 1, responseData, 
 	 	        &responseLength, &completionCode, fdebug);
 	    if (status != 0 || completionCode != 0) 
                responseData[0] = 0;
@@ -562,7 +566,7 @@ static int GetSerEntry(uchar subfunc, uchar bset, uchar *pLanRecord)
 	   inputData[3] = 1;
  	}
 
-        status = ipmi_cmd(GET_SER_CONFIG, inputData, 4, responseData,
+        status = ipmi_cmd_cfg(psnap, GET_SER_CONFIG, inputData, 4, responseData,
                         &responseLength, &completionCode, fdebug); 
 	if (status == ACCESS_OK) {
 		if( completionCode ) {
@@ -645,7 +649,7 @@ static int GetLanEntry(uchar subfunc, uchar bset, uchar *pLanRecord)
 	inputData[2]            = bset;  // Set selector 
 	inputData[3]            = 0;  // Block selector
 
-        status = ipmi_cmd(GET_LAN_CONFIG, inputData, 4, responseData,
+        status = ipmi_cmd_cfg(psnap, GET_LAN_CONFIG, inputData, 4, responseData,
                         &responseLength, &completionCode, fdebug); 
 
 	if (status == ACCESS_OK) {
@@ -738,7 +742,7 @@ static int GetPefEntry(uchar subfunc, ushort rec_id, PEF_RECORD *pPefRecord)
 	inputData[1]            = (uchar)rec_id; 
 	inputData[2]            = 0; 
 
-        status = ipmi_cmd(GET_PEF_CONFIG, inputData, 3, responseData,
+        status = ipmi_cmd_cfg(psnap, GET_PEF_CONFIG, inputData, 3, responseData,
                         &responseLength, &completionCode, fdebug); 
 
         if (status == ACCESS_OK) {
@@ -1778,6 +1782,83 @@ int SerialIsOptional(int bparam)
    return(rv);
 }
 
+/*
+ * prefetch_config
+ * Queue all of the Get requests that the list/save code below will make,
+ * and read them with one pipelined batch, so that a save takes a few
+ * round trips instead of one per parameter.  Requests that are skipped
+ * here or that fail are just sent again by the Get functions.
+ */
+static void prefetch_config(int ndest, int fpef)
+{
+   IPMI_CFGPARM *pp;
+   uchar chan, nd;
+   int idx, ival, i;
+
+   if (fdebug) printf("prefetch_config: start\n");
+   if (!fIPMI10 && fpef) {  /*only if PEF capabilities were ok*/
+      for (idx = 1; idx <= pefmax; idx++) 
+	 ipmi_cfg_add(&cfgsnap, CFG_PEF, 0, 6, (uchar)idx, 0);
+      for (idx = 1; idx <= 4; idx++) 
+	 ipmi_cfg_add(&cfgsnap, CFG_PEF, 0, (uchar)idx, 0, 0);
+      for (idx = 1; idx <= ndest; idx++) 
+	 ipmi_cfg_add(&cfgsnap, CFG_PEF, 0, 9, (uchar)idx, 0);
+   }
+   for (chan = lan_ch; chan < MAXCHAN; chan++) {
+      if (chan_type[chan] != 4) continue;  /*not LAN*/
+      for (idx = 0; idx < NLAN; idx++) {
+	 ival = lanparams[idx].cmd;
+	 if (ival == 8 || ival == 9 || (ival >= 96 && ival <= 98)) continue;
+	 if (ival >= 102 && ival <= 108 && !fipv6) continue;
+	 if (ival >= 20 && ival <= 25 && !fIPMI20) continue;
+	 if (ival == 18 || ival == 19 || ival >= 192) continue;
+	 ipmi_cfg_add(&cfgsnap, CFG_LAN, chan, (uchar)ival, 0, 0);
+      }
+      ipmi_cfg_add(&cfgsnap, CFG_CHANACC, chan, 0x40, 0, 0);
+      for (i = 1; i <= nusers; i++) {
+	 ipmi_cfg_add(&cfgsnap, CFG_USERACC, chan, (uchar)i, 0, 0);
+	 ipmi_cfg_add(&cfgsnap, CFG_USERNAME, 0, (uchar)i, 0, 0);
+      }
+      if (lan_ch_parm != 0xff) break;
+   }
+   if (!fmBMC && (ser_ch != 0)) {
+      for (idx = 0; idx < NSER; idx++) {
+	 ival = serparams[idx].cmd;
+	 if (ival == 201) ipmi_cfg_add(&cfgsnap, CFG_CHANACC, ser_ch, 0x40,0,0);
+	 else if (ival == 10) ipmi_cfg_add(&cfgsnap, CFG_SER, ser_ch, 10, 0, 1);
+	 else ipmi_cfg_add(&cfgsnap, CFG_SER, ser_ch, (uchar)ival, 
+			(uchar)((ival == 17 || ival == 19) ? 1 : 0), 0);
+      }
+      for (i = 1; i <= nusers; i++) 
+	 ipmi_cfg_add(&cfgsnap, CFG_USERACC, ser_ch, (uchar)i, 0, 0);
+   }
+   ipmi_cfg_read(&cfgsnap, fdebug);
+
+   /* second pass: the LAN and serial alert destinations */
+   for (chan = lan_ch; chan < MAXCHAN; chan++) {
+      if (chan_type[chan] != 4) continue;
+      pp = ipmi_cfg_find(&cfgsnap, CFG_LAN, chan, 17, 0, 0);
+      if (pp == NULL || pp->rv != 0 || pp->cc != 0 || pp->len < 2) continue;
+      nd = pp->data[1];
+      for (i = 1; i <= nd && i < 16; i++) {
+	 ipmi_cfg_add(&cfgsnap, CFG_LAN, chan, 18, (uchar)i, 0);
+	 ipmi_cfg_add(&cfgsnap, CFG_LAN, chan, 19, (uchar)i, 0);
+      }
+      if (lan_ch_parm != 0xff) break;
+   }
+   pp = ipmi_cfg_find(&cfgsnap, CFG_SER, ser_ch, 16, 0, 0);
+   if (pp != NULL && pp->rv == 0 && pp->cc == 0 && pp->len >= 2) {
+      nd = pp->data[1];
+      for (i = 2; i <= nd && i < 16; i++) {
+	 ipmi_cfg_add(&cfgsnap, CFG_SER, ser_ch, 17, (uchar)i, 0);
+	 ipmi_cfg_add(&cfgsnap, CFG_SER, ser_ch, 19, (uchar)i, 0);
+      }
+   }
+   ipmi_cfg_read(&cfgsnap, fdebug);
+   psnap = &cfgsnap;
+   if (fdebug) printf("prefetch_config: %d params\n",cfgsnap.n);
+}
+
 static int parse_line(char *line, char *keyret, char *value)
 {
 	char *eol;
@@ -1812,6 +1893,224 @@ static int parse_line(char *line, char *keyret, char *value)
 	return 0;
 }
 
+/*
+ * Diff-based restore (-u): the current configuration is saved to a
+ * temporary file with the same code as -s, both files are loaded into
+ * CFG_ITEM tables, and only the records that differ are passed on to
+ * the normal restore loop.
+ */
+#define NCFG  512     /* parameter records added to a CFG_ITEM table at once */
+typedef struct {
+   char  key[40];     /* keyword and params, e.g. "LanParam 1,3,0" */
+   uchar rank;        /* group order for the apply pass */
+   uchar chan;
+   uchar idx;
+   uchar len;
+   uchar data[64];
+   uchar fchg;        /* 1=changed, 2=read-only, skipped */
+   int   line;
+} CFG_ITEM;
+
+static int cfg_rank(char *key)
+{
+   if (strncasecmp(key,"PEFParam",8) == 0) return(0);
+   if (strncasecmp(key,"LanParam",8) == 0) return(1);
+   if (strncasecmp(key,"ChannelAccess",13) == 0) return(2);
+   if (strncasecmp(key,"SOL",3) == 0) return(3);
+   if (strncasecmp(key,"SerialParam",11) == 0) return(4);
+   if (strncasecmp(key,"User",4) == 0) return(5);
+   if (strncasecmp(key,"SystemParam",11) == 0) return(6);
+   return(7);
+}
+
+/*
+ * cfg_load
+ * Load the parameter records in fp into a new CFG_ITEM table in *ppcfg,
+ * grown by NCFG records as needed.  The caller frees *ppcfg.
+ * Returns the number of records, or < 0 if out of memory.
+ */
+static int cfg_load(FILE *fp, CFG_ITEM **ppcfg)
+{
+   char line[240];
+   char key[40];
+   char value[200];
+   char *pk, *pc;
+   uchar bParams[5];
+   CFG_ITEM *pcfg = NULL;
+   CFG_ITEM *pgrow;
+   int n, i, sz, nparm;
+
+   n = 0;
+   *ppcfg = NULL;
+   while (fgets(line, sizeof(line), fp) != NULL)
+   {
+      if (parse_line(line, key, value) != 0) continue;
+      if ((n % NCFG) == 0) {
+         pgrow = (CFG_ITEM *)realloc(pcfg, (n + NCFG) * sizeof(CFG_ITEM));
+         if (pgrow == NULL) {
+            printf("cfg_load: out of memory at record %d\n",n);
+            free(pcfg);
+            return(LAN_ERR_OTHER);
+         }
+         pcfg = pgrow;
+      }
+      memset(&pcfg[n],0,sizeof(CFG_ITEM));
+      memset(bParams,0,sizeof(bParams));
+      pk = strchr(key,' ');
+      if (pk != NULL) *pk++ = 0;
+      nparm = 0;
+      while ((pk != NULL) && (nparm < sizeof(bParams))) {
+         while (*pk == ' ') pk++;
+         if (*pk == 0) break;
+         pc = strchr(pk,',');
+         if (pc != NULL) *pc++ = 0;
+         bParams[nparm++] = atob(pk);
+         pk = pc;
+      }
+      sz = sprintf(pcfg[n].key,"%.20s",key);
+      for (i = 0; i < nparm; i++) 
+         sz += sprintf(&pcfg[n].key[sz],"%c%d",(i == 0 ? ' ' : ','),
+			bParams[i]);
+      pcfg[n].rank = (uchar)cfg_rank(key);
+      pcfg[n].chan = bParams[0];
+      pcfg[n].idx  = bParams[1];
+      sz = strlen_(value);
+      for (i = 0; (i < sz) && (pcfg[n].len < sizeof(pcfg[n].data)); i += 3)
+         pcfg[n].data[pcfg[n].len++] = htoi(&value[i]);
+      pcfg[n].line = n;
+      n++;
+   }
+   *ppcfg = pcfg;
+   return(n);
+}
+
+static int cfg_readonly(CFG_ITEM *pitem)
+{
+   uchar idx = pitem->idx;
+   if (pitem->rank == 1) {  /*LanParam*/
+      if (idx == 0 || idx == 1 || idx == 17) return(1);
+      if (idx >= 22 && idx <= 24) return(1);   /*Cipher*/
+      if (idx == 5 && fIPMI20 && !fdomac) return(1);  /*MAC w/o -m*/
+   } else if (pitem->rank == 4) {  /*SerialParam*/
+      if (idx == 0 || idx == 1 || idx == 16) return(1);
+   } else if (strncasecmp(pitem->key,"SOLPayloadSupport",17) == 0) 
+      return(1);
+   return(0);
+}
+
+static void cfg_show(char *tag, CFG_ITEM *pitem)
+{
+   int i;
+   printf("%s %s%c",tag,pitem->key,bdelim);
+   for (i = 0; i < pitem->len; i++) printf(" %02x",pitem->data[i]);
+}
+
+/*
+ * cfg_diff 
+ * Compare the wanted config (fpnew) against the current one (fpcur),
+ * report each difference, and write the changed records to fpout,
+ * grouped by type and channel so that each kind of Set runs together.
+ * Returns the number of changed records, or < 0 on error.
+ */
+static int cfg_diff(FILE *fpnew, FILE *fpcur, FILE *fpout, uchar *pusers)
+{
+   CFG_ITEM *pnew, *pcur, *pc, *pn;
+   int *order;
+   int nnew, ncur, nchg, nsame, nro;
+   int i, j, k;
+
+   nnew = cfg_load(fpnew, &pnew);
+   if (nnew < 0) return(nnew);
+   ncur = cfg_load(fpcur, &pcur);
+   order = (int *)malloc((nnew + 1) * sizeof(int));
+   if (ncur < 0 || order == NULL) {
+      free(pnew);
+      if (ncur >= 0) free(pcur);
+      return(LAN_ERR_OTHER);  /*out of memory*/
+   }
+   if (fdebug) printf("cfg_diff: %d records in file, %d current\n",nnew,ncur);
+   nchg = 0; nsame = 0; nro = 0;
+   for (i = 0; i < nnew; i++) 
+   {
+      pn = &pnew[i];
+      if (cfg_readonly(pn)) { pn->fchg = 2; nro++; continue; }
+      for (j = 0; j < ncur; j++) 
+         if (strncasecmp(pcur[j].key,pn->key,sizeof(pn->key)) == 0) break;
+      pc = (j < ncur) ? &pcur[j] : NULL;
+      if ((pc != NULL) && (pc->len == pn->len) && 
+          (memcmp(pc->data,pn->data,pn->len) == 0) &&
+          !(fpassword && (strncasecmp(pn->key,"UserName",8) == 0)) ) {
+         nsame++;
+         continue;
+      }
+      pn->fchg = 1;
+      nchg++;
+      cfg_show("Change",pn);
+      if (pc == NULL) printf("  (not set)\n");
+      else {
+         printf("  was");
+         for (k = 0; k < pc->len; k++) printf(" %02x",pc->data[k]);
+         printf("\n");
+      }
+   }
+   /* Setting the IP (LanParam 3) also resets its source and grat arp,
+    * so put those back too, even if unchanged. */
+   for (i = 0; i < nnew; i++) {
+      if (pnew[i].rank != 1 || pnew[i].idx != 3 || pnew[i].fchg != 1) 
+         continue;
+      for (j = 0; j < nnew; j++) {
+         pn = &pnew[j];
+         if (pn->rank == 1 && pn->chan == pnew[i].chan && pn->fchg == 0 &&
+             (pn->idx == 4 || pn->idx == 10)) {
+            pn->fchg = 1;
+            nchg++;
+            cfg_show("Reset ",pn);
+            printf("  (with IP)\n");
+         }
+      }
+   }
+   /* Users not marked NoAccess currently, so a disable is needed */
+   for (j = 0; j < ncur; j++) {
+      pc = &pcur[j];
+      if ((strncasecmp(pc->key,"UserAccess",10) == 0) && (pc->len > 3) &&
+          ((pc->data[3] & 0x0f) != 0x0F) && (pc->idx < 64)) 
+         pusers[pc->idx] = 1;
+   }
+   for (i = 0; i < nnew; i++) {   /*last user enabled in the file*/
+      pn = &pnew[i];
+      if ((strncasecmp(pn->key,"UserAccess",10) == 0) && (pn->len > 3) &&
+          ((pn->data[3] & 0x0f) != 0x0F) && (pn->idx > last_user_enable))
+         last_user_enable = pn->idx;
+   }
+
+   /* order the changes: by group, then channel, then file order */
+   for (i = 0, k = 0; i < nnew; i++) {
+      if (pnew[i].fchg != 1) continue;
+      for (j = k; j > 0; j--) {
+         pc = &pnew[order[j-1]];
+         pn = &pnew[i];
+         if (pc->rank < pn->rank) break;
+         if (pc->rank == pn->rank && 
+             (pn->rank < 1 || pn->rank > 3 || pc->chan <= pn->chan)) break;
+         order[j] = order[j-1];
+      }
+      order[j] = i;
+      k++;
+   }
+   for (i = 0; i < k; i++) {
+      pn = &pnew[order[i]];
+      fprintf(fpout,"%s%c",pn->key,bdelim);
+      for (j = 0; j < pn->len; j++) fprintf(fpout," %02x",pn->data[j]);
+      fprintf(fpout,"\n");
+   }
+   printf("%s: %d records, %d unchanged, %d to set, %d read-only skipped\n",
+		progname,nnew,nsame,nchg,nro);
+   free(order);
+   free(pcur);
+   free(pnew);
+   return(nchg);
+}
+
 #ifdef METACOMMAND
 int i_config(int argc, char **argv)
 #else
@@ -1847,12 +2146,17 @@ main(int argc, char **argv)
    char *pk;
    char fpefok = 1;
    char fignore_err;
+   char fpefcap;
+   FILE *fd_new = NULL;   /* wanted config for -u */
+   FILE *fd_chg;
+   uchar rgusers[64];    /* users that may need a disable, for -u */
+   int nchg = 0;
 
    // progname = argv[0];
    printf("%s ver %s \n",progname,progver);
    func = 'l'; freadonly = 1;  /*list is default*/
 
-   while ((c = getopt(argc, argv,"cdmlr:s:xL:T:V:J:EYF:P:N:R:U:Z:?")) != EOF)
+   while ((c = getopt(argc, argv,"cdmlr:s:u:xL:T:V:J:EYF:P:N:R:U:Z:?")) != EOF)
       switch(c) {
           case 'c': fcanonical = 1; bdelim = BDELIM; break; 
           case 'd': func = 'd'; freadonly = 0; break;  /*set Defaults*/
@@ -1868,6 +2172,11 @@ main(int argc, char **argv)
 		if (sz > sizeof(filename)) sz = sizeof(filename);
 		strncpy(filename,optarg,sz);
 		break;
+          case 'u': func = 'u'; freadonly = 0;   /*restore changes only*/
+		sz = strlen_(optarg);
+		if (sz > sizeof(filename)) sz = sizeof(filename);
+		strncpy(filename,optarg,sz);
+		break;
           case 'x': fdebug = 1;     break;
 	  case 'p':      /* password to set */
 		fpassword = 1;
@@ -1895,11 +2204,12 @@ main(int argc, char **argv)
                 parse_lan_options(c,optarg,fdebug);
                 break;
 	  default:
-             printf("Usage: %s [-clmpxLNUPREFTJVY -r <file> -s <file>]\n",
+             printf("Usage: %s [-clmpxLNUPREFTJVY -r <file> -s <file> -u <file>]\n",
 			 progname);
              printf("where -l  Lists BMC configuration parameters\n");
              printf("      -r  Restores BMC configuration from <file>\n");
              printf("      -s  Saves BMC configuration to <file>\n");
+             printf("      -u  Restores only the params that differ from <file>\n");
              printf("      -c  canonical output with delimiter '%c'\n",BDELIM);
              printf("      -m  Set BMC MAC during restore\n");
              printf("      -x  show eXtra debug messages\n");
@@ -1914,6 +2224,9 @@ main(int argc, char **argv)
 	case 'l':  fd_bmc = stdout; break;
 	case 'r':  fd_bmc = fopen(filename,"r"); break;
 	case 's':  fd_bmc = fopen(filename,"w"); break;
+	case 'u':  fd_new = fopen(filename,"r"); 
+		   if (fd_new != NULL) fd_bmc = tmpfile(); /*current config*/
+		   break;
 	default: break;
    }
    if (fd_bmc == NULL) {
@@ -2034,6 +2347,7 @@ main(int argc, char **argv)
    }
 
    ret = GetPefCapabilities(&bset);
+   fpefcap = (ret == 0);
    if ((ret == 0) && (bset <= MAXPEF)) pefmax = bset;
 
    /* Get the BMC LAN channel & match it to an OS eth if. */
@@ -2091,8 +2405,9 @@ main(int argc, char **argv)
    }
 
    /* set the lan_user appropriately */
-   if (freadonly) 
+   if (freadonly || (func == 'u'))  /* -u saves the current config first */
    {
+     prefetch_config(ndest, fpefcap);
      if (!fIPMI10) {
       printf("%c## %s, GetPefEntry ...\n",bcomment,progname);
       for (idx = 1; idx <= pefmax; idx++)
@@ -2359,14 +2674,37 @@ main(int argc, char **argv)
 	}
      }  /*end-for System Params*/
 
+     psnap = NULL;  /* the snapshot is stale once anything is set */
+     ipmi_cfg_free(&cfgsnap);
     } /*endif readonly*/
 
+    if (func == 'u') {  /* keep only the records that differ */
+       fd_chg = tmpfile();
+       if (fd_chg == NULL) {
+	  printf("Error: cannot create temp file\n");
+	  ret = ERR_FILE_OPEN;
+	  goto do_exit;
+       }
+       rewind(fd_bmc);
+       memset(rgusers,0,sizeof(rgusers));
+       nchg = cfg_diff(fd_new, fd_bmc, fd_chg, rgusers);
+       fclose(fd_bmc);
+       fd_bmc = fd_chg;
+       rewind(fd_bmc);
+       if (nchg <= 0) {
+	  ret = nchg;
+	  goto do_exit;
+       }
+       ret = 0;
+    }
+
     if (!freadonly)  /* Set parameters via Restore */
     {
        if (fipmilan) { /* Sets not valid via ipmi_lan if same channel. */
          printf("\nWarning: Setting LAN %d params while using a LAN channel.\n",		lan_ch);
        }
-       GetUser(1);  /*sets num enabled_users */
+       if (func != 'u') 
+          GetUser(1);  /*sets num enabled_users, -u already did*/
 
        /* Set BMC parameters.  (restore)  */
        /* read each record from the file */
@@ -2669,6 +3007,10 @@ main(int argc, char **argv)
 
        /* Disable any users not enabled above */
        for (i = last_user_enable+1; i < max_users; i++) {
+		/* with -u, skip users that are already NoAccess */
+		if ((func == 'u') && ((i >= sizeof(rgusers)) || !rgusers[i]))
+		   continue;
+		pc = (uchar *)&PefRecord;
 		pc[0] = (uchar)i;  /*user number, 1=null_user */
 		pc[1] = 0x00;  /*disable user*/
 		rlen = sizeof(rData);
@@ -2682,7 +3024,11 @@ main(int argc, char **argv)
 
 do_exit:
    if (fd_bmc != NULL && fd_bmc != stdout) fclose(fd_bmc);
+   if (fd_new != NULL) fclose(fd_new);
    ipmi_close_();
+   if ((func == 'u') && (nchg > 0)) 
+	printf("%s: %d params changed, %d sets ok, %d errors\n",
+		progname,nchg,ngood,nerrs);
    if (nerrs > 0) {
 	printf("Warning: %d ok, %d errors occurred, last error = %d\n",ngood,nerrs,lasterr);
         ret = lasterr;
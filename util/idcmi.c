@@ -4,6 +4,7 @@
  *
  * Change history:
  *  11/17/2011 ARCress - created
+ *  10/19/26 - added power sample, with rolling stats and -f fleet mode
  *
  *---------------------------------------------------------------------
  */
@@ -41,6 +42,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "getopt.h"
 #else
 #include <sys/types.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
 #if defined(HPUX)
 /* getopt is defined in stdio.h */
 #elif defined(MACOS)
@@ -84,6 +92,13 @@ static int asset_len = 0;
 static int mcid_len  = 0;
 static char mc_id[64];
 static char asset[64];
+static char  *hostfile  = NULL;  /*-f file of nodes, for fleet sampling*/
+static char  *outfile   = NULL;  /*-o file for the sample stream*/
+static int    samp_ms   = 1000;  /*-i msec between power samples*/
+static int    samp_cnt  = 0;     /*-c samples to take, 0 = until killed*/
+static int    samp_win  = 120;   /*-w samples in the rolling stats*/
+static int    stale_ms  = 0;     /*-l reply msec that flags a sample stale*/
+static uchar  fbinary   = 0;     /*-b write binary sample records*/
 
 #ifdef NOT
 /* see idcmi.h */
@@ -108,11 +123,18 @@ static char asset[64];
 
 static int dcmi_usage(void)
 {
-   printf("Usage: %s [-admsx -NUPREFTVY] <function>\n", progname);
+   printf("Usage: %s [-abcdfilmoswx -NUPREFTVY] <function>\n", progname);
    printf("       -a       Set DCMI Asset Tag to this string\n");
+   printf("       -b       power sample: write binary records to -o file\n");
+   printf("       -c N     power sample: take N samples (default 0=until killed)\n");
    printf("       -d       Set DCMI MC ID to this string\n");
+   printf("       -f file  power sample: sample each BMC node in this file\n");
+   printf("       -i N     power sample: msec between samples (default 1000)\n");
+   printf("       -l N     power sample: flag replies over N msec as stale\n");
    printf("       -m002000 specific MC (bus 00,sa 20,lun 00)\n");
+   printf("       -o file  power sample: append the samples to this file\n");
    printf("       -s       Get DCMI sensor info\n");
+   printf("       -w N     power sample: samples in the rolling stats (default 120)\n");
    printf("       -x       Display extra debug messages\n");
    print_lan_opt_usage(1);
    printf("where <function> is one of:\n");
@@ -123,6 +145,7 @@ static int dcmi_usage(void)
    printf("                             (action = no_action | power_off | log_sel)\n");
    printf("   power set_correction <ms> Set Power limit correction time (in ms)\n");
    printf("   power set_sample <sec>    Set Power limit sampling period (in sec)\n");
+   printf("   power sample              Sample the Power reading every -i msec\n");
    printf("   power activate            Activate Power limit\n");
    printf("   power deactivate          Deactivate Power limit\n");
    printf("   thermal     Get/Set DCMI Thermal parameters\n");
@@ -734,6 +757,485 @@ static int dcmi_show_all_capab(void)
    return(rv);
 }
 
+#ifdef WIN32
+static int dcmi_sample(int ffleet)
+{
+   printf("DCMI power sample is not supported on this OS\n");
+   return(LAN_ERR_NOTSUPPORT);
+}
+#else
+/*
+ * Power sampling: "power sample" sends Get Power Reading every samp_ms
+ * over the one open session.  The deadlines are fixed multiples of samp_ms
+ * from a start time, so a slow reply does not shift the later samples;
+ * any ticks that pass during a slow reply are skipped and counted.
+ * Each sample goes to the stream as a CSV line, or a binary record if -b,
+ * and each node keeps rolling stats over its last samp_win samples.
+ * With -f, each node is sampled by a child process, since the IPMI
+ * library keeps one session per process, and the children send their
+ * samples to the parent over a pipe.  All children use the same start
+ * time, so the nodes are sampled at the same ticks.
+ */
+#define PS_STALE   0x01  /*reply took longer than stale_ms*/
+#define PS_NOTICK  0x02  /*BMC timestamp has not advanced in PS_TSLAG*/
+#define PS_INACT   0x04  /*power reading state is not active*/
+#define PS_SKIP    0x08  /*ticks were skipped before this sample*/
+#define PS_ERROR   0x80  /*the command failed, cc has the error*/
+#define PS_TSLAG   3000  /*msec the 1-sec BMC timestamp may stay the same*/
+#define PS_HDRSZ   16    /*binary stream header, before the node names*/
+#define PS_RECSZ   24    /*binary stream sample record*/
+#define PS_STOPMS  5000  /*msec children have to exit after a stop*/
+
+typedef struct {
+   double tms;      /*wall clock when the request was sent, msec*/
+   ulong  bmc_ts;   /*timestamp in the power reading*/
+   ulong  lat_us;   /*usec until the BMC replied*/
+   ulong  nskip;    /*ticks skipped before this sample*/
+   ushort watts;    /*current power*/
+   uchar  flags;    /*PS_* flags*/
+   uchar  cc;       /*completion code, or 0xFF for a LAN error*/
+} POWSAMP;
+
+typedef struct {
+   char    node[SZGNODE+1];
+   pid_t   pid;
+   int     fd;      /*read end of the pipe from the child*/
+   char    state;   /*0=idle, 1=running, 2=done*/
+   char    result;  /*0=ok, 1=failed*/
+   int     npart;   /*bytes of a partial sample from the pipe*/
+   uchar   part[sizeof(POWSAMP)];
+   ushort *wring;   /*watts of the last samp_win good samples*/
+   ulong  *lring;   /*latency usec of the same samples*/
+   int     nring;
+   int     iring;
+   ulong   nsamp, nerr, nstale, nskip;
+} PSNODE;
+static PSNODE *psnode = NULL;
+static int     npsnode = 0;
+static FILE   *fpsamp = NULL;  /*sample stream*/
+static FILE   *fpstat = NULL;  /*stats report*/
+static volatile sig_atomic_t samp_done = 0;
+static volatile sig_atomic_t samp_dump = 0;
+
+static void ps_sig(int sig)
+{
+   if (sig == SIGUSR1) samp_dump = 1;
+   else samp_done = 1;
+}
+
+static double ps_wall(void)
+{
+   struct timeval tv;
+   gettimeofday(&tv,NULL);
+   return((double)tv.tv_sec * 1000.0 + (double)(tv.tv_usec / 1000));
+}
+
+static int ps_add_node(char *node)
+{
+   PSNODE *pnew;
+   if ((npsnode % 64) == 0) {
+      pnew = realloc(psnode, (npsnode + 64) * sizeof(PSNODE));
+      if (pnew == NULL) return(ERR_BAD_PARAM);
+      psnode = pnew;
+   }
+   memset(&psnode[npsnode],0,sizeof(PSNODE));
+   strncpy(psnode[npsnode].node,node,SZGNODE);
+   psnode[npsnode].fd = -1;
+   npsnode++;
+   return(0);
+}
+
+/* ps_alloc_rings - the rolling stats use fixed memory per node */
+static int ps_alloc_rings(void)
+{
+   uchar *pmem;
+   int i;
+
+   pmem = malloc(npsnode * samp_win * (sizeof(ushort) + sizeof(ulong)));
+   if (pmem == NULL) return(ERR_BAD_PARAM);
+   for (i = 0; i < npsnode; i++) {
+      psnode[i].lring = (ulong *)pmem;
+      pmem += samp_win * sizeof(ulong);
+   }
+   for (i = 0; i < npsnode; i++) {
+      psnode[i].wring = (ushort *)pmem;
+      pmem += samp_win * sizeof(ushort);
+   }
+   return(0);
+}
+
+static void ps_put(uchar *p, double val, int len)
+{
+   unsigned long long v = (unsigned long long)val;
+   int i;
+   for (i = 0; i < len; i++) { p[i] = (uchar)(v & 0xff); v >>= 8; }
+}
+
+static void ps_write_hdr(void)
+{
+   uchar hdr[PS_HDRSZ];
+   int i;
+
+   memset(hdr,0,sizeof(hdr));
+   memcpy(hdr,"iDCM",4);
+   ps_put(&hdr[4],1,2);         /*version*/
+   ps_put(&hdr[6],PS_RECSZ,2);
+   ps_put(&hdr[8],samp_ms,4);
+   ps_put(&hdr[12],npsnode,4);
+   fwrite(hdr,1,sizeof(hdr),fpsamp);
+   for (i = 0; i < npsnode; i++)
+      fwrite(psnode[i].node,1,strlen(psnode[i].node)+1,fpsamp);
+}
+
+/* ps_write - write one sample to the stream, as a CSV line or a record */
+static void ps_write(int inode, POWSAMP *ps)
+{
+   uchar rec[PS_RECSZ];
+
+   if (fbinary) {
+      ps_put(&rec[0],ps->tms,8);
+      ps_put(&rec[8],inode,4);
+      ps_put(&rec[12],ps->bmc_ts,4);
+      ps_put(&rec[16],ps->lat_us,4);
+      ps_put(&rec[20],ps->watts,2);
+      rec[22] = ps->flags;
+      rec[23] = ps->cc;
+      fwrite(rec,1,sizeof(rec),fpsamp);
+   } else
+      fprintf(fpsamp,"%.3f,%s,%u,%.3f,%lu,%u,%u\n", ps->tms / 1000.0,
+	      psnode[inode].node, ps->watts, ps->lat_us / 1000.0,
+	      ps->bmc_ts, ps->flags, ps->cc);
+}
+
+/* ps_record - add a sample to the node stats, and write it out */
+static void ps_record(PSNODE *pn, POWSAMP *ps)
+{
+   pn->nsamp++;
+   pn->nskip += ps->nskip;
+   if (ps->flags & (PS_STALE | PS_NOTICK)) pn->nstale++;
+   if (ps->flags & PS_ERROR) pn->nerr++;
+   else {
+      pn->wring[pn->iring] = ps->watts;
+      pn->lring[pn->iring] = ps->lat_us;
+      pn->iring = (pn->iring + 1) % samp_win;
+      if (pn->nring < samp_win) pn->nring++;
+   }
+   ps_write((int)(pn - psnode),ps);
+}
+
+static int ps_cmp(const void *a, const void *b)
+{
+   ulong x = *(const ulong *)a;
+   ulong y = *(const ulong *)b;
+   return((x > y) - (x < y));
+}
+
+/* ps_pct - percentile from a sorted array, nearest rank */
+static ulong ps_pct(ulong *v, int n, int pct)
+{
+   return(v[((n - 1) * pct + 50) / 100]);
+}
+
+/* ps_report - show the rolling stats of each node */
+static void ps_report(void)
+{
+   ulong *v;
+   PSNODE *pn;
+   double wsum, lsum;
+   int i, j, n;
+   char b = BDELIM;
+
+   v = malloc(samp_win * sizeof(ulong));
+   if (v == NULL) return;
+   fprintf(fpstat,"%-16s%c%7s%c%6s%c%6s%c%6s%c%5s%c%7s%c%5s%c%5s%c%5s%c%5s%c%8s%c%8s%c%8s\n",
+	"Node",b,"Samples",b,"Errors",b,"Stale",b,"Skips",b,"Min",b,"Avg",b,
+	"Max",b,"P50",b,"P95",b,"P99",b,"Lat_avg",b,"Lat_p99",b,"Lat_max");
+   for (i = 0; i < npsnode; i++) {
+      pn = &psnode[i];
+      fprintf(fpstat,"%-16s%c%7lu%c%6lu%c%6lu%c%6lu",pn->node,b,
+	      pn->nsamp,b,pn->nerr,b,pn->nstale,b,pn->nskip);
+      n = pn->nring;
+      if (n == 0) { fprintf(fpstat,"\n"); continue; }
+      wsum = lsum = 0;
+      for (j = 0; j < n; j++) { v[j] = pn->wring[j]; wsum += v[j]; }
+      qsort(v,n,sizeof(ulong),ps_cmp);
+      fprintf(fpstat,"%c%5lu%c%7.1f%c%5lu%c%5lu%c%5lu%c%5lu",b,v[0],b,
+	      wsum / n,b,v[n-1],b,ps_pct(v,n,50),b,ps_pct(v,n,95),b,
+	      ps_pct(v,n,99));
+      for (j = 0; j < n; j++) { v[j] = pn->lring[j]; lsum += v[j]; }
+      qsort(v,n,sizeof(ulong),ps_cmp);
+      fprintf(fpstat,"%c%8.2f%c%8.2f%c%8.2f\n",b,lsum / n / 1000.0,b,
+	      ps_pct(v,n,99) / 1000.0,b,v[n-1] / 1000.0);
+   }
+   fflush(fpstat);
+   free(v);
+}
+
+/* ps_take - get one power reading and time the BMC reply */
+static void ps_take(POWSAMP *ps, ulong *plast_ts, double *plast_chg)
+{
+   uchar rdata[32];
+   double t1, t2;
+   int rv;
+
+   memset(ps,0,sizeof(POWSAMP));
+   memset(rdata,0,sizeof(rdata));
+   ps->tms = ps_wall();
+   t1 = os_mono();
+   rv = dcmi_get_power_read(1, rdata, sizeof(rdata));
+   t2 = os_mono();
+   ps->lat_us = (ulong)((t2 - t1) * 1000.0);
+   if (stale_ms > 0 && (t2 - t1) > stale_ms) ps->flags |= PS_STALE;
+   if (rv != 0) {
+      ps->flags |= PS_ERROR;
+      ps->cc = (rv > 0 && rv < 0x100) ? (uchar)rv : 0xFF;
+      return;
+   }
+   ps->watts  = rdata[1] + (rdata[2] << 8);
+   ps->bmc_ts = rdata[9] + (rdata[10] << 8) + (rdata[11] << 16) +
+                ((ulong)rdata[12] << 24);
+   if ((rdata[17] & 0x40) == 0) ps->flags |= PS_INACT;
+   if (ps->bmc_ts != *plast_ts) {
+      *plast_ts = ps->bmc_ts;
+      *plast_chg = t2;
+   } else if (t2 - *plast_chg > PS_TSLAG) ps->flags |= PS_NOTICK;
+}
+
+/*
+ * ps_sampler - take samples at the ticks t0 + k*samp_ms until done.
+ * If fdout is open, the samples are sent there (fleet child), otherwise
+ * they are recorded for pn directly.
+ */
+static int ps_sampler(PSNODE *pn, int fdout, double t0)
+{
+   POWSAMP ps;
+   struct timespec ts;
+   double tnow, tnext, last_chg;
+   ulong k, n, nskip, last_ts;
+   long us;
+
+   last_ts = 0;
+   last_chg = tnow = os_mono();
+   /* start at the first tick from now, allowing 1 msec of slack */
+   k = (tnow > t0) ? (ulong)((tnow - t0) / samp_ms) : 0;
+   if (t0 + (double)k * samp_ms < tnow - 1.0) k++;
+   nskip = 0;
+   for (n = 0; (samp_cnt == 0) || (n < (ulong)samp_cnt); n++) {
+      tnext = t0 + (double)k * samp_ms;
+      while (!samp_done && (tnow = os_mono()) < tnext) {
+         us = (long)((tnext - tnow) * 1000.0);
+         ts.tv_sec  = us / 1000000;
+         ts.tv_nsec = (us % 1000000) * 1000;
+         nanosleep(&ts,NULL);
+      }
+      if (samp_done) break;
+      ps_take(&ps,&last_ts,&last_chg);
+      ps.nskip = nskip;
+      if (nskip > 0) ps.flags |= PS_SKIP;
+      if (fdout >= 0) {
+         if (write(fdout,&ps,sizeof(ps)) != sizeof(ps)) break;
+      } else {
+         ps_record(pn,&ps);
+         fflush(fpsamp);
+         if (samp_dump) { samp_dump = 0; ps_report(); }
+      }
+      /* the next tick is the first one still ahead of the clock */
+      k++;
+      tnow = os_mono();
+      nskip = 0;
+      if (t0 + (double)k * samp_ms <= tnow) {
+         nskip = (ulong)((tnow - t0) / samp_ms) + 1 - k;
+         k += nskip;
+      }
+   }
+   return(0);
+}
+
+static void ps_start(PSNODE *pn, double t0)
+{
+   int i, rv, fd;
+   uchar cdata[32];
+
+   pn->state = 2;
+   pn->result = 1;
+   pn->pid = node_fork(pn->node,0,&fd);
+   if (pn->pid < 0) {
+      fprintf(fpstat,"%s: fork error %d\n",pn->node,errno);
+      return;
+   }
+   if (pn->pid == 0) {  /*child*/
+      for (i = 0; i < npsnode; i++)
+         if (psnode[i].state == 1) close(psnode[i].fd);
+      dup2(2,1);  /*library messages go to stderr, not the stream*/
+      rv = dcmi_get_capab(1, cdata, sizeof(cdata));
+      if (rv == 0 && (cdata[5] & 0x01) == 0) rv = LAN_ERR_NOTSUPPORT;
+      if (rv != 0)
+         fprintf(stderr,"%s: DCMI power reading not available, ret = %d\n",
+		 pn->node,rv);
+      else rv = ps_sampler(pn,fd,t0);
+      ipmi_close_();
+      _exit(rv == 0 ? 0 : 1);
+   }
+   pn->fd = fd;
+   pn->state = 1;
+   pn->result = 0;
+}
+
+static void ps_read(PSNODE *pn)
+{
+   uchar buf[sizeof(POWSAMP) * 64];
+   POWSAMP ps;
+   int n, m, i;
+   int status;
+
+   n = (int)read(pn->fd,buf,sizeof(buf));
+   if (n < 0 && errno == EINTR) return;
+   if (n <= 0) {  /*child has exited*/
+      status = node_reap(pn->pid,pn->fd,0);
+      pn->fd = -1;
+      pn->state = 2;
+      if ((status == -1) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0)) 
+         pn->result = 1;
+      return;
+   }
+   for (i = 0; i < n; i += m) {
+      m = (int)sizeof(POWSAMP) - pn->npart;
+      if (m > n - i) m = n - i;
+      memcpy(&pn->part[pn->npart],&buf[i],m);
+      pn->npart += m;
+      if (pn->npart == sizeof(POWSAMP)) {
+         memcpy(&ps,pn->part,sizeof(ps));
+         ps_record(pn,&ps);
+         pn->npart = 0;
+      }
+   }
+}
+
+/* ps_fleet - sample each node in a child, and merge the samples */
+static int ps_fleet(double t0)
+{
+   struct pollfd *pfds;
+   struct rlimit rl;
+   int *pmap;
+   int i, n, np, nrun, nfail;
+   double tstop = 0;
+
+   /* one pipe per node, so allow as many open files as permitted */
+   if (getrlimit(RLIMIT_NOFILE,&rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+      rl.rlim_cur = rl.rlim_max;
+      setrlimit(RLIMIT_NOFILE,&rl);
+   }
+   pfds = malloc(npsnode * sizeof(struct pollfd));
+   pmap = malloc(npsnode * sizeof(int));
+   if (pfds == NULL || pmap == NULL) return(ERR_BAD_PARAM);
+   nrun = 0;
+   for (i = 0; i < npsnode && !samp_done; i++) {
+      ps_start(&psnode[i],t0);
+      if (psnode[i].state == 1) nrun++;
+   }
+   while (nrun > 0) {
+      if (samp_done) {
+         if (tstop == 0) {  /*pass the stop on to the children*/
+            tstop = os_mono();
+            for (i = 0; i < npsnode; i++)
+               if (psnode[i].state == 1) kill(psnode[i].pid,SIGTERM);
+         } else if (os_mono() - tstop > PS_STOPMS) {
+            for (i = 0; i < npsnode; i++)
+               if (psnode[i].state == 1) kill(psnode[i].pid,SIGKILL);
+         }
+      }
+      np = 0;
+      for (i = 0; i < npsnode; i++) {
+         if (psnode[i].state != 1) continue;
+         pfds[np].fd = psnode[i].fd;
+         pfds[np].events = POLLIN;
+         pfds[np].revents = 0;
+         pmap[np++] = i;
+      }
+      n = poll(pfds,np,1000);
+      if (n < 0 && errno != EINTR) {
+         fprintf(fpstat,"poll error %d\n",errno);
+         samp_done = 1;
+      }
+      for (i = 0; n > 0 && i < np; i++) {
+         if (pfds[i].revents == 0) continue;
+         ps_read(&psnode[pmap[i]]);
+         if (psnode[pmap[i]].state == 2) nrun--;
+      }
+      fflush(fpsamp);
+      if (samp_dump) { samp_dump = 0; ps_report(); }
+   }
+   free(pfds);
+   free(pmap);
+   nfail = 0;
+   for (i = 0; i < npsnode; i++)
+      if (psnode[i].result != 0) nfail++;
+   if (nfail > 0) {
+      fprintf(fpstat,"%s: %d of %d nodes failed\n",progname,nfail,npsnode);
+      return(LAN_ERR_OTHER);
+   }
+   return(0);
+}
+
+/*
+ * dcmi_sample - sample the power reading of this node, or of each
+ * node in the -f file if ffleet.
+ */
+static int dcmi_sample(int ffleet)
+{
+   char *node;
+   int rv;
+
+   if (samp_ms < 1) samp_ms = 1;
+   if (samp_win < 1) samp_win = 1;
+   if (stale_ms == 0) stale_ms = samp_ms;
+   if (fbinary && outfile == NULL) {
+      printf("power sample -b needs an output file (-o)\n");
+      return(ERR_BAD_PARAM);
+   }
+   if (ffleet) rv = read_nodes(hostfile,ps_add_node);
+   else {
+      node = get_nodename();
+      rv = ps_add_node((node == NULL || node[0] == 0) ? "local" : node);
+   }
+   if (rv == 0) rv = ps_alloc_rings();
+   if (rv != 0) return(rv);
+   if (outfile == NULL) {
+      fpsamp = stdout;
+      fpstat = stderr;
+   } else {
+      fpsamp = fopen(outfile,"a");
+      if (fpsamp == NULL) {
+         printf("cannot open %s\n",outfile);
+         return(ERR_FILE_OPEN);
+      }
+      fpstat = stdout;
+   }
+   if (fbinary) ps_write_hdr();
+   else fprintf(fpsamp,"time,node,watts,latency_ms,bmc_time,flags,ccode\n");
+   fflush(fpsamp);
+
+   signal(SIGINT,ps_sig);
+   signal(SIGTERM,ps_sig);
+   signal(SIGUSR1,ps_sig);
+   signal(SIGPIPE,SIG_IGN);
+   if (ffleet) rv = ps_fleet(os_mono());
+   else rv = ps_sampler(&psnode[0],-1,os_mono());
+   signal(SIGINT,SIG_DFL);
+   signal(SIGTERM,SIG_DFL);
+   signal(SIGUSR1,SIG_DFL);
+
+   ps_report();
+   if (fpsamp != stdout) fclose(fpsamp);
+   else fflush(fpsamp);
+   free(psnode[0].lring);
+   free(psnode);
+   psnode = NULL;
+   npsnode = 0;
+   return(rv);
+}
+#endif
+
 #ifdef METACOMMAND
 int i_dcmi(int argc, char **argv)
 #else
@@ -750,14 +1252,22 @@ main(int argc, char **argv)
 	char *s1;
 	uchar cdata[32];
 	uchar powdata[32];
+	uchar fsample = 0;
 
 	printf("%s ver %s\n", progname,progver);
 	parse_lan_options('V',"4",0);  /*default to admin priv*/
 
-        while ( (c = getopt( argc, argv,"a:d:m:p:sT:V:J:EYF:P:N:R:U:Z:x?")) != EOF )
+        while ( (c = getopt( argc, argv,"a:bc:d:f:i:l:m:o:p:sw:T:V:J:EYF:P:N:R:U:Z:x?")) != EOF )
 	switch (c) {
           case 'a': set_asset = 1; asset_new = optarg;  break;
+          case 'b': fbinary = 1; break;  /* binary sample records */
+          case 'c': samp_cnt = atoi(optarg); break;  /* number of samples */
           case 'd': set_mcid = 1; mcid_new = optarg; break;
+          case 'f': hostfile = optarg; break;  /* file of nodes to sample */
+          case 'i': samp_ms = atoi(optarg); break;  /* msec between samples */
+          case 'l': stale_ms = atoi(optarg); break;  /* stale reply msec */
+          case 'o': outfile = optarg; break;  /* sample stream file */
+          case 'w': samp_win = atoi(optarg); break;  /* rolling window */
           case 'm': /* specific IPMB MC, 3-byte address, e.g. "409600" */
                     g_bus = htoi(&optarg[0]);  /*bus/channel*/
                     g_sa  = htoi(&optarg[2]);  /*device slave address*/
@@ -795,15 +1305,29 @@ main(int argc, char **argv)
 	if ((argc > 0) && strcmp(argv[0], "help") == 0) {
 	   return(dcmi_usage());
         } 
+	if ((argc > 1) && (strncmp(argv[0], "power",5) == 0) &&
+	    (strcmp(argv[1], "sample") == 0)) {
+	   fsample = 1;
+	   /* the fleet children open their own sessions */
+	   if (hostfile != NULL) return(dcmi_sample(1));
+	}
 
         rv = ipmi_getdeviceid( cdata, sizeof(cdata),fdebug);
 	if (rv == 0) {
 	   uchar ipmi_maj, ipmi_min;
 	   ipmi_maj = cdata[4] & 0x0f;
 	   ipmi_min = cdata[4] >> 4;
-	   show_devid( cdata[2],  cdata[3], ipmi_maj, ipmi_min);
+	   if (!fsample) show_devid( cdata[2],  cdata[3], ipmi_maj, ipmi_min);
 	} else goto do_exit;
 
+	if (fsample) {  /*keep stdout for the sample stream*/
+	   rv = dcmi_get_capab(1, cdata, sizeof(cdata));
+	   if (rv == 0 && (cdata[5] & 0x01) == 0) rv = LAN_ERR_NOTSUPPORT;
+	   if (rv == 0) rv = dcmi_sample(0);
+	   else fprintf(stderr,"DCMI power reading not available, ret = %d\n",rv);
+	   goto do_exit;
+	}
+
 	if (set_asset) {
 	   rv = dcmi_get_asset_tag(asset,sizeof(asset),&asset_len);
 	   memset(asset,' ',asset_len); /*fill with spaces*/
@@ -19,6 +19,12 @@
  * 11/21/08 Andy Cress - detect eth intf and broadcast ip addr
  * 01/04/16 Andy Cress - v1.11, allow 0 if fBroadcastOk (-a) 
  * 11/30/24 Andy Cress - v1.12, detect if IP address
+ * 10/19/26 - added -s subnet list and -t rate for a batched scanner,
+ *            with sendmmsg/recvmmsg and per-host retry deadlines.
+ * 10/19/26 - added -f to fingerprint each responder in the same pass:
+ *            auth caps (1.5 and 2.0), cipher suites and Device ID.
+ * 10/19/26 - added -d/-u to keep a host table, and rescan the known hosts
+ *            first, showing only the hosts added, removed or changed.
  */
 /*M*
 Copyright (c) 2006, Intel Corporation
@@ -50,6 +56,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #if defined(HAVE_CONFIG_H)
 #include "config.h"
 #endif
+#if defined(LINUX) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE 1   /* for sendmmsg/recvmmsg */
+#endif
 
 #ifdef WIN32
 #include <windows.h>
@@ -104,6 +113,12 @@ typedef unsigned int socklen_t;
 
 /* comment out NO_THREADS to use this utility in Linux with threads */
 #define NO_THREADS  1
+#include <sys/time.h>
+#include <time.h>
+#define SCAN_ENGINE 1   /* batched scanner for -s/-t */
+#if defined(LINUX) && defined(MSG_WAITFORONE)
+#define HAVE_MMSG   1   /* sendmmsg/recvmmsg */
+#endif
 #endif
 #ifndef ETH_P_IP
 #define ETH_P_IP  0x0800 /* Internet Protocol packet, see linux/if_ether.h */
@@ -151,6 +166,11 @@ static char frawok = 1;  /*raw works in Linux*/
 #define SZ_PING    12
 #define IPMI_PING_MAX_LEN  50  /* usu 28 */
 #define CMD_GET_CHAN_AUTH_CAP      0x38
+#ifdef WIN32
+#define HOSTTAB_FILE  "idiscover.hosts"
+#else
+#define HOSTTAB_FILE  "/var/lib/ipmiutil/idiscover.hosts"
+#endif
 
 #ifdef WIN32
 int GetFirstIP(uchar *ipaddr, uchar *macadr, char *ipname, char fdb); /*ilan.c*/
@@ -187,6 +207,14 @@ static int  g_recv_status = 0;
 static int  g_wait   = 1; /* num sec to wait */
 static int  g_delay  = 0; /* num usec between sends */
 static int  g_repeat = 1; /* number of times to repeat ping to each node */
+static int  g_rate   = 2000; /* probes/sec for the batched scanner (-t) */
+static char fscan    = 0;  /* =1 use the batched scanner (-s/-t) */
+static char ffinger  = 0;  /* =1 fingerprint each responder (-f) */
+static char fcreds   = 0;  /* =1 if -U/-P/-R/-E/-Y were given, for -f */
+static char fhosts   = 0;  /* =1 keep the host table (-d/-u) */
+static char frescan  = 0;  /* =1 rescan the known hosts first (-u) */
+static char fknownonly = 0; /* =1 if -u without a -s/-b range */
+static char g_hostfile[160] = "";  /* host table file (-d) */
 static char bdelim = BDELIM;  /* '|' */
 
 #ifdef METACOMMAND
@@ -220,6 +248,22 @@ void dump_buf(char *tag, uchar *pbuf, int sz, char fshowascii)
    fprintf(fpdbg,"%s\n",line);
    return;
 } 
+
+/* os_msec - millisecond clock for intervals, as in subs.c */
+ulong os_msec(void)
+{
+#ifdef WIN32
+   return((ulong)GetTickCount());
+#elif defined(CLOCK_MONOTONIC)
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC,&ts);
+   return((ulong)ts.tv_sec * 1000 + (ts.tv_nsec / 1000000));
+#else
+   struct timeval tv;
+   gettimeofday(&tv,NULL);
+   return((ulong)tv.tv_sec * 1000 + (tv.tv_usec / 1000));
+#endif
+}
 #endif
 
 void printerr( const char *pattn, ...)
@@ -284,10 +328,16 @@ static void cleanup(void)
 
 void show_usage(void)
 {
-   printf("Usage: %s [-abeghimprx] \n",progname);
+   printf("Usage: %s [-abdefghimprstux] \n",progname);
    printf("  -a            all nodes, enables broadcast ping\n");
    printf("  -b <ip>       beginning IP address (x.x.x.x), required\n");
+   printf("  -d <file>     keep the hosts found in a host table file,\n");
+   printf("                default %s\n",HOSTTAB_FILE);
    printf("  -e <ip>       ending IP address (x.x.x.x), default is begin IP\n");
+   printf("  -f            fingerprint: get auth caps and cipher suites,\n");
+#ifdef METACOMMAND
+   printf("                and the Device ID if -U/-P are given\n");
+#endif
    printf("  -g            use GetChanAuthCap instead of RMCP ping\n");
    printf("  -h            print this help text\n");
    printf("  -i <name|ip>  interface to use: name, IP address or 0.0.0.0\n");
@@ -295,7 +345,10 @@ void show_usage(void)
    printf("  -m            get MAC addresses with a raw broadcast ping\n");
    printf("  -p <N>        specific port (IPMI LAN port=623)\n");
    printf("  -r <N>        number of repeat pings to each node (default=1)\n");
-// printf("  -s            specific subnet\n");
+   printf("  -s <subnets>  subnet list to scan, e.g. 10.1.0.0/16,10.2.3.0/24\n");
+   printf("  -t <N>        probes per second for batched scan (default=2000)\n");
+   printf("  -u            rescan the hosts in the host table first, and\n");
+   printf("                show only the hosts added, removed or changed\n");
    printf("  -x            show extra debug messages\n");
 }
 
@@ -959,6 +1012,1145 @@ void *sendThread(void *p)
    return(p);
 }
 
+#ifdef SCAN_ENGINE
+/*
+ * Batched scanner (-s/-t)
+ * Probes the target list in sendmmsg batches, paced by a token bucket
+ * (g_rate probes/sec), and drains the replies with recvmmsg.
+ * Outstanding probes are kept in a hash table by IP address, and in a 
+ * FIFO in deadline order, so that each host can be retried when its 
+ * deadline passes, without rescanning the table.
+ * With -f, each host that responds goes through a short pipeline of
+ * probes on the same socket: GetChanAuthCap in the IPMI 1.5 and 2.0
+ * forms, then GetChanCipherSuites, and one record is kept per host.
+ * With -d/-u, the records are kept in a host table file.  A rescan (-u)
+ * probes the known hosts first, at the full rate, and sweeps the rest
+ * of the range at SCAN_SWEEP_DIV of the rate, then shows only the 
+ * hosts that were added, removed or changed.
+ */
+#define SCAN_BATCH    64      /* probes per sendmmsg, replies per recvmmsg */
+#define SCAN_WINDOW   8192    /* max outstanding probes */
+#define SCAN_FIFOSZ   (SCAN_WINDOW*2)
+#define SCAN_TABSZ    (SCAN_WINDOW*2)  /* power of 2 */
+#define SCAN_MAXNETS  64
+#define CMD_GET_CHAN_CIPHERS  0x54
+#define ASF_IANA      4542    /* IANA of the ASF/RMCP pong */
+#define SCAN_SWEEP_DIV 10     /* -u sweeps unknown hosts at rate/10 */
+
+/* probe stages, also sent as the IPMI rqSeq to match the responses */
+#define STAGE_DONE    0
+#define STAGE_DISC    1   /* RMCP ping, or GetChanAuthCap with -g */
+#define STAGE_AUTH15  2   /* GetChanAuthCap, IPMI 1.5 form */
+#define STAGE_AUTH20  3   /* GetChanAuthCap, IPMI 2.0 form */
+#define STAGE_CIPHER  4   /* GetChanCipherSuites, by list index */
+#define CIPHER_MAXIDX 59  /* rqSeq = STAGE_CIPHER + index, up to 63 */
+
+typedef struct {
+   uint start;     /* first address, host order */
+   uint end;       /* last address, host order */
+   uint base;      /* ordinal of start in the target list */
+   char fskip;     /* =1 skip x.x.x.0 and x.x.x.255, as for -b/-e */
+} SCAN_NET;
+
+typedef struct {
+   uint  ip;       /* 0 = empty slot */
+   int   tries;
+   ulong deadline; /* msec, 0 if queued to send now */
+   uchar stage;
+   uchar csidx;    /* cipher suite list index */
+   int   rec;      /* index in scan_recs (-f), or -1 */
+} SCAN_PROBE;
+
+typedef struct {
+   uint  ip;
+   ulong deadline; /* stale if not the same as the probe deadline */
+} SCAN_FIFO;
+
+/* one record per responding host, for -f */
+typedef struct {
+   uint  ip;
+   uint  iana;       /* IANA from the RMCP pong data */
+   uchar fpong;
+   uchar fauth15;
+   uchar fauth20;
+   uchar auth[8];    /* GetChanAuthCap data, 2.0 form if supported */
+   uchar ncs;
+   uchar cs[32];     /* cipher suite IDs */
+   uchar csdata[80]; /* GetChanCipherSuites record data */
+   int   cslen;
+   uchar fdevid;
+   uchar devid[16];  /* Get Device ID data, with -U/-P */
+   uchar fmac;
+   uchar mac[6];     /* from the ARP table, if on this subnet */
+   ulong first;      /* first seen, time_t, for the host table */
+   ulong last;       /* last seen */
+} SCAN_REC;
+
+/* record fields, as shown and as compared for -u */
+#define SCAN_NCOLS    7
+static char *scan_colnames[SCAN_NCOLS] = { "MAC", "IPMI", "Auth", "Login",
+		"Cipher Suites", "Vendor", "Device" };
+
+static SCAN_NET   scan_nets[SCAN_MAXNETS];
+static int        scan_nnets = 0;
+static uint       scan_total = 0;   /* addresses in the target list */
+static int        scan_inet  = 0;   /* next target: net index */
+static uint       scan_iip   = 0;   /* next target: address */
+static SCAN_PROBE *scan_tab  = NULL;
+static int        scan_nout  = 0;   /* outstanding probes */
+static SCAN_FIFO  *scan_fifo = NULL;
+static uint       *scan_ready = NULL;  /* hosts to send the next stage */
+static uint       ready_head = 0;
+static uint       ready_tail = 0;
+static SCAN_REC   *scan_recs = NULL;
+static int        scan_nrecs = 0;
+static int        scan_maxrecs = 0;
+static uint       fifo_head = 0;
+static uint       fifo_tail = 0;
+static uchar      *scan_seen = NULL;  /* bitmap by target ordinal */
+static int        scan_nretry = 0;
+static SCAN_REC   *host_recs = NULL;  /* host table, sorted by ip */
+static int        host_nrecs = 0;
+static int        host_iknown = 0;    /* next known host to probe (-u) */
+
+/* scan_addnet - add a.b.c.d, a.b.c.d/n or a.b.c.d-e.f.g.h to the list */
+static int scan_addnet(char *str)
+{
+   struct in_addr a;
+   char buf[40];
+   char *p;
+   uint ip, ip2, mask;
+   int bits = 32;
+   SCAN_NET *pn;
+
+   if (scan_nnets >= SCAN_MAXNETS) return(ERR_BAD_PARAM);
+   strncpy(buf,str,sizeof(buf)-1);
+   buf[sizeof(buf)-1] = 0;
+   pn = &scan_nets[scan_nnets];
+   pn->fskip = 0;
+   if ((p = strchr(buf,'-')) != NULL) {
+      *p++ = 0;
+      if (!inet_aton(p,&a)) return(ERR_BAD_PARAM);
+      ip2 = ntohl(a.s_addr);
+      if (!inet_aton(buf,&a)) return(ERR_BAD_PARAM);
+      ip = ntohl(a.s_addr);
+      if (ip2 < ip) return(ERR_BAD_PARAM);
+      pn->fskip = 1;
+   } else {
+      if ((p = strchr(buf,'/')) != NULL) {
+         *p++ = 0;
+         bits = atoi(p);
+         if ((bits < 8) || (bits > 32)) return(ERR_BAD_PARAM);
+      }
+      if (!inet_aton(buf,&a)) return(ERR_BAD_PARAM);
+      mask = (bits == 32) ? 0xffffffff : ~(0xffffffff >> bits);
+      ip  = ntohl(a.s_addr) & mask;
+      ip2 = ip | ~mask;
+      if (bits <= 30) { ip++; ip2--; }  /*skip network and broadcast*/
+   }
+   pn->start = ip;
+   pn->end   = ip2;
+   pn->base  = scan_total;
+   scan_total += (ip2 - ip + 1);
+   scan_nnets++;
+   if (fdebug) printf("scan_addnet: %s = %08x - %08x\n",str,ip,ip2);
+   return(0);
+}
+
+static int scan_parse(char *list)
+{
+   char buf[1024];
+   char *p;
+   int rv = 0;
+
+   strncpy(buf,list,sizeof(buf)-1);
+   buf[sizeof(buf)-1] = 0;
+   for (p = strtok(buf,", "); (p != NULL) && (rv == 0); p = strtok(NULL,", "))
+      rv = scan_addnet(p);
+   if (rv != 0) printerr("Invalid subnet: %s\n",(p == NULL)? list: p);
+   return(rv);
+}
+
+/* scan_rec_find - index of ip in recs sorted by ip, or -1 */
+static int scan_rec_find(SCAN_REC *recs, int n, uint ip)
+{
+   int lo = 0, hi = n - 1, mid;
+   while (lo <= hi) {
+      mid = (lo + hi) / 2;
+      if (recs[mid].ip == ip) return(mid);
+      if (recs[mid].ip < ip) lo = mid + 1;
+      else hi = mid - 1;
+   }
+   return(-1);
+}
+
+/* scan_ordinal - index of ip in the target list, or -1 */
+static long scan_ordinal(uint ip)
+{
+   int i;
+   for (i = 0; i < scan_nnets; i++)
+      if ((ip >= scan_nets[i].start) && (ip <= scan_nets[i].end))
+	 return((long)(scan_nets[i].base + (ip - scan_nets[i].start)));
+   if (frescan) {   /* known hosts outside the range follow the range */
+      i = scan_rec_find(host_recs,host_nrecs,ip);
+      if (i >= 0) return((long)(scan_total + i));
+   }
+   return(-1);
+}
+
+/* scan_next - get the next target address, returns 0 if no more */
+static int scan_next(uint *pip)
+{
+   uint ip;
+   while (scan_inet < scan_nnets) {
+      SCAN_NET *pn = &scan_nets[scan_inet];
+      if (scan_iip < pn->start) scan_iip = pn->start;
+      ip = scan_iip;
+      if ((ip > pn->end) || (ip < pn->start)) {  /*done or wrapped*/
+	 scan_inet++;
+	 scan_iip = 0;
+	 continue;
+      }
+      scan_iip++;
+      if (scan_iip == 0) scan_inet++;  /*255.255.255.255*/
+      if (pn->fskip && (((ip & 0xff) == 0) || ((ip & 0xff) == 0xff)))
+	 continue;
+      if (frescan && (scan_rec_find(host_recs,host_nrecs,ip) >= 0))
+	 continue;   /*known host, already probed*/
+      *pip = ip;
+      return(1);
+   }
+   return(0);
+}
+
+/* scan_next_known - get the next known host to probe (-u) */
+static int scan_next_known(uint *pip)
+{
+   if (!frescan || (host_iknown >= host_nrecs)) return(0);
+   *pip = host_recs[host_iknown++].ip;
+   return(1);
+}
+
+static uint scan_hash(uint ip)
+{
+   return((ip * 2654435761U) & (SCAN_TABSZ - 1));
+}
+
+static SCAN_PROBE *scan_find(uint ip)
+{
+   uint h;
+   for (h = scan_hash(ip); scan_tab[h].ip != 0; h = (h+1) & (SCAN_TABSZ-1))
+      if (scan_tab[h].ip == ip) return(&scan_tab[h]);
+   return(NULL);
+}
+
+static SCAN_PROBE *scan_insert(uint ip)
+{
+   uint h;
+   for (h = scan_hash(ip); scan_tab[h].ip != 0; h = (h+1) & (SCAN_TABSZ-1))
+      if (scan_tab[h].ip == ip) return(&scan_tab[h]);
+   scan_tab[h].ip = ip;
+   scan_tab[h].tries = 0;
+   scan_tab[h].deadline = 0;
+   scan_tab[h].stage = STAGE_DISC;
+   scan_tab[h].csidx = 0;
+   scan_tab[h].rec = -1;
+   scan_nout++;
+   return(&scan_tab[h]);
+}
+
+/* scan_delete - remove ip, shifting back any entries that probed past it */
+static void scan_delete(uint ip)
+{
+   uint i, j, h;
+   SCAN_PROBE *p;
+
+   p = scan_find(ip);
+   if (p == NULL) return;
+   i = (uint)(p - scan_tab);
+   scan_tab[i].ip = 0;
+   scan_nout--;
+   for (j = (i+1) & (SCAN_TABSZ-1); scan_tab[j].ip != 0; 
+	j = (j+1) & (SCAN_TABSZ-1)) {
+      h = scan_hash(scan_tab[j].ip);
+      /* move j to i if its home slot h is not in (i, j] */
+      if (((j > i) && ((h <= i) || (h > j))) ||
+          ((j < i) && ((h <= i) && (h > j)))) {
+	 scan_tab[i] = scan_tab[j];
+	 scan_tab[j].ip = 0;
+	 i = j;
+      }
+   }
+}
+
+/* scan_rec_new - add a record for a responding host (-f) */
+static int scan_rec_new(uint ip)
+{
+   SCAN_REC *precs;
+   if (scan_nrecs >= scan_maxrecs) {
+      scan_maxrecs = (scan_maxrecs == 0)? 256: scan_maxrecs * 2;
+      precs = realloc(scan_recs, scan_maxrecs * sizeof(SCAN_REC));
+      if (precs == NULL) return(-1);
+      scan_recs = precs;
+   }
+   memset(&scan_recs[scan_nrecs],0,sizeof(SCAN_REC));
+   scan_recs[scan_nrecs].ip = ip;
+   return(scan_nrecs++);
+}
+
+/* scan_stage - move a host to the next stage, or finish it */
+static void scan_stage(SCAN_PROBE *p, uchar stage)
+{
+   if (stage == STAGE_DONE) {
+      scan_delete(p->ip);
+      return;
+   }
+   p->stage = stage;
+   p->tries = 0;
+   p->deadline = 0;   /*any FIFO entry is now stale*/
+   scan_ready[ready_tail++ % SCAN_WINDOW] = p->ip;
+}
+
+/* scan_ciphers - get the cipher suite IDs from the record data */
+static void scan_ciphers(SCAN_REC *r)
+{
+   int i;
+   r->ncs = 0;
+   for (i = 0; (i < r->cslen - 1) && (r->ncs < sizeof(r->cs)); i++) {
+      if (r->csdata[i] == 0xC0) {        /*standard cipher suite*/
+	 r->cs[r->ncs++] = r->csdata[++i];
+      } else if (r->csdata[i] == 0xC1) { /*OEM cipher suite, then IANA*/
+	 r->cs[r->ncs++] = r->csdata[++i];
+	 i += 3;
+      }  /* else an algorithm byte */
+   }
+}
+
+/* scan_reply - handle one received datagram */
+static void scan_reply(uchar *buffer, int len, struct sockaddr_in *from)
+{
+   SCAN_PROBE *p;
+   SCAN_REC *r = NULL;
+   uchar *pdata = NULL;
+   uint ip;
+   long ord;
+   int off, dlen = 0;
+   uchar stage, seq = 0, cc = 0;
+   char rstr[40];
+   char estr[40];
+
+   if ((len < 12) || (buffer[0] != 0x06)) return;  /*not RMCP*/
+   if (buffer[3] == 0x06) {   /* ASF class */
+      if (buffer[8] != 0x40) return;  /*not a pong*/
+      stage = STAGE_DISC;
+   } else if (buffer[3] == 0x07) {   /* IPMI class, 1.5 session header */
+      off = (buffer[4] != 0)? 30: 14;   /*skip the auth code, if any*/
+      if (len < off + 8) return;
+      stage = seq = buffer[off+4] >> 2;   /*rqSeq*/
+      if (stage > STAGE_CIPHER) stage = STAGE_CIPHER;  /*and the index*/
+      if ((buffer[off+1] >> 2) != 0x07) return;  /*not App response*/
+      cc = buffer[off+6];
+      pdata = &buffer[off+7];
+      dlen = buffer[off-1] - 8;         /*msg len - hdr,ccode,cksum*/
+      if (dlen > len - off - 8) dlen = len - off - 8;
+      if (dlen < 0) dlen = 0;
+   } else return;
+   ip = ntohl(from->sin_addr.s_addr);
+   ord = scan_ordinal(ip);
+   if (ord < 0) return;  /*not a target*/
+   if (!ffinger || (stage == STAGE_DISC)) {
+      if (scan_seen[ord / 8] & (1 << (ord % 8))) return;  /*duplicate*/
+      scan_seen[ord / 8] |= (1 << (ord % 8));
+      g_npongs++;
+   }
+   p = scan_find(ip);
+   if (!ffinger) {
+      if (p != NULL) scan_delete(ip);
+      rstr[0] = 0;
+      if (!fping) {
+	 if (cc != 0)  /*ccode error*/
+	    sprintf(rstr,"%c (ccode=0x%02x)",bdelim,cc);
+	 else
+	    sprintf(rstr,"%c (channel %d)",bdelim,(dlen > 0)? pdata[0]: 0);
+      }
+      if (fcanonical) { estr[0] = 0; rstr[0] = 0; }
+      else sprintf(estr,"response from %c ",bdelim);
+      printf("%.2d%c %s %s \t%c %s %s\n",
+	     g_npongs,bdelim,estr,inet_ntoa(from->sin_addr),bdelim,"",rstr);
+      return;
+   }
+
+   /* -f: advance this host through the probe stages */
+   if ((p == NULL) || (p->stage != stage)) return;  /*late or duplicate*/
+   if ((stage == STAGE_CIPHER) && (seq != STAGE_CIPHER + p->csidx)) return;
+   if (p->rec < 0) p->rec = scan_rec_new(ip);
+   if (p->rec < 0) { scan_stage(p,STAGE_DONE); return; }
+   r = &scan_recs[p->rec];
+   if (stage == STAGE_DISC && fping) {
+      r->fpong = 1;
+      if (len >= 16) 
+	 r->iana = (buffer[12] << 24) | (buffer[13] << 16) | 
+		   (buffer[14] << 8) | buffer[15];
+      scan_stage(p,STAGE_AUTH15);
+      return;
+   }
+   switch(stage) {
+      case STAGE_DISC:     /* -g, the 1.5 form GetChanAuthCap */
+      case STAGE_AUTH15:
+	 if ((cc != 0) || (dlen < 8)) { scan_stage(p,STAGE_DONE); break; }
+	 r->fauth15 = 1;
+	 memcpy(r->auth,pdata,8);
+	 /* bit 7 of the auth type support: IPMI 2.0 data is available */
+	 scan_stage(p, (pdata[1] & 0x80)? STAGE_AUTH20: STAGE_DONE);
+	 break;
+      case STAGE_AUTH20:
+	 if ((cc != 0) || (dlen < 8)) { scan_stage(p,STAGE_DONE); break; }
+	 r->fauth20 = 1;
+	 memcpy(r->auth,pdata,8);
+	 /* ext caps bit 1: supports IPMI 2.0 (RMCP+) sessions */
+	 scan_stage(p, (pdata[3] & 0x02)? STAGE_CIPHER: STAGE_DONE);
+	 break;
+      case STAGE_CIPHER:
+	 if ((cc != 0) || (dlen < 1)) { scan_ciphers(r); scan_stage(p,STAGE_DONE); break; }
+	 dlen--;   /*skip the channel*/
+	 if (r->cslen + dlen > sizeof(r->csdata)) 
+	    dlen = sizeof(r->csdata) - r->cslen;
+	 memcpy(&r->csdata[r->cslen],&pdata[1],dlen);
+	 r->cslen += dlen;
+	 if ((dlen == 16) && (p->csidx < CIPHER_MAXIDX) && 
+	     (r->cslen < sizeof(r->csdata))) {
+	    p->csidx++;   /*more records in the list*/
+	    scan_stage(p,STAGE_CIPHER);
+	 } else {
+	    scan_ciphers(r);
+	    scan_stage(p,STAGE_DONE);
+	 }
+	 break;
+   }
+}
+
+static void scan_recv(void)
+{
+   uchar bufs[SCAN_BATCH][IPMI_PING_MAX_LEN];
+   struct sockaddr_in froms[SCAN_BATCH];
+   int i, n;
+#ifdef HAVE_MMSG
+   struct mmsghdr msgs[SCAN_BATCH];
+   struct iovec iovs[SCAN_BATCH];
+
+   do {
+      memset(msgs,0,sizeof(msgs));
+      for (i = 0; i < SCAN_BATCH; i++) {
+	 iovs[i].iov_base = bufs[i];
+	 iovs[i].iov_len  = IPMI_PING_MAX_LEN;
+	 msgs[i].msg_hdr.msg_iov = &iovs[i];
+	 msgs[i].msg_hdr.msg_iovlen = 1;
+	 msgs[i].msg_hdr.msg_name = &froms[i];
+	 msgs[i].msg_hdr.msg_namelen = sizeof(froms[i]);
+      }
+      n = recvmmsg(g_sockfd, msgs, SCAN_BATCH, MSG_DONTWAIT, NULL);
+      for (i = 0; i < n; i++) 
+	 scan_reply(bufs[i],(int)msgs[i].msg_len,&froms[i]);
+   } while (n == SCAN_BATCH);
+#else
+   socklen_t fromlen;
+   for (i = 0; i < SCAN_BATCH; i++) {
+      fromlen = sizeof(froms[0]);
+      n = (int)recvfrom(g_sockfd, bufs[0], IPMI_PING_MAX_LEN, MSG_DONTWAIT,
+			(struct sockaddr *)&froms[0], &fromlen);
+      if (n < 0) break;
+      scan_reply(bufs[0],n,&froms[0]);
+   }
+#endif
+}
+
+/* scan_ipmi_pkt - build a session-less IPMI 1.5 App request */
+static int scan_ipmi_pkt(uchar *pkt, uchar cmd, uchar seq, uchar *data, 
+			 int dlen)
+{
+   /* [RMCP hdr ] [IPMI session hdr, no auth (len)] [IPMI msg ] [data] */
+   uchar hdr[14] = { 0x06, 0x00, 0xff, 0x07, 0x00, 0x00, 0x00, 0x00, 
+   		     0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+   memcpy(pkt,hdr,sizeof(hdr));
+   pkt[13] = (uchar)(7 + dlen);
+   pkt[14] = 0x20;          /*rsSA = BMC*/
+   pkt[15] = 0x18;          /*netfn App*/
+   pkt[16] = cksum(&pkt[14],2);
+   pkt[17] = 0x81;          /*rqSA = remote console*/
+   pkt[18] = seq << 2;
+   pkt[19] = cmd;
+   memcpy(&pkt[20],data,dlen);
+   pkt[20+dlen] = cksum(&pkt[17],3+dlen);
+   return(21+dlen);
+}
+
+/* scan_pkt - build the probe for the host's stage */
+static int scan_pkt(uchar *pkt, SCAN_PROBE *p)
+{
+   uchar pingbuf[SZ_PING] = {06,0,0xFF,06,0x00,0x00,0x11,0xBE,0x80,0,0,0 };
+   uchar data[3];
+   int len;
+
+   data[1] = 0x02;   /*requested priv_level: 2=user, 4=admin*/
+   switch(p->stage) {
+      case STAGE_DISC:
+	 if (fping) {
+	    memcpy(pkt,pingbuf,sizeof(pingbuf));
+	    len = sizeof(pingbuf);
+	    break;
+	 } /*else fall through to GetChanAuthCap*/
+      case STAGE_AUTH15:
+	 data[0] = 0x0E;   /*this channel*/
+	 len = scan_ipmi_pkt(pkt,CMD_GET_CHAN_AUTH_CAP,p->stage,data,2);
+	 break;
+      case STAGE_AUTH20:
+	 data[0] = 0x8E;   /*this channel, get IPMI 2.0 data*/
+	 len = scan_ipmi_pkt(pkt,CMD_GET_CHAN_AUTH_CAP,p->stage,data,2);
+	 break;
+      case STAGE_CIPHER:
+      default:
+	 data[0] = 0x0E;   /*this channel*/
+	 data[1] = 0x00;   /*payload type IPMI*/
+	 data[2] = 0x80 | p->csidx;   /*list by cipher suite*/
+	 len = scan_ipmi_pkt(pkt,CMD_GET_CHAN_CIPHERS,
+			     (uchar)(STAGE_CIPHER + p->csidx),data,3);
+	 break;
+   }
+   return(len);
+}
+
+/* scan_wouldblock - the last send failed because the socket is full */
+static int scan_wouldblock(void)
+{
+#ifdef WIN32
+   int rv = WSAGetLastError();
+   return((rv == WSAEWOULDBLOCK) || (rv == WSAENOBUFS));
+#else
+   return((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ENOBUFS));
+#endif
+}
+
+/*
+ * scan_send - send the current probe to each of ips[0..n)
+ * Returns the number sent.  A probe that fails for another reason than
+ * a full socket, e.g. no route, counts as sent, and is retried after 
+ * g_wait like a lost one, so the rest are sent only when it would block.
+ */
+static int scan_send(uint *ips, int n)
+{
+   uchar pkts[SCAN_BATCH][32];
+   int lens[SCAN_BATCH];
+   struct sockaddr_in dests[SCAN_BATCH];
+   SCAN_PROBE *p;
+   int i, rv;
+
+   for (i = 0; i < n; i++) {
+      p = scan_find(ips[i]);
+      lens[i] = scan_pkt(pkts[i],p);
+      memset(&dests[i],0,sizeof(dests[i]));
+      dests[i].sin_family = AF_INET;
+      dests[i].sin_port = htons(g_port);
+      dests[i].sin_addr.s_addr = htonl(ips[i]);
+   }
+#ifdef HAVE_MMSG
+   {
+   struct mmsghdr msgs[SCAN_BATCH];
+   struct iovec iovs[SCAN_BATCH];
+   memset(msgs,0,sizeof(msgs));
+   for (i = 0; i < n; i++) {
+      iovs[i].iov_base = pkts[i];
+      iovs[i].iov_len  = lens[i];
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = &dests[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(dests[i]);
+   }
+   for (i = 0; i < n; i += rv) {
+      rv = sendmmsg(g_sockfd, &msgs[i], n - i, MSG_DONTWAIT);
+      if (rv < 0 && !scan_wouldblock()) {
+	 if (fdebug) printerr("scan_send: %s\n",showlasterr());
+	 rv = 1;   /*skip this one*/
+      }
+      if (rv <= 0) break;
+   }
+   }
+#else
+   for (i = 0; i < n; i++) {
+      rv = ipmilan_sendto(g_sockfd, pkts[i], lens[i], MSG_DONTWAIT,
+		     (struct sockaddr *)&dests[i], sizeof(dests[i]));
+      if (rv < 0 && scan_wouldblock()) break;
+      if (rv < 0 && fdebug) printerr("scan_send: %s\n",showlasterr());
+   }
+#endif
+   if ((i < n) && fdebug) 
+      printerr("scan_send: %d of %d sent, %s\n",i,n,showlasterr());
+   g_npings += i;
+   return(i);
+}
+
+static int scan_rec_cmp(const void *a, const void *b)
+{
+   uint ipa = ((SCAN_REC *)a)->ip;
+   uint ipb = ((SCAN_REC *)b)->ip;
+   return((ipa < ipb)? -1: (ipa > ipb));
+}
+
+static char *scan_recfmt(void)
+{
+   if (fcanonical) return("%s%c%s%c%s%c%s%c%s%c%s%c%s%c%s\n");
+   else return("%-15s %c %-17s %c %-4s %c %-14s %c %-17s %c %-20s %c %s %c %s\n");
+}
+
+/* scan_cols - format the fields of one record */
+static void scan_cols(SCAN_REC *r, char cols[SCAN_NCOLS][100])
+{
+   static char *authnames[6] = {"none","md2","md5","","pswd","oem"};
+   char *auth, *login, *ciphers;
+   int i, mfg;
+
+   for (i = 0; i < SCAN_NCOLS; i++) cols[i][0] = 0;
+   if (r->fmac) 
+      sprintf(cols[0],"%02x:%02x:%02x:%02x:%02x:%02x",r->mac[0],r->mac[1],
+	      r->mac[2],r->mac[3],r->mac[4],r->mac[5]);
+   if (r->fauth20 && (r->auth[3] & 0x02)) strcpy(cols[1],"2.0");
+   else if (r->fauth15) strcpy(cols[1],"1.5");
+   else strcpy(cols[1],"-");
+   auth = cols[2]; login = cols[3]; ciphers = cols[4];
+   if (r->fauth15) {
+      for (i = 0; i < 6; i++)
+	 if ((r->auth[1] & (1 << i)) && (authnames[i][0] != 0)) 
+	    sprintf(&auth[strlen(auth)],"%s%s",(auth[0]? " ": ""),authnames[i]);
+      if (r->auth[2] & 0x01) strcat(login,"anon ");
+      if (r->auth[2] & 0x02) strcat(login,"null ");
+      if (r->auth[2] & 0x04) strcat(login,"nonnull ");
+      if (r->auth[2] & 0x20) strcat(login,"kg ");
+      i = (int)strlen(login);
+      if (i > 0) login[i-1] = 0;
+   }
+   for (i = 0; (i < r->ncs) && (strlen(ciphers) + 5 < sizeof(cols[4])); i++)
+      sprintf(&ciphers[strlen(ciphers)],"%s%d",(i? " ": ""),r->cs[i]);
+   /* vendor from Get Device ID, else the OEM ID, else the pong IANA */
+   mfg = 0;
+   if (r->fdevid) 
+      mfg = r->devid[6] + (r->devid[7] << 8) + ((r->devid[8] & 0x0f) << 16);
+   else if (r->fauth15) 
+      mfg = r->auth[4] + (r->auth[5] << 8) + (r->auth[6] << 16);
+   if ((mfg == 0) && r->fpong && (r->iana != ASF_IANA)) mfg = (int)r->iana;
+#ifdef METACOMMAND
+   if (mfg != 0) sprintf(cols[5],"%d (%.60s)",mfg,get_iana_str(mfg));
+#else
+   if (mfg != 0) sprintf(cols[5],"%d",mfg);
+#endif
+   if (r->fdevid) 
+      sprintf(cols[6],"prod %d fw %d.%02x ipmi %d.%d",
+	      r->devid[9] + (r->devid[10] << 8),
+	      r->devid[2] & 0x7f,r->devid[3],
+	      r->devid[4] & 0x0f,r->devid[4] >> 4);
+}
+
+/* scan_show_rec - show one record per host for -f, with a tag for -u */
+static void scan_show_rec(char *tag, SCAN_REC *r)
+{
+   char cols[SCAN_NCOLS][100];
+   struct in_addr a;
+
+   scan_cols(r,cols);
+   a.s_addr = htonl(r->ip);
+   if (tag != NULL) printf((fcanonical? "%s%c": "%-7s %c "),tag,bdelim);
+   printf(scan_recfmt(),inet_ntoa(a),bdelim,cols[0],bdelim,cols[1],bdelim,
+	  cols[2],bdelim,cols[3],bdelim,cols[4],bdelim,cols[5],bdelim,cols[6]);
+}
+
+static void scan_show_hdr(void)
+{
+   if (frescan) printf((fcanonical? "%s%c": "%-7s %c "),"Status",bdelim);
+   printf(scan_recfmt(),"IP",bdelim,scan_colnames[0],bdelim,
+	  scan_colnames[1],bdelim,scan_colnames[2],bdelim,scan_colnames[3],
+	  bdelim,scan_colnames[4],bdelim,scan_colnames[5],bdelim,
+	  scan_colnames[6]);
+}
+
+#ifdef LINUX
+/* scan_arp - get the MAC addresses of the responders from the ARP table */
+static void scan_arp(void)
+{
+   FILE *fp;
+   char line[160];
+   char ipstr[40], hwstr[40];
+   struct in_addr a;
+   uint hwtype, flags, m[6];
+   int i, j;
+
+   fp = fopen("/proc/net/arp","r");
+   if (fp == NULL) return;
+   while (fgets(line,sizeof(line),fp) != NULL) {
+      /* IP address  HW type  Flags  HW address  Mask  Device */
+      if (sscanf(line,"%39s 0x%x 0x%x %39s",ipstr,&hwtype,&flags,hwstr) != 4)
+	 continue;  /*the heading*/
+      if ((flags & 0x02) == 0) continue;  /*not complete*/
+      if (!inet_aton(ipstr,&a)) continue;
+      i = scan_rec_find(scan_recs,scan_nrecs,ntohl(a.s_addr));
+      if (i < 0) continue;
+      if (sscanf(hwstr,"%x:%x:%x:%x:%x:%x",&m[0],&m[1],&m[2],&m[3],
+		 &m[4],&m[5]) != 6) continue;
+      for (j = 0; j < 6; j++) scan_recs[i].mac[j] = (uchar)m[j];
+      scan_recs[i].fmac = 1;
+   }
+   fclose(fp);
+}
+#endif
+
+/*
+ * Host table (-d/-u)
+ * One line per host, sorted by IP: 
+ *   ip mac flags iana authcap ciphers devid first last
+ * where flags has 1=pong, 2=auth15, 4=auth20, authcap and devid are 
+ * hex bytes, ciphers is a comma list, and '-' is used for none.
+ */
+#define HOST_CSSZ    (32*4+1)  /* ciphers: "255," for each of SCAN_REC.cs */
+#define HOST_LINESZ  320       /* longest line, with HOST_CSSZ ciphers */
+
+static void host_hex(char *str, uchar *buf, int len)
+{
+   int i;
+   for (i = 0; i < len; i++) sprintf(&str[i*2],"%02x",buf[i]);
+}
+
+static int host_unhex(char *str, uchar *buf, int len)
+{
+   uint b;
+   int i;
+   if ((int)strlen(str) != len * 2) return(-1);
+   for (i = 0; i < len; i++) {
+      if (sscanf(&str[i*2],"%2x",&b) != 1) return(-1);
+      buf[i] = (uchar)b;
+   }
+   return(0);
+}
+
+/* host_load - read the host table, if any */
+static int host_load(void)
+{
+   FILE *fp;
+   char line[HOST_LINESZ];
+   char ipstr[40], macstr[40], authstr[40], csstr[HOST_CSSZ], devstr[40];
+   struct in_addr a;
+   SCAN_REC *r, *precs;
+   uint flags, iana, m[6];
+   ulong first, last;
+   int maxrecs = 0;
+   int lineno = 0;
+   int i;
+   char *p;
+
+   fp = fopen(g_hostfile,"r");
+   if (fp == NULL) {
+      if (fdebug) printf("host_load: cannot open %s\n",g_hostfile);
+      return(ERR_FILE_OPEN);
+   }
+   while (fgets(line,sizeof(line),fp) != NULL) {
+      lineno++;
+      if ((line[0] == '#') || (line[0] == '\n')) continue;
+      if (sscanf(line,"%39s %39s %x %u %39s %128s %39s %lu %lu",ipstr,
+		 macstr,&flags,&iana,authstr,csstr,devstr,&first,&last) != 9 ||
+	  !inet_aton(ipstr,&a)) {
+	 printerr("%s line %d: bad format\n",g_hostfile,lineno);
+	 continue;
+      }
+      if (host_nrecs >= maxrecs) {
+	 maxrecs = (maxrecs == 0)? 256: maxrecs * 2;
+	 precs = realloc(host_recs, maxrecs * sizeof(SCAN_REC));
+	 if (precs == NULL) break;
+	 host_recs = precs;
+      }
+      r = &host_recs[host_nrecs];
+      memset(r,0,sizeof(SCAN_REC));
+      r->ip = ntohl(a.s_addr);
+      if (sscanf(macstr,"%x:%x:%x:%x:%x:%x",&m[0],&m[1],&m[2],&m[3],
+		 &m[4],&m[5]) == 6) {
+	 for (i = 0; i < 6; i++) r->mac[i] = (uchar)m[i];
+	 r->fmac = 1;
+      }
+      r->fpong   = (flags & 0x01)? 1: 0;
+      r->fauth15 = (flags & 0x02)? 1: 0;
+      r->fauth20 = (flags & 0x04)? 1: 0;
+      r->iana = iana;
+      if (host_unhex(authstr,r->auth,sizeof(r->auth)) != 0) r->fauth15 = 0;
+      for (p = strtok(csstr,","); (p != NULL) && (*p != '-') && 
+	   (r->ncs < sizeof(r->cs)); p = strtok(NULL,","))
+	 r->cs[r->ncs++] = (uchar)atoi(p);
+      if (host_unhex(devstr,r->devid,sizeof(r->devid)) == 0) r->fdevid = 1;
+      r->first = first;
+      r->last  = last;
+      host_nrecs++;
+   }
+   fclose(fp);
+   qsort(host_recs,host_nrecs,sizeof(SCAN_REC),scan_rec_cmp);
+   if (fdebug) printf("host_load: %d hosts from %s\n",host_nrecs,g_hostfile);
+   return(0);
+}
+
+/* host_save - write the host table, replacing the file */
+static int host_save(SCAN_REC *recs, int n)
+{
+   char tmpfile[sizeof(g_hostfile)+4];
+   char macstr[20], authstr[20], csstr[HOST_CSSZ], devstr[40];
+   FILE *fp;
+   SCAN_REC *r;
+   int i, j, k, len, rv = 0;
+
+   sprintf(tmpfile,"%s.tmp",g_hostfile);
+   fp = fopen(tmpfile,"w");
+   if (fp == NULL) {
+      printerr("Cannot open host table %s\n",tmpfile);
+      return(ERR_FILE_OPEN);
+   }
+   fprintf(fp,"# %s host table: ip mac flags iana authcap ciphers devid first last\n",
+	   progname);
+   for (i = 0; i < n; i++) {
+      struct in_addr a;
+      r = &recs[i];
+      a.s_addr = htonl(r->ip);
+      if (r->fmac) sprintf(macstr,"%02x:%02x:%02x:%02x:%02x:%02x",r->mac[0],
+			   r->mac[1],r->mac[2],r->mac[3],r->mac[4],r->mac[5]);
+      else strcpy(macstr,"-");
+      host_hex(authstr,r->auth,sizeof(r->auth));
+      csstr[0] = 0;
+      for (j = 0, len = 0; j < r->ncs; j++) {
+	 k = snprintf(&csstr[len],sizeof(csstr)-len,"%s%d",(j? ",": ""),
+		      r->cs[j]);
+	 if ((k < 0) || (k >= (int)sizeof(csstr) - len)) {
+	    csstr[len] = 0;   /*no room, drop this one*/
+	    break;
+	 }
+	 len += k;
+      }
+      if (csstr[0] == 0) strcpy(csstr,"-");
+      if (r->fdevid) host_hex(devstr,r->devid,sizeof(r->devid));
+      else strcpy(devstr,"-");
+      if (fprintf(fp,"%s %s %x %u %s %s %s %lu %lu\n",inet_ntoa(a),macstr,
+		  (r->fpong | (r->fauth15 << 1) | (r->fauth20 << 2)),
+		  r->iana,authstr,csstr,devstr,r->first,r->last) < 0) 
+	 rv = ERR_FILE_OPEN;
+   }
+   if (fclose(fp) != 0) rv = ERR_FILE_OPEN;
+   if (rv == 0) {
+#ifdef WIN32
+      remove(g_hostfile);   /*rename will not replace it*/
+#endif
+      if (rename(tmpfile,g_hostfile) != 0) rv = ERR_FILE_OPEN;
+   }
+   if (rv != 0) {
+      printerr("Cannot write host table %s\n",g_hostfile);
+      remove(tmpfile);
+   } else if (fdebug) printf("host_save: %d hosts to %s\n",n,g_hostfile);
+   return(rv);
+}
+
+/* host_show_changes - show the fields of a known host that changed (-u) */
+static int host_show_changes(SCAN_REC *old, SCAN_REC *r)
+{
+   char ocols[SCAN_NCOLS][100];
+   char cols[SCAN_NCOLS][100];
+   struct in_addr a;
+   int i, n = 0;
+
+   scan_cols(old,ocols);
+   scan_cols(r,cols);
+   a.s_addr = htonl(r->ip);
+   for (i = 0; i < SCAN_NCOLS; i++) {
+      if (strcmp(ocols[i],cols[i]) == 0) continue;
+      if (fcanonical) 
+	 printf("%s%c%s%c%s%c%s%c%s\n","changed",bdelim,inet_ntoa(a),bdelim,
+		scan_colnames[i],bdelim,ocols[i],bdelim,cols[i]);
+      else
+	 printf("%-7s %c %-15s %c %s: %s -> %s\n","changed",bdelim,
+		inet_ntoa(a),bdelim,scan_colnames[i],ocols[i],cols[i]);
+      n++;
+   }
+   return(n);
+}
+
+/*
+ * host_merge
+ * Merge the scan records into the host table and save it.
+ * A known host that was probed and did not respond is removed, the
+ * others that were not probed (outside the range without -u) are kept.
+ * With -u, only the hosts added, removed or changed are shown.
+ */
+static int host_merge(void)
+{
+   SCAN_REC *recs, *r, *old;
+   ulong now;
+   int nadd = 0, ndel = 0, nchg = 0, nsame = 0;
+   int i, j, n, rv;
+
+   now = (ulong)time(NULL);
+   recs = malloc((scan_nrecs + host_nrecs + 1) * sizeof(SCAN_REC));
+   if (recs == NULL) return(-1);
+   if (frescan) scan_show_hdr();
+   i = 0; j = 0; n = 0;
+   while ((i < scan_nrecs) || (j < host_nrecs)) {
+      if ((j >= host_nrecs) || 
+	  ((i < scan_nrecs) && (scan_recs[i].ip < host_recs[j].ip))) {
+	 r = &scan_recs[i++];   /*new host*/
+	 r->first = now;
+	 r->last  = now;
+	 if (frescan) scan_show_rec("added",r);
+	 recs[n++] = *r;
+	 nadd++;
+      } else if ((i >= scan_nrecs) || (host_recs[j].ip < scan_recs[i].ip)) {
+	 old = &host_recs[j++];   /*known host, no response*/
+	 if (frescan || (scan_ordinal(old->ip) >= 0)) {
+	    if (frescan) scan_show_rec("removed",old);
+	    ndel++;
+	 } else recs[n++] = *old;   /*not probed this time*/
+      } else {
+	 r = &scan_recs[i++];
+	 old = &host_recs[j++];
+	 /* keep what this scan could not get */
+	 if (!r->fmac && old->fmac) {
+	    r->fmac = 1;
+	    memcpy(r->mac,old->mac,sizeof(r->mac));
+	 }
+	 if (!r->fdevid && old->fdevid) {
+	    r->fdevid = 1;
+	    memcpy(r->devid,old->devid,sizeof(r->devid));
+	 }
+	 r->first = old->first;
+	 r->last  = now;
+	 if (frescan && (host_show_changes(old,r) > 0)) nchg++;
+	 else nsame++;
+	 recs[n++] = *r;
+      }
+   }
+   if (frescan && (fdebug || !fcanonical))
+      printf("rescan: %d known, %d added, %d removed, %d changed, %d same\n",
+	     host_nrecs,nadd,ndel,nchg,nsame);
+   rv = host_save(recs,n);
+   free(recs);
+   return(rv);
+}
+
+#ifdef METACOMMAND
+/* scan_devids - get the Device ID from each IPMI host, with -f -U/-P */
+static void scan_devids(void)
+{
+   struct in_addr a;
+   uchar devid[20];
+   char ipstr[INET_ADDRSTRLEN+1];
+   int i, rv;
+
+   for (i = 0; i < scan_nrecs; i++) {
+      if (!scan_recs[i].fauth15) continue;
+      a.s_addr = htonl(scan_recs[i].ip);
+      strncpy(ipstr,inet_ntoa(a),sizeof(ipstr));
+      parse_lan_options('N',ipstr,0);
+      rv = ipmi_getdeviceid(devid,sizeof(devid),fdebug);
+      if (fdebug) printf("scan_devids: %s rv = %d\n",ipstr,rv);
+      if (rv == 0) {
+	 memcpy(scan_recs[i].devid,devid,sizeof(scan_recs[i].devid));
+	 scan_recs[i].fdevid = 1;
+      }
+      ipmi_close_();
+   }
+}
+#endif
+
+/*
+ * scan_run
+ * Sends probes at g_rate per second, up to SCAN_WINDOW outstanding,
+ * and retries each host every g_wait seconds, up to g_repeat+1 probes.
+ * With -u, the known hosts are sent first, and the other new targets 
+ * are also limited by a second token bucket at g_rate/SCAN_SWEEP_DIV.
+ * If nothing can be sent, because the window is full, the tokens are 
+ * used up, or the socket would block, it waits in select for a reply, 
+ * the next retry deadline, the next token, or the socket to drain.
+ */
+static int scan_run(void)
+{
+   uint batch[SCAN_BATCH];
+   SCAN_PROBE *p;
+   SCAN_FIFO *pf;
+   struct timeval tv;
+   fd_set rset, wset;
+   ulong now, last, t0, next, t;
+   ulong credit;   /* token bucket, in probes * 1000 */
+   ulong scredit;  /* sweep token bucket, for -u */
+   ulong wait_ms;
+   uint ip;
+   int ntries, n, nsweep, i, sent, rv;
+   int sweep_rate;
+   char fmore = 1;
+   char fknown = frescan;
+   char fwork;
+   char fblock = 0;   /* =1 if the last send would block */
+
+   scan_tab   = calloc(SCAN_TABSZ, sizeof(SCAN_PROBE));
+   scan_fifo  = calloc(SCAN_FIFOSZ, sizeof(SCAN_FIFO));
+   scan_ready = calloc(SCAN_WINDOW, sizeof(uint));
+   scan_seen  = calloc((scan_total + host_nrecs) / 8 + 1, 1);
+   if (scan_tab == NULL || scan_fifo == NULL || scan_ready == NULL ||
+       scan_seen == NULL) {
+      printerr("scan: cannot allocate %d hosts\n",scan_total);
+      return(-1);
+   }
+   if (g_rate <= 0) g_rate = 1;
+   sweep_rate = g_rate / SCAN_SWEEP_DIV;
+   if (sweep_rate <= 0) sweep_rate = 1;
+   if (fknownonly) fmore = 0;   /*no range to sweep*/
+   ntries = g_repeat + 1;
+   wait_ms = g_wait * 1000;
+   if (fdebug) printf("scan: %u addresses, %d/sec, %d tries, %lu ms wait\n",
+			scan_total,g_rate,ntries,wait_ms);
+   t0 = last = os_msec();
+   credit = SCAN_BATCH * 1000;
+   scredit = SCAN_BATCH * 1000;
+   while (fmore || fknown || (scan_nout > 0)) {
+      now = os_msec();
+      credit += (now - last) * g_rate;
+      if (credit > SCAN_BATCH * 1000) credit = SCAN_BATCH * 1000;
+      scredit += (now - last) * sweep_rate;
+      if (scredit > SCAN_BATCH * 1000) scredit = SCAN_BATCH * 1000;
+      last = now;
+      n = 0;
+      /* hosts that answered and go on to the next stage (-f) */
+      while ((ready_head != ready_tail) && (n < (int)(credit / 1000)) &&
+	     (fifo_tail - fifo_head < SCAN_FIFOSZ - SCAN_BATCH)) {
+	 ip = scan_ready[ready_head++ % SCAN_WINDOW];
+	 if (scan_find(ip) != NULL) batch[n++] = ip;
+      }
+      /* expired probes, in deadline order */
+      while ((fifo_head != fifo_tail) && (n < (int)(credit / 1000))) {
+	 pf = &scan_fifo[fifo_head % SCAN_FIFOSZ];
+	 p = scan_find(pf->ip);
+	 if ((p == NULL) || (p->deadline != pf->deadline)) { 
+	    fifo_head++;   /*answered, or stale*/
+	    continue; 
+	 }
+	 if (p->deadline > now) break;
+	 fifo_head++;
+	 if (p->tries >= ntries) { scan_delete(pf->ip); continue; } /*no answer*/
+	 scan_nretry++;
+	 batch[n++] = pf->ip;
+      }
+      /* then new targets, if there is room in the window */
+      while (fknown && (n < (int)(credit / 1000)) && 
+	     (scan_nout < SCAN_WINDOW) && 
+	     (fifo_tail - fifo_head < SCAN_FIFOSZ - SCAN_BATCH)) {
+	 if (!scan_next_known(&ip)) { fknown = 0; break; }
+	 scan_insert(ip);
+	 batch[n++] = ip;
+      }
+      nsweep = 0;
+      while (fmore && (n < (int)(credit / 1000)) && 
+	     (!frescan || (nsweep < (int)(scredit / 1000))) &&
+	     (scan_nout < SCAN_WINDOW) && 
+	     (fifo_tail - fifo_head < SCAN_FIFOSZ - SCAN_BATCH)) {
+	 if (!scan_next(&ip)) { fmore = 0; break; }
+	 scan_insert(ip);
+	 batch[n++] = ip;
+	 nsweep++;
+      }
+      if (n > 0) {
+	 sent = scan_send(batch,n);
+	 for (i = 0; i < sent; i++) {
+	    p = scan_find(batch[i]);   /*slots may move in scan_delete*/
+	    if (p == NULL) continue;
+	    p->tries++;
+	    p->deadline = now + wait_ms;
+	    pf = &scan_fifo[fifo_tail++ % SCAN_FIFOSZ];
+	    pf->ip = batch[i];
+	    pf->deadline = p->deadline;
+	 }
+	 /* unsent ones go back to the front of the ready queue, in order,
+	  * rather than behind the FIFO entries that are waiting */
+	 for (i = n - 1; i >= sent; i--) {
+	    p = scan_find(batch[i]);
+	    if (p == NULL) continue;
+	    p->deadline = 0;   /*any FIFO entry is now stale*/
+	    if (ready_tail - ready_head < SCAN_WINDOW)
+	       scan_ready[--ready_head % SCAN_WINDOW] = batch[i];
+	    else {
+	       p->deadline = now + 1;
+	       pf = &scan_fifo[fifo_tail++ % SCAN_FIFOSZ];
+	       pf->ip = batch[i];
+	       pf->deadline = p->deadline;
+	    }
+	 }
+	 credit -= sent * 1000;
+	 if (frescan) scredit -= ((nsweep < sent)? nsweep: sent) * 1000;
+	 fblock = (sent < n);   /*socket is full, wait until writable*/
+      }
+      /* wait for replies, until the next token or the next deadline */
+      next = 50;
+      while (fifo_head != fifo_tail) {
+	 pf = &scan_fifo[fifo_head % SCAN_FIFOSZ];
+	 p = scan_find(pf->ip);
+	 if ((p == NULL) || (p->deadline != pf->deadline)) { 
+	    fifo_head++;  /*answered, or stale*/
+	    continue; 
+	 }
+	 next = (p->deadline > now)? (p->deadline - now): 0;
+	 break;
+      }
+      if ((next < 50) && (credit < 1000))
+	 next = (1000 - credit) / g_rate + 1;  /*time to the next token*/
+      /* more to send now only if there is room, else wait as above */
+      fwork = (ready_head != ready_tail) ||
+	      ((fknown || fmore) && (scan_nout < SCAN_WINDOW));
+      if (fifo_tail - fifo_head >= SCAN_FIFOSZ - SCAN_BATCH) fwork = 0;
+      if (fwork && !fblock) {
+	 if (credit < 1000) 
+	    t = (1000 - credit) / g_rate + 1;   /*next token*/
+	 else if (fknown || (ready_head != ready_tail) || !frescan || 
+		  (scredit >= 1000)) 
+	    t = 0;
+	 else t = (1000 - scredit) / sweep_rate + 1;  /*next sweep token*/
+	 if (t < next) next = t;
+      }
+      if (next > 50) next = 50;
+      tv.tv_sec  = 0;
+      tv.tv_usec = next * 1000;
+      FD_ZERO(&rset);
+      FD_SET(g_sockfd, &rset);
+      FD_ZERO(&wset);
+      if (fblock) FD_SET(g_sockfd, &wset);
+      rv = select((int)(g_sockfd+1), &rset, &wset, NULL, &tv);
+      if (rv > 0) {
+	 if (FD_ISSET(g_sockfd, &wset)) fblock = 0;
+	 if (FD_ISSET(g_sockfd, &rset)) scan_recv();
+      } else if (rv < 0 && errno != EINTR) {
+	 printerr("select: %s\n", showlasterr());
+	 break;
+      }
+   }
+   if (fdebug || !fcanonical)
+      printf("scan: %u addresses, %d retries, %lu ms\n",
+	     scan_total,scan_nretry,os_msec() - t0);
+   if (ffinger) {
+#ifdef METACOMMAND
+      if (fcreds) scan_devids();
+#endif
+      qsort(scan_recs,scan_nrecs,sizeof(SCAN_REC),scan_rec_cmp);
+#ifdef LINUX
+      scan_arp();
+#endif
+      if (!frescan) {
+	 scan_show_hdr();
+	 for (i = 0; i < scan_nrecs; i++) scan_show_rec(NULL,&scan_recs[i]);
+      }
+      if (fhosts) rv = host_merge();
+      else rv = 0;
+   } else rv = 0;
+   free(scan_tab);   scan_tab = NULL;
+   free(scan_fifo);  scan_fifo = NULL;
+   free(scan_ready); scan_ready = NULL;
+   free(scan_seen);  scan_seen = NULL;
+   return(rv);
+}
+#endif
+
 #ifdef METACOMMAND
 int i_discover(int argc, char **argv)
 #else
@@ -983,7 +2175,12 @@ main(int argc, char **argv)
 #endif
    printf("%s ver %s\n", progname,progver);
 
-   while ( (c = getopt( argc, argv,"ab:ce:ghi:l:mp:r:s:x?")) != EOF )
+#ifdef METACOMMAND
+#define IDISC_OPTS "ab:cd:e:fghi:l:mp:r:s:t:uxEJ:P:R:T:U:V:Y?"
+#else
+#define IDISC_OPTS "ab:cd:e:fghi:l:mp:r:s:t:ux?"
+#endif
+   while ( (c = getopt( argc, argv,IDISC_OPTS)) != EOF )
       switch(c) {
           case 'a': fBroadcastOk = 1; fping = 1;
 		break;  /*all (broadcast ping)*/
@@ -1011,17 +2208,78 @@ main(int argc, char **argv)
           case 'r':   /*repeat N times*/
                 g_repeat = atoi(optarg);
 		break;
-          case 's':   /*subnet*/
-                /* copy optarg from 10.243.42.0 or similar, to
-                 * begin/end range. */
+          case 's':   /*subnet list, e.g. 10.243.42.0/24,10.243.44.0/22 */
+#ifdef SCAN_ENGINE
+                if (scan_parse(optarg) != 0) {
+                   rv = ERR_BAD_PARAM;
+                   goto do_exit;
+                }
+#endif
+                fscan = 1;
+		break;
+          case 't':   /*probes per second, for the batched scanner*/
+                g_rate = atoi(optarg);
+                fscan = 1;
 		break;
           case 'x': fdebug = 1;     break;  /* debug messages */
+          case 'f': ffinger = 1;    /* fingerprint, with the scanner */
+                fscan = 1;
+		break;
+          case 'd':   /*host table file*/
+                strncpy(g_hostfile,optarg,sizeof(g_hostfile)-1);
+                fhosts = 1; ffinger = 1; fscan = 1;
+		break;
+          case 'u':   /*rescan the known hosts, show changes*/
+                frescan = 1; fhosts = 1; ffinger = 1; fscan = 1;
+		break;
+#ifdef METACOMMAND
+          case 'U':    /* remote username */
+          case 'P':    /* remote password */
+          case 'R':    /* remote password */
+          case 'E':    /* get password from IPMI_PASSWORD environment var */
+          case 'Y':    /* prompt for remote password */
+                fcreds = 1;
+          case 'T':    /* auth type */
+          case 'J':    /* cipher suite */ 
+          case 'V':    /* priv level */
+                parse_lan_options(c,optarg,fdebug);
+                break;
+#endif
 	  case 'h': default:
 		if (fdebug) printerr("getopt(%c) default\n",c);
                 show_usage();
                 rv = ERR_USAGE;
 		goto do_exit;
       }
+#ifdef SCAN_ENGINE
+   if (fhosts) {
+      if (g_hostfile[0] == 0) 
+         strncpy(g_hostfile,HOSTTAB_FILE,sizeof(g_hostfile)-1);
+      host_load();   /*if none, a new table*/
+      if (frescan && (scan_nnets == 0) && (g_startDest[0] == 0)) {
+         struct in_addr a;   /*known hosts only*/
+         if (host_nrecs == 0) {
+            printerr("No hosts in %s, and no -s or -b range\n",g_hostfile);
+            rv = ERR_FILE_OPEN;
+            goto do_exit;
+         }
+         a.s_addr = htonl(host_recs[0].ip);
+         strncpy(g_startDest,inet_ntoa(a),MAXHOSTNAMELEN);
+         fknownonly = 1;
+      }
+   }
+   if (fscan && (scan_nnets > 0) && (g_startDest[0] == 0)) {
+      struct in_addr a;  /*sock_init needs a begin IP*/
+      a.s_addr = htonl(scan_nets[0].start);
+      strncpy(g_startDest,inet_ntoa(a),MAXHOSTNAMELEN);
+   }
+#else
+   if (fscan) {
+      printerr("Options -s, -t, -f, -d and -u are not supported on this OS\n");
+      rv = LAN_ERR_NOTSUPPORT;
+      goto do_exit;
+   }
+#endif
 #ifdef WIN32
    /* Winsock inet_aton() does not like 255.255.255.255 */
    if (!fBroadcastOk && (g_startDest[0] == 0) ) {
@@ -1061,6 +2319,25 @@ main(int argc, char **argv)
    }
 
    printf("Discovering IPMI Devices:\n");
+#ifdef SCAN_ENGINE
+   if (fscan) {
+      if (fBroadcastOk) {
+         printerr("Options -s and -t cannot be used with broadcast\n");
+         rv = ERR_BAD_PARAM;
+         goto do_exit;
+      }
+      if ((scan_nnets == 0) && !fknownonly) {  /* use the -b/-e range */
+         char range[MAXHOSTNAMELEN*2+2];
+         sprintf(range,"%s-%s",g_startDest,g_endDest);
+         rv = scan_addnet(range);
+         if (rv != 0) {
+            printerr("Invalid range %s\n",range);
+            goto do_exit;
+         }
+      }
+      rv = scan_run();
+   } else
+#endif
 #ifdef NO_THREADS
    sendThread(NULL);
 #else
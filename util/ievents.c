@@ -22,6 +22,7 @@
  * 04/11/07 Andy Cress - added events -p decoding for PET data
  * 10/03/07 Andy Cress - added file_grep for -p in Windows
  * 03/03/08 Andy Cress - added -f to interpret raw SEL file
+ * 10/19/26 - added -j for multi-threaded raw SEL decoding, file lists
  */
 /*M*
 Copyright (c) 2009 Kontron America, Inc.
@@ -67,6 +68,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <syslog.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#define SEL_THREADS  1   /*can decode raw SEL files with worker threads*/
 #endif
 #include <time.h>
 
@@ -102,6 +107,15 @@ extern char fdebug;          /* 1= debug output, from ipmicmd.c*/
 extern char fsm_debug;       /*mem_if.c*/
 #endif
 #define SDR_SZ   80
+#define SEL_MSGSZ  132   /*size of one decoded SEL output line*/
+#define SEL_CHUNK  256   /*SEL records per raw decode job*/
+#define MAX_DTHREADS 64  /*max raw SEL decode threads*/
+static int  nthreads  = 1;   /*raw SEL decode threads, -j*/
+#ifdef SEL_THREADS
+/* serializes the OEM decoders and SMBIOS lookups while decoding in threads */
+static pthread_mutex_t sel_lock = PTHREAD_MUTEX_INITIALIZER;
+static char fsel_mt = 0;     /*1= worker threads are decoding now*/
+#endif
 
 #pragma pack(1)
 typedef struct
@@ -724,7 +738,7 @@ void get_mfgid(int *vend, int *prod)
 }
 char * decode_rv(int rv) 
 {
-   static char mystr[30];
+   static SEL_TLS char mystr[30];
    char *pstr;
    switch(rv) {
    case 0:  pstr = "completed successfully"; break;
@@ -808,8 +822,14 @@ static int decode_mem_default(uchar b1, uchar b2, uchar b3, uchar etype, char *d
       n = sprintf(desc,DIMM_NUM,dimm);
       /* Use DMI if we get confirmation about cpu/dimm indices. */
       if (! is_remote()) {
+#ifdef SEL_THREADS
+         if (fsel_mt) pthread_mutex_lock(&sel_lock);
+#endif
          fsm_debug = fdebug;
          rv = get_MemDesc(cpu,dimm,desc,psz);
+#ifdef SEL_THREADS
+         if (fsel_mt) pthread_mutex_unlock(&sel_lock);
+#endif
          if (rv != 0) n = sprintf(desc,DIMM_NUM,dimm);
       }
    }
@@ -857,7 +877,7 @@ int new_event(uchar *buf, int len)
 char *get_sensor_type_desc(uchar stype)
 {
     int i;
-    static char stype_desc[25];
+    static SEL_TLS char stype_desc[25];
     char *pstr;
     if (stype == 0xF3) i = 0x2D; /*OEM SMI*/
     else if (stype == 0xDC) i = 0x2E; /*NM*/
@@ -924,16 +944,27 @@ get_misc_desc(ushort genid, uchar type, uchar num, uchar trig,
 time_t utc2local(time_t t)
 {
    struct tm * tm_tmp;
+#ifdef SEL_THREADS
+   struct tm tm_buf;
+#endif
    int gt_year,gt_yday,gt_hour,lt_year,lt_yday,lt_hour;
    int delta_hour;
    time_t lt;
    // convert UTC time to local time 
    // i.e. number of seconds from 1/1/70 0:0:0 1970 GMT
+#ifdef SEL_THREADS
+   tm_tmp=gmtime_r(&t,&tm_buf);
+#else
    tm_tmp=gmtime(&t);
+#endif
    gt_year=tm_tmp->tm_year;
    gt_yday=tm_tmp->tm_yday;
    gt_hour=tm_tmp->tm_hour;
+#ifdef SEL_THREADS
+   tm_tmp=localtime_r(&t,&tm_buf);
+#else
    tm_tmp=localtime(&t);
+#endif
    lt_year=tm_tmp->tm_year;
    lt_yday=tm_tmp->tm_yday;
    lt_hour=tm_tmp->tm_hour;
@@ -950,11 +981,18 @@ time_t utc2local(time_t t)
 void fmt_time(time_t etime, char *buf, int bufsz)
 {
 	time_t t;
+#ifdef SEL_THREADS
+	struct tm tm_buf;
+#endif
 	if (bufsz < 18) printf("fmt_time: buffer size should be >= 18\n");
 	if (futc) t = etime;
         else t = utc2local(etime);  /*assume input time is UTC*/
 	strncpy(buf,"00/00/00 00:00:00",bufsz);
+#ifdef SEL_THREADS
+        strftime(buf,bufsz, "%x %H:%M:%S", gmtime_r(&t,&tm_buf));
+#else
         strftime(buf,bufsz, "%x %H:%M:%S", gmtime(&t)); /*or "%x %T"*/
+#endif
 	return;
 }
 
@@ -1162,7 +1200,7 @@ int get_sensdesc(uchar sa, int snum, char *sensdesc, int *pstyp, int *pidx)
 
 char *get_genid_str(ushort genid)
 {
-   static char genstr[10];
+   static SEL_TLS char genstr[10];
    char *gstr;
    int i;
 		    
@@ -1544,7 +1582,13 @@ int decode_sel_entry( uchar *pevt, char *outbuf, int szbuf)
 	psel = (SEL_RECORD *)pevt;
 	etype = psel->event_trigger;
 
+#ifdef SEL_THREADS
+	if (fsel_mt) pthread_mutex_lock(&sel_lock);
+	j = decode_sel_oem(vend,pevt,outbuf,szbuf,fsensdesc,fdebug);
+	if (fsel_mt) pthread_mutex_unlock(&sel_lock);
+#else
 	j = decode_sel_oem(vend,pevt,outbuf,szbuf,fsensdesc,fdebug);
+#endif
 	if (j == 0) return(0);  /*successful, have the description*/
 
 	if (psel->record_type == RT_OEMIU) { /* 0xDB usu ipmiutil OEM string */
@@ -2173,11 +2217,13 @@ int decode_sel_entry( uchar *pevt, char *outbuf, int szbuf)
 
 static void show_usage(void)
 {
-    printf("Usage: %s [-bdfhprstux] 01 02 03 04 05 06 07 08 09 0a 0b 0c 0d 0e 0f 10\n",progname);
+    printf("Usage: %s [-bdfhjprstux] 01 02 03 04 05 06 07 08 09 0a 0b 0c 0d 0e 0f 10\n",progname);
     printf("where -b = interpret Binary raw SEL file, from ipmitool sel writeraw\n");
     printf("      -d = get DeviceID for vendor/product-specific events\n");
     printf("      -f = interpret File with raw ascii SEL data, from ipmiutil sel -r\n");
     printf("      -h = interpret Hex binary raw SEL file (same as -b)\n");
+    printf("      -j N = use N threads to decode raw SEL files (0=all cpus)\n");
+    printf("           More raw files or directories may follow -b/-f/-r.\n");
 #ifndef ALONE
     printf("      -o = specify the target vendor IANA number.\n");
 #endif
@@ -2195,6 +2241,244 @@ static void show_usage(void)
     printf("      -x = show eXtra debug messages\n");
 }
 
+/*
+ * Raw SEL file decoding
+ * The raw records are read in order by the main thread into a ring of 
+ * SEL_CHUNK-record jobs.  With -j, worker threads decode the ready jobs,
+ * and the main thread shows each job in the original order once it is done.
+ * Without threads, each job is decoded inline when it is shown.
+ */
+#define JOB_FREE   0
+#define JOB_READY  1
+#define JOB_BUSY   2
+#define JOB_DONE   3
+typedef struct {
+   int   state;    /*JOB_FREE, JOB_READY, JOB_BUSY, JOB_DONE*/
+   int   nrec;     /*number of SEL records in this job*/
+   char  fhdr;     /*1= show the header before this job*/
+   char *fname;    /*raw file that this job came from*/
+   uchar evt[SEL_CHUNK][16];
+   char  out[SEL_CHUNK][SEL_MSGSZ];
+} SEL_JOB;
+
+static SEL_JOB *seljobs = NULL;
+static int njobs  = 0;   /*number of job slots in the ring*/
+static int jhead  = 0;   /*oldest job, next to be shown*/
+static int jtail  = 0;   /*next free job slot*/
+static int jcount = 0;   /*number of jobs in the ring*/
+static int nrawfiles = 0;
+#ifdef SEL_THREADS
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  job_cv   = PTHREAD_COND_INITIALIZER; /*job ready*/
+static pthread_cond_t  done_cv  = PTHREAD_COND_INITIALIZER; /*job done*/
+static char fjobs_end = 0;
+#endif
+
+/* read_raw_rec - read the next 16-byte SEL record, returns 0 at EOF */
+static int read_raw_rec(FILE *fp, int mode, uchar *hbuf)
+{
+   char buff[256];
+   int fvalid, i;
+
+   if (mode != 1) /*hex raw*/
+      return(fread(hbuf, 1, 16, fp) == 16);
+   while (fgets(buff, 255, fp)) {  /*ascii raw*/
+      fvalid = 0;
+      if (buff[0] >= '0' && (buff[0] <= '9')) fvalid = 1;
+      else if (buff[0] >= 'a' && (buff[0] <= 'f')) fvalid = 1;
+      else if (buff[0] >= 'A' && (buff[0] <= 'F')) fvalid = 1;
+      if (fvalid == 0) continue;
+      for (i = 0; i < 16; i++) {
+         hbuf[i] = _htoi(&buff[i*3]);
+      }
+      return(1);
+   }
+   return(0);
+}
+
+static void decode_job(SEL_JOB *job)
+{
+   int i;
+   for (i = 0; i < job->nrec; i++)
+      decode_sel_entry(job->evt[i], job->out[i], SEL_MSGSZ);
+}
+
+#ifdef SEL_THREADS
+static void *decode_thread(void *arg)
+{
+   SEL_JOB *job;
+   int i;
+
+   pthread_mutex_lock(&job_lock);
+   for ( ; ; ) {
+      job = NULL;
+      for (i = 0; i < jcount; i++) {  /*oldest ready job first*/
+         if (seljobs[(jhead + i) % njobs].state == JOB_READY) {
+            job = &seljobs[(jhead + i) % njobs];
+            break;
+         }
+      }
+      if (job == NULL) {
+         if (fjobs_end) break;
+         pthread_cond_wait(&job_cv, &job_lock);
+         continue;
+      }
+      job->state = JOB_BUSY;
+      pthread_mutex_unlock(&job_lock);
+      decode_job(job);
+      pthread_mutex_lock(&job_lock);
+      job->state = JOB_DONE;
+      pthread_cond_broadcast(&done_cv);
+   }
+   pthread_mutex_unlock(&job_lock);
+   return(NULL);
+}
+#endif
+
+/* submit_job - mark the job at jtail ready for decoding */
+static void submit_job(void)
+{
+#ifdef SEL_THREADS
+   pthread_mutex_lock(&job_lock);
+   seljobs[jtail].state = JOB_READY;
+   jtail = (jtail + 1) % njobs;
+   jcount++;
+   pthread_cond_signal(&job_cv);
+   pthread_mutex_unlock(&job_lock);
+#else
+   seljobs[jtail].state = JOB_READY;
+   jtail = (jtail + 1) % njobs;
+   jcount++;
+#endif
+}
+
+/* flush_job - wait for the oldest job, show it, and free its slot */
+static void flush_job(void)
+{
+   SEL_JOB *job;
+   int i;
+
+   job = &seljobs[jhead];
+#ifdef SEL_THREADS
+   if (fsel_mt) {
+      pthread_mutex_lock(&job_lock);
+      while (job->state != JOB_DONE) 
+         pthread_cond_wait(&done_cv, &job_lock);
+      pthread_mutex_unlock(&job_lock);
+   } else 
+#endif
+      decode_job(job);
+   if (job->fhdr) {
+      if (nrawfiles > 1) printf("%s:\n",job->fname);
+      printf("%s",evt_hdr); /*"RecId Date/Time_______*/
+   }
+   for (i = 0; i < job->nrec; i++)
+      printf("%s", job->out[i]);
+#ifdef SEL_THREADS
+   pthread_mutex_lock(&job_lock);
+   job->state = JOB_FREE;
+   jhead = (jhead + 1) % njobs;
+   jcount--;
+   pthread_mutex_unlock(&job_lock);
+#else
+   job->state = JOB_FREE;
+   jhead = (jhead + 1) % njobs;
+   jcount--;
+#endif
+}
+
+/* 
+ * decode_raw_files
+ * input parameters:  
+ * files    : list of raw SEL file names
+ * nfiles   : number of files in the list
+ * mode     : 1 = ascii raw from ipmiutil sel -r
+ *            2 = binary hex from ipmiutil sel writeraw {raw_file}
+ * Uses nthreads (-j) worker threads, if more than one.
+ * The output is always shown in the original file/record order.
+ */
+int decode_raw_files(char **files, int nfiles, int mode)
+{
+   FILE *fp;
+   SEL_JOB *job;
+   int nthr, i, n;
+   char fhdr;
+   int rv = 0;
+#ifdef SEL_THREADS
+   pthread_t thr[MAX_DTHREADS];
+#endif
+
+   nthr = nthreads;
+#ifdef SEL_THREADS
+   if (nthr < 1) nthr = 1;
+   if (nthr > MAX_DTHREADS) nthr = MAX_DTHREADS;
+#else
+   nthr = 1;
+#endif
+   njobs = (nthr > 1) ? (nthr * 2) : 1;
+   seljobs = calloc(njobs, sizeof(SEL_JOB));
+   if (seljobs == NULL) {
+      printf("Cannot allocate raw SEL buffers\n");
+      return(-1);
+   }
+   jhead = 0; jtail = 0; jcount = 0;
+   nrawfiles = nfiles;
+#ifdef SEL_THREADS
+   fjobs_end = 0;
+   if (nthr > 1) {
+      for (i = 0; i < nthr; i++) 
+         if (pthread_create(&thr[i], NULL, decode_thread, NULL) != 0) break;
+      nthr = i;  /*number of threads actually created*/
+      if (nthr > 0) fsel_mt = 1;
+   }
+   if (fdebug) printf("decoding raw SEL with %d threads\n",nthr);
+#endif
+
+   for (i = 0; i < nfiles; i++) {
+      fp = fopen(files[i],"r");
+      if (fp == NULL) {
+	 while (jcount > 0) flush_job();  /*keep messages in order*/
+	 printf("Cannot open file %s\n",files[i]);
+	 rv = ERR_FILE_OPEN;
+	 continue;
+      }
+      if (fdebug) {
+	 if (mode == 1) 
+            printf("decoding raw ascii file with IPMI event bytes\n");
+	 else printf("decoding binary hex file with IPMI event bytes\n");
+      }
+      fhdr = 1;
+      do {
+	 if (jcount == njobs) flush_job();  /*ring is full*/
+	 job = &seljobs[jtail];
+	 for (n = 0; n < SEL_CHUNK; n++) 
+	    if (read_raw_rec(fp, mode, job->evt[n]) == 0) break;
+	 if (n == 0 && !fhdr) break;
+	 job->nrec  = n;
+	 job->fhdr  = fhdr;
+	 job->fname = files[i];
+	 submit_job();
+	 fhdr = 0;
+      } while (n == SEL_CHUNK);
+      fclose(fp);
+   }
+   while (jcount > 0) flush_job();
+
+#ifdef SEL_THREADS
+   if (fsel_mt) {
+      pthread_mutex_lock(&job_lock);
+      fjobs_end = 1;
+      pthread_cond_broadcast(&job_cv);
+      pthread_mutex_unlock(&job_lock);
+      for (i = 0; i < nthr; i++) pthread_join(thr[i], NULL);
+      fsel_mt = 0;
+   }
+#endif
+   free(seljobs);
+   seljobs = NULL;
+   return(rv);
+}
+
 /* 
  * decode_raw_sel
  * input parameters:  
@@ -2204,46 +2488,49 @@ static void show_usage(void)
  */
 int decode_raw_sel(char *raw_file, int mode)
 {
-      FILE *fp;
-      char buff[256];
-      char msg[132];
-      uchar hbuf[50];
-      int fvalid = 0;
-      int len, i;
-
-      fp = fopen(raw_file,"r");
-      if (fp == NULL) {
-	 printf("Cannot open file %s\n",raw_file);
+   return(decode_raw_files(&raw_file, 1, mode));
+}
+
+static char **rawlist = NULL;  /*raw SEL files to decode*/
+static int nrawlist = 0;
+
+/* add_raw_path - add a raw SEL file, or the files in a directory */
+static int add_raw_path(char *path)
+{
+   char **plist;
+   char *pfile;
+#if !defined(WIN32) && !defined(DOS)
+   struct stat st;
+   struct dirent **ents;
+   int i, n, len;
+
+   if ((stat(path,&st) == 0) && S_ISDIR(st.st_mode)) {
+      n = scandir(path, &ents, NULL, alphasort);
+      if (n < 0) {
+	 printf("Cannot open directory %s\n",path);
 	 return(ERR_FILE_OPEN);
-      } else {
-         printf("%s",evt_hdr); /*"RecId Date/Time_______*/
-	 if (mode == 1) { /*ascii raw*/
-	    if (fdebug)
-                printf("decoding raw ascii file with IPMI event bytes\n");
-            while (fgets(buff, 255, fp)) {
-   	       len = strlen_(buff);
-   	       fvalid = 0;
-   	       if (buff[0] >= '0' && (buff[0] <= '9')) fvalid = 1;
-   	       else if (buff[0] >= 'a' && (buff[0] <= 'f')) fvalid = 1;
-   	       else if (buff[0] >= 'A' && (buff[0] <= 'F')) fvalid = 1;
-   	       if (fvalid == 0) continue;
-   	       for (i = 0; i < 16; i++) {
-                  hbuf[i] = _htoi(&buff[i*3]);
-   	       }
-               decode_sel_entry(hbuf,msg,sizeof(msg));
-               printf("%s", msg);
-            } /*end while*/
-	 } else {  /*hex raw*/
-	    if (fdebug)
-		printf("decoding binary hex file with IPMI event bytes\n");
-            while (fread(hbuf, 1, 16, fp) == 16) {
-               decode_sel_entry(hbuf,msg,sizeof(msg));
-               printf("%s", msg);
-	    } /*end while*/
+      }
+      for (i = 0; i < n; i++) {
+	 len = strlen_(path) + strlen_(ents[i]->d_name) + 2;
+	 pfile = malloc(len);
+	 if (pfile != NULL) {
+	    snprintf(pfile,len,"%s/%s",path,ents[i]->d_name);
+	    if ((stat(pfile,&st) == 0) && S_ISREG(st.st_mode)) 
+	       add_raw_path(pfile);
+	    free(pfile);
 	 }
-	 fclose(fp);
+	 free(ents[i]);
       }
+      free(ents);
       return(0);
+   }
+#endif
+   plist = realloc(rawlist, (nrawlist + 1) * sizeof(char *));
+   pfile = strdup(path);
+   if (plist == NULL || pfile == NULL) return(-1);
+   rawlist = plist;
+   rawlist[nrawlist++] = pfile;
+   return(0);
 }
 
 /*
@@ -2325,7 +2612,7 @@ int i_events(int argc, char **argv)
    
    printf("%s version %s\n",progname,progver);
    if (argc > 0) { argc--; argv++; } /*skip argv[0], program name*/
-   /* ievents getopt:  [ -bdfhnoprstux -NPRUEFJTVY */
+   /* ievents getopt:  [ -bdfhjnoprstux -NPRUEFJTVY */
    while ((argc > 0) && argv[0][0] == '-') 
    { 
       c = argv[0][1];
@@ -2333,6 +2620,18 @@ int i_events(int argc, char **argv)
         case 'x':  fdebug = 1; break;
 	case 'd': fgetdevid = 1; break; /*get device id (vendor, product)*/
 	case 'n': fnewevt = 1; break;  /* generate New event */
+	case 'j':  /* number of threads for raw SEL decoding */
+          if (argc > 1) { /*next argv is number of threads*/
+             nthreads = atoi(argv[1]);
+#ifdef SEL_THREADS
+             if (nthreads <= 0) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+             argc--; argv++;
+          } else {
+             printf("option -%c requires an argument\n",c);
+             rv = ERR_BAD_PARAM;
+          }
+	  break;
         case 'p':  /* PET format, minus first 8 bytes*/
           /* This is important for some SNMP trap receivers that obscure 
            * the first 8 bytes of the trap data */
@@ -2574,10 +2873,18 @@ int i_events(int argc, char **argv)
       printf("%s", msg);
    } else if (fnewevt) {
       rv = new_event(buf,len);  /*do new platform event*/
-   } else if (frawfile) {
-      rv = decode_raw_sel(rawfil,1);  /*ascii raw data from file */
-   } else if (fhexfile) {
-      rv = decode_raw_sel(rawfil,2);  /*binary/hex raw data from file*/
+   } else if (frawfile || fhexfile) {
+      /* any remaining arguments are more raw files or directories */
+      rv = add_raw_path(rawfil);
+      for (i = 0; (i < argc) && (rv == 0); i++) rv = add_raw_path(argv[i]);
+      if (rv == 0) {
+         if (frawfile) 
+            rv = decode_raw_files(rawlist,nrawlist,1); /*ascii raw data*/
+         else rv = decode_raw_files(rawlist,nrawlist,2); /*binary/hex raw*/
+      }
+      for (i = 0; i < nrawlist; i++) free(rawlist[i]);
+      free(rawlist);
+      rawlist = NULL; nrawlist = 0;
    } else {
       if (fdebug) printf("decoding standard IPMI event bytes\n");
       if (fdebug) dump_buf("IPMI event",buf,16,0);
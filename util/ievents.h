@@ -46,6 +46,19 @@ void format_event(ushort id, time_t timestamp, int sevid, ushort genid,
 		  char *ptype, uchar snum, char *psens, char *pstr, char *more, 
 		  char *outbuf, int outsz);
 
+/*
+ * SEL_TLS marks static string buffers returned by the decode routines
+ * as thread-local, so that decode_sel_entry() may be called from the
+ * decode_raw_sel() worker threads (ievents -j).
+ */
+#if defined(WIN32)
+#define SEL_TLS  __declspec(thread)
+#elif defined(DOS)
+#define SEL_TLS
+#else
+#define SEL_TLS  __thread
+#endif
+
 #define DIMM_UNKNOWN  "DIMM_unknown"
 #define DIMM_NUM  "DIMM(%d)"
 /*
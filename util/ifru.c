@@ -37,6 +37,12 @@
  * 08/22/05 Andy Cress v1.18 allow setting Product Serial Number also (-s),
  *                           also add -b option to show only baseboard data.
  * 10/31/06 Andy Cress v1.25 handle 1-char asset/serial strings (avoid c1)
+ * 10/19/26 - added -g to gather the FRU SDRs first, then read only the
+ *            FRU areas in use, with larger chunks, and show the timing.
+ * 10/19/26 - added -u to cache FRU contents per BMC, and re-read only the
+ *            areas whose header or checksum changed.
+ * 10/19/26 - write_fru_data writes only the changed bytes, and verifies
+ *            them by reading back only those ranges.
  */
 /*M*
 Copyright (c) 2009 Kontron America, Inc.
@@ -139,7 +145,10 @@ static char foemkontron = 0;
 static char fbasefru = 1;
 static char fdump = 0;
 static char frestore = 0;
+static char fru_whole = 0;     /* =1 if load_fru read every byte of frubuf*/
 static char fchild = 0;        /* =1 follow child MCs if picmg bladed*/
+static char fgather = 0;       /* =1 gather FRU SDRs, then read them (-g)*/
+static char fgather_now = 0;   /* =1 while reading the gathered FRUs */
 static char do_systeminfo = 1;
 static char do_guid = 1;
 static char bdelim = ':';
@@ -201,6 +210,10 @@ static int sdr_get_reservation(uchar *res_id, int fdev) { return(-1); }
 #define STRING_DATA_TYPE_LANG_DEPENDENT 0x03
 
 #define FRUCHUNK_SZ   16   /* optimal chunk = 16 bytes */
+#define FRUCHUNK_MAX  32   /* largest chunk to try, with -g */
+static int fru_chunk  = FRUCHUNK_SZ;  /* reduced if the MC rejects it */
+static int fru_ncmds  = 0;  /* READ_FRU_DATA commands, for -g timing */
+static int fru_nbytes = 0;  /* FRU bytes read, for -g timing */
 #define FRU_END         0xC1
 #define FRU_EMPTY_FIELD 0xC0
 #define FRU_TYPE_MASK   0xC0
@@ -266,6 +279,485 @@ free_fru(uchar *pfrubuf)
    return;
 }
 
+uchar calc_cksum(uchar *pbuf,int len);
+
+/*
+ * read_fru_range
+ * Reads len FRU bytes at offset off into buf, in fru_chunk pieces.
+ * If the MC rejects the chunk size, fru_chunk is reduced and retried.
+ * Returns an error only if the first read fails, and *pnread = bytes read.
+ */
+static int read_fru_range(uchar frudev, char fwords, uchar *buf, 
+			  int off, int len, int *pnread)
+{
+   int ret = 0;
+   uchar indata[4];
+   uchar resp[FRUCHUNK_MAX+2];
+   int sresp;
+   uchar cc;
+   ushort fruoff = 0;
+   int i, chunk;
+
+   *pnread = 0;
+   for (i = off; i < off + len; i += chunk)
+   {
+	chunk = fru_chunk;
+	if ((i+chunk) >= (off + len)) chunk = off + len - i;
+	indata[0] = frudev;  /* FRU Device ID */
+	if (fwords) {
+	   indata[3] = chunk / 2;
+	   fruoff = (i/2);
+	} else {
+	   indata[3] = (uchar)chunk;
+	   fruoff = (ushort)i;
+	}
+        indata[1] = fruoff & 0x00FF;
+        indata[2] = (fruoff & 0xFF00) >> 8;
+        sresp = sizeof(resp);
+        ret = ipmi_cmd_mc(READ_FRU_DATA,indata,4,resp,&sresp,&cc,fdebug);
+	fru_ncmds++;
+        if (ret != 0) break;
+        else if ((cc == 0xC7 || cc == 0xC8 || cc == 0xCA) && 
+		 (fru_chunk > FRUCHUNK_SZ)) {
+	   /* too many bytes for this MC, retry with the usual chunk */
+           if (fdebug) printf("read_fru[%d]: cc = %x, chunk %d -> %d\n",
+				i,cc,fru_chunk,FRUCHUNK_SZ);
+	   fru_chunk = FRUCHUNK_SZ;
+	   chunk = 0;
+	   continue;
+        } else if (cc != 0) {
+           if (i == off) ret = cc & 0x00ff; 
+           if (fdebug) printf("read_fru[%d]: ret = %d cc = %x\n",i,ret,cc);
+           break; 
+        }
+        memcpy(&buf[i],&resp[1],chunk);
+	*pnread += chunk;
+	fru_nbytes += chunk;
+   }
+   return(ret);
+}
+
+/*
+ * FRU block map for load_fru_areas: one byte per 8-byte FRU block,
+ * nonzero once that block has been read.
+ */
+#define FRU_BLK(off)   ((off) >> 3)
+#define FRU_MAXBATCH   32   /* READ_FRU_DATA requests per ipmi_cmd_batch */
+
+/* fru_can_batch - ipmi_cmd_batch goes the same way as ipmi_cmd_mc */
+static int fru_can_batch(void)
+{
+   uchar adrtype;
+   ipmi_get_mc(NULL, NULL, NULL, &adrtype);
+   return((get_driver_type() == DRV_MV) || (adrtype != ADDR_IPMB) || 
+	  is_remote());
+}
+
+/* fru_batch_send - send n chunk reads as one batch, mark what was read.
+ * A chunk that fails in the batch, or every chunk if !fbatch, is read 
+ * alone with read_fru_range, which also drops a rejected chunk size. */
+static int fru_batch_send(uchar frudev, char fwords, uchar *buf, uchar *map,
+			  int *coff, int *clen, int n, char fbatch)
+{
+   IPMI_BATCH b[FRU_MAXBATCH];
+   uchar indata[FRU_MAXBATCH][4];
+   uchar resp[FRU_MAXBATCH][FRUCHUNK_MAX+2];
+   uchar sa, bus, lun;
+   ushort fruoff;
+   int i, j, nread, ret, rv = 0;
+
+   ipmi_get_mc(&bus, &sa, &lun, NULL);
+   for (i = 0; i < n; i++) {
+      fruoff = (ushort)(fwords ? coff[i]/2 : coff[i]);
+      indata[i][0] = frudev;
+      indata[i][1] = fruoff & 0x00FF;
+      indata[i][2] = (fruoff & 0xFF00) >> 8;
+      indata[i][3] = (uchar)(fwords ? clen[i]/2 : clen[i]);
+      memset(&b[i],0,sizeof(IPMI_BATCH));
+      b[i].cmd   = (READ_FRU_DATA & 0x00FF);
+      b[i].netfn = (READ_FRU_DATA & 0xFF00) >> 8;
+      b[i].sa    = sa;
+      b[i].bus   = bus;
+      b[i].lun   = lun;
+      b[i].pdata = indata[i];
+      b[i].sdata = 4;
+      b[i].presp = resp[i];
+      b[i].sresp = sizeof(resp[i]);
+   }
+   if (fbatch) {
+      ret = ipmi_cmd_batch(b, n, fdebug);
+      fru_ncmds += n;
+   } else ret = LAN_ERR_NOTSUPPORT;  /*read each one with ipmi_cmd_mc*/
+   for (i = 0; i < n; i++) {
+      if ((ret == 0) && (b[i].rv == 0) && (b[i].cc == 0) && 
+	  (b[i].sresp > clen[i])) {
+         memcpy(&buf[coff[i]],&resp[i][1],clen[i]);
+	 fru_nbytes += clen[i];
+      } else {
+         if (fdebug && fbatch) printf("fru_batch[%d]: rv = %d cc = %x, retry\n",
+			    coff[i],b[i].rv,b[i].cc);
+         rv = read_fru_range(frudev,fwords,buf,coff[i],clen[i],&nread);
+	 if (rv == 0 && nread < clen[i]) rv = ERR_LENMIN;
+	 if (rv != 0) continue;
+      }
+      for (j = coff[i]; j < coff[i] + clen[i]; j += 8) map[FRU_BLK(j)] = 1;
+   }
+   return(rv);
+}
+
+/*
+ * read_fru_batch
+ * Reads the FRU blocks in the nr ranges poff/plen that are not yet in 
+ * map, in fru_chunk pieces, FRU_MAXBATCH pieces per ipmi_cmd_batch.
+ * If requests to this MC are bridged by ipmi_cmd_ipmb, which 
+ * ipmi_cmd_batch does not do, the pieces are read one at a time.
+ * Returns an error if any piece could not be read.
+ */
+static int read_fru_batch(uchar frudev, char fwords, uchar *buf, int sz,
+			  uchar *map, int *poff, int *plen, int nr)
+{
+   int coff[FRU_MAXBATCH];
+   int clen[FRU_MAXBATCH];
+   int i, n, off, end, len, rv, ret = 0;
+   char fbatch;
+
+   fbatch = fru_can_batch();
+   n = 0;
+   for (i = 0; i < nr; i++) {
+      off = poff[i] & ~7;
+      end = poff[i] + plen[i];
+      if (off < 0 || off >= sz) continue;
+      if (end > sz) end = sz;
+      while (off < end) {
+	 if (map[FRU_BLK(off)]) { off += 8; continue; }
+	 for (len = 0; (off + len < end) && (len < fru_chunk) && 
+		       !map[FRU_BLK(off+len)]; len += 8) ;
+	 if (off + len > sz) len = sz - off;
+	 coff[n] = off;
+	 clen[n] = len;
+	 n++;
+	 off += len;
+	 if (n == FRU_MAXBATCH) {
+	    rv = fru_batch_send(frudev,fwords,buf,map,coff,clen,n,fbatch);
+	    if (rv != 0) ret = rv;
+	    n = 0;
+	 }
+      }
+   }
+   if (n > 0) {
+      rv = fru_batch_send(frudev,fwords,buf,map,coff,clen,n,fbatch);
+      if (rv != 0) ret = rv;
+   }
+   return(ret);
+}
+
+/*
+ * load_fru_areas
+ * Reads only the FRU bytes that are in use, per the common header.
+ * The header is read first, then the start of each area, for its 
+ * length, then the rest of the areas, each step as one ipmi_cmd_batch.
+ * The multi-record list is read one record per batch, since each record
+ * header gives the offset of the next one.  The rest of the buffer is 
+ * left zeroed.  If there is no valid common header (e.g. a DIMM SPD), 
+ * all sz bytes are read.
+ */
+static int load_fru_areas(uchar frudev, char fwords, uchar *buf, int sz)
+{
+   int poff[5], plen[5];
+   uchar *map;
+   int i, j, n, off, len, have;
+   int ret;
+
+   map = calloc(1,FRU_BLK(sz+7));
+   if (map == NULL) return(get_errno());
+   len = (fru_chunk < sz) ? fru_chunk : sz;
+   ret = read_fru_range(frudev,fwords,buf,0,len,&have);
+   if (have == 0) { free(map); return(ret); } /*first read failed*/
+   for (i = 0; i < have; i += 8) map[FRU_BLK(i)] = 1;
+   if ((have < 8) || (buf[0] != 0x01) || (calc_cksum(buf,7) != buf[7])) {
+      poff[0] = 0; plen[0] = sz;
+      read_fru_batch(frudev,fwords,buf,sz,map,poff,plen,1);
+      free(map);
+      return(0);
+   }
+   /* the start of the chassis, board, product and multi-record areas */
+   for (n = 0, i = 2; i <= 5; i++) {
+      if (buf[i] == 0) continue;
+      poff[n] = buf[i] * 8; 
+      plen[n] = fru_chunk;
+      n++;
+   }
+   read_fru_batch(frudev,fwords,buf,sz,map,poff,plen,n);
+   /* then the rest of the internal use, chassis, board, product areas */
+   for (n = 0, i = 1; i <= 4; i++) {
+      off = buf[i] * 8;
+      if ((off == 0) || (off + 2 > sz)) continue;
+      if (i == 1) {  /* internal use area ends at the next area */
+	 len = sz - off;
+	 for (j = 2; j <= 5; j++)
+	    if ((buf[j] * 8 > off) && (buf[j] * 8 - off < len)) 
+	       len = buf[j] * 8 - off;
+      } else {       /* chassis, board, product areas have a length */
+	 if (!map[FRU_BLK(off)]) continue;  /*could not read its start*/
+	 len = buf[off+1] * 8;
+      }
+      poff[n] = off; 
+      plen[n] = len;
+      n++;
+   }
+   read_fru_batch(frudev,fwords,buf,sz,map,poff,plen,n);
+   off = buf[5] * 8;   /* walk the multi-record area */
+   while ((off > 0) && (off + 5 <= sz)) {
+      poff[0] = off; plen[0] = 5;
+      if (read_fru_batch(frudev,fwords,buf,sz,map,poff,plen,1) != 0) break;
+      if (buf[off] == 0 && buf[off+2] == 0) break; /*type/len invalid*/
+      len = 5 + buf[off+2];
+      /* this record, and the next record header with it */
+      plen[0] = (buf[off+1] & 0x80) ? len : len + 5;
+      if (read_fru_batch(frudev,fwords,buf,sz,map,poff,plen,1) != 0) break;
+      if (buf[off+1] & 0x80) break;  /*end of list*/
+      off += len;
+   }
+   if (fdebug) {
+      for (have = 0, i = 0; i < sz; i += 8) if (map[FRU_BLK(i)]) have += 8;
+      printf("load_fru_areas: read %d of %d bytes\n",have,sz);
+   }
+   free(map);
+   return(0);
+}
+
+/*
+ * FRU content cache (-u)
+ * The FRU image for each (sa, fru id, inventory size) is kept in a file
+ * per BMC.  On later runs only the common header, plus the header and 
+ * checksum bytes of each area, are read and compared with the cached 
+ * image, and only the areas that changed are read again.
+ */
+#ifdef WIN32
+#define FRUCACHE_DIR  "."      /* or %ipmiutildir% if set */
+#else
+#define FRUCACHE_DIR  "/var/lib/ipmiutil"
+#endif
+static char fcache = 0;            /* =1 use the FRU content cache (-u) */
+static char fru_cachefile[160] = "";  /* cache file for the last load_fru */
+static int  fru_nrefresh = 0;      /* area reads after a cache compare */
+
+static void fru_cache_name(uchar sa, uchar frudev, int sz)
+{
+   char *dir = FRUCACHE_DIR;
+   char *node = "local";
+   char *p;
+#ifdef WIN32
+   p = getenv("ipmiutildir");  /*ipmiutil directory path*/
+   if (p != NULL) dir = p;
+#endif
+   if (is_remote()) node = get_nodename();
+   if (strlen(dir) + strlen(node) + 32 > sizeof(fru_cachefile)) {
+      fru_cachefile[0] = 0;  /*too long, no cache*/
+      return;
+   }
+   sprintf(fru_cachefile,"%s/fru_%s_%02x_%02x_%d.cache",dir,node,
+	   sa,frudev,sz);
+   /* the nodename could have path or IPv6 characters */
+   for (p = &fru_cachefile[strlen(dir)+1]; *p != 0; p++)
+      if (*p == '/' || *p == '\\' || *p == ':') *p = '_';
+}
+
+static int fru_cache_load(uchar *buf, int sz)
+{
+   FILE *fp;
+   int n;
+
+   if (fru_cachefile[0] == 0) return(ERR_FILE_OPEN);
+   fp = fopen(fru_cachefile,"rb");
+   if (fp == NULL) return(ERR_FILE_OPEN);
+   n = (int)fread(buf, 1, sz, fp);
+   if (fgetc(fp) != EOF) n = 0;   /*longer than this FRU*/
+   fclose(fp);
+   if ((n != sz) || (sz < 8) || (buf[0] != 0x01) || 
+       (calc_cksum(buf,7) != buf[7])) {
+      memset(buf,0,sz);
+      return(ERR_BAD_FORMAT);
+   }
+   return(0);
+}
+
+static void fru_cache_save(uchar *buf, int sz)
+{
+   char tmpfile[sizeof(fru_cachefile)+4];
+   FILE *fp;
+   int n;
+
+   if (fru_cachefile[0] == 0) return;
+   sprintf(tmpfile,"%s.tmp",fru_cachefile);
+   fp = fopen(tmpfile,"wb");
+   if (fp == NULL) {
+      if (fdebug) printf("fru_cache: cannot open %s\n",tmpfile);
+      return;
+   }
+   n = (int)fwrite(buf, 1, sz, fp);
+   if (fclose(fp) != 0) n = 0;
+   if (n == sz) {
+#ifdef WIN32
+      remove(fru_cachefile);   /*rename will not replace it*/
+#endif
+      if (rename(tmpfile,fru_cachefile) == 0) {
+         if (fdebug) printf("fru_cache: saved %s\n",fru_cachefile);
+	 return;
+      }
+   }
+   remove(tmpfile);
+}
+
+/* fru_area_fetch - read an area that changed into the cached image */
+static int fru_area_fetch(uchar frudev, uchar *buf, int sz, int off, int len)
+{
+   int n, ret;
+   if (off + len > sz) len = sz - off;
+   ret = read_fru_range(frudev,0,buf,off,len,&n);
+   if (ret == 0 && n < len) ret = ERR_LENMIN;
+   if (fdebug) printf("fru_cache: area at %d, len %d re-read, ret = %d\n",
+		      off,len,ret);
+   fru_nrefresh++;
+   return(ret);
+}
+
+/* fru_probe_add - add a range to compare, in offset order */
+#define FRU_MAXPROBE  48
+static int fru_probe_add(int *poff, int *plen, int np, int off, int len, int sz)
+{
+   int i;
+   if ((np >= FRU_MAXPROBE) || (off < 0) || (off >= sz)) return(np);
+   if (off + len > sz) len = sz - off;
+   for (i = np; (i > 0) && (poff[i-1] > off); i--) {
+      poff[i] = poff[i-1];
+      plen[i] = plen[i-1];
+   }
+   poff[i] = off;
+   plen[i] = len;
+   return(np+1);
+}
+
+/*
+ * load_fru_cached
+ * Validates the cached FRU image against the device and re-reads only
+ * the areas that changed.  The ranges compared are the common header, 
+ * the first and last 8 bytes of each area (version, length ... checksum),
+ * each multi-record header (with both checksums), and the internal use
+ * area, which has no checksum.  Adjacent ranges are merged into one read.
+ * Falls back to load_fru_areas if the common header changed or there is 
+ * no usable cache.  Not used with word access FRUs.
+ */
+static int load_fru_cached(uchar frudev, uchar *buf, int sz)
+{
+   uchar *cur;
+   int poff[FRU_MAXPROBE], plen[FRU_MAXPROBE];
+   int np = 0;
+   int i, j, off, len, end, n;
+   int ret;
+   char fchg = 0;
+
+   fru_nrefresh = 0;
+   ret = fru_cache_load(buf,sz);
+   if (ret != 0) {
+      if (fdebug) printf("fru_cache: %s not usable, ret = %d\n",
+			 fru_cachefile,ret);
+      ret = load_fru_areas(frudev,0,buf,sz);
+      if (ret == 0 && buf[0] == 0x01) fru_cache_save(buf,sz);
+      return(ret);
+   }
+   /* build the list of ranges to compare from the cached layout */
+   np = fru_probe_add(poff,plen,np,0,8,sz);
+   for (i = 1; i <= 4; i++) {
+      off = buf[i] * 8;
+      if (off == 0) continue;
+      if (i == 1) {  
+	 len = sz - off;
+	 for (j = 2; j <= 5; j++)
+	    if ((buf[j] * 8 > off) && (buf[j] * 8 - off < len)) 
+	       len = buf[j] * 8 - off;
+	 np = fru_probe_add(poff,plen,np,off,len,sz);
+      } else {
+	 if (off + 8 > sz) continue;  /*past the end, from a bad cache*/
+	 len = buf[off+1] * 8;
+	 np = fru_probe_add(poff,plen,np,off,8,sz);
+	 if (len > 8) np = fru_probe_add(poff,plen,np,off+len-8,8,sz);
+      }
+   }
+   off = buf[5] * 8;
+   while ((off > 0) && (off + 5 <= sz)) {
+      np = fru_probe_add(poff,plen,np,off,5,sz);
+      if (buf[off] == 0 && buf[off+2] == 0) break; /*type/len invalid*/
+      if (buf[off+1] & 0x80) break;  /*end of list*/
+      off += 5 + buf[off+2];
+   }
+   cur = calloc(1,sz);
+   if (cur == NULL) return(get_errno());
+   for (i = 0; (i < np) && (ret == 0); i = j) {
+      end = poff[i] + plen[i];
+      for (j = i+1; (j < np) && (poff[j] <= end); j++)  /*merge*/
+	 if (poff[j] + plen[j] > end) end = poff[j] + plen[j];
+      ret = read_fru_range(frudev,0,cur,poff[i],end - poff[i],&n);
+      if (ret == 0 && n < end - poff[i]) ret = ERR_LENMIN;
+   }
+   if (ret != 0) { free(cur); return(ret); }
+   if (memcmp(cur,buf,8) != 0) {  /*layout changed*/
+      if (fdebug) printf("fru_cache: common header changed\n");
+      free(cur);
+      memset(buf,0,sz);
+      ret = load_fru_areas(frudev,0,buf,sz);
+      if (ret == 0 && buf[0] == 0x01) fru_cache_save(buf,sz);
+      return(ret);
+   }
+   /* compare each range, and re-read the areas that changed */
+   for (i = 1; (i <= 4) && (ret == 0); i++) {
+      off = buf[i] * 8;
+      if ((off == 0) || (off >= sz)) continue;
+      if (i == 1) {  /* internal use area was read in full */
+	 for (j = 0; (j < np) && (poff[j] != off); j++) ;
+	 if ((j < np) && memcmp(&cur[off],&buf[off],plen[j]) != 0) {
+	    memcpy(&buf[off],&cur[off],plen[j]);
+	    fru_nrefresh++;
+	    fchg = 1;
+	 }
+	 continue;
+      }
+      if (off + 8 > sz) continue;
+      len = buf[off+1] * 8;
+      n = 8;
+      if ((memcmp(&cur[off],&buf[off],n) == 0) && (len >= 8) && 
+	  (off + len <= sz) &&
+	  (memcmp(&cur[off+len-8],&buf[off+len-8],8) == 0)) continue;
+      len = cur[off+1] * 8;   /* the new length */
+      if (len == 0) len = 8;
+      fchg = 1;
+      ret = fru_area_fetch(frudev,buf,sz,off,len);
+   }
+   off = buf[5] * 8;   /* multi-record area */
+   while ((ret == 0) && (off > 0) && (off + 5 <= sz)) {
+      if (memcmp(&cur[off],&buf[off],5) != 0) break;
+      if (buf[off] == 0 && buf[off+2] == 0) { off = 0; break; }
+      if (buf[off+1] & 0x80) { off = 0; break; }
+      off += 5 + buf[off+2];
+   }
+   /* a record changed, so re-read the rest of the list */
+   while ((ret == 0) && (off > 0) && (off + 5 <= sz)) {
+      fchg = 1;
+      ret = fru_area_fetch(frudev,buf,sz,off,5);
+      if (ret != 0) break;
+      if (buf[off] == 0 && buf[off+2] == 0) break; /*type/len invalid*/
+      len = 5 + buf[off+2];
+      if (len > 5) ret = fru_area_fetch(frudev,buf,sz,off+5,len-5);
+      if (buf[off+1] & 0x80) break;  /*end of list*/
+      off += len;
+   }
+   free(cur);
+   if (fdebug) printf("fru_cache: %d area reads to refresh, ret = %d\n",
+		      fru_nrefresh,ret);
+   if (ret == 0 && fchg) fru_cache_save(buf,sz);
+   return(ret);
+}
+
 int
 load_fru(uchar sa, uchar frudev, uchar frutype, uchar **pfrubuf)
 {
@@ -276,9 +768,7 @@ load_fru(uchar sa, uchar frudev, uchar frutype, uchar **pfrubuf)
    uchar cc;
    int sz;
    char fwords;
-   ushort fruoff = 0;
    int i, rv;
-   int chunk;
 
    if (pfrubuf == NULL) return(ERR_BAD_PARAM);
    *pfrubuf = NULL;
@@ -297,34 +787,23 @@ load_fru(uchar sa, uchar frudev, uchar frutype, uchar **pfrubuf)
    if (resp[2] & 0x01) { fwords = 1; sz = sz * 2; }
    else fwords = 0;
 
-   frubuf = malloc(sz);
+   frubuf = calloc(1,sz);
    if (frubuf == NULL) return(get_errno());
    *pfrubuf = frubuf;
    sfru = sz;
       
+   fru_whole = 0;
+   fru_cache_name(sa,frudev,sz);
    /* Loop on READ_FRU_DATA */
-   for (i = 0, chunk=FRUCHUNK_SZ; i < sz; i+=chunk)
-   {
-	if ((i+chunk) >= sz) chunk = sz - i;
-	indata[0] = frudev;  /* FRU Device ID */
-	if (fwords) {
-	   indata[3] = chunk / 2;
-	   fruoff = (i/2);
-	} else {
-	   indata[3] = (uchar)chunk;
-	   fruoff = (ushort)i;
-	}
-        indata[1] = fruoff & 0x00FF;
-        indata[2] = (fruoff & 0xFF00) >> 8;
-        sresp = sizeof(resp);
-        ret = ipmi_cmd_mc(READ_FRU_DATA,indata,4,resp,&sresp,&cc,fdebug);
-        if (ret != 0) break;
-        else if (cc != 0) {
-           if (i == 0) ret = cc & 0x00ff; 
-           if (fdebug) printf("read_fru[%d]: ret = %d cc = %x\n",i,ret,cc);
-           break; 
-        }
-        memcpy(&frubuf[i],&resp[1],chunk);
+   if (fcache && !fdump && !fwritefru && !fwords) 
+      ret = load_fru_cached(frudev,frubuf,sz);
+   else if (fgather && !fdump && !fwritefru) 
+      ret = load_fru_areas(frudev,fwords,frubuf,sz);
+   else {
+      ret = read_fru_range(frudev,fwords,frubuf,0,sz,&i);
+      if ((ret == 0) && (i == sz)) fru_whole = 1;
+      if (fcache && fru_whole && !fwords) 
+         fru_cache_save(frubuf,sz);  /*keep the cache current*/
    }
 
    if ((frudev == 0) && (sa == bmc_sa) && do_guid) 
@@ -1076,25 +1555,77 @@ show_fru(uchar sa, uchar frudev, uchar frutype, uchar *pfrubuf)
    return(ret);
 }
 
-int write_fru_data(uchar id, ushort offset, uchar *data, int dlen, char fdebug)
+/* fru_verify - read back FRU bytes [start,end) of a write and compare */
+static int fru_verify(uchar id, ushort offset, uchar *data, uchar *vbuf,
+		      int start, int end)
 {
-   int ret = -1;
+   int n, ret;
+   ret = read_fru_range(id,0,vbuf,offset+start,end-start,&n);
+   if (ret == 0 && n < end - start) ret = ERR_LENMIN;
+   if (ret == 0 && memcmp(&vbuf[offset+start],&data[start],end-start) != 0) {
+      printf("write_fru_data: verify error at offset %d, len %d\n",
+	     offset+start,end-start);
+      ret = ERR_OTHER;
+   }
+   return(ret);
+}
+
+/* fru_next_run - find the next changed run of up to FRUCHUNK_SZ bytes */
+static int fru_next_run(uchar *data, uchar *old, int dlen, int i, int *pend)
+{
+   int k;
+   if (old != NULL) 
+      while ((i < dlen) && (data[i] == old[i])) i++;
+   *pend = i;
+   for (k = i; (k < i + FRUCHUNK_SZ) && (k < dlen); k++)
+      if ((old == NULL) || (data[k] != old[k])) *pend = k+1;
+   return(i);
+}
+
+/*
+ * write_fru_diff
+ * Writes only the bytes in data that differ from old (the current FRU 
+ * contents at offset), coalesced into runs of up to FRUCHUNK_SZ bytes,
+ * then reads back only those runs to verify them.
+ * If old is NULL, the current contents are read from the FRU first, 
+ * and if that fails, all of data is written.
+ */
+int write_fru_diff(uchar id, ushort offset, uchar *data, uchar *old, 
+		   int dlen, char fdebug)
+{
+   int ret = 0;
    int chunk;
    ushort fruoff;
    uchar req[FRUCHUNK_SZ+9];
    uchar resp[FRUCHUNK_SZ];
+   uchar *vbuf;
    int sresp;
    uchar cc;
-   int i, j;
+   int i, j, end, vstart, vend;
+   int nwrites = 0;
+   int nbytes = 0;
+
+   if (dlen <= 0) return(0);
+   /* vbuf is indexed by FRU offset, as for read_fru_range */
+   vbuf = calloc(1,offset + dlen);
+   if (vbuf == NULL) return(get_errno());
+   if (old == NULL) {
+      ret = read_fru_range(id,0,vbuf,offset,dlen,&i);
+      if ((ret == 0) && (i == dlen)) old = &vbuf[offset];
+      else if (fdebug) 
+	 printf("write_fru_data: read ret = %d, writing all %d bytes\n",
+		ret,dlen);
+      ret = 0;
+   }
 
-   /* Write the buffer in small 16-byte (FRUCHUNK_SZ) chunks */
-   req[0] = 0x00;  /* override FRU Device ID (fruid) */
-   fruoff = offset;
-   chunk = FRUCHUNK_SZ;
-   for (i = 0; i < dlen; i += chunk) {
+   /* Write the changed runs in small 16-byte (FRUCHUNK_SZ) chunks */
+   req[0] = id;  /* FRU Device ID (fruid) */
+   for (i = fru_next_run(data,old,dlen,0,&end); i < dlen; 
+	i = fru_next_run(data,old,dlen,end,&end)) {
+	chunk = end - i;
+	fruoff = offset + (ushort)i;
 	req[1] = fruoff & 0x00ff;
 	req[2] = (fruoff & 0xff00) >> 8;
-	if ((i + chunk) > dlen) chunk = dlen - i;
 	memcpy(&req[3],&data[i],chunk);
 	if (fdebug) {
 	   printf("write_fru_data[%d] (len=%d): ",i,chunk+3);
@@ -1108,11 +1639,37 @@ int write_fru_data(uchar id, ushort offset, uchar *data, int dlen, char fdebug)
 	if (fdebug && ret == 0) 
 		printf("write_fru_data[%d]: %d bytes written\n",i,resp[0]);
 	if (ret != 0) break;
-	fruoff += (ushort)chunk;
+	nwrites++;
+	nbytes += chunk;
    }
+
+   /* Verify by reading back the written runs, merging nearby ones */
+   vstart = vend = -1;
+   for (i = fru_next_run(data,old,dlen,0,&end); (ret == 0) && (i < dlen); 
+	i = fru_next_run(data,old,dlen,end,&end)) {
+	if ((vend >= 0) && (i > vend + 8)) {
+	   ret = fru_verify(id,offset,data,vbuf,vstart,vend);
+	   vend = -1;
+	}
+	if (vend < 0) vstart = i;
+	vend = end;
+   }
+   if ((ret == 0) && (vend >= 0)) 
+	ret = fru_verify(id,offset,data,vbuf,vstart,vend);
+   free(vbuf);
+   if (fdebug) 
+	printf("write_fru_data: wrote %d of %d bytes in %d cmds, ret = %d\n",
+		nbytes,dlen,nwrites,ret);
+   /* the FRU changed, so the cached copy from load_fru is stale */
+   if ((nwrites > 0) && (fru_cachefile[0] != 0)) remove(fru_cachefile);
    return(ret);
 }
 
+int write_fru_data(uchar id, ushort offset, uchar *data, int dlen, char fdebug)
+{
+   return(write_fru_diff(id,offset,data,NULL,dlen,fdebug));
+}
+
 /* write_asset updates the FRU Product area only. */
 int
 write_asset(char *tag, char *sernum, char *prodver, int flag, uchar *pfrubuf)
@@ -1318,7 +1875,9 @@ write_asset(char *tag, char *sernum, char *prodver, int flag, uchar *pfrubuf)
    newlen = 0;
 #endif
 
-   ret = write_fru_data(0, (ushort)prod_offset, newdata, newlen, fdebug);
+   /* if frubuf was only partly read, the FRU is read again to compare */
+   ret = write_fru_diff(g_fruid, (ushort)prod_offset, newdata, 
+		(fru_whole ? &pfrubuf[prod_offset] : NULL), newlen, fdebug);
    return(ret);
 }
 
@@ -1412,6 +1971,30 @@ void show_loadfru_error(uchar sa, uchar fruid, int ret)
    return;
 }
 
+/* FRU locator SDRs gathered with -g, to be read in SDR order */
+typedef struct {
+   ushort recid;
+   int    len;
+   uchar  sdr[48];
+} FRU_SDR;
+static FRU_SDR *frusdrs = NULL;
+static int nfrusdrs = 0;
+static int maxfrusdrs = 0;
+static ulong fru_totms = 0;
+static int   fru_totcmds = 0;
+static int   fru_ndevs = 0;
+
+static void show_fru_time(uchar sa, uchar fruid, ulong t0)
+{
+   ulong ms;
+   ms = os_msec() - t0;
+   printf("\tFRU(%x,%x) read %d bytes in %d cmds, %lu ms\n",
+	  sa,fruid,fru_nbytes,fru_ncmds,ms);
+   fru_totms += ms;
+   fru_totcmds += fru_ncmds;
+   fru_ndevs++;
+}
+
 int get_show_fru(ushort recid, uchar *sdr, int sdrlen)
 {
    int ret = 0;
@@ -1422,7 +2005,23 @@ int get_show_fru(ushort recid, uchar *sdr, int sdrlen)
    char fgetfru = 0;
    char fisbase = 0;
    uchar *pfru;
-
+   ulong t0 = 0;
+
+   if (fgather && !fgather_now) {  /* save it for show_gathered_frus */
+      if (nfrusdrs >= maxfrusdrs) {
+	 FRU_SDR *p;
+	 p = realloc(frusdrs,(maxfrusdrs + 32) * sizeof(FRU_SDR));
+	 if (p == NULL) return(get_errno());
+	 frusdrs = p;
+	 maxfrusdrs += 32;
+      }
+      if (sdrlen > sizeof(frusdrs[0].sdr)) sdrlen = sizeof(frusdrs[0].sdr);
+      frusdrs[nfrusdrs].recid = recid;
+      frusdrs[nfrusdrs].len = sdrlen;
+      memcpy(frusdrs[nfrusdrs].sdr,sdr,sdrlen);
+      nfrusdrs++;
+      return(0);
+   }
    if (sdrlen > SDR_STR_OFF) {
 	ilen = sdrlen - SDR_STR_OFF;
 	if (ilen >= sizeof(idstr)) ilen = sizeof(idstr) - 1;
@@ -1493,6 +2092,8 @@ int get_show_fru(ushort recid, uchar *sdr, int sdrlen)
                 if (fdebug) printf("set_mc %02x:%02x:%02x type=%d fruid=%02x\n",
 				g_bus,sa,g_lun,adrtype,fruid);
                 ipmi_set_mc(g_bus, sa, g_lun,adrtype);
+		t0 = os_msec();
+		fru_ncmds = 0; fru_nbytes = 0;
                 ret = load_fru(sa,fruid,frutype,&pfru);
                 if (ret != 0) {
 		   show_loadfru_error(sa,fruid,ret);
@@ -1501,6 +2102,7 @@ int get_show_fru(ushort recid, uchar *sdr, int sdrlen)
                    if (ret != 0) printf("show_fru error = %d\n",ret);
                    if (sa == bmc_sa && fruid == 0) fbasefru = 0;
                 }
+		if (fgather) show_fru_time(sa,fruid,t0);
 		free_fru(pfru);
 		pfru = NULL;
                 ipmi_restore_mc();
@@ -1511,6 +2113,25 @@ int get_show_fru(ushort recid, uchar *sdr, int sdrlen)
    return(ret);
 }
 
+/*
+ * show_gathered_frus
+ * Reads and shows the FRU devices gathered by get_show_fru with -g.
+ * The SDR walk is done first, so that it keeps its SDR reservation,
+ * and then each FRU device is read in SDR order.
+ */
+static int show_gathered_frus(void)
+{
+   int i, ret = 0;
+   fgather_now = 1;
+   for (i = 0; i < nfrusdrs; i++) 
+      ret = get_show_fru(frusdrs[i].recid,frusdrs[i].sdr,frusdrs[i].len);
+   fgather_now = 0;
+   if (frusdrs != NULL) free(frusdrs);
+   frusdrs = NULL;
+   nfrusdrs = maxfrusdrs = 0;
+   return(ret);
+}
+
 /*
  * test_show_fru
  *
@@ -1653,7 +2274,7 @@ int i_fru(int argc, char **argv)
    printf("%s version %s\n",progname,progver);
           
    parse_lan_options('V',"4",0);  /*default to admin privilege*/
-   while ( (c = getopt( argc, argv,"a:bcd:efhkl:m:n:i:p:r:s:t:v:xyzT:V:J:EYF:P:N:R:U:Z:?")) != EOF )
+   while ( (c = getopt( argc, argv,"a:bcd:efghkl:m:n:i:p:r:s:t:uv:xyzT:V:J:EYF:P:N:R:U:Z:?")) != EOF )
       switch(c) {
           case 'x': fdebug = 1;  break;
           case 'z': fdebug = 3;  break; /*do more LAN debug detail*/
@@ -1665,9 +2286,12 @@ int i_fru(int argc, char **argv)
                 break;
           case 'e': fchild = 1;  break;  /*extra child MCs if bladed*/
           case 'f': fchild = 1;  break;  /*follow child MCs if bladed*/
+          case 'g': fgather = 1;         /*gather FRUs, read areas in use*/
+		    fru_chunk = FRUCHUNK_MAX;  break;
           case 'h': fonlyhsc = 1;     /* show HSC FRU, same as -m00c000s */
 		    g_frutype = 0x0f;   break;
           case 'k': foemkontron = 1;  break;
+          case 'u': fcache = 1;  break;  /*use the FRU content cache*/
           case 'n': 
 		fwritefru |= 0x200; 
 		if (optarg) {
@@ -1773,17 +2397,19 @@ int i_fru(int argc, char **argv)
                 parse_lan_options(c,optarg,fdebug);
                 break;
           default:
-                printf("Usage: %s [-bceikmtvx -a asset_tag -s ser_num -NUPREFTVYZ]\n",
+                printf("Usage: %s [-bcegikmtuvx -a asset_tag -s ser_num -NUPREFTVYZ]\n",
 			 progname);
 		printf("   -a tag   Sets the Product Asset Tag\n");
 		printf("   -b       Only show Baseboard FRU data\n");
 		printf("   -c       show canonical, delimited output\n");
 		printf("   -d file  Dump the binary FRU data to a file\n");
 		printf("   -e       walk Every child FRU, for blade MCs\n");
+		printf("   -g       Gather FRU SDRs, then read only the FRU areas in use, timed\n");
 		printf("   -i 00    Get a specific FRU ID\n");
 		printf("   -k       Kontron setsn, setmfgdate\n");
                 printf("   -m002000 specific MC (bus 00,sa 20,lun 00)\n");
 		printf("   -s snum  Sets the Product Serial Number\n");
+		printf("   -u       Use a FRU content cache, re-read only changed areas\n");
 		printf("   -v pver  Sets the Product Version Number\n");
 		printf("   -x       Display extra debug messages\n");
 		print_lan_opt_usage(0);
@@ -1976,6 +2602,7 @@ int i_fru(int argc, char **argv)
            else fdevsdrs = 0;
         }
      } /*end ipass loop*/
+     if (fgather) show_gathered_frus();
    } /*endif not fonlybase*/
  
    /* load the FRU data for Baseboard (address 0x20) */
@@ -1988,7 +2615,10 @@ int i_fru(int argc, char **argv)
       ipmi_set_mc(g_bus,sa,g_lun,g_addrtype);
 
    if (fbasefru) {
+      ulong t0;
       /* get and display the Baseboard FRU data */
+      t0 = os_msec();
+      fru_ncmds = 0; fru_nbytes = 0;
       ret = load_fru(sa,g_fruid,g_frutype,&pfru);
       if (ret != 0) {
 	 show_loadfru_error(sa,g_fruid,ret);
@@ -1998,7 +2628,11 @@ int i_fru(int argc, char **argv)
       }
       ret = show_fru(sa,g_fruid,g_frutype,pfru);
       if (ret != 0) printf("show_fru error = %d\n",ret);
+      if (fgather) show_fru_time(sa,g_fruid,t0);
    }
+   if (fgather && (fru_ndevs > 0))
+      printf("--- %d FRU devices read in %d cmds, %lu ms ---\n",
+	     fru_ndevs,fru_totcmds,fru_totms);
 
    if (fcanonical) devstr[0] = 0;  /*default is empty string*/
    else sprintf(devstr,"[%s,%02x,%02x] ", /*was by g_frutype*/
@@ -2061,6 +2695,7 @@ int i_fru(int argc, char **argv)
    }
    else if (frestore) {
       uchar cksum;
+      uchar *oldbuf = NULL;
       /* Restore FRU from a binary file */
 #ifdef WIN32
       fp = fopen(binfile,"rb");
@@ -2073,6 +2708,9 @@ int i_fru(int argc, char **argv)
       } else {
 	 ret = 0;
 	 /* sfru and frubuf were set from load_fru above. */
+	 /* keep the old data, to write only changes, if it was all read */
+	 if (fru_whole) oldbuf = malloc(sfru);
+	 if (oldbuf != NULL) memcpy(oldbuf,frubuf,sfru);
 	 len = (int)fread(frubuf, 1, sfru, fp);
 	 if (len <= 0) { 
 	     ret = get_LastError();
@@ -2096,7 +2734,7 @@ int i_fru(int argc, char **argv)
 	 }
 	 if (ret == 0) {  /*successfully read data*/
         printf("Writing FRU size %d from %s  ...\n",sfru,binfile);
-        ret = write_fru_data(g_fruid, 0, frubuf, sfru, fdebug);
+        ret = write_fru_diff(g_fruid, 0, frubuf, oldbuf, sfru, fdebug);
         free_fru(frubuf);
         if (ret != 0) printf("write_fru error %d (0x%02x)\n",ret,ret);
 	    else {  /* successful, show new data */
@@ -2107,6 +2745,7 @@ int i_fru(int argc, char **argv)
 	       pfru = NULL;
 	    }
 	 } 
+	 if (oldbuf != NULL) free(oldbuf);
       }
    }  /*end-else frestore */
    else if ((fwritefru != 0) && ret == 0) {
@@ -10,6 +10,8 @@
  * Copyright (c) 2009 Kontron America, Inc.
  *
  * 04/01/10 Andy Cress - created from ifru.c 2.6.1
+ * 10/19/26 - write_fru_data writes only the changed bytes, and verifies
+ *            them by reading back only those ranges.
  */
 /*M*
 Copyright (c) 2009 Kontron America, Inc.
@@ -924,26 +926,78 @@ show_fru(uchar sa, uchar frudev, uchar frutype)
    return(ret);
 }
 
+/* read_fru_bytes - read len FRU bytes at offset off into buf[0..len) */
+static int read_fru_bytes(uchar id, int off, uchar *buf, int len)
+{
+   uchar indata[4];
+   uchar resp[FRUCHUNK_SZ+2];
+   int sresp;
+   uchar cc;
+   int i, chunk, ret = 0;
+
+   for (i = 0, chunk = FRUCHUNK_SZ; i < len; i += chunk) {
+	if ((i + chunk) > len) chunk = len - i;
+	indata[0] = id;
+	indata[1] = (off + i) & 0x00FF;
+	indata[2] = ((off + i) & 0xFF00) >> 8;
+	indata[3] = (uchar)chunk;
+	sresp = sizeof(resp);
+        ret = ipmi_cmd_mc(READ_FRU_DATA,indata,4,resp,&sresp,&cc,fdebug);
+	if ((ret == 0) && (cc != 0)) ret = cc & 0x00ff; 
+	if ((ret == 0) && (resp[0] < chunk)) ret = ERR_LENMIN;
+	if (ret != 0) break;
+        memcpy(&buf[i],&resp[1],chunk);
+   }
+   return(ret);
+}
+
+/* fru_next_run - find the next changed run of up to FRUCHUNK_SZ bytes */
+static int fru_next_run(uchar *data, uchar *old, int dlen, int i, int *pend)
+{
+   int k;
+   if (old != NULL) 
+      while ((i < dlen) && (data[i] == old[i])) i++;
+   *pend = i;
+   for (k = i; (k < i + FRUCHUNK_SZ) && (k < dlen); k++)
+      if ((old == NULL) || (data[k] != old[k])) *pend = k+1;
+   return(i);
+}
+
+/*
+ * write_fru_data
+ * Writes only the bytes in data that differ from old (the current FRU 
+ * contents at offset, read from the FRU if NULL), coalesced into runs 
+ * of up to FRUCHUNK_SZ bytes, then reads back only those runs to verify.
+ */
 static int 
-write_fru_data(uchar id, ushort offset, uchar *data, int dlen, char fdebug)
+write_fru_data(uchar id, ushort offset, uchar *data, uchar *old, int dlen, 
+		char fdebug)
 {
-   int ret = -1;
+   int ret = 0;
    int chunk;
    ushort fruoff;
    uchar req[FRUCHUNK_SZ+9];
    uchar resp[16];
+   uchar *vbuf;
    int sresp;
    uchar cc;
-   int i, j;
+   int i, j, end, vstart, vend;
+   int nwrites = 0;
+
+   if (dlen <= 0) return(0);
+   vbuf = malloc(dlen);
+   if (vbuf == NULL) return(get_errno());
+   if ((old == NULL) && (read_fru_bytes(id,offset,vbuf,dlen) == 0)) 
+      old = vbuf;
 
-   /* Write the buffer in small 16-byte (FRUCHUNK_SZ) chunks */
+   /* Write the changed runs in small 16-byte (FRUCHUNK_SZ) chunks */
    req[0] = id;  /* FRU Device ID (fruid) */
-   fruoff = offset;
-   chunk = FRUCHUNK_SZ;
-   for (i = 0; i < dlen; i += chunk) {
+   for (i = fru_next_run(data,old,dlen,0,&end); i < dlen; 
+	i = fru_next_run(data,old,dlen,end,&end)) {
+	chunk = end - i;
+	fruoff = offset + i;
 	req[1] = fruoff & 0x00ff;
 	req[2] = (fruoff & 0xff00) >> 8;
-	if ((i + chunk) > dlen) chunk = dlen - i;
 	memcpy(&req[3],&data[i],chunk);
 	if (fdebug) {
 	   printf("write_fru_data[%d] (len=%d): ",i,chunk+3);
@@ -957,8 +1011,28 @@ write_fru_data(uchar id, ushort offset, uchar *data, int dlen, char fdebug)
 	if (fdebug && ret == 0) 
 		printf("write_fru_data[%d]: %d bytes written\n",i,resp[0]);
 	if (ret != 0) break;
-	fruoff += chunk;
+	nwrites++;
+   }
+
+   /* Verify by reading back the written runs, merging nearby ones */
+   vstart = vend = -1;
+   for (i = fru_next_run(data,old,dlen,0,&end); (ret == 0); 
+	i = fru_next_run(data,old,dlen,end,&end)) {
+	if ((vend >= 0) && ((i >= dlen) || (i > vend + 8))) {
+	   ret = read_fru_bytes(id,offset+vstart,vbuf,vend-vstart);
+	   if (ret == 0 && memcmp(vbuf,&data[vstart],vend-vstart) != 0) {
+	      printf("write_fru_data: verify error at offset %d, len %d\n",
+		     offset+vstart,vend-vstart);
+	      ret = ERR_OTHER;
+	   }
+	   vend = -1;
+	}
+	if (i >= dlen) break;
+	if (vend < 0) vstart = i;
+	vend = end;
    }
+   if (fdebug) printf("write_fru_data: %d writes, ret = %d\n",nwrites,ret);
+   free(vbuf);
    return(ret);
 }
 
@@ -1118,7 +1192,8 @@ write_product(void)
 	newlen = 0;  /*don't actually write the new data, if testing*/
 #endif
 
-   ret = write_fru_data(g_fruid, prod_offset, newdata, newlen, fdebug);
+   ret = write_fru_data(g_fruid, prod_offset, newdata, &frubuf[prod_offset],
+			newlen, fdebug);
    return(ret);
 }
 
@@ -1593,6 +1668,7 @@ main(int argc, char **argv)
       }
    } else if (frestore) {
       uchar cksum;
+      uchar *oldbuf = NULL;
       /* Restore FRU from a binary file */
 #ifdef WIN32
       fp = fopen(binfile,"rb");
@@ -1605,6 +1681,8 @@ main(int argc, char **argv)
       } else {
 	 ret = 0;
 	 /* sfru and frubuf were set from load_fru above. */
+	 oldbuf = malloc(sfru);  /*keep the old data, to write only changes*/
+	 if (oldbuf != NULL) memcpy(oldbuf,frubuf,sfru);
 	 len = fread(frubuf, 1, sfru, fp);
 	 if (len <= 0) { 
 	     ret = get_LastError();
@@ -1628,7 +1706,7 @@ main(int argc, char **argv)
 	 }
 	 if (ret == 0) {  /*successfully read data*/
             printf("Writing FRU size %d from %s  ...\n",sfru,binfile);
-	    ret = write_fru_data(g_fruid, 0, frubuf, sfru, fdebug);
+	    ret = write_fru_data(g_fruid, 0, frubuf, oldbuf, sfru, fdebug);
             free_fru();
             if (ret != 0) printf("write_fru error %d (0x%02x)\n",ret,ret);
 	    else {  /* successful, show new data */
@@ -1638,6 +1716,7 @@ main(int argc, char **argv)
                free_fru();
 	    }
 	 } 
+	 if (oldbuf != NULL) free(oldbuf);
       }
    }  /*end-else frestore */
    else if ((fwritefru != 0) && ret == 0) {
@@ -4,6 +4,9 @@
  *
  * Change history:
  *  08/20/2010 ARCress - ported from ipmitool/lib/ipmi_fwum.c
+ *  10/19/26 - map the image instead of copying it to a fixed
+ *             512K buffer, adapt the block size both ways,
+ *             show KB/s, ETA and a block latency histogram.
  *
  *---------------------------------------------------------------------
  */
@@ -54,12 +57,19 @@
 #include <getopt.h>
 #endif
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <time.h>
 #ifdef LINUX
 #include <unistd.h>
 #endif
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#define KFWUM_MMAP  1   /* map the image file, instead of reading it */
+#endif
 #include "ipmicmd.h"
 #include "ifwum.h"
 
@@ -180,17 +190,36 @@ typedef struct sKFWUM_SaveFirmwareInfo
 #define KFWUM_PAGE_SIZE        256
 
 static unsigned char fileName[512];
-static unsigned char firmBuf[1024*512];
+static unsigned char *firmBuf = NULL;  /* image, mapped or read from file */
+static unsigned long  firmSize = 0;
+static char           firmMapped = 0;
 static tKFWUM_SaveFirmwareInfo saveFirmwareInfo;
 
+/* Upload statistics, to tell slow flash writes from network stalls */
+#define KFWUM_NHIST     12
+#define KFWUM_GROW_AFTER 64  /* good blocks before trying a larger one */
+static const unsigned long kfwumHistMs[KFWUM_NHIST] = 
+   { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 0 };
+static struct {
+   unsigned long blocks;
+   unsigned long hist[KFWUM_NHIST];  /* block latency, < kfwumHistMs[i] */
+   unsigned long maxMs;
+   unsigned long busy;       /* 0xC0 node busy, BMC still writing flash */
+   unsigned long noResponse; /* no response, network or session stall */
+   unsigned long shrink;     /* block size reduced */
+   unsigned long grow;       /* block size increased again */
+} kfwumStats;
+
 static void KfwumOutputHelp(void);
 static int KfwumMain(void * intf, tKFWUM_Task task);
 static tKFWUM_Status KfwumGetFileSize(unsigned char * pFileName,
                                                      unsigned long * pFileSize);
 static tKFWUM_Status KfwumSetupBuffersFromFile(unsigned char * pFileName,
                                                         unsigned long fileSize);
+static void KfwumFreeBuffers(void);
 static void KfwumShowProgress( const unsigned char * task,
-                                    unsigned long current, unsigned long total);
+        unsigned long current, unsigned long total, unsigned long msec);
+static void KfwumShowStats(unsigned long totalSize, unsigned long msec);
 static unsigned short KfwumCalculateChecksumPadding(unsigned char * pBuffer,
                                                        unsigned long totalSize);
 
@@ -499,6 +528,7 @@ static int KfwumMain(void * intf, tKFWUM_Task task)
       status = KfwumGetTraceLog(intf);
    }
 
+   KfwumFreeBuffers();
    return(status);
 }
 
@@ -534,7 +564,7 @@ static tKFWUM_Status KfwumGetFileSize(unsigned char * pFileName,
    return(status);
 }
 
-/* KfwumSetupBuffersFromFile  -  small buffers are used to store the file data
+/* KfwumSetupBuffersFromFile  -  map the file, or read it in small pieces
  *
  * @pFileName : filename ptr
  * unsigned long : filesize
@@ -545,44 +575,92 @@ static tKFWUM_Status KfwumGetFileSize(unsigned char * pFileName,
 static tKFWUM_Status KfwumSetupBuffersFromFile(unsigned char * pFileName,
                                                         unsigned long fileSize)
 {
-   tKFWUM_Status status = KFWUM_STATUS_OK;
+   tKFWUM_Status status = KFWUM_STATUS_ERROR;
    FILE * pFileHandle;
 
+   KfwumFreeBuffers();
+#ifdef KFWUM_MMAP
+   {  /* read-only mapping, paged in ahead of the upload */
+      int fd;
+      void *p;
+
+      fd = open((const char *)pFileName, O_RDONLY);
+      if (fd >= 0)
+      {
+         p = mmap(NULL, (size_t)fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+         if (p != MAP_FAILED)
+         {
+#ifdef MADV_SEQUENTIAL
+            madvise(p, (size_t)fileSize, MADV_SEQUENTIAL);
+#endif
+            firmBuf    = (unsigned char *)p;
+            firmSize   = fileSize;
+            firmMapped = 1;
+            status = KFWUM_STATUS_OK;
+         }
+         close(fd);
+      }
+   }
+   if (status == KFWUM_STATUS_OK)
+   {
+      KfwumShowProgress((const unsigned char *)"Reading Firmware from File", 100, 100, 0);
+      return(status);
+   }
+#endif
+
+   firmBuf = malloc(fileSize);
+   if (firmBuf == NULL) return(status);
+   firmSize = fileSize;
    pFileHandle = fopen((const char *)pFileName, "rb");
 
    if(pFileHandle)
    {
-      int count   = fileSize / MAX_FW_BUFFER_SIZE;
-      int modulus = fileSize % MAX_FW_BUFFER_SIZE;
-      int qty     =0;
+      unsigned long count   = fileSize / MAX_FW_BUFFER_SIZE;
+      unsigned long modulus = fileSize % MAX_FW_BUFFER_SIZE;
+      unsigned long qty     =0;
 
       rewind(pFileHandle);
 
-      for(qty=0;qty<count;qty++)
+      status = KFWUM_STATUS_OK;
+      for(qty=0;qty<count && status == KFWUM_STATUS_OK;qty++)
       {
-         KfwumShowProgress((const unsigned char *)"Reading Firmware from File", qty, count );
+         KfwumShowProgress((const unsigned char *)"Reading Firmware from File", qty, count, 0 );
          if(fread(&firmBuf[qty*MAX_FW_BUFFER_SIZE], 1, MAX_FW_BUFFER_SIZE ,pFileHandle)
-            ==  MAX_FW_BUFFER_SIZE)
+            !=  MAX_FW_BUFFER_SIZE)
          {
-            status = KFWUM_STATUS_OK;
+            status = KFWUM_STATUS_ERROR;
          }
       }
-      if( modulus )
+      if( modulus && status == KFWUM_STATUS_OK )
       {
-         if(fread(&firmBuf[qty*MAX_FW_BUFFER_SIZE], 1, modulus, pFileHandle) == modulus)
+         if(fread(&firmBuf[qty*MAX_FW_BUFFER_SIZE], 1, modulus, pFileHandle) != modulus)
          {
-            status = KFWUM_STATUS_OK;
+            status = KFWUM_STATUS_ERROR;
          }
       }
       if(status == KFWUM_STATUS_OK)
       {
-         KfwumShowProgress((const unsigned char *)"Reading Firmware from File", 100, 100);
+         KfwumShowProgress((const unsigned char *)"Reading Firmware from File", 100, 100, 0);
       }
       fclose(pFileHandle);
    }
+   if (status != KFWUM_STATUS_OK) KfwumFreeBuffers();
    return(status);
 }
 
+static void KfwumFreeBuffers(void)
+{
+   if (firmBuf == NULL) return;
+#ifdef KFWUM_MMAP
+   if (firmMapped) munmap(firmBuf, (size_t)firmSize);
+   else
+#endif
+   free(firmBuf);
+   firmBuf = NULL;
+   firmSize = 0;
+   firmMapped = 0;
+}
+
 /* KfwumShowProgress  -  helper routine to display progress bar
  *
  * Converts current/total in percent
@@ -590,18 +668,20 @@ static tKFWUM_Status KfwumSetupBuffersFromFile(unsigned char * pFileName,
  * *task  : string identifying current operation
  * current: progress
  * total  : limit 
+ * msec   : time since the start, to show the rate and ETA, or 0
  */
 #define PROG_LENGTH 42
 void KfwumShowProgress( const unsigned char * task,  unsigned long current ,
-                                                           unsigned long total)
+                                   unsigned long total, unsigned long msec)
 {
    static unsigned long staticProgress=0xffffffff;
    unsigned char spaces[PROG_LENGTH + 1];
    unsigned short hash;
    float  percent = ((float)current/total);
    unsigned long progress;
+   unsigned long rate, eta;
 
-   progress = 100*((unsigned long)percent);
+   progress = (unsigned long)(100*percent);
    if(staticProgress == progress)
    {
       /* We displayed the same last time.. so don't do it */
@@ -613,7 +693,7 @@ void KfwumShowProgress( const unsigned char * task,  unsigned long current ,
 
       printf("%-25s : ",task);    /* total 20 bytes */
 
-      hash = ( (unsigned short)percent * PROG_LENGTH );
+      hash = (unsigned short)(percent * PROG_LENGTH);
       memset(spaces,'#', hash);
       spaces[ hash ] = '\0';
       printf("%s", spaces );
@@ -623,7 +703,19 @@ void KfwumShowProgress( const unsigned char * task,  unsigned long current ,
       printf("%s", spaces );
 
 
-      printf(" %3ld %%\r",progress); /* total 7 bytes */
+      printf(" %3ld %%",progress); /* total 7 bytes */
+      if( (msec > 0) && (current > 0) && (progress < 100) )
+      {
+         rate = (current * 1000) / msec;   /* bytes per second */
+         eta  = (rate > 0) ? (total - current) / rate : 0;
+         printf(" %5.1f KB/s ETA %02lu:%02lu", (float)rate / 1024,
+                eta / 60, eta % 60);
+      }
+      else if( msec > 0 )
+      {
+         printf("%22s","");
+      }
+      printf("\r");
 
       if( progress == 100 )
       {
@@ -633,6 +725,41 @@ void KfwumShowProgress( const unsigned char * task,  unsigned long current ,
    }
 }
 
+/* KfwumShowStats  -  show the upload rate and block latency histogram
+ *
+ * Mostly short blocks with some 0xC0 busy retries points at the BMC
+ * writing flash, while long blocks with no response point at the network.
+ */
+static void KfwumShowStats(unsigned long totalSize, unsigned long msec)
+{
+   int i;
+   unsigned long lo = 0;
+
+   if (kfwumStats.blocks == 0) return;
+   printf("Uploaded %lu bytes in %lu blocks, %lu.%03lu sec",
+          totalSize, kfwumStats.blocks, msec / 1000, msec % 1000);
+   if (msec > 0) printf(", %.1f KB/s", ((float)totalSize * 1000 / msec) / 1024);
+   printf("\n");
+   printf("Block latency (ms)        : blocks\n");
+   for (i = 0; i < KFWUM_NHIST; i++)
+   {
+      if (kfwumStats.hist[i] != 0)
+      {
+         if (kfwumHistMs[i] == 0)
+            printf("  >= %-21lu : %lu\n", lo, kfwumStats.hist[i]);
+         else
+            printf("  %4lu - %-17lu : %lu\n", lo, kfwumHistMs[i] - 1,
+                   kfwumStats.hist[i]);
+      }
+      lo = kfwumHistMs[i];
+   }
+   printf("Max block latency         : %lu ms\n", kfwumStats.maxMs);
+   printf("Busy retries (0xC0)       : %lu\n", kfwumStats.busy);
+   printf("No response retries       : %lu\n", kfwumStats.noResponse);
+   printf("Block size reduced/raised : %lu/%lu\n", 
+          kfwumStats.shrink, kfwumStats.grow);
+}
+
 /* KfwumCalculateChecksumPadding
  *
  * TBD
@@ -1116,6 +1243,7 @@ static tKFWUM_Status KfwumSaveFirmwareImage(void * intf,
          if(is_remote())
          {
             noResponse++;
+            kfwumStats.noResponse++;
 
             if(noResponse < FWUM_SAVE_FIRMWARE_NO_RESPONSE_LIMIT )
             {
@@ -1135,6 +1263,7 @@ static tKFWUM_Status KfwumSaveFirmwareImage(void * intf,
          if(rv == 0xc0)
          {
             status = KFWUM_STATUS_OK;
+            kfwumStats.busy++;
 	    os_usleep(1,0);
          }
          else if(
@@ -1264,8 +1393,15 @@ static tKFWUM_Status KfwumUploadFirmware(void * intf,
    unsigned long lastAddress = 0;
    unsigned char sequenceNumber = 0;
    unsigned char retry = FWUM_MAX_UPLOAD_RETRY;
+   unsigned char maxBufferSize = saveFirmwareInfo.bufferSize;
+   unsigned long goodBlocks = 0;
+   unsigned char grown = 0;
+   unsigned long start, t0, ms;
+   int i;
    // unsigned char isLengthValid = 1;
 
+   memset(&kfwumStats, 0, sizeof(kfwumStats));
+   start = os_msec();
    do
    {
       writeSize = saveFirmwareInfo.bufferSize - saveFirmwareInfo.overheadSize;
@@ -1282,13 +1418,20 @@ static tKFWUM_Status KfwumUploadFirmware(void * intf,
       }
 
       oldWriteSize = writeSize;
+      t0 = os_msec();
       status = KfwumSaveFirmwareImage(intf, sequenceNumber, address, 
                                                 &pBuffer[address], &writeSize);
+      ms = os_msec() - t0;
+      kfwumStats.blocks++;
+      if (ms > kfwumStats.maxMs) kfwumStats.maxMs = ms;
+      for (i = 0; i < KFWUM_NHIST-1 && ms >= kfwumHistMs[i]; i++) ;
+      kfwumStats.hist[i]++;
  
       if((status != KFWUM_STATUS_OK) && (retry-- != 0))
       {
          address = lastAddress;
          status = KFWUM_STATUS_OK;
+         goodBlocks = 0;
       }
       else if( writeSize == 0 )
       {
@@ -1300,7 +1443,21 @@ static tKFWUM_Status KfwumUploadFirmware(void * intf,
          {
             printf("Adjusting length to %d bytes \n", writeSize);
             saveFirmwareInfo.bufferSize -= (oldWriteSize - writeSize);
+            kfwumStats.shrink++;
+            /* the size just grown into was refused, stay below it */
+            if (grown) maxBufferSize = saveFirmwareInfo.bufferSize;
+            goodBlocks = 0;
+         }
+         else if ((++goodBlocks >= KFWUM_GROW_AFTER) &&
+                  (saveFirmwareInfo.bufferSize < maxBufferSize))
+         {
+            /* a stall may have shrunk the block, try one byte more */
+            saveFirmwareInfo.bufferSize++;
+            kfwumStats.grow++;
+            goodBlocks = 0;
+            grown = 1;
          }
+         else grown = 0;
          
          retry = FWUM_MAX_UPLOAD_RETRY;
          lastAddress = address;
@@ -1312,7 +1469,8 @@ static tKFWUM_Status KfwumUploadFirmware(void * intf,
          if((address % 1024) == 0)
          {
             KfwumShowProgress((const unsigned char *)\
-                                 "Writing Firmware in Flash",address,totalSize);
+                     "Writing Firmware in Flash",address,totalSize,
+                     os_msec() - start);
          }
          sequenceNumber++;
       }
@@ -1322,8 +1480,9 @@ static tKFWUM_Status KfwumUploadFirmware(void * intf,
    if(status == KFWUM_STATUS_OK)
    {
       KfwumShowProgress((const unsigned char *)\
-                                       "Writing Firmware in Flash", 100 , 100 );
+                                "Writing Firmware in Flash", 100 , 100, 0 );
    }
+   KfwumShowStats(address, os_msec() - start);
 
    return(status);
 }
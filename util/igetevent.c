@@ -63,6 +63,12 @@
  *                           call syncevent_sel after every new event.
  * 09/21/07 Andy Cress 1.21 - implemented IMB Async method for remote
  *                            OS shutdown via SMS requests.
+ * 10/19/26 - SEL method checks Get SEL Info for changes before reading
+ *            entries, fetches new entries in a batch, added -i msec.
+ * 10/19/26 - added -d epoll event loop and -f file of remote BMCs (Linux)
+ * 10/19/26 - SEL cursors are appended to the evt.jrn journal instead of
+ *            rewriting evt.idx per event, added -k N to batch the syncs.
+ * 10/19/26 - syslog writes go through the async event sink, added -g dest
  */
 /*M*
 Copyright (c) 2009 Kontron America, Inc.
@@ -136,6 +142,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "imb_api.h"
 #define DO_ASYNC  1   
 #define DO_MVL  1   
+#define DO_EVLOOP  1   
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
 #elif BSD
 #define DO_MVL  1   
 #define HandleType  long
@@ -186,6 +200,12 @@ static char   fbackground = 0;
 static char   frunscript  = 0;
 static char   fcanonical  = 0;
 static char   fsettime    = 0;   /* =1 if timeout is set by -t */
+static char   fevloop     = 0;   /* =1 if using the event loop (-d) */
+static char  *hostfile    = NULL; /* file of remote BMC nodes (-f) */
+static char   fjournal    = 0;   /* =1 if the SEL cursor journal is open */
+static int    jrn_nbatch  = 1;   /* -k sync the journal every N updates */
+static char  *jrnkey      = "";  /* journal key, the nodename if remote */
+static char  *sinkdest    = NULL; /* -g event sink destination, else syslog */
 static uchar  evt_stype = 0xff;  /* event sensor type, 0xff = get any events */
 static uchar  evt_snum  = 0xff;  /* event sensor num, 0xff = get any events */
 static int    timeout     = 120; /* 120 seconds default timeout */
@@ -202,6 +222,16 @@ static char fselevts = 0;
 static char fmsgevts = 0;
 static ushort sel_recid = 0;
 static uint   sel_time  = 0;
+static int    sel_poll_ms = 0;   /* -i SEL poll interval in msec, 0=1 sec */
+static char   fselinfo  = 0;     /* =1 if have a SEL Info baseline */
+static ushort sel_nent  = 0;     /* SEL entries at last SEL Info */
+static uint   sel_addtime   = 0; /* most recent addition time, SEL Info */
+static uint   sel_erasetime = 0; /* most recent erase time, SEL Info */
+#define SEL_QSZ  32              /* max new SEL entries read in one batch */
+static uchar  selq[SEL_QSZ][16]; /* batch of new SEL entries */
+static ushort selq_id[SEL_QSZ];  /* requested record ids for the batch */
+static int    selq_n = 0;        /* number of entries in the batch */
+static int    selq_i = 0;        /* next batch entry to return */
 static uchar sms_sa = 0x81;
 static uchar *sdrs = NULL;
 #define LAST_REC  0xFFFF
@@ -209,12 +239,15 @@ static uchar *sdrs = NULL;
 #define IDXFILE  "ipmi_evt.idx"
 static char idxfile[80]  = IDXFILE;
 static char idxfile2[80] = "c:\\ipmi_evt.idx";
+#define JRNFILE  "ipmi_evt.jrn"
+static char jrnfile[80]  = JRNFILE;
 static char outfile[80] = "c:\\ipmiutil_evt.log";
 #define   SHUTDOWN_CMD  "shutdown -s -d p:01:01 -t 10"
 #define   REBOOT_CMD    "shutdown -r -d p:01:01 -t 10"
 #else
 static char idxfile[80] = "/var/lib/ipmiutil/evt.idx";
 static char idxfile2[80] = "/usr/share/ipmiutil/evt.idx";
+static char jrnfile[80] = "/var/lib/ipmiutil/evt.jrn";
 static char outfile[80] = "/var/log/ipmiutil_evt.log";
 #define   SHUTDOWN_CMD  "init 0"   // or shutdown now
 #define   REBOOT_CMD    "init 6"
@@ -748,18 +781,60 @@ static int get_sel_entry(ushort recid, ushort *nextid, uchar *rec)
    return(rv);
 }
 
-static int startevent_sel(ushort *precid, uint *ptime) 
+/*
+ * get_sel_info
+ * Get the SEL entry count and the most recent addition and erase 
+ * timestamps, which change whenever the SEL contents change.
+ */
+static int get_sel_info(ushort *nent, uint *addtime, uint *erasetime)
 {
-    FILE *fd;
+   uchar ibuf[4];
+   uchar rbuf[32];
+   int rlen;
+   uchar cc;
+   int rv; 
+
+   rlen = sizeof(rbuf);
+   rv = ipmi_cmd(GET_SEL_INFO, ibuf, 0, rbuf, &rlen, &cc, fdebug);
+   if (rv == 0 && cc != 0) rv = cc;
+   if (rv == 0 && rlen < 13) rv = LAN_ERR_TOO_SHORT;
+   if (rv == 0) {
+      *nent = rbuf[1] + (rbuf[2] << 8);
+      *addtime = rbuf[5] + (rbuf[6] << 8) + (rbuf[7] << 16) + (rbuf[8] << 24);
+      *erasetime = rbuf[9] + (rbuf[10] << 8) + (rbuf[11] << 16) + 
+			(rbuf[12] << 24);
+   }
+   if (fdebug) msgout("get_sel_info rv=%d entries=%d add=%x erase=%x\n",
+			rv,*nent,*addtime,*erasetime);
+   return(rv);
+}
+
+/*
+ * startevent_sel
+ * Gets the saved SEL cursor for this BMC (key) from the journal, or 
+ * from its old index file if the journal does not have it yet.
+ */
+static int startevent_sel(char *key, char *fidx, char *fidx2, 
+			  ushort *precid, uint *ptime) 
+{
+    FILE *fd = NULL;
     uchar rec[24];
     uint t = 0;
     ushort r = 0;
     ushort r2 = 0;
     int rv = -1;
 
-    fd = fopen(idxfile,"r");
-    if (fd == NULL) fd = fopen(idxfile2,"r"); /*handle old location*/
-    if (fdebug) msgout("start: idxfile=%s fd=%p\n",idxfile,fd);
+    if (fjournal && cursor_get(key,&r,&t) == 0) {
+        if (fdebug) msgout("start: journal key=%s recid=%x time=%x\n",
+				key,r,t);
+        if (r == LAST_REC) r = 0;
+        *ptime  = t;
+        *precid = r;
+        return(0);
+    }
+    fd = fopen(fidx,"r");
+    if (fd == NULL && fidx2 != NULL) fd = fopen(fidx2,"r"); /*old location*/
+    if (fdebug) msgout("start: idxfile=%s fd=%p\n",fidx,fd);
     if (fd != NULL) {
         // Read the file, get savtime & savid
         rv = fscanf(fd,"%x %x",&t,(uint *)&r);
@@ -781,15 +856,20 @@ static int startevent_sel(ushort *precid, uint *ptime)
     return(rv);
 }
 
-static int syncevent_sel(ushort recid, uint itime)
+static int syncevent_sel(char *key, char *fidx, ushort recid, uint itime)
 {
     FILE *fd;
     int rv;
-    // Rewrite the saved time & record id
     if (fdebug) msgout("sync: recid=%x time=%x\n",recid,itime);
-    fd = fopen(idxfile,"w");
+    if (fjournal) {  /* append it to the journal */
+        rv = cursor_put(key,recid,itime);
+        if (rv != 0) msgout("syncevent: journal %s error %d\n",jrnfile,rv);
+        return(rv);
+    }
+    // Rewrite the saved time & record id
+    fd = fopen(fidx,"w");
     if (fd == NULL) {
-	msgout("syncevent: cannot open %s for writing\n",idxfile);
+	msgout("syncevent: cannot open %s for writing\n",fidx);
 	rv = -1;
     } else {
         fprintf(fd,"%x %x\n",itime,recid);
@@ -799,6 +879,14 @@ static int syncevent_sel(ushort recid, uint itime)
     return(rv);
 }
 
+/* 
+ * getevent_sel
+ * Returns the next new SEL entry, or ccode 0x80 if nothing new.
+ * Get SEL Info is checked first, and the SEL entries are only read 
+ * when its entry count or timestamps have changed.  All the new 
+ * entries are then read back-to-back into selq, and returned from 
+ * there on the following calls without waiting or re-checking.
+ */
 int getevent_sel(uchar *rdata, int *rlen, uchar *ccode)
 {
     uchar rec[24];
@@ -806,50 +894,97 @@ int getevent_sel(uchar *rdata, int *rlen, uchar *ccode)
     ushort newid;
     ushort nextid;
     ushort recid;
+    ushort nent = 0;
+    uint addtime = 0;
+    uint erasetime = 0;
+    char finfo = 0;
     
-    /* get current last record */
-    recid = sel_recid;
-    rv = get_sel_entry(recid,&nextid,rec);
-    if (rv == 0xCB && recid == 0) {  /* SEL is empty */
-        *ccode = (uchar)rv;  /* save the real ccode */
-        rv = 0x80;    /* this is ok, just keep waiting  */
-    }
-    if (rv == 0) {
-       if (fdebug) msgout("sel ok, id=%x next=%x\n",recid,nextid);
-       if ((nextid == LAST_REC) || (recid == nextid)) { 
-           *ccode = 0x80;  /*nothing new*/
-       } else {
-         recid = nextid;  /* else get new one */
-         rv = get_sel_entry(recid,&nextid,rec);
-         if (rv == 0) {  /* new event */ 
-            newid = rec[0] + (rec[1] << 8);
-            if (drvtype == DRV_MV && recid != newid) {  
-               /* handle MV driver bug, try to get next one. */
-               if (fdebug) msgout("%s bug, record mismatch\n",
+    if (selq_i >= selq_n) {  /* batch is empty, check for changes */
+       selq_i = 0; selq_n = 0;
+       rv = get_sel_info(&nent,&addtime,&erasetime);
+       if (rv == 0) {
+          finfo = 1;
+          if (fselinfo && (nent == sel_nent) && (addtime == sel_addtime) &&
+              (erasetime == sel_erasetime)) {
+             *ccode = 0x80;  /*nothing new*/
+             return(0);
+          }
+       } /* else Get SEL Info failed, just read the entries */
+
+       /* get current last record */
+       recid = sel_recid;
+       rv = get_sel_entry(recid,&nextid,rec);
+       if (rv == 0xCB && recid == 0) {  /* SEL is empty */
+          *ccode = (uchar)rv;  /* save the real ccode */
+          rv = 0x80;    /* this is ok, just keep waiting  */
+       }
+       if (rv == 0) {
+          if (fdebug) msgout("sel ok, id=%x next=%x\n",recid,nextid);
+          /* read any new entries in one batch */
+          while ((nextid != LAST_REC) && (recid != nextid) && 
+                 (selq_n < SEL_QSZ)) {
+             recid = nextid; 
+             rv = get_sel_entry(recid,&nextid,rec);
+             if (rv != 0) break;
+             newid = rec[0] + (rec[1] << 8);
+             if (drvtype == DRV_MV && recid != newid) {  
+                /* handle MV driver bug, try to get next one. */
+                if (fdebug) msgout("%s bug, record mismatch\n",
 				   show_driver_type(DRV_MV));
-            }
-            if (fdebug) msgout("recid=%x newid=%x next=%x\n",
-	   		       recid,newid,nextid);
-            memcpy(rdata,rec,16);
-            *rlen = 16;
-            *ccode = 0;
-            sel_recid = recid;  /*or newid*/
-            memcpy(&sel_time,&rec[3],4);
-         }
+             }
+             if (fdebug) msgout("recid=%x newid=%x next=%x\n",
+	   		        recid,newid,nextid);
+             memcpy(selq[selq_n],rec,16);
+             selq_id[selq_n] = recid;  /*or newid*/
+             selq_n++;
+          }
+          /* Only keep the SEL Info baseline if all new ones were read */
+          if (finfo && (rv == 0) && (selq_n < SEL_QSZ)) {
+             sel_nent = nent;
+             sel_addtime = addtime;
+             sel_erasetime = erasetime;
+             fselinfo = 1;
+          } else fselinfo = 0;
+          if (fdebug && selq_n > 0) msgout("sel batch of %d new\n",selq_n);
+          if ((rv != 0) && (selq_n > 0)) rv = 0; /*return the ones we have*/
+          if (selq_n == 0) *ccode = 0x80;  /*nothing new*/
        }
-    }
-    else {  /* Error reading last recid saved */
-       if (fdebug) msgout("sel recid %x error, rv = %d\n",recid,rv);
-       /* We want to set sel_recid = 0 here for some errors. */
-       if (rv == 0xCB || rv == 0xCD) { /* empty, or wrong SDR id */
-	  sel_recid = 0;
-          *ccode = (uchar)rv;
-          rv = 0x80; /* wait again */
+       else if ((rv == 0x80) && finfo) {  /* SEL is empty, keep baseline */
+          sel_nent = nent;
+          sel_addtime = addtime;
+          sel_erasetime = erasetime;
+          fselinfo = 1;
+       }
+       else {  /* Error reading last recid saved */
+          fselinfo = 0;
+          if (fdebug) msgout("sel recid %x error, rv = %d\n",recid,rv);
+          /* We want to set sel_recid = 0 here for some errors. */
+          if (rv == 0xCB || rv == 0xCD) { /* empty, or wrong SDR id */
+	     sel_recid = 0;
+             *ccode = (uchar)rv;
+             rv = 0x80; /* wait again */
+          }
        }
     }
+    if (selq_i < selq_n) {  /* new event from the batch */
+       memcpy(rdata,selq[selq_i],16);
+       *rlen = 16;
+       *ccode = 0;
+       sel_recid = selq_id[selq_i];
+       memcpy(&sel_time,&selq[selq_i][3],4);
+       selq_i++;
+       rv = 0;
+    }
     return(rv); 
 }
 
+/* sel_wait - wait for the SEL poll interval (-i msec, or wait_interval) */
+static void sel_wait(void)
+{
+    if (sel_poll_ms > 0) os_usleep(0, sel_poll_ms * 1000);
+    else do_wait(wait_interval);
+}
+
 static int get_event(uchar etype, uchar snum, int timeout, 
 			uchar *evt, uchar *stype)
 {
@@ -858,9 +993,14 @@ static int get_event(uchar etype, uchar snum, int timeout,
    	int rlen;
 	uchar ccode;
 	int fretry;
-	int i;
+	int i, nloops;
 
-	for (i = 0; (timeout == 0) || (i < timeout); i++)
+	nloops = timeout;  /*usu one second per loop*/
+	if (fselevts && (sel_poll_ms > 0)) {
+	   nloops = (int)(((long)timeout * 1000) / sel_poll_ms);
+	   if (nloops == 0 && timeout != 0) nloops = 1;
+	}
+	for (i = 0; (timeout == 0) || (i < nloops); i++)
 	{
 	   rlen = sizeof(rdata);
 	   fretry = 0;  ccode = 0;
@@ -882,7 +1022,8 @@ static int get_event(uchar etype, uchar snum, int timeout,
            if (ret == 0 && ccode != 0) { ret = ccode; }
            if (ret == 0x80) { 
 		fretry = 1; 
-		do_wait(wait_interval); /*wait 1 sec*/ 
+		if (fselevts) sel_wait();
+		else do_wait(wait_interval); /*wait 1 sec*/ 
            } else {
         	if (ret == 0) {
 		    char ismatch = 0;
@@ -896,7 +1037,9 @@ static int get_event(uchar etype, uchar snum, int timeout,
 	       	        memcpy(evt,rdata,rlen);
 			*stype = rdata[10];  /* return sensor type */
             	    } else {       /* keep looking */
-			do_wait(wait_interval);
+			if (fselevts) { 
+			   if (selq_i >= selq_n) sel_wait();
+			} else do_wait(wait_interval);
 			continue; 
 		    }
         	}
@@ -940,13 +1083,558 @@ void show_event(uchar *evt,char *obuf, int sz)
    write_syslog(sysbuf);
 }
 
+#ifdef DO_EVLOOP
+/*
+ * Event loop (-d)
+ * One epoll loop waits on the event sources of this process:  a timerfd 
+ * for the BMC polled with the SEL method, the local OpenIPMI driver fd for
+ * event messages, a signalfd for exiting scripts, and a timerfd for the 
+ * -t timeout, so there are no sleeps between polls.
+ * New events go into a bounded queue, and are dispatched from the loop to
+ * show_event and to the -r script, with up to EVQ_MAXRUN scripts running.
+ * Remote BMCs may be listed in a file (-f).  The IPMI library keeps only 
+ * one LAN session per process, so these cannot all be polled from this 
+ * loop.  Each is polled on its own timerfd by a child process with its 
+ * own session, and the child sends its new events to the loop over a pipe
+ * in the same epoll set.  So the sessions stay open, and a BMC that does 
+ * not answer only delays its own polls.  With -f, the local driver fd is
+ * also in the epoll set, if the driver can be opened.
+ */
+#define MAX_EVHOSTS  128
+#define EVQ_SZ       128    /* max events waiting to be dispatched */
+#define EVQ_MAXRUN     4    /* max -r scripts running at once */
+#define EVSRC_HOST   0x10000  /* epoll data is EVSRC_HOST | host index */
+#define EVSRC_DRV    0x20000
+#define EVSRC_SIG    0x30000
+#define EVSRC_TMO    0x40000
+extern int get_fd_mv(void);  /*see ipmimv.c*/
+extern int ipmi_open_mv(char fdebugcmd);
+extern int ipmi_close_mv(void);
+
+typedef struct {
+   char   node[SZGNODE+1];   /* nodename of this BMC */
+   char   idxfile[SZGNODE+88];  /* SEL cursor file for this BMC */
+   int    tfd;               /* timerfd for the SEL polls */
+   int    pfd;               /* or the pipe from its poller child (-f) */
+   pid_t  pid;               /* poller child, if any */
+   ushort recid;             /* SEL cursor, see sel_recid */
+   uint   time;
+   char   fselinfo;          /* SEL Info baseline, see getevent_sel */
+   ushort nent;
+   uint   addtime;
+   uint   erasetime;
+} EVHOST;
+
+typedef struct {
+   uchar  evt[16];
+   int    host;    /* index into evhosts, or -1 if from the driver */
+   ushort recid;
+   uint   time;
+} EVQENT;
+
+static EVHOST evhosts[MAX_EVHOSTS];
+static int    nevhosts = 0;
+static sigset_t evloop_oldmask;  /* signal mask before evloop_run */
+static volatile sig_atomic_t evhost_done = 0;  /* poller child stop */
+static EVQENT evq[EVQ_SZ];
+static int    evq_head = 0;
+static int    evq_count = 0;
+static int    evq_maxdepth = 0;
+static ulong  evq_nevts = 0;   /* events dispatched */
+static ulong  evq_ndrop = 0;   /* events dropped, queue full */
+static int    nrunning = 0;    /* scripts running now */
+
+static void evq_put(uchar *evt, int host, ushort recid, uint etime);
+
+static int evhost_add(char *node)
+{
+   EVHOST *h;
+   if (nevhosts >= MAX_EVHOSTS) {
+      msgout("Too many BMCs, max is %d\n",MAX_EVHOSTS);
+      return(ERR_BAD_PARAM);
+   }
+   h = &evhosts[nevhosts++];
+   memset(h,0,sizeof(EVHOST));
+   strncpy(h->node,node,SZGNODE);
+   h->tfd = -1;
+   h->pfd = -1;
+   return(0);
+}
+
+static void evhost_save(int i)
+{
+   EVHOST *h = &evhosts[i];
+   h->recid = sel_recid;
+   h->time  = sel_time;
+   h->fselinfo  = fselinfo;
+   h->nent      = sel_nent;
+   h->addtime   = sel_addtime;
+   h->erasetime = sel_erasetime;
+}
+
+static void evhost_load(int i)
+{
+   EVHOST *h = &evhosts[i];
+   sel_recid = h->recid;
+   sel_time  = h->time;
+   fselinfo  = h->fselinfo;
+   sel_nent  = h->nent;
+   sel_addtime   = h->addtime;
+   sel_erasetime = h->erasetime;
+   selq_n = 0; selq_i = 0;
+}
+
+/* evhosts_init - set up the SEL cursor file for each BMC */
+static void evhosts_init(void)
+{
+   int i, len;
+   char *node;
+
+   if (nevhosts == 0) {  /* just the current BMC, local or -N */
+      if (fipmilan) node = get_nodename();
+      else node = "";
+      evhost_add(node);
+   }
+   strncpy(evhosts[0].idxfile,idxfile,sizeof(evhosts[0].idxfile)-1);
+   evhost_save(0);  /* started in main */
+   /* The others use idxfile with their own nodename suffix */
+   len = strlen(idxfile) - strlen(evhosts[0].node) - 1;
+   for (i = 1; i < nevhosts; i++) 
+      snprintf(evhosts[i].idxfile,sizeof(evhosts[i].idxfile),"%.*s-%s",
+		len,idxfile,evhosts[i].node);
+}
+
+static void evhost_sig(int sig)
+{
+   evhost_done = 1;
+}
+
+/*
+ * evhost_child - poll the SEL of BMC i on its own session on a timerfd 
+ * every ms, and send each new event up the pipe.  Runs until SIGTERM.
+ */
+static void evhost_child(int i, int fd, int ms, int first_ms)
+{
+   struct sigaction sact;
+   struct itimerspec its;
+   EVQENT e;
+   uchar rdata[64];
+   uint64_t exp;
+   int rlen, rv, tfd;
+   uchar cc;
+
+   /* no SA_RESTART, so that SIGTERM ends the wait on the timerfd */
+   sact.sa_handler = evhost_sig;
+   sact.sa_flags = 0;
+   sigemptyset(&sact.sa_mask);
+   sigaction(SIGTERM, &sact, NULL);
+   set_driver_type(show_driver_type(drvtype));  /*keep lan or lan2*/
+   evhost_load(i);
+   if (i > 0)   /* the first one was started in main */
+      startevent_sel(evhosts[i].node,evhosts[i].idxfile,NULL,
+			&sel_recid,&sel_time);
+   tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+   memset(&its,0,sizeof(its));
+   its.it_value.tv_sec     = first_ms / 1000;
+   its.it_value.tv_nsec    = (long)(first_ms % 1000) * 1000000;
+   its.it_interval.tv_sec  = ms / 1000;
+   its.it_interval.tv_nsec = (long)(ms % 1000) * 1000000;
+   if (tfd < 0 || timerfd_settime(tfd, 0, &its, NULL) < 0) {
+      msgout("%s: timerfd error %d\n",evhosts[i].node,errno);
+      evhost_done = 1;
+   }
+   while (!evhost_done) {
+      /* ticks missed by a slow poll are collapsed into one */
+      if (read(tfd,&exp,sizeof(exp)) != sizeof(exp)) {
+         if (errno == EINTR) continue;
+         break;
+      }
+      do {
+         rlen = sizeof(rdata);
+         cc = 0;
+         rv = getevent_sel(rdata,&rlen,&cc);
+         if (rv == 0 && cc == 0) {
+            memcpy(e.evt,rdata,16);
+            e.host  = i;
+            e.recid = sel_recid;
+            e.time  = sel_time;
+            if (write(fd,&e,sizeof(e)) != sizeof(e)) evhost_done = 1;
+         }
+      } while (rv == 0 && cc == 0 && !evhost_done);
+      if (rv != 0 && rv != 0x80 && fdebug) 
+         msgout("%s: SEL poll error 0x%x\n",evhosts[i].node,rv);
+   }
+   ipmi_close_();
+   _exit(0);
+}
+
+/* evhost_start - start the poller child for BMC i */
+static int evhost_start(int epfd, int i, int ms, int first_ms)
+{
+   struct epoll_event ev;
+   int fd, j;
+
+   evhosts[i].pid = node_fork(evhosts[i].node,0,&fd);
+   if (evhosts[i].pid < 0) {
+      evhosts[i].pid = 0;
+      return(-1);
+   }
+   if (evhosts[i].pid == 0) {  /*child*/
+      sigprocmask(SIG_SETMASK, &evloop_oldmask, NULL);
+      close(epfd);
+      for (j = 0; j < i; j++) 
+         if (evhosts[j].pfd >= 0) close(evhosts[j].pfd);
+      evhost_child(i,fd,ms,first_ms);
+   }
+   evhosts[i].pfd = fd;
+   fcntl(fd,F_SETFL,O_NONBLOCK);
+   ev.events = EPOLLIN;
+   ev.data.u32 = EVSRC_HOST | i;
+   if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) return(-1);
+   return(0);
+}
+
+/* evhost_read - queue the events sent by the poller child of BMC i */
+static void evhost_read(int epfd, int i)
+{
+   EVQENT e;
+   int n;
+
+   while ((n = (int)read(evhosts[i].pfd,&e,sizeof(e))) == sizeof(e)) 
+      evq_put(e.evt,i,e.recid,e.time);
+   if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+      msgout("%s: SEL poller exited\n",evhosts[i].node);
+      epoll_ctl(epfd, EPOLL_CTL_DEL, evhosts[i].pfd, NULL);
+      close(evhosts[i].pfd);
+      evhosts[i].pfd = -1;
+   }
+}
+
+/* evhost_stop - stop the poller children, SIGKILL any still busy in 2 sec */
+static void evhost_stop(void)
+{
+   ulong t0;
+   int i, nleft;
+
+   for (i = 0; i < nevhosts; i++) 
+      if (evhosts[i].pid > 0) kill(evhosts[i].pid,SIGTERM);
+   t0 = os_msec();
+   do {
+      nleft = 0;
+      for (i = 0; i < nevhosts; i++) {
+         if (evhosts[i].pid <= 0) continue;
+         if (waitpid(evhosts[i].pid,NULL,WNOHANG) == evhosts[i].pid) 
+            evhosts[i].pid = 0;
+         else if (os_msec() - t0 > 2000) {
+            node_reap(evhosts[i].pid,-1,1);
+            evhosts[i].pid = 0;
+         } else nleft++;
+      }
+      if (nleft > 0) os_usleep(0,20000);
+   } while (nleft > 0);
+   for (i = 0; i < nevhosts; i++) 
+      if (evhosts[i].pfd >= 0) close(evhosts[i].pfd);
+}
+
+/* evq_put - queue a new event for dispatch, unless it is filtered out */
+static void evq_put(uchar *evt, int host, ushort recid, uint etime)
+{
+   EVQENT *e;
+   if ((evt_stype != 0xff) && (evt_stype != evt[10])) return;
+   if ((evt_snum != 0xff) && (evt_snum != evt[11])) return;
+   if (evq_count >= EVQ_SZ) {
+      evq_ndrop++;
+      if (fdebug) msgout("event queue full, dropped event %04x\n",recid);
+      return;
+   }
+   e = &evq[(evq_head + evq_count) % EVQ_SZ];
+   memcpy(e->evt,evt,16);
+   e->host  = host;
+   e->recid = recid;
+   e->time  = etime;
+   evq_count++;
+   if (evq_count > evq_maxdepth) evq_maxdepth = evq_count;
+}
+
+static void evloop_run_script(char *desc, int host)
+{
+   char run_cmd[300];
+   pid_t pid;
+
+   if (nevhosts > 1 && host >= 0) 
+      snprintf(run_cmd,sizeof(run_cmd),"%s \"%s\" %s",run_script,desc,
+		evhosts[host].node);
+   else snprintf(run_cmd,sizeof(run_cmd),"%s \"%s\"",run_script,desc);
+   pid = fork();
+   if (pid == 0) {
+      sigprocmask(SIG_SETMASK, &evloop_oldmask, NULL);  /*unblock SIGCHLD*/
+      execl("/bin/sh","sh","-c",run_cmd,(char *)NULL);
+      _exit(127);
+   }
+   if (pid > 0) nrunning++;
+   else msgout("run(%s) fork error %d\n",run_script,errno);
+}
+
+/* evloop_reap - collect any exited scripts */
+static void evloop_reap(int fwait)
+{
+   int status, i;
+   pid_t pid;
+   while (nrunning > 0) {
+      pid = waitpid(-1,&status,(fwait ? 0 : WNOHANG));
+      if (pid <= 0) break;
+      for (i = 0; i < nevhosts; i++) 
+         if (evhosts[i].pid == pid) break;
+      if (i < nevhosts) {  /*a poller child, not a script*/
+         evhosts[i].pid = 0;
+         continue;
+      }
+      nrunning--;
+      msgout("run(%s $1), ret = %d\n",run_script,WEXITSTATUS(status));
+   }
+}
+
+/* evq_dispatch - show and handle queued events, returns number handled */
+static int evq_dispatch(void)
+{
+   EVQENT *e;
+   char outbuf[160];
+   int n = 0;
+
+   while (evq_count > 0) {
+      if (frunscript && (nrunning >= EVQ_MAXRUN)) break; /*wait for one*/
+      e = &evq[evq_head];
+      if (nevhosts > 1) 
+         msgout("%s: ",(e->host >= 0) ? evhosts[e->host].node : "local");
+      msgout("got event id %04x, sensor_type = %02x\n", e->recid, e->evt[10]);
+      show_event(e->evt,outbuf,sizeof(outbuf));
+      if (e->host >= 0) 
+         syncevent_sel(evhosts[e->host].node,evhosts[e->host].idxfile,
+			e->recid,e->time);
+      if (frunscript) evloop_run_script(outbuf,e->host);
+      evq_head = (evq_head + 1) % EVQ_SZ;
+      evq_count--;
+      evq_nevts++;
+      n++;
+   }
+   return(n);
+}
+
+/* evloop_poll_sel - check one BMC SEL for changes, queue any new events */
+static void evloop_poll_sel(int i)
+{
+   uchar rdata[64];
+   int rlen, rv;
+   uchar cc;
+
+   evhost_load(i);
+   do {
+      rlen = sizeof(rdata);
+      cc = 0;
+      rv = getevent_sel(rdata,&rlen,&cc);
+      if (rv == 0 && cc == 0) evq_put(rdata,i,sel_recid,sel_time);
+   } while (rv == 0 && cc == 0);
+   if (rv != 0 && rv != 0x80 && fdebug) 
+      msgout("%s: SEL poll error 0x%x\n",evhosts[i].node,rv);
+   evhost_save(i);
+}
+
+/* evloop_read_drv - read the event messages ready on the driver fd */
+static void evloop_read_drv(void)
+{
+   uchar rdata[64];
+   int rlen, rv, i;
+   uchar cc;
+
+   for (i = 0; i < EVQ_SZ; i++) {
+      rlen = sizeof(rdata);
+      cc = 0;
+      rv = getevent_mv(rdata,&rlen,&cc,1);  /*ready, so no poll*/
+      if (rv != 0) break;
+      if (cc == 0 && rlen >= 16) evq_put(rdata,-1,sel_recid,0);
+   }
+}
+
+static int add_timer(int epfd, uint src, int ms, int first_ms, int fperiodic)
+{
+   struct itimerspec its;
+   struct epoll_event ev;
+   int tfd;
+
+   tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+   if (tfd < 0) return(-1);
+   memset(&its,0,sizeof(its));
+   its.it_value.tv_sec  = first_ms / 1000;
+   its.it_value.tv_nsec = (long)(first_ms % 1000) * 1000000;
+   if (fperiodic) {
+      its.it_interval.tv_sec  = ms / 1000;
+      its.it_interval.tv_nsec = (long)(ms % 1000) * 1000000;
+   }
+   ev.events = EPOLLIN;
+   ev.data.u32 = src;
+   if (timerfd_settime(tfd, 0, &its, NULL) < 0 ||
+       epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev) < 0) {
+      close(tfd);
+      return(-1);
+   }
+   return(tfd);
+}
+
+/* 
+ * evloop_run
+ * Wait for events from all sources until the timeout or run once.
+ * Returns 0, or 0x80 if the timeout expired.
+ */
+static int evloop_run(void)
+{
+   struct epoll_event ev, evs[16];
+   struct signalfd_siginfo si;
+   sigset_t mask;
+   uint64_t exp;
+   int epfd, sfd, tmofd = -1;
+   int i, n, ms, src, idx;
+   int nsrc = 0;
+   char fdone = 0;
+   char fdrv = 0;   /* 1 = driver events, 2 = also with the -f BMC SELs */
+   int rv = 0;
+
+   epfd = epoll_create(MAX_EVHOSTS + 4);
+   if (epfd < 0) {
+      msgout("epoll_create error %d\n",errno);
+      return(-1);
+   }
+   /* scripts are reaped when SIGCHLD arrives on the signalfd */
+   sigemptyset(&mask);
+   sigaddset(&mask, SIGCHLD);
+   sigprocmask(SIG_BLOCK, &mask, &evloop_oldmask);
+   sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+   ev.events = EPOLLIN;
+   ev.data.u32 = EVSRC_SIG;
+   if (sfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev) < 0) rv = -1;
+   ms = (sel_poll_ms > 0) ? sel_poll_ms : (wait_interval * 1000);
+   if (ms <= 0) ms = 1000;
+   if (fselevts) {
+      evhosts_init();
+      nsrc = nevhosts;
+      if (nevhosts > 1) ipmi_close_();  /*each child opens its own*/
+      for (i = 0; i < nevhosts; i++) {
+         /* spread the first polls over the interval */
+         n = 1 + (int)(((long)ms * i) / nevhosts);
+         if (nevhosts > 1) {
+            if (evhost_start(epfd,i,ms,n) != 0) {
+               msgout("%s: poller start error %d\n",evhosts[i].node,errno);
+               rv = -1;
+            }
+            continue;
+         }
+         evhosts[i].tfd = add_timer(epfd, EVSRC_HOST | i, ms, n, 1);
+         if (evhosts[i].tfd < 0) {
+            msgout("%s: timerfd error %d\n",evhosts[i].node,errno);
+            rv = -1;
+         }
+      }
+   }
+   if (!fselevts) {
+      if (drvtype == DRV_MV && get_fd_mv() >= 0) fdrv = 1;
+      else {
+         msgout("The event loop needs -s or the %s driver\n",
+		show_driver_type(DRV_MV));
+         rv = LAN_ERR_NOTSUPPORT;
+      }
+   } else if (hostfile != NULL) {
+      /* the remote BMC SELs, and the local driver events if it opens */
+      if (ipmi_open_mv(fdebug) == 0) fdrv = 2;
+      else if (fdebug) msgout("no local %s driver for events\n",
+				show_driver_type(DRV_MV));
+   }
+   if (fdrv) {
+      ev.events = EPOLLIN;
+      ev.data.u32 = EVSRC_DRV;
+      if (epoll_ctl(epfd, EPOLL_CTL_ADD, get_fd_mv(), &ev) < 0) rv = -1;
+      nsrc++;
+      /* enables event messages from the driver, gets any pending ones */
+      evloop_read_drv();
+   }
+   if (timeout > 0) {
+      tmofd = add_timer(epfd, EVSRC_TMO, 0, timeout * 1000, 0);
+      if (tmofd < 0) rv = -1;
+   }
+   if (rv == 0) 
+      msgout("Event loop waiting for events from %d source(s) ...\n",nsrc);
+
+   while ((rv == 0) && !fdone)
+   {
+      n = epoll_wait(epfd, evs, 16, -1);
+      if (n < 0) {
+         if (errno == EINTR) continue;
+         msgout("epoll_wait error %d\n",errno);
+         rv = -1;
+         break;
+      }
+      for (i = 0; i < n; i++) {
+         src = evs[i].data.u32 & 0xFFFF0000;
+         idx = evs[i].data.u32 & 0x0000FFFF;
+         switch(src) {
+         case EVSRC_HOST:
+            if (evhosts[idx].pfd >= 0) evhost_read(epfd,idx);
+            else if (read(evhosts[idx].tfd,&exp,sizeof(exp)) == sizeof(exp))
+               evloop_poll_sel(idx);
+            break;
+         case EVSRC_DRV:
+            evloop_read_drv();
+            break;
+         case EVSRC_SIG:
+            while (read(sfd,&si,sizeof(si)) == sizeof(si)) ;
+            evloop_reap(0);
+            break;
+         case EVSRC_TMO:
+            msgout("get_event timeout\n");
+            rv = 0x80;
+            fdone = 1;
+            break;
+         }
+      }
+      if ((evq_dispatch() > 0) && frunonce) fdone = 1;
+   }  /*end while loop*/
+
+   /* stop the pollers, flush any queued events, and wait for the scripts */
+   evhost_stop();
+   while (evq_count > 0) {
+      if (nrunning >= EVQ_MAXRUN) evloop_reap(1);
+      evq_dispatch();
+   }
+   while (nrunning > 0) evloop_reap(1);
+   msgout("event loop: %lu events, %lu dropped, max queue depth %d\n",
+		evq_nevts, evq_ndrop, evq_maxdepth);
+   for (i = 0; i < nevhosts; i++) 
+      if (evhosts[i].tfd >= 0) close(evhosts[i].tfd);
+   if (tmofd >= 0) close(tmofd);
+   if (sfd >= 0) close(sfd);
+   if (fdrv == 2) ipmi_close_mv();
+   close(epfd);
+   sigprocmask(SIG_SETMASK, &evloop_oldmask, NULL);
+   return(rv);
+}
+#endif
+   /*endif DO_EVLOOP*/
+
 static void ievt_cleanup(void)
 {
    char obuf[48];
-   if (fselevts) syncevent_sel(sel_recid,sel_time);
+   if (fselevts && !fevloop) syncevent_sel(jrnkey,idxfile,sel_recid,sel_time);
+   cursor_close();
    snprintf(obuf,sizeof(obuf),"%s exiting.\n",progname);
    msgout(obuf);
    write_syslog(obuf);
+   {  /* flush the event sink, if running */
+      ulong nput, ndrop, nbp;
+      int maxq;
+      evsink_close();
+      evsink_stats(&nput,&ndrop,&nbp,&maxq);
+      if (ndrop > 0 || fdebug) 
+         msgout("event sink: %lu queued, %lu dropped, %lu backpressure, "
+		"max queue %d\n",nput,ndrop,nbp,maxq);
+   }
    free_sdr_cache(sdrs);
    iclose(); 
    exit(EXIT_SUCCESS);
@@ -1053,7 +1741,7 @@ main(int argc, char **argv)
    fdout = stdout;
    msgout("%s ver %s\n", progname,progver);
 
-   while ( (c = getopt(argc,argv,"abce:lmn:op:r:st:uvT:V:J:YEF:P:N:R:U:Z:x?")) != EOF ) 
+   while ( (c = getopt(argc,argv,"abcde:f:g:i:k:lmn:op:r:st:uvT:V:J:YEF:P:N:R:U:Z:x?")) != EOF ) 
       switch(c) {
           case 'a': fAsync = 1;    /* imb async message method */   
 		    /* chenge the output log filename */
@@ -1062,11 +1750,22 @@ main(int argc, char **argv)
 		    break;
           case 'b': fbackground = 1; break; /* background */
           case 'c': fcanonical = 1; break; /* canonical */
+          case 'd': fevloop = 1; break;   /* use the event loop */
+          case 'f': hostfile = optarg; break;  /* file of remote BMCs */
+          case 'g': sinkdest = optarg; break;  /* event sink destination */
           case 'e':   /* event sensor type */
 		if (strncmp(optarg,"0x",2) == 0) 
 		     evt_stype = htoi(&optarg[2]);
 		else evt_stype = atob(optarg);
 		break;
+          case 'i':   /* SEL poll interval in msec */
+		sel_poll_ms = atoi(optarg);
+		if (sel_poll_ms < 0) sel_poll_ms = 0;
+		break;
+          case 'k':   /* sync the SEL cursor journal every N updates */
+		jrn_nbatch = atoi(optarg);
+		if (jrn_nbatch < 1) jrn_nbatch = 1;
+		break;
           case 'l': fAsyncNOP = 1; break;   /* do not reset (for testing)*/
           case 'm': fmsgevts = 1; break;   /* use local getmessage method */
           case 'n':   /* event sensor num, always hex */
@@ -1107,11 +1806,20 @@ main(int argc, char **argv)
                 parse_lan_options(c,optarg,fdebug);
                 break;
 	  default:
-                printf("Usage: %s [-abenorsux -t sec -NPRUEFTVY]\n", progname);
+                printf("Usage: %s [-abdefgiknorsux -t sec -NPRUEFTVY]\n", progname);
                 printf(" where -a     use Async method\n");
                 printf("       -b     run in Background\n");
                 printf("       -c     use Canonical/delimited event format\n");
+#ifdef DO_EVLOOP
+                printf("       -d     use one event loop for all event sources\n");
+#endif
                 printf("       -e T   wait for specific event sensor type T\n");
+#ifdef DO_EVLOOP
+                printf("       -f F   watch the remote BMC nodes listed in File F\n");
+#endif
+                printf("       -g D   log events to Dest file, unix:/path or syslog\n");
+                printf("       -i N   SEL poll Interval of N msec, with -s\n");
+                printf("       -k N   sync the SEL cursor journal every N events\n");
                 printf("       -n N   wait for specific event sensor num  N\n");
                 printf("       -o     run Once for the first event\n");
                 printf("       -r F   Run file F when an event occurs\n");
@@ -1124,6 +1832,27 @@ main(int argc, char **argv)
 		goto do_exit;
       }
 
+   if (hostfile != NULL) {
+#ifdef DO_EVLOOP
+      /* watch each BMC SEL from the event loop, via the first one */
+      ret = read_nodes(hostfile,evhost_add);
+      if (ret != 0) goto do_exit;
+      parse_lan_options('N',evhosts[0].node,fdebug);
+      fevloop = 1;
+      fselevts = 1;
+#else
+      printf("Option -f is only supported on Linux\n");
+      ret = LAN_ERR_NOTSUPPORT;
+      goto do_exit;
+#endif
+   }
+#ifndef DO_EVLOOP
+   if (fevloop) {
+      printf("Option -d is only supported on Linux\n");
+      ret = LAN_ERR_NOTSUPPORT;
+      goto do_exit;
+   }
+#endif
    fipmilan = is_remote();
    ret = ipmi_getdeviceid(devrec,16,fdebug);
    if (ret != 0) {
@@ -1170,6 +1899,10 @@ main(int argc, char **argv)
    ret = get_msg_flags(&msg_flags);
    msgout("igetevent reading sensors ...\n");
    write_syslog("igetevent reading sensors ...\n");
+#ifdef DO_EVLOOP
+   if (nevhosts > 1) ret = -1; /*each BMC has its own SDRs, do not cache*/
+   else
+#endif
    ret = get_sdr_cache(&sdrs);
    // if (!fipmilan) set_sel_opts(1,0, NULL,fdebug);
    if (fdebug) msgout("get_sdr_cache ret = %d\n",ret);
@@ -1184,6 +1917,7 @@ main(int argc, char **argv)
 	  if (ipath != NULL) {
 	     if (strlen(ipath)+12 < sizeof(idxfile)) {
 	        sprintf(idxfile,"%s\\%s",ipath,IDXFILE);
+	        sprintf(jrnfile,"%s\\%s",ipath,JRNFILE);
 	     }
 	  }
        }
@@ -1198,8 +1932,12 @@ main(int argc, char **argv)
           strcat(idxfile2,node);
           strcat(outfile,"-");
           strcat(outfile,node);
+          jrnkey = node;
        }
-       ret = startevent_sel(&sel_recid,&sel_time);
+       /* one journal holds the SEL cursors for all of the BMCs */
+       fjournal = (cursor_open(jrnfile,jrn_nbatch) == 0);
+       if (!fjournal) msgout("cannot use %s, using %s\n",jrnfile,idxfile);
+       ret = startevent_sel(jrnkey,idxfile,idxfile2,&sel_recid,&sel_time);
        ret = 0;  /*ignore any earlier errors, keep going*/
    }
 
@@ -1284,6 +2022,13 @@ main(int argc, char **argv)
 #endif
    }
    ievt_siginit();
+   /* The event records are logged by the sink writer thread, so that
+    * a slow syslog or disk does not hold up reading the events. */
+   if (evsink_open("ipmiutil",sinkdest,0) != 0 && sinkdest != NULL) {
+      msgout("Cannot open event sink %s\n",sinkdest);
+      ret = ERR_FILE_OPEN;
+      goto do_exit;
+   }
 
    if (fAsync && (fAsyncOK))   /*use imb/mv async messages*/
    {
@@ -1404,6 +2149,10 @@ main(int argc, char **argv)
       msgout(outbuf);
       write_syslog(outbuf);
 
+#ifdef DO_EVLOOP
+      if (fevloop) ret = evloop_run();
+      else 
+#endif
       /* loop on events here, like a daemon would. */
       while (ret == 0) 
       {            /*wait for bmc message events*/
@@ -1415,7 +2164,7 @@ main(int argc, char **argv)
             msgout("got event id %04x, sensor_type = %02x\n",
 			sel_recid, sensor_type);
 	    show_event(event,outbuf,sizeof(outbuf));
-            if (fselevts) syncevent_sel(sel_recid,sel_time);
+            if (fselevts) syncevent_sel(jrnkey,idxfile,sel_recid,sel_time);
 	    if (frunscript) {  /*run some script for each event*/
 		char run_cmd[256];
 		sprintf(run_cmd,"%s \"%s\"\n",run_script,outbuf);
@@ -13,6 +13,9 @@
  * 01/10/07 Andy Cress 1.4 - added product strings
  * 02/25/07 Andy Cress 2.8 - added more Chassis Status decoding
  * 09/18/17 Andy Cress 3.07 - Set do_powerstate=0 for Sun, continue if failure
+ * 10/19/26 - send the independent health queries as a batch via 
+ *            ipmi_cmd_batch, added -a/-j/-t to check a file of hosts
+ *            concurrently, with a time limit for each host.
  */
 /*M*
 Copyright (c) 2006, Intel Corporation
@@ -56,7 +59,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
 #if defined(HPUX)
 /* getopt is defined in stdio.h */
 #elif defined(MACOS)
@@ -120,6 +128,30 @@ static uchar  g_bus  = PUBLIC_BUS;
 static uchar  g_sa   = BMC_SA;
 static uchar  g_lun  = BMC_LUN;
 static uchar  g_addrtype = ADDR_SMI;
+static char  *hostfile  = NULL;  /*-a file of nodes, for fleet mode*/
+static int    fleet_max = 16;    /*-j max hosts checked at once*/
+static int    fleet_tmo = 30;    /*-t seconds allowed for each host*/
+
+/*
+ * The health queries below do not depend on each other, so they are sent
+ * with ipmi_cmd_batch, which pipelines them if the driver allows it.
+ * Batch 1 is HQ_PWR thru the channel info, batch 2 needs the LAN channel.
+ */
+#define HQ_PWR     0   /*Get ACPI Power State*/
+#define HQ_SELF    1   /*Get Self Test Results*/
+#define HQ_LAST    2   /*Get last selftest, Intel OEM*/
+#define HQ_CHS     3   /*Get Chassis Status*/
+#define HQ_GUID    4   /*Get System GUID*/
+#define HQ_POH     5   /*Get Power On Hours*/
+#define HQ_CHAN    6   /*Get Channel Info, channels 1 thru HQ_NCHAN*/
+#define HQ_NCHAN   11  
+#define HQ_CHAUTH  (HQ_CHAN + HQ_NCHAN)  /*Get Channel Auth Capabilities*/
+#define HQ_LANST   (HQ_CHAUTH + 1)      /*Get LAN Statistics*/
+#define HQ_NUM     (HQ_LANST + 1)
+static IPMI_BATCH hq[HQ_NUM];
+static uchar  hq_req[HQ_NUM][4];
+static uchar  hq_rsp[HQ_NUM][32];
+static char   hq_want[HQ_NUM];
 
 
 int oem_get_health(char *pstr, int sz)
@@ -171,21 +203,10 @@ char *getdmiprod(void)
    return(prod);
 }
 
-int get_lan_stats(uchar chan)
+static void show_lan_stats(uchar chan, uchar cc, uchar *rdata)
 {
-   uchar idata[2];
-   uchar rdata[20];
-   int rlen, rv;
-   uchar cc;
    ushort *rw;
 
-   /* get BMC LAN Statistics */
-   idata[0] = chan;
-   idata[1] = 0x00;  /*do not clear stats*/
-   rlen = sizeof(rdata);
-   rv = ipmi_cmd(GET_LAN_STATS, idata,2, rdata,&rlen, &cc, fdebug); 
-   if (fdebug) printf("get_lan_stats: rv = %d, cc = %02x\n",rv,cc);
-   if (rv == 0) {
      if (cc == 0) {  /*success, show BMC LAN stats*/
 	rw = (ushort *)&rdata[0];
 	printf("IPMI LAN channel %d statistics: \n",chan);
@@ -201,7 +222,22 @@ int get_lan_stats(uchar chan)
      } else if (cc == 0xc1) {
 	printf("IPMI LAN channel %d statistics: not supported\n",chan);
      }
-   }
+}
+
+int get_lan_stats(uchar chan)
+{
+   uchar idata[2];
+   uchar rdata[20];
+   int rlen, rv;
+   uchar cc;
+
+   /* get BMC LAN Statistics */
+   idata[0] = chan;
+   idata[1] = 0x00;  /*do not clear stats*/
+   rlen = sizeof(rdata);
+   rv = ipmi_cmd(GET_LAN_STATS, idata,2, rdata,&rlen, &cc, fdebug); 
+   if (fdebug) printf("get_lan_stats: rv = %d, cc = %02x\n",rv,cc);
+   if (rv == 0) show_lan_stats(chan,cc,rdata);
    return(rv);
 }
 
@@ -827,31 +863,36 @@ void show_devid_all(int dtype, uchar *devrec, int sdevrec)
       return;
 }
 
+/* poh_hours - decode the Get Power On Hours response */
+static unsigned int poh_hours(uchar *resp)
+{
+   unsigned int hrs;
+   int i;
+
+   /* show the hours (32-bits) */
+   hrs = resp[1] | (resp[2] << 8) | (resp[3] << 16) | (resp[4] << 24);
+   /* 60=normal, more is OOB, so avoid div-by-zero*/ 
+   if ((resp[0] <= 0) || (resp[0] >= 60)) i = 1; 
+   else {
+      i = 60 / resp[0];
+      hrs = hrs / i;
+   }
+   return(hrs);
+}
+
 int GetPowerOnHours(unsigned int *val)
 {
    uchar resp[MAX_BUFFER_SIZE];
    int sresp = MAX_BUFFER_SIZE;
    uchar cc;
    int rc = -1;
-   int i;
-   unsigned int hrs;
 
    *val = 0;
    if (fmBMC) return(rc);
    sresp = MAX_BUFFER_SIZE;
    memset(resp,0,6);  /* default response size is 5 */
    rc = ipmi_cmd_mc(GET_POWERON_HOURS, NULL, 0, resp, &sresp, &cc, fdebug);
-   if (rc == 0 && cc == 0) {
-      /* show the hours (32-bits) */
-      hrs = resp[1] | (resp[2] << 8) | (resp[3] << 16) | (resp[4] << 24);
-      /* 60=normal, more is OOB, so avoid div-by-zero*/ 
-      if ((resp[0] <= 0) || (resp[0] >= 60)) i = 1; 
-      else {
-                i = 60 / resp[0];
-                hrs = hrs / i;
-      }
-      *val = hrs;
-   }
+   if (rc == 0 && cc == 0) *val = poh_hours(resp);
    return(rc);
 }
 
@@ -876,19 +917,58 @@ char *decode_selftest(int stat)
    return(s);
 }
 
-#ifdef METACOMMAND
-int i_health(int argc, char **argv)
-#else
-#ifdef WIN32
-int __cdecl
-#else
-int
-#endif
-main(int argc, char **argv)
-#endif
+/* hq_add - add one query to the health batch, with hq_req[id] as its data */
+static void hq_add(int id, uchar cmd, uchar netfn, uchar sa, uchar bus, 
+		   uchar lun, int sdata, int sresp)
+{
+   hq[id].cmd   = cmd;
+   hq[id].netfn = netfn;
+   hq[id].sa    = sa;
+   hq[id].bus   = bus;
+   hq[id].lun   = lun;
+   hq[id].pdata = hq_req[id];
+   hq[id].sdata = sdata;
+   hq[id].presp = hq_rsp[id];
+   if (sresp > sizeof(hq_rsp[id])) sresp = sizeof(hq_rsp[id]);
+   hq[id].sresp = sresp;
+   hq[id].cc    = 0;
+   hq[id].rv    = LAN_ERR_NOTSUPPORT;
+   hq_want[id]  = 1;
+}
+
+/* hq_send - send the wanted queries from first thru last as one batch */
+static int hq_send(int first, int last)
+{
+   IPMI_BATCH b[HQ_NUM];
+   int bid[HQ_NUM];
+   int i, n, rv;
+
+   n = 0;
+   for (i = first; i <= last; i++) {
+      if (!hq_want[i]) continue;
+      b[n] = hq[i];
+      bid[n++] = i;
+   }
+   rv = ipmi_cmd_batch(b, n, fdebug);
+   if (fdebug) printf("ipmi_cmd_batch(%d): rv = %d\n",n,rv);
+   for (i = 0; i < n; i++) {
+      if (rv != 0) b[i].rv = rv;
+      hq[bid[i]] = b[i];
+   }
+   return(rv);
+}
+
+/* hq_ret - result of one batch query, the ccode if the command failed */
+static int hq_ret(int id)
+{
+   if (!hq_want[id]) return(LAN_ERR_NOTSUPPORT);
+   if (hq[id].rv == 0 && hq[id].cc != 0) return(hq[id].cc);
+   return(hq[id].rv);
+}
+
+static int health_check(void)
 {
    int ret = 0;
-   int c;
    uchar selfbuf[16];
    uchar devrec[30];
    char biosver[80];
@@ -897,81 +977,13 @@ main(int argc, char **argv)
    uchar pwr_state;
    char selfstr[36];
    char *s;
-   char *s1;
    int i, sresp;
    uint n;
    int rlen, len;
    uchar idata[4];
    uchar rdata[16];
-
-   printf("%s ver %s\n", progname,progver);
-
-   while ( (c = getopt( argc, argv,"cfghiln:o:p:q:sT:V:J:YEF:P:N:R:U:Z:x?")) != EOF ) 
-      switch(c) {
-          case 'c': fcanonical = 1;
-		    bdelim = BDELIM;  break;  /* canonical output */
-          case 'f': do_frusdr = 1;  break;  /* check the FRUSDR too */
-          case 'g': do_guid = 1;    break;  /* get the System GUID also */
-          case 'h': do_hsc = 1;     break;  /* check the HSC too */
-          case 'i': do_systeminfo = 1;  break;  /* get system info too */
-          case 'l': do_lanstats = 1;  break;  /* get the LAN stats too */
-          case 'm': /* specific IPMB MC, 3-byte address, e.g. "409600" */
-                    g_bus = htoi(&optarg[0]);  /*bus/channel*/
-                    g_sa  = htoi(&optarg[2]);  /*device slave address*/
-                    g_lun = htoi(&optarg[4]);  /*LUN*/
-                    g_addrtype = ADDR_IPMB;
-                    if (optarg[6] == 's') {
-                             g_addrtype = ADDR_SMI;  s1 = "SMI";
-                    } else { g_addrtype = ADDR_IPMB; s1 = "IPMB"; }
-                    ipmi_set_mc(g_bus,g_sa,g_lun,g_addrtype);
-                    printf("Use MC at %s bus=%x sa=%x lun=%x\n",
-                            s1,g_bus,g_sa,g_lun);
-                    break;
-          case 'n': set_name = 1; 		/* set the system name*/
-		    pname = optarg;
-		    break; 
-          case 'o': set_os = 1; 		/* set the Operating System*/
-		    pos = optarg;
-		    break; 
-          case 'q': set_os2 = 1; 		/* set the Operating System*/
-		    pos2 = optarg;
-		    break; 
-          case 'p': set_restore = 1; 		/* set the restore policy */
-		    restore_policy = atob(optarg);
-		    if (restore_policy > 2) restore_policy = 1;
-		    break; 
-          case 's': do_session = 1;  break;  /* get session info too */
-          case 'x': fdebug = 1;     break;  /* debug messages */
-          case 'N':    /* nodename */
-          case 'U':    /* remote username */
-          case 'P':    /* remote password */
-          case 'R':    /* remote password */
-          case 'E':    /* get password from IPMI_PASSWORD environment var */
-          case 'F':    /* force driver type */
-          case 'T':    /* auth type */
-          case 'J':    /* cipher suite */ 
-          case 'V':    /* priv level */
-          case 'Y':    /* prompt for remote password */
-          case 'Z':    /* set local MC address */
-                parse_lan_options(c,optarg,fdebug);
-                break;
-	  default:
-                printf("Usage: %s [-cfghilnopsx -N node -U user -P/-R pswd -EFTVY]\n", progname);
-                printf(" where -x   show eXtra debug messages\n");
-                printf("       -c   canonical output\n");
-                printf("       -f   get the FRUSDR version also\n");
-                printf("       -g   get the System GUID also\n");
-                printf("       -h   check the HotSwap Controller also\n");
-                printf("       -i   get System Info also: Name and OS\n");
-                printf("       -l   get the IPMI LAN statistics also\n");
-		printf("       -n   set System Name to this string \n");
-		printf("       -o   set Operating System to this string\n");
-		printf("       -p1  set restore policy: 0=off, 1=last, 2=on\n");
-                printf("       -s   get the IPMI Session info also\n");
-		print_lan_opt_usage(0);
-		ret = ERR_USAGE;
-		goto health_end;
-      }
+   uchar lanch[HQ_NCHAN];
+   int nlanch;
 
    fipmilan = is_remote();
    if (fipmilan && set_restore) 
@@ -979,7 +991,7 @@ main(int argc, char **argv)
 	
    ret = ipmi_getdeviceid(devrec,16,fdebug);
    if (ret != 0) {
-	goto health_end;
+	return(ret);
    } else {
        show_devid_all(BMC,devrec,16);
    }
@@ -1028,9 +1040,41 @@ main(int argc, char **argv)
    i = get_driver_type();
    printf("IPMI driver type  %c %d        (%s)\n",bdelim,i,show_driver_type(i));
 
+   /* send the independent queries together, then show each result */
+   memset(hq_want,0,sizeof(hq_want));
+   if (do_powerstate) 
+      hq_add(HQ_PWR, GET_POWER_STATE, NETFN_APP, g_sa,g_bus,g_lun, 0,4);
+   hq_add(HQ_SELF, SELFTEST_STATUS, NETFN_APP, g_sa,g_bus,g_lun, 0,16);
+   if (!fmBMC) {
+      hq_req[HQ_LAST][0] = 0;  /*0=first, 1=next*/
+      hq_add(HQ_LAST, 0x16, 0x30, g_sa,g_bus,g_lun, 1,16);
+      memset(hq_rsp[HQ_LAST],0xFF,2);  /*initial value = end-of-list*/
+   }
+   hq_add(HQ_CHS, CHASSIS_STATUS, NETFN_CHAS, g_sa,g_bus,g_lun, 0,4);
+   if (do_guid) 
+      hq_add(HQ_GUID, (GET_SYSTEM_GUID & 0xff), NETFN_APP, 
+		BMC_SA,PUBLIC_BUS,BMC_LUN, 0,sizeof(devrec));
+   if (!fmBMC && (g_addrtype == ADDR_SMI)) {
+      hq_add(HQ_POH, GET_POWERON_HOURS, NETFN_CHAS, g_sa,g_bus,g_lun, 0,6);
+      memset(hq_rsp[HQ_POH],0,6);  /* default response size is 5 */
+   }
+   if ((bChan != 7) || !fmBMC) {
+      for (i = 0; i < HQ_NCHAN; i++) {
+         hq_req[HQ_CHAN+i][0] = (uchar)(i + 1); /*channel #*/
+         hq_add(HQ_CHAN+i, (GET_CHANNEL_INFO & 0xff), NETFN_APP,
+		BMC_SA,PUBLIC_BUS,BMC_LUN, 1,9);
+         memset(hq_rsp[HQ_CHAN+i],0,9);
+      }
+   }
+   ret = hq_send(HQ_PWR, HQ_CHAN + HQ_NCHAN - 1);
+   if (ret != 0) return(ret);
+
    if (do_powerstate) 
    {  /* Some BMCs dont support get_power_state*/
-     ret = get_power_state(selfbuf,4);
+     ret = hq_ret(HQ_PWR);
+     if (ret == 0xC1)  /*usu. SuperMicro, retry */
+        ret = get_power_state(selfbuf,4);
+     else if (ret == 0) memcpy(selfbuf,hq_rsp[HQ_PWR],4);
      if (ret != 0) {
         printf("ipmi_getpowerstate error, ret = %d\n",ret);
         pwr_state = 0;
@@ -1041,17 +1085,20 @@ main(int argc, char **argv)
      }
    }
 
-   ret = get_selftest_status(&selfbuf[0],sizeof(selfbuf));
+   ret = hq_ret(HQ_SELF);
    if (ret != 0) {
 	printf("get_selftest_status error, ret = %x\n",ret);
-	goto health_end;
+	return(ret);
    } else {
+        memcpy(selfbuf,hq_rsp[HQ_SELF],sizeof(selfbuf));
         selfstatus = selfbuf[0] + (selfbuf[1] << 8);
         s = decode_selftest(selfstatus);
         if (fmBMC) {
            sprintf(selfstr,"%s",s);
 	} else {
-	   ret = get_last_selftest(&selfbuf[0],sizeof(selfbuf));
+	   ret = hq_ret(HQ_LAST);
+	   if (ret == 0 && hq[HQ_LAST].sresp <= 0) ret = LAN_ERR_BADLENGTH; 
+	   memcpy(selfbuf,hq_rsp[HQ_LAST],sizeof(selfbuf));
 	   if (fdebug) printf("get_last_selftest ret = %x, %02x%02x\n",
 				ret, selfbuf[1],selfbuf[0]);
 	   if (ret == 0 && (selfbuf[0] != 0xFF)) {
@@ -1067,13 +1114,13 @@ main(int argc, char **argv)
 	printf("%s\n",selfstr);
    }
 
-   rlen = 4;
-   ret = get_chassis_status(selfbuf,&rlen);
+   ret = hq_ret(HQ_CHS);
    if (ret != 0) {
 	printf("Cannot do get_chassis_status, ret = %d\n",ret);
-	goto health_end;
+	return(ret);
    } else {
-        show_chs_status(selfbuf,rlen);
+        rlen = hq[HQ_CHS].sresp;
+        show_chs_status(hq_rsp[HQ_CHS],rlen);
    }
 
    if (vend_id == VENDOR_INTEL) {
@@ -1086,8 +1133,9 @@ main(int argc, char **argv)
    }
 
    if (do_guid) {
-      sresp = sizeof(devrec);
-      ret = ipmi_cmd(GET_SYSTEM_GUID,NULL,0,devrec,&sresp,&cc,fdebug);
+      ret = hq[HQ_GUID].rv;
+      cc = hq[HQ_GUID].cc;
+      memcpy(devrec,hq_rsp[HQ_GUID],sizeof(devrec));
       if (ret != 0) {
 	 if (!is_remote()) {  /* get UUID from SMBIOS */
 	    cc = 0;  sresp = 16;
@@ -1110,29 +1158,56 @@ main(int argc, char **argv)
       }
    }
 
-   if (bChan != 7)  /* do not get first lan chan if set above */
-      ret = get_lan_channel(1,&bChan);
+   /* find the LAN channels from the channel info, as get_lan_channel */
+   nlanch = 0;
+   for (i = 0; i < HQ_NCHAN; i++) {
+      if (!hq_want[HQ_CHAN+i]) break;
+      if (hq[HQ_CHAN+i].rv == 0xcc || hq[HQ_CHAN+i].cc == 0xcc) continue;
+      if (hq[HQ_CHAN+i].rv != 0) {
+         if (fdebug) printf("get_chan_info rc = %x\n",hq[HQ_CHAN+i].rv);
+         break;
+      }
+      /* hq_rsp[1] == channel medium type, 4 = 802.3 LAN type */
+      if (hq_rsp[HQ_CHAN+i][1] == 4) lanch[nlanch++] = (uchar)(i + 1);
+   }
+   if (bChan != 7) {  /* do not get first lan chan if set above */
+      if (nlanch > 0) { bChan = lanch[0]; ret = 0; }
+      else ret = -1;
+   }
+
+   if ((fmBMC == 0) && !lan_ch_restrict) {  /*skip if vendor fw bug*/
+      hq_req[HQ_CHAUTH][0] = bChan; /*0x0e = this channel*/
+      hq_req[HQ_CHAUTH][1] = 0x02;  /*priv level = user*/
+      hq_add(HQ_CHAUTH, 0x38, NETFN_APP, /*CMD_GET_CHAN_AUTH_CAP*/ 
+		g_sa,g_bus,g_lun, 2,sizeof(devrec));
+   }
+   if (do_lanstats) {
+      hq_req[HQ_LANST][0] = bChan;
+      hq_req[HQ_LANST][1] = 0x00;  /*do not clear stats*/
+      hq_add(HQ_LANST, (GET_LAN_STATS & 0xff), NETFN_TRANS, 
+		BMC_SA,PUBLIC_BUS,BMC_LUN, 2,20);
+   }
+   hq_send(HQ_CHAUTH, HQ_LANST);
 
    if (fmBMC == 0) {
-      ret = GetPowerOnHours(&n);
+      if (hq_want[HQ_POH]) {
+         ret = hq[HQ_POH].rv;
+         if (ret == 0 && hq[HQ_POH].cc == 0) n = poh_hours(hq_rsp[HQ_POH]);
+         else n = 0;
+      } else ret = GetPowerOnHours(&n);
       if (ret == 0) 
 	 printf("Power On Hours    %c %d hours (%d days)\n",bdelim,n,(n/24));
       if (ret == 0xC1) ret = 0; /* not supporting poweron hours is ok. */
 
       printf("BMC LAN Channels  %c ",bdelim);
-      for (i = 1; i<= 16; ) {
-         c = get_lan_channel(i,&cc);
-	 if (c != 0) break;
-	 printf("%d ",cc);
-	 i = cc+1;
-      }
+      for (i = 0; i < nlanch; i++) printf("%d ",lanch[i]);
       printf("\n");
 
       if (lan_ch_restrict) ;   /*skip if vendor fw bug*/
       else {
-         ret = get_chan_auth(bChan,&devrec[0],sizeof(devrec));
+         ret = hq_ret(HQ_CHAUTH);
          if (ret == 0) 
-            show_chan_auth("Channel Auth Cap",devrec,8);
+            show_chan_auth("Channel Auth Cap",hq_rsp[HQ_CHAUTH],8);
          else 
             printf("get_chan_auth error: ret = %x\n",ret);
       }
@@ -1165,7 +1240,10 @@ main(int argc, char **argv)
    }
 
    if (do_lanstats) {
-	ret = get_lan_stats(bChan);
+	ret = hq[HQ_LANST].rv;
+	if (fdebug) printf("get_lan_stats: rv = %d, cc = %02x\n",ret,
+			   hq[HQ_LANST].cc);
+	if (ret == 0) show_lan_stats(bChan,hq[HQ_LANST].cc,hq_rsp[HQ_LANST]);
    }
 
    if (do_session) {
@@ -1218,6 +1296,299 @@ main(int argc, char **argv)
         printf("set_restore_policy(%x): ret = %d\n",restore_policy,ret);
    }
 
+   return(ret);
+}  /*end health_check*/
+
+#if defined(WIN32) || defined(DOS) || defined(EFI)
+static int health_fleet(void)
+{
+   printf("Options -a, -j and -t are not supported on this OS\n");
+   return(LAN_ERR_NOTSUPPORT);
+}
+#else
+/*
+ * Fleet mode: each node in the -a file is checked by a child process,
+ * since the IPMI library keeps one session per process.  Up to fleet_max
+ * children run at once, each is killed if it runs past fleet_tmo, and
+ * the output of each node is shown in file order.
+ */
+typedef struct {
+   char   node[SZGNODE+1];
+   pid_t  pid;
+   int    fd;      /*read end of the pipe from the child*/
+   char  *out;     /*output collected from the child*/
+   int    nout;
+   int    szout;
+   ulong  start;
+   char   state;   /*0=waiting, 1=running, 2=done*/
+   char   result;  /*0=ok, 1=failed, 2=timed out*/
+} FLEET_HOST;
+static FLEET_HOST *fleet = NULL;
+static int nfleet = 0;
+
+/* fleet_add - add a node from the -a file, called by read_nodes */
+static int fleet_add(char *node)
+{
+   FLEET_HOST *pnew;
+   if ((nfleet % 64) == 0) {
+      pnew = realloc(fleet, (nfleet + 64) * sizeof(FLEET_HOST));
+      if (pnew == NULL) return(ERR_BAD_PARAM);
+      fleet = pnew;
+   }
+   memset(&fleet[nfleet],0,sizeof(FLEET_HOST));
+   strncpy(fleet[nfleet].node,node,SZGNODE);
+   nfleet++;
+   return(0);
+}
+
+static void fleet_append(FLEET_HOST *h, char *buf, int len)
+{
+   char *pnew;
+   if (h->nout + len + 1 > h->szout) {
+      pnew = realloc(h->out, h->nout + len + 1024);
+      if (pnew == NULL) return;
+      h->out = pnew;
+      h->szout = h->nout + len + 1024;
+   }
+   memcpy(&h->out[h->nout],buf,len);
+   h->nout += len;
+}
+
+static void fleet_start(FLEET_HOST *h)
+{
+   int ret;
+   char msg[80];
+
+   h->state = 2;
+   h->result = 1;
+   h->pid = node_fork(h->node,NODE_STDOUT | NODE_STDERR,&h->fd);
+   if (h->pid < 0) {
+      sprintf(msg,"fork error %d\n",errno);
+      fleet_append(h,msg,(int)strlen(msg));
+      return;
+   }
+   if (h->pid == 0) {  /*child*/
+      ret = health_check();
+      ipmi_close_();
+      fflush(stdout);
+      _exit(ret == 0 ? 0 : 1);
+   }
+   h->start = os_msec();
+   h->state = 1;
+}
+
+static void fleet_finish(FLEET_HOST *h, char ftimeout)
+{
+   int status;
+   char msg[80];
+
+   if (ftimeout) {
+      sprintf(msg,"timed out after %d sec\n",fleet_tmo);
+      if (h->nout > 0 && h->out[h->nout-1] != '\n') fleet_append(h,"\n",1);
+      fleet_append(h,msg,(int)strlen(msg));
+   }
+   status = node_reap(h->pid,h->fd,ftimeout);
+   h->state = 2;
+   if (ftimeout) h->result = 2;
+   else if ((status != -1) && WIFEXITED(status) && (WEXITSTATUS(status) == 0)) 
+      h->result = 0;
+   else h->result = 1;
+}
+
+static void fleet_show(FLEET_HOST *h)
+{
+   char *p, *q, *pend;
+
+   if (!fcanonical) printf("=== %s ===\n",h->node);
+   p = h->out;
+   pend = h->out + h->nout;
+   while (p != NULL && p < pend) {
+      q = memchr(p,'\n',pend - p);
+      if (q == NULL) q = pend;
+      if (fcanonical) printf("%s%c",h->node,bdelim);
+      printf("%.*s\n",(int)(q - p),p);
+      p = q + 1;
+   }
+   free(h->out);
+   h->out = NULL;
+}
+
+static int health_fleet(void)
+{
+   fd_set readfds;
+   struct timeval tv;
+   char buf[1024];
+   FLEET_HOST *h;
+   ulong t0, tnow, tleft;
+   int next, nrun, nshow, maxfd, i, n;
+   int nok, nfail, ntmo;
+
+   i = read_nodes(hostfile,fleet_add);
+   if (i != 0) return(i);
+   if (fleet_max < 1) fleet_max = 1;
+   t0 = os_msec();
+   next = nrun = nshow = 0;
+   while (nshow < nfleet) {
+      while ((nrun < fleet_max) && (next < nfleet)) {
+         h = &fleet[next++];
+         fleet_start(h);
+         if (h->state == 1) nrun++;
+      }
+      if (nrun > 0) {
+         /* wait for output, or for the next host time limit */
+         FD_ZERO(&readfds);
+         maxfd = 0;
+         tnow = os_msec();
+         tleft = (ulong)fleet_tmo * 1000;
+         for (i = nshow; i < next; i++) {
+            h = &fleet[i];
+            if (h->state != 1) continue;
+            FD_SET(h->fd,&readfds);
+            if (h->fd > maxfd) maxfd = h->fd;
+            if (tnow - h->start >= (ulong)fleet_tmo * 1000) tleft = 0;
+            else if (h->start + (ulong)fleet_tmo * 1000 - tnow < tleft)
+               tleft = h->start + (ulong)fleet_tmo * 1000 - tnow;
+         }
+         tv.tv_sec  = tleft / 1000;
+         tv.tv_usec = (tleft % 1000) * 1000;
+         n = select(maxfd+1,&readfds,NULL,NULL,&tv);
+         if (n < 0 && errno != EINTR) {
+            printf("select error %d\n",errno);
+            FD_ZERO(&readfds);
+         } else if (n < 0) FD_ZERO(&readfds);
+         tnow = os_msec();
+         for (i = nshow; i < next; i++) {
+            h = &fleet[i];
+            if (h->state != 1) continue;
+            if (FD_ISSET(h->fd,&readfds)) {
+               n = (int)read(h->fd,buf,sizeof(buf));
+               if (n > 0) fleet_append(h,buf,n);
+               else { fleet_finish(h,0); nrun--; }
+            } else if (tnow - h->start >= (ulong)fleet_tmo * 1000) {
+               fleet_finish(h,1); 
+               nrun--;
+            }
+         }
+      }
+      /* show the finished hosts in file order */
+      while ((nshow < nfleet) && (fleet[nshow].state == 2)) 
+         fleet_show(&fleet[nshow++]);
+      fflush(stdout);
+   }
+   nok = nfail = ntmo = 0;
+   for (i = 0; i < nfleet; i++) {
+      if (fleet[i].result == 0) nok++;
+      else if (fleet[i].result == 2) ntmo++;
+      else nfail++;
+   }
+   printf("%s: %d hosts, %d ok, %d failed, %d timed out, %lu ms\n",
+	  progname, nfleet, nok, nfail, ntmo, os_msec() - t0);
+   free(fleet);
+   fleet = NULL;
+   if (ntmo > 0) return(LAN_ERR_TIMEOUT);
+   if (nfail > 0) return(LAN_ERR_OTHER);
+   return(0);
+}
+#endif
+
+#ifdef METACOMMAND
+int i_health(int argc, char **argv)
+#else
+#ifdef WIN32
+int __cdecl
+#else
+int
+#endif
+main(int argc, char **argv)
+#endif
+{
+   int ret = 0;
+   int c;
+   char *s1;
+
+   printf("%s ver %s\n", progname,progver);
+
+   while ( (c = getopt( argc, argv,"a:cfghij:ln:o:p:q:st:T:V:J:YEF:P:N:R:U:Z:x?")) != EOF ) 
+      switch(c) {
+          case 'a': hostfile = optarg;  break;  /* file of nodes to check */
+          case 'c': fcanonical = 1;
+		    bdelim = BDELIM;  break;  /* canonical output */
+          case 'f': do_frusdr = 1;  break;  /* check the FRUSDR too */
+          case 'g': do_guid = 1;    break;  /* get the System GUID also */
+          case 'h': do_hsc = 1;     break;  /* check the HSC too */
+          case 'i': do_systeminfo = 1;  break;  /* get system info too */
+          case 'j': fleet_max = atoi(optarg);  break;  /* hosts at once */
+          case 'l': do_lanstats = 1;  break;  /* get the LAN stats too */
+          case 'm': /* specific IPMB MC, 3-byte address, e.g. "409600" */
+                    g_bus = htoi(&optarg[0]);  /*bus/channel*/
+                    g_sa  = htoi(&optarg[2]);  /*device slave address*/
+                    g_lun = htoi(&optarg[4]);  /*LUN*/
+                    g_addrtype = ADDR_IPMB;
+                    if (optarg[6] == 's') {
+                             g_addrtype = ADDR_SMI;  s1 = "SMI";
+                    } else { g_addrtype = ADDR_IPMB; s1 = "IPMB"; }
+                    ipmi_set_mc(g_bus,g_sa,g_lun,g_addrtype);
+                    printf("Use MC at %s bus=%x sa=%x lun=%x\n",
+                            s1,g_bus,g_sa,g_lun);
+                    break;
+          case 'n': set_name = 1; 		/* set the system name*/
+		    pname = optarg;
+		    break; 
+          case 'o': set_os = 1; 		/* set the Operating System*/
+		    pos = optarg;
+		    break; 
+          case 'q': set_os2 = 1; 		/* set the Operating System*/
+		    pos2 = optarg;
+		    break; 
+          case 'p': set_restore = 1; 		/* set the restore policy */
+		    restore_policy = atob(optarg);
+		    if (restore_policy > 2) restore_policy = 1;
+		    break; 
+          case 's': do_session = 1;  break;  /* get session info too */
+          case 't': fleet_tmo = atoi(optarg);  /* time limit per host */
+		    if (fleet_tmo <= 0) fleet_tmo = 30;
+		    break; 
+          case 'x': fdebug = 1;     break;  /* debug messages */
+          case 'N':    /* nodename */
+          case 'U':    /* remote username */
+          case 'P':    /* remote password */
+          case 'R':    /* remote password */
+          case 'E':    /* get password from IPMI_PASSWORD environment var */
+          case 'F':    /* force driver type */
+          case 'T':    /* auth type */
+          case 'J':    /* cipher suite */ 
+          case 'V':    /* priv level */
+          case 'Y':    /* prompt for remote password */
+          case 'Z':    /* set local MC address */
+                parse_lan_options(c,optarg,fdebug);
+                break;
+	  default:
+                printf("Usage: %s [-acfghijlnopstx -N node -U user -P/-R pswd -EFTVY]\n", progname);
+                printf(" where -x   show eXtra debug messages\n");
+                printf("       -a   check each node in this file, concurrently\n");
+                printf("       -c   canonical output\n");
+                printf("       -f   get the FRUSDR version also\n");
+                printf("       -g   get the System GUID also\n");
+                printf("       -h   check the HotSwap Controller also\n");
+                printf("       -i   get System Info also: Name and OS\n");
+                printf("       -j   max nodes checked at once with -a (default 16)\n");
+                printf("       -l   get the IPMI LAN statistics also\n");
+		printf("       -n   set System Name to this string \n");
+		printf("       -o   set Operating System to this string\n");
+		printf("       -p1  set restore policy: 0=off, 1=last, 2=on\n");
+                printf("       -s   get the IPMI Session info also\n");
+                printf("       -t   seconds allowed for each node with -a (default 30)\n");
+		print_lan_opt_usage(0);
+		ret = ERR_USAGE;
+		goto health_end;
+      }
+
+   if (hostfile != NULL) {
+      ret = health_fleet();
+      return(ret);
+   }
+   ret = health_check();
+
 health_end:
    ipmi_close_();
    // show_outcome(progname,ret);  
@@ -6,6 +6,14 @@
  *  08/25/2010 ARCress - ported from ipmitool/lib/ipmi_hpmfwupg.c
  *  08/24/2011 ARcress - updated to Kontron 1.08 (K17) version,
  *                       added hpm_decode_cc(), etc.
+ *  10/19/26 - mmap the image file, check its MD5 in a thread
+ *             while the target is queried.
+ *  10/19/26 - probe the upload block size, keep a window of
+ *             blocks in flight, show KB/s and ETA.
+ *  10/19/26 - added -a/-j/-t/-r/-c/-k to roll out an image
+ *             to a file of nodes.
+ *  10/19/26 - retry busy/inaccessible commands with a backoff against
+ *             a deadline, instead of fixed sleeps.
  *
  *---------------------------------------------------------------------
  */
@@ -65,6 +73,15 @@ typedef uint32_t    socklen_t;
 #else
 #include <getopt.h>
 #endif
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#define HPM_MMAP  1   /* map the image, and check its MD5 in a thread */
 #endif
 #include <stdio.h>
 #include <stdarg.h>
@@ -193,6 +210,14 @@ static uchar  g_sa   = BMC_SA;
 static uchar  g_lun  = BMC_LUN;
 static uchar  g_addrtype = ADDR_SMI;
 static int    g_channel_buf_size = 0;
+static char  *hostfile  = NULL;  /*-a file of nodes, for rollout mode*/
+static int    fleet_max = 16;    /*-j max nodes upgraded at once*/
+static int    fleet_tmo = 3600;  /*-t seconds allowed for each node*/
+static int    fleet_retry = 1;   /*-r retries for each node*/
+static int    fleet_canary = 0;  /*-c canary nodes, upgraded first*/
+static int    fleet_stop = 0;    /*-k stop after this many failed nodes*/
+static char   fleet_child = 0;   /*=1 in a rollout child process*/
+static struct HpmfwupgUpgradeCtx *pFleetImage = NULL;
 
 /*
  *  HPM.1 FIRMWARE UPGRADE COMMANDS (part of PICMG)
@@ -259,6 +284,9 @@ static int errorCount;
 #define HPMFWUPG_DEFAULT_INACCESS_TIMEOUT 60 /* sec */
 #define HPMFWUPG_DEFAULT_UPGRADE_TIMEOUT  60 /* sec */
 #define HPMFWUPG_MD5_SIGNATURE_LENGTH     16
+#define HPMFWUPG_POLL_FIRST_MS            10   /* first busy retry delay */
+#define HPMFWUPG_POLL_MAX_MS            1000   /* busy retries back off to this */
+#define HPMFWUPG_INACCESS_MAX_MS        5000   /* retries while the IPMC is away */
 
 /* Component IDs */
 typedef enum eHpmfwupgComponentId
@@ -639,6 +667,12 @@ struct HpmfwupgInitiateUpgradeActionCtx
 #define HPMFWUPG_SEND_DATA_COUNT_LAN   25
 #define HPMFWUPG_SEND_DATA_COUNT_IPMB  26
 #define HPMFWUPG_SEND_DATA_COUNT_IPMBL 26
+#define HPMFWUPG_SEND_DATA_COUNT_PROBE 160 /* first block size tried, then bisected */
+#define HPMFWUPG_UPLOAD_WINDOW_MAX     4   /* blocks in flight, if pipelined */
+#define HPMFWUPG_UPLOAD_RESTART_MAX    8   /* component restarts after a failed window */
+
+static int g_upload_fast = FALSE;  /* =TRUE to probe and pipeline, with "window n" */
+static int g_upload_window = 1;
 
 #ifdef HAVE_PRAGMA_PACK
 #pragma pack(1)
@@ -1008,6 +1042,8 @@ struct HpmfwupgUpgradeCtx
    struct HpmfwupgComponentBitMask compUpdateMask;
    unsigned int   imageSize;
    unsigned char* pImageData;
+   unsigned char  fMapped;      /* =1 if pImageData is mmap'd, else malloc'd */
+   unsigned char  fShared;      /* =1 if pImageData is the rollout image */
    unsigned char  componentId;
    struct HpmfwupgGetTargetUpgCapabilitiesResp targetCap;
    struct HpmfwupgGetGeneralPropResp           genCompProp[HPMFWUPG_COMPONENT_ID_MAX];
@@ -1095,6 +1131,13 @@ static int HpmfwupgAbortUpgrade(void *intf,
 static int HpmfwupgInitiateUpgradeAction(void *intf,
                                          struct HpmfwupgInitiateUpgradeActionCtx* pCtx,
                                          struct HpmfwupgUpgradeCtx* pFwupgCtx);
+static int HpmfwupgUploadBlockRsp(void *intf, struct HpmfwupgUpgradeCtx* pFwupgCtx,
+                                  unsigned char ccode, unsigned char *data,
+                                  int data_len, unsigned int *imageOffset,
+                                  unsigned int *blockLength);
+static int HpmfwupgRestartUpload(void *intf,
+                                 struct HpmfwupgInitiateUpgradeActionCtx* pInitCmd,
+                                 struct HpmfwupgUpgradeCtx* pFwupgCtx);
 static int HpmfwupgUploadFirmwareBlock(void *intf,
                                        struct HpmfwupgUploadFirmwareBlockCtx* pCtx,
                                        struct HpmfwupgUpgradeCtx* pFwupgCtx, int count ,
@@ -1115,6 +1158,9 @@ static void HpmfwupgPrintUsage(void);
 static unsigned char HpmfwupgCalculateChecksum(unsigned char* pData, unsigned int length);
 static int HpmfwupgGetDeviceId(void *intf, struct ipm_devid_rsp* pGetDevId);
 static int HpmfwupgGetBufferFromFile(char* imageFilename, struct HpmfwupgUpgradeCtx* pFwupgCtx);
+static void HpmfwupgFreeBuffer(struct HpmfwupgUpgradeCtx* pFwupgCtx);
+static int HpmfwupgMd5Wait(void);
+static int HpmfwupgMd5Check(void);
 static int HpmfwupgWaitLongDurationCmd(void *intf, struct HpmfwupgUpgradeCtx* pFwupgCtx);
 
 static struct ipmi_rs *  HpmfwupgSendCmd(void *intf, struct ipmi_rq req,
@@ -1145,6 +1191,25 @@ static char * hpm_decode_cc( uchar cmd, uchar cc )
    return(pstr);
 }
 
+/*
+ * Timing of the last long duration command: status polls are sent once per
+ * second until a deadline, and any session re-opens while the IPMC was
+ * inaccessible (e.g. rebooting into new firmware) are counted.
+ */
+static struct {
+   ulong msec;        /* time waited for the last long duration command */
+   int   polls;       /* Get Upgrade Status requests sent */
+   int   reconnects;  /* IOL sessions re-opened */
+} hpmPoll;
+
+/* HpmfwupgBackoff - sleep *pdelay ms, then double it, up to maxms */
+static void HpmfwupgBackoff(ulong *pdelay, ulong maxms)
+{
+   os_usleep((int)(*pdelay / 1000), (int)((*pdelay % 1000) * 1000));
+   *pdelay *= 2;
+   if (*pdelay > maxms) *pdelay = maxms;
+}
+
 /****************************************************************************
 *
 * Function Name:  HpmGetuserInput
@@ -1157,6 +1222,10 @@ int HpmGetUserInput(char *str)
 {
     char userInput[2];
     printf("%s",str);
+    if (fleet_child) {   /* no one to ask in a rollout */
+        printf("N\n");
+        return 0;
+    }
     scanf("%s",userInput);
     if (toupper(userInput[0]) == 'Y')
     {
@@ -1206,6 +1275,12 @@ void HpmDisplayUpgrade( int skip, unsigned int totalSent,
 {
     int percent;
     static int old_percent=1;
+    static int old_len=0;    /* length of the rate text after the percent */
+    unsigned int rate = 0;   /* bytes per second */
+    unsigned int eta;
+    char rtext[32];
+    int i;
+
     if (skip)
     {
         printf(" Skip |\n");
@@ -1213,20 +1288,40 @@ void HpmDisplayUpgrade( int skip, unsigned int totalSent,
     }
     fflush(stdout);
 
-    percent = (int)((totalSent * 100)/displayFWLength);
+    if (timeElapsed > 0) rate = totalSent / (unsigned int)timeElapsed;
+    percent = (int)(((double)totalSent * 100) / displayFWLength);
     if (percent != old_percent)
     {
+        for (i = 0; i < old_len; i++) printf("\b");
         if ( percent == 0 ) printf("  0 %% |");
-        else if (percent == 100) printf("\b\b\b\b\b\b\b100 %% |\n");
+        else if (percent == 100) {
+           printf("\b\b\b\b\b\b\b100 %% |");
+           for (i = 0; i < old_len; i++) printf(" ");
+           printf("\n");
+           old_len = 0;
+        }
         else printf("\b\b\b\b\b\b\b%3d %% |", percent);
-           old_percent = percent;
+        if ((percent != 100) && (rate > 0)) {
+           /* live throughput and time remaining */
+           eta = (displayFWLength - totalSent) / rate;
+           sprintf(rtext," %u.%u KB/s ETA %02u:%02u", rate / 1024,
+                   ((rate % 1024) * 10) / 1024, eta / 60, eta % 60);
+           printf("%-24s", rtext);
+           old_len = 24;
+        }
+        else if (percent != 100) {
+           for (i = 0; i < old_len; i++) printf(" ");
+           for (i = 0; i < old_len; i++) printf("\b");
+           old_len = 0;
+        }
+        old_percent = percent;
     }
 
     if (totalSent== displayFWLength)
     {
         /* Display the time taken to complete the upgrade */
-        printf("|   | Upload Time: %02d.%02d          | Image Size: %05x                        |\n",
-         timeElapsed/60,timeElapsed%60,totalSent);
+        printf("|   | Upload Time: %02d.%02d %4u KB/s| Image Size: %05x                        |\n",
+         (int)(timeElapsed/60),(int)(timeElapsed%60),rate/1024,totalSent);
     }
 }
 
@@ -1514,7 +1609,7 @@ int HpmfwupgUpgrade(void *intf, char* imageFilename,
 
    if ( rc == HPMFWUPG_SUCCESS )
    {
-      printf("Validating firmware image integrity...");
+      printf("Validating firmware image header...");
       fflush(stdout);
       rc = HpmfwupgValidateImageIntegrity(&fwupgCtx);
       if ( rc == HPMFWUPG_SUCCESS )
@@ -1524,7 +1619,7 @@ int HpmfwupgUpgrade(void *intf, char* imageFilename,
       }
       else
       {
-         free(fwupgCtx.pImageData);
+         HpmfwupgFreeBuffer(&fwupgCtx);
       }
    }
 
@@ -1544,7 +1639,7 @@ int HpmfwupgUpgrade(void *intf, char* imageFilename,
       }
       else
       {
-         free(fwupgCtx.pImageData);
+         HpmfwupgFreeBuffer(&fwupgCtx);
       }
    }
 
@@ -1565,10 +1660,16 @@ int HpmfwupgUpgrade(void *intf, char* imageFilename,
       if (option & VIEW_MODE)
       {
           rc = HpmfwupgPreUpgradeCheck(intf, &fwupgCtx,componentToUpload,VIEW_MODE);
+          if (rc == HPMFWUPG_SUCCESS) rc = HpmfwupgMd5Check();
       }
       else
       {
           rc = HpmfwupgPreUpgradeCheck(intf, &fwupgCtx,componentToUpload,option);
+			 if (rc == HPMFWUPG_SUCCESS )
+			 {
+				 /* Do not start the upload until the MD5 is known good */
+				 rc = HpmfwupgMd5Check();
+			 }
 			 if (rc == HPMFWUPG_SUCCESS )
 			 {
 				 if( verbose ) {
@@ -1581,7 +1682,7 @@ int HpmfwupgUpgrade(void *intf, char* imageFilename,
       if ( rc != HPMFWUPG_SUCCESS )
       {
 	 if (verbose) printf("HPM Upgrade error %d\n",rc);
-         free(fwupgCtx.pImageData);
+         HpmfwupgFreeBuffer(&fwupgCtx);
       }
    }
 
@@ -1595,7 +1696,7 @@ int HpmfwupgUpgrade(void *intf, char* imageFilename,
       if ( rc != HPMFWUPG_SUCCESS )
       {
 	 if (verbose) printf("HPM Activation error %d\n",rc);
-         free(fwupgCtx.pImageData);
+         HpmfwupgFreeBuffer(&fwupgCtx);
       }
    }
 
@@ -1610,7 +1711,7 @@ int HpmfwupgUpgrade(void *intf, char* imageFilename,
       {
           lprintf(LOG_NOTICE,"\nFirmware upgrade procedure successful\n");
       }
-      free(fwupgCtx.pImageData);
+      HpmfwupgFreeBuffer(&fwupgCtx);
    }
    else
    {
@@ -1622,36 +1723,120 @@ int HpmfwupgUpgrade(void *intf, char* imageFilename,
 
 /****************************************************************************
 *
-* Function Name:  HpmfwupgValidateImageIntegrity
+* Function Name:  HpmfwupgMd5Start, HpmfwupgMd5Wait
 *
-* Description: This function validates a HPM.1 firmware image file as defined
-*              in section 4 of the IPM Controller Firmware Upgrade
-*              Specification version 1.0
+* Description: The MD5 of the whole image is checked in a thread, while the
+*              header is checked and the target is queried.  HpmfwupgMd5Wait
+*              returns the result, and must be called before the upload
+*              and before the image buffer is freed.  HpmfwupgMd5Check
+*              also shows the result.
 *
 *****************************************************************************/
-int HpmfwupgValidateImageIntegrity(struct HpmfwupgUpgradeCtx* pFwupgCtx)
+static struct {
+   unsigned char* pData;
+   unsigned int   length;       /* bytes covered by the MD5 */
+   int            rc;           /* HPMFWUPG_SUCCESS if the MD5 matched */
+   int            fRunning;
+   int            fShown;       /* =1 once a mismatch was reported */
+#ifdef HPM_MMAP
+   pthread_t      thread;
+#endif
+} hpmMd5;
+
+static void *HpmfwupgMd5Thread(void *arg)
 {
-   int rc = HPMFWUPG_SUCCESS;
-   struct HpmfwupgImageHeader* pImageHeader = (struct HpmfwupgImageHeader*)
-                                                         pFwupgCtx->pImageData;
    md5_state_t ctx;
-	static unsigned char md[HPMFWUPG_MD5_SIGNATURE_LENGTH];
-   unsigned char* pMd5Sig = pFwupgCtx->pImageData +
-                           (pFwupgCtx->imageSize -
-                            HPMFWUPG_MD5_SIGNATURE_LENGTH);
+   unsigned char md[HPMFWUPG_MD5_SIGNATURE_LENGTH];
+   unsigned int offset, n;
 
-   /* Validate MD5 checksum */
    memset(md, 0, HPMFWUPG_MD5_SIGNATURE_LENGTH);
    memset(&ctx, 0, sizeof(md5_state_t));
    md5_init(&ctx);
-   md5_append(&ctx, pFwupgCtx->pImageData, pFwupgCtx->imageSize -
-                                           HPMFWUPG_MD5_SIGNATURE_LENGTH);
+   for (offset = 0; offset < hpmMd5.length; offset += n)
+   {
+      n = hpmMd5.length - offset;
+      if (n > 0x100000) n = 0x100000;   /* 1 MB at a time */
+      md5_append(&ctx, hpmMd5.pData + offset, (int)n);
+   }
    md5_finish(&ctx, md);
-   if ( memcmp(md, pMd5Sig,HPMFWUPG_MD5_SIGNATURE_LENGTH) != 0 )
+   if ( memcmp(md, hpmMd5.pData + hpmMd5.length,
+               HPMFWUPG_MD5_SIGNATURE_LENGTH) != 0 )
+      hpmMd5.rc = HPMFWUPG_ERROR;
+   else
+      hpmMd5.rc = HPMFWUPG_SUCCESS;
+   return(arg);
+}
+
+static void HpmfwupgMd5Start(struct HpmfwupgUpgradeCtx* pFwupgCtx)
+{
+   hpmMd5.pData    = pFwupgCtx->pImageData;
+   hpmMd5.length   = pFwupgCtx->imageSize - HPMFWUPG_MD5_SIGNATURE_LENGTH;
+   hpmMd5.rc       = HPMFWUPG_ERROR;
+   hpmMd5.fRunning = 0;
+   hpmMd5.fShown   = 0;
+#ifdef HPM_MMAP
+   if (pthread_create(&hpmMd5.thread, NULL, HpmfwupgMd5Thread, NULL) == 0)
+   {
+      hpmMd5.fRunning = 1;
+      return;
+   }
+#endif
+   HpmfwupgMd5Thread(NULL);   /* no thread, so do it now */
+}
+
+static int HpmfwupgMd5Wait(void)
+{
+#ifdef HPM_MMAP
+   if (hpmMd5.fRunning)
+   {
+      pthread_join(hpmMd5.thread, NULL);
+      hpmMd5.fRunning = 0;
+   }
+#endif
+   if ((hpmMd5.rc != HPMFWUPG_SUCCESS) && !hpmMd5.fShown)
    {
       lprintf(LOG_NOTICE,"\n    Invalid MD5 signature");
-      rc = HPMFWUPG_ERROR;
+      hpmMd5.fShown = 1;
    }
+   return hpmMd5.rc;
+}
+
+static int HpmfwupgMd5Check(void)
+{
+   int rc;
+
+   printf("Validating firmware image integrity...");
+   fflush(stdout);
+   hpmMd5.fShown = 1;   /* shown here, after the wait */
+   rc = HpmfwupgMd5Wait();
+   if (rc == HPMFWUPG_SUCCESS)
+      printf("OK\n");
+   else
+      printf("FAIL\n    Invalid MD5 signature\n");
+   fflush(stdout);
+   return rc;
+}
+
+/****************************************************************************
+*
+* Function Name:  HpmfwupgValidateImageIntegrity
+*
+* Description: This function validates a HPM.1 firmware image file as defined
+*              in section 4 of the IPM Controller Firmware Upgrade
+*              Specification version 1.0
+*
+*****************************************************************************/
+int HpmfwupgValidateImageIntegrity(struct HpmfwupgUpgradeCtx* pFwupgCtx)
+{
+   int rc = HPMFWUPG_SUCCESS;
+   struct HpmfwupgImageHeader* pImageHeader = (struct HpmfwupgImageHeader*)
+                                                         pFwupgCtx->pImageData;
+
+   /* Validate MD5 checksum, in the background if possible */
+   if ( pFwupgCtx->fShared )
+      hpmMd5.rc = HPMFWUPG_SUCCESS;  /* checked before the rollout */
+   else
+      HpmfwupgMd5Start(pFwupgCtx);
 
    if ( rc == HPMFWUPG_SUCCESS )
    {
@@ -1855,7 +2040,9 @@ int HpmfwupgPreparationStage(void *intf, struct HpmfwupgUpgradeCtx* pFwupgCtx, i
              if ( pFwupgCtx->targetCap.GlobalCapabilities.bitField.servAffectDuringUpg == 1 ||
                   pImageHeader->imageCapabilities.bitField.servAffected == 1 )
              {
-                if (HpmGetUserInput("\nServices may be affected during upgrade. Do you wish to continue? y/n "))
+                /* a rollout was confirmed once, for all of its nodes */
+                if (fleet_child ||
+                    HpmGetUserInput("\nServices may be affected during upgrade. Do you wish to continue? y/n "))
                 {
                    rc = HPMFWUPG_SUCCESS;
                 }
@@ -2292,6 +2479,16 @@ static int HpmFwupgActionUploadFirmware
    unsigned char  mode = 0;
    unsigned char  componentId = 0x00;
    unsigned char  componentIdByte = 0x00;
+   IPMI_BATCH     blkBatch[HPMFWUPG_UPLOAD_WINDOW_MAX];
+   unsigned char  blkReq[HPMFWUPG_UPLOAD_WINDOW_MAX][2+HPMFWUPG_SEND_DATA_COUNT_MAX];
+   unsigned char  blkRsp[HPMFWUPG_UPLOAD_WINDOW_MAX][16];
+   unsigned char  blkCount[HPMFWUPG_UPLOAD_WINDOW_MAX];
+   unsigned char  *pBlk;
+   unsigned char  probeLo, cc;
+   unsigned char  mcBus, mcSa, mcLun;
+   int            fProbe = FALSE;
+   int            window, maxWindow, nblk, iblk, i, rv;
+   int            nrestart = 0;
 
    /* Save component ID on which the upload is done */
    componentIdByte = components.ComponentBits.byte;
@@ -2367,7 +2564,6 @@ static int HpmFwupgActionUploadFirmware
         }
         else
         {
-	   int i;
            i = get_driver_type();
            if ((i == DRV_MV || i == DRV_KCS) &&   /*open driver*/
                (g_sa ==  BMC_SA) )
@@ -2414,112 +2610,239 @@ static int HpmFwupgActionUploadFirmware
       displayFWLength= firmwareLength;
       time(&start);
 
-
-      while ( (pData < (pDataTemp+lengthOfBlock)) && (rc == HPMFWUPG_SUCCESS) )
+      /*
+       * With "window n", unless a buffer size was given with -z, first 
+       * try a large block and bisect down to the default size until the 
+       * target accepts one.  Where the driver can pipeline (LAN 1.5, 
+       * OpenIPMI), keep a window of n blocks in flight.  If a probe block
+       * or a block in a window fails or times out, the component is
+       * aborted and started again from Initiate Upgrade Action.  Targets
+       * that redirect the offset or answer "in progress" get one block 
+       * at a time for the rest of the component.
+       */
+      probeLo = bufLength;
+      maxWindow = 1;
+      if (g_upload_fast)
       {
-         if ( (pData+bufLength) <= (pDataTemp+lengthOfBlock) )
+         if ((g_channel_buf_size == 0) && (g_sa == BMC_SA) &&
+             (bufLength < HPMFWUPG_SEND_DATA_COUNT_PROBE))
          {
-            count = bufLength;
+            fProbe = TRUE;
+            bufLength = HPMFWUPG_SEND_DATA_COUNT_PROBE;
          }
-         else
-         {
-            count = (unsigned char)((pDataTemp+lengthOfBlock) - pData);
-         }
-         memcpy(&uploadCmd.req.data, pData, bufLength);
-
-         imageOffset = 0x00;
-         blockLength = 0x00;
-         numTxPkts++;
-         rc = HpmfwupgUploadFirmwareBlock(intf, &uploadCmd, pFwupgCtx, count,
-                                            &imageOffset,&blockLength);
-         numRxPkts++;
+         i = get_driver_type();
+         if ((i == DRV_LAN || i == DRV_MV) && (g_sa == BMC_SA))
+            maxWindow = g_upload_window;
+      }
+      window = maxWindow;
+      nblk = iblk = 0;
+      ipmi_get_mc(&mcBus, &mcSa, &mcLun, NULL);
 
-         if ( rc != HPMFWUPG_SUCCESS)
+      while ( (pData < (pDataTemp+lengthOfBlock)) && (rc == HPMFWUPG_SUCCESS) )
+      {
+         if ( (iblk < nblk) || fProbe || (window > 1) )
          {
-            if ( rc == HPMFWUPG_UPLOAD_BLOCK_LENGTH )
+            if ( iblk >= nblk )
             {
-               /* Retry with a smaller buffer length */
-               if ( is_remote() ) // strstr(intf->name,"lan") != NULL
+               /* Send the next window of blocks raw, then check each reply */
+               nblk = (fProbe ? 1 : window);
+               pBlk = pData;
+               for (i = 0; i < nblk && pBlk < (pDataTemp+lengthOfBlock); i++)
                {
-                  bufLength -= (unsigned char)8;
-                  lprintf(LOG_INFO,"Trying reduced buffer length: %d", bufLength);
+                  if ( (pBlk+bufLength) <= (pDataTemp+lengthOfBlock) )
+                     blkCount[i] = bufLength;
+                  else
+                     blkCount[i] = (unsigned char)((pDataTemp+lengthOfBlock) - pBlk);
+                  blkReq[i][0] = HPMFWUPG_PICMG_IDENTIFIER;
+                  blkReq[i][1] = (unsigned char)(uploadCmd.req.blockNumber + i);
+                  memcpy(&blkReq[i][2], pBlk, blkCount[i]);
+                  memset(&blkBatch[i], 0, sizeof(IPMI_BATCH));
+                  blkBatch[i].cmd   = HPMFWUPG_UPLOAD_FIRMWARE_BLOCK;
+                  blkBatch[i].netfn = IPMI_NETFN_PICMG;
+                  blkBatch[i].sa    = mcSa;
+                  blkBatch[i].bus   = mcBus;
+                  blkBatch[i].lun   = mcLun;
+                  blkBatch[i].pdata = blkReq[i];
+                  blkBatch[i].sdata = 2 + blkCount[i];
+                  blkBatch[i].presp = blkRsp[i];
+                  blkBatch[i].sresp = sizeof(blkRsp[i]);
+                  pBlk += blkCount[i];
                }
-               else
+               nblk = i;
+               iblk = 0;
+               numTxPkts += nblk;
+               rv = ipmi_cmd_batch(blkBatch, nblk, (char)fdebug);
+               if (rv != 0)
+                  for (i = 0; i < nblk; i++) blkBatch[i].rv = rv;
+            }
+            /* check the next reply in the window */
+            i = iblk++;
+            count = blkCount[i];
+            imageOffset = 0x00;
+            blockLength = 0x00;
+            if ( blkBatch[i].rv == 0 )
+               rc = HpmfwupgUploadBlockRsp(intf, pFwupgCtx, blkBatch[i].cc,
+                                           blkRsp[i], blkBatch[i].sresp,
+                                           &imageOffset, &blockLength);
+            else
+               rc = HPMFWUPG_ERROR;
+            if ( (rc == HPMFWUPG_SUCCESS) && (imageOffset != 0x00) &&
+                 (iblk < nblk) )
+               rc = HPMFWUPG_ERROR;  /* redirected, the rest went to the wrong offset */
+            if ( rc != HPMFWUPG_SUCCESS )
+            {
+               /*
+                * The target may have taken blocks after this one, so never
+                * resend from an offset.  Abort and start the component
+                * again from Initiate Upgrade Action, with a smaller probe
+                * block, or else one block at a time.
+                */
+               lprintf(LOG_INFO,"Upload block %d failed (rv=%d cc=%x), restarting the component",
+                       blkReq[i][1], blkBatch[i].rv, blkBatch[i].cc);
+               if (++nrestart > HPMFWUPG_UPLOAD_RESTART_MAX)
                {
-                  bufLength -= (unsigned char)1;
+                  lprintf(LOG_NOTICE,"\n Error in Upload FIRMWARE command, %d restarts\n",
+                          nrestart - 1);
+                  rc = HPMFWUPG_ERROR;
+                  break;
+               }
+               rc = HpmfwupgRestartUpload(intf, &initUpgActionCmd, pFwupgCtx);
+               pData = pDataInitial;
+               pDataTemp = pDataInitial;
+               lengthOfBlock = firmwareLength;
+               displayFWLength = firmwareLength;
+               totalSent = 0;
+               uploadCmd.req.blockNumber = 0;
+               nblk = iblk = 0;
+               if ( fProbe )
+               {
+                  /* too large, or dropped: bisect down toward the default */
+                  bufLength = (unsigned char)((bufLength + probeLo) / 2);
+                  if (bufLength <= probeLo) {
+                     bufLength = probeLo;
+                     fProbe = FALSE;
+                  }
                   lprintf(LOG_INFO,"Trying reduced buffer length: %d", bufLength);
                }
-               rc = HPMFWUPG_SUCCESS;
-            }
-            else if ( rc == HPMFWUPG_UPLOAD_RETRY )
-            {
-               rc = HPMFWUPG_SUCCESS;
+               else
+                  maxWindow = window = 1;
+               continue;
             }
-            else
+            if ( fProbe )
             {
-               fflush(stdout);
-               lprintf(LOG_NOTICE,"\n Error in Upload FIRMWARE command [rc=%d]\n",rc);
-               lprintf(LOG_NOTICE,"\n TotalSent:0x%x ",totalSent);
-               /* Exiting from the function */
-               rc = HPMFWUPG_ERROR;
+               fProbe = FALSE;
+               lprintf(LOG_INFO,"Upload block size: %d", bufLength);
             }
+            if ( (blkBatch[i].cc == HPMFWUPG_COMMAND_IN_PROGRESS) ||
+                 (blkBatch[i].sresp > 1) )
+               maxWindow = window = 1;  /* one block at a time from here on */
+            numRxPkts++;
          }
          else
          {
-            if (blockLength > firmwareLength)
-            {
-                /*
-                 * blockLength is the remaining length of the firmware to upload so
-                 * if its greater than the firmware length then its kind of error
-                 */
-                lprintf(LOG_NOTICE,"\n Error in Upload FIRMWARE command [rc=%d]\n",rc);
-                lprintf(LOG_NOTICE,"\n TotalSent:0x%x Img offset:0x%x  Blk length:0x%x  Fwlen:0x%x\n",
-                            totalSent,imageOffset,blockLength,firmwareLength);
-                rc = HPMFWUPG_ERROR;
-            }
-            totalSent += count;
-            if (imageOffset != 0x00)
+            if ( (pData+bufLength) <= (pDataTemp+lengthOfBlock) )
             {
-                /* block Length is valid  */
-                lengthOfBlock = blockLength;
-                pDataTemp = pDataInitial + imageOffset;
-                pData = pDataTemp;
-                if ( displayFWLength == firmwareLength)
-                {
-                   /* This is basically used only to make sure that we display uptil 100% */
-                   displayFWLength = blockLength + totalSent;
-                }
+               count = bufLength;
             }
             else
             {
-                pData += count;
+               count = (unsigned char)((pDataTemp+lengthOfBlock) - pData);
             }
-            time(&end);
-            /*
-             * Just added debug mode in case we need to see exactly how many bytes have
-             * gone through - Its a hidden option used mainly should be used for debugging
-             */
-            if ( option & DEBUG_MODE)
-            {
-                fflush(stdout);
-                printf(" Blk Num : %02x        Bytes : %05x \r\n",
-                                uploadCmd.req.blockNumber,totalSent);
-                if (imageOffset || blockLength)
-                {
-                   printf("\r--> ImgOff : %x BlkLen : %x\n",imageOffset,blockLength);
-                }
-                if (displayFWLength == totalSent)
-                {
-                   printf(" Time Taken %02d:%02d\n",(end-start)/60, (end-start)%60);
-                   printf("\n");
-                }
-            }
-            else
+            memcpy(&uploadCmd.req.data, pData, count);
+
+            imageOffset = 0x00;
+            blockLength = 0x00;
+            numTxPkts++;
+            rc = HpmfwupgUploadFirmwareBlock(intf, &uploadCmd, pFwupgCtx, count,
+                                               &imageOffset,&blockLength);
+            numRxPkts++;
+
+            if ( rc != HPMFWUPG_SUCCESS)
             {
-               HpmDisplayUpgrade(0,totalSent,displayFWLength,(end-start));
+               if ( rc == HPMFWUPG_UPLOAD_BLOCK_LENGTH )
+               {
+                  /* Retry with a smaller buffer length */
+                  if ( is_remote() ) // strstr(intf->name,"lan") != NULL
+                  {
+                     bufLength -= (unsigned char)8;
+                     lprintf(LOG_INFO,"Trying reduced buffer length: %d", bufLength);
+                  }
+                  else
+                  {
+                     bufLength -= (unsigned char)1;
+                     lprintf(LOG_INFO,"Trying reduced buffer length: %d", bufLength);
+                  }
+                  rc = HPMFWUPG_SUCCESS;
+               }
+               else if ( rc == HPMFWUPG_UPLOAD_RETRY )
+               {
+                  rc = HPMFWUPG_SUCCESS;
+               }
+               else
+               {
+                  fflush(stdout);
+                  lprintf(LOG_NOTICE,"\n Error in Upload FIRMWARE command [rc=%d]\n",rc);
+                  lprintf(LOG_NOTICE,"\n TotalSent:0x%x ",totalSent);
+                  /* Exiting from the function */
+                  rc = HPMFWUPG_ERROR;
+               }
+               continue;
             }
-            uploadCmd.req.blockNumber++;
          }
+
+         if (blockLength > firmwareLength)
+         {
+             /*
+              * blockLength is the remaining length of the firmware to upload so
+              * if its greater than the firmware length then its kind of error
+              */
+             lprintf(LOG_NOTICE,"\n Error in Upload FIRMWARE command [rc=%d]\n",rc);
+             lprintf(LOG_NOTICE,"\n TotalSent:0x%x Img offset:0x%x  Blk length:0x%x  Fwlen:0x%x\n",
+                         totalSent,imageOffset,blockLength,firmwareLength);
+             rc = HPMFWUPG_ERROR;
+         }
+         totalSent += count;
+         if (imageOffset != 0x00)
+         {
+             /* block Length is valid  */
+             lengthOfBlock = blockLength;
+             pDataTemp = pDataInitial + imageOffset;
+             pData = pDataTemp;
+             if ( displayFWLength == firmwareLength)
+             {
+                /* This is basically used only to make sure that we display uptil 100% */
+                displayFWLength = blockLength + totalSent;
+             }
+         }
+         else
+         {
+             pData += count;
+         }
+         time(&end);
+         /*
+          * Just added debug mode in case we need to see exactly how many bytes have
+          * gone through - Its a hidden option used mainly should be used for debugging
+          */
+         if ( option & DEBUG_MODE)
+         {
+             fflush(stdout);
+             printf(" Blk Num : %02x        Bytes : %05x \r\n",
+                             uploadCmd.req.blockNumber,totalSent);
+             if (imageOffset || blockLength)
+             {
+                printf("\r--> ImgOff : %x BlkLen : %x\n",imageOffset,blockLength);
+             }
+             if (displayFWLength == totalSent)
+             {
+                printf(" Time Taken %02d:%02d\n",(end-start)/60, (end-start)%60);
+                printf("\n");
+             }
+         }
+         else
+         {
+            HpmDisplayUpgrade(0,totalSent,displayFWLength,(end-start));
+         }
+         uploadCmd.req.blockNumber++;
       }
    }
 
@@ -2628,37 +2951,108 @@ static int HpmfwupgActivationStage(void *intf, struct HpmfwupgUpgradeCtx* pFwupg
 int HpmfwupgGetBufferFromFile(char* imageFilename, struct HpmfwupgUpgradeCtx* pFwupgCtx)
 {
    int rc = HPMFWUPG_SUCCESS;
-   FILE* pImageFile = fopen(imageFilename, "rb");
-
-   if ( pImageFile == NULL )
-   {
-      lprintf(LOG_NOTICE,"Cannot open image file %s", imageFilename);
-      rc = HPMFWUPG_ERROR;
+   FILE* pImageFile;
+   long  fsize;
+
+   pFwupgCtx->pImageData = NULL;
+   pFwupgCtx->imageSize  = 0;
+   pFwupgCtx->fMapped    = 0;
+   pFwupgCtx->fShared    = 0;
+   pFwupgCtx->compUpdateMask.ComponentBits.byte = 0;
+   if ( pFleetImage != NULL )
+   {  /* a rollout child uses the image its parent already mapped */
+      pFwupgCtx->pImageData = pFleetImage->pImageData;
+      pFwupgCtx->imageSize  = pFleetImage->imageSize;
+      pFwupgCtx->fShared    = 1;
+      return HPMFWUPG_SUCCESS;
    }
-
-   if ( rc == HPMFWUPG_SUCCESS )
+#ifdef HPM_MMAP
+   {  /* map the image file read-only, instead of copying it to memory */
+      int fd;
+      struct stat st;
+      void *p;
+
+      fd = open(imageFilename, O_RDONLY);
+      if ( fd < 0 )
+      {
+         lprintf(LOG_NOTICE,"Cannot open image file %s", imageFilename);
+         return HPMFWUPG_ERROR;
+      }
+      if ( (fstat(fd, &st) == 0) && (st.st_size > 0) &&
+           (st.st_size <= 0x7fffffff) )
+      {
+         p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+         if ( p != MAP_FAILED )
+         {
+#ifdef MADV_SEQUENTIAL
+            madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+            pFwupgCtx->pImageData = (unsigned char *)p;
+            pFwupgCtx->imageSize  = (unsigned int)st.st_size;
+            pFwupgCtx->fMapped    = 1;
+         }
+      }
+      close(fd);
+   }
+   if ( pFwupgCtx->fMapped == 0 )  /* could not map it, so read it */
+#endif
    {
+      pImageFile = fopen(imageFilename, "rb");
+      if ( pImageFile == NULL )
+      {
+         lprintf(LOG_NOTICE,"Cannot open image file %s", imageFilename);
+         return HPMFWUPG_ERROR;
+      }
       /* Get the raw data in file */
       fseek(pImageFile, 0, SEEK_END);
-      pFwupgCtx->imageSize  = ftell(pImageFile);
-      pFwupgCtx->pImageData = malloc(sizeof(unsigned char)*pFwupgCtx->imageSize);
-      pFwupgCtx->compUpdateMask.ComponentBits.byte = 0;
+      fsize = ftell(pImageFile);
       rewind(pImageFile);
-      if ( pFwupgCtx->pImageData != NULL )
+      if ( fsize > 0 )
+         pFwupgCtx->pImageData = malloc(sizeof(unsigned char)*fsize);
+      if ( pFwupgCtx->pImageData == NULL )
       {
-         fread(pFwupgCtx->pImageData, sizeof(unsigned char), pFwupgCtx->imageSize, pImageFile);
+         rc = HPMFWUPG_ERROR;
       }
-      else
+      else if ( fread(pFwupgCtx->pImageData, sizeof(unsigned char), fsize,
+                      pImageFile) != (size_t)fsize )
       {
+         lprintf(LOG_NOTICE,"Cannot read image file %s", imageFilename);
+         free(pFwupgCtx->pImageData);
+         pFwupgCtx->pImageData = NULL;
          rc = HPMFWUPG_ERROR;
       }
-
+      else
+      {
+         pFwupgCtx->imageSize = (unsigned int)fsize;
+      }
       fclose(pImageFile);
    }
 
+   if ( (rc == HPMFWUPG_SUCCESS) && (pFwupgCtx->imageSize <= 
+         sizeof(struct HpmfwupgImageHeader) + HPMFWUPG_MD5_SIGNATURE_LENGTH) )
+   {
+      lprintf(LOG_NOTICE,"Image file %s is too short", imageFilename);
+      HpmfwupgFreeBuffer(pFwupgCtx);
+      rc = HPMFWUPG_ERROR;
+   }
    return rc;
 }
 
+void HpmfwupgFreeBuffer(struct HpmfwupgUpgradeCtx* pFwupgCtx)
+{
+   if ( pFwupgCtx->pImageData == NULL ) return;
+   HpmfwupgMd5Wait();  /* the MD5 thread may still be reading it */
+   if ( pFwupgCtx->fShared )
+      ;   /* owned by the rollout */
+#ifdef HPM_MMAP
+   else if ( pFwupgCtx->fMapped )
+      munmap(pFwupgCtx->pImageData, pFwupgCtx->imageSize);
+   else
+#endif
+      free(pFwupgCtx->pImageData);
+   pFwupgCtx->pImageData = NULL;
+}
+
 int HpmfwupgGetDeviceId(void *intf, struct ipm_devid_rsp* pGetDevId)
 {
    int rc = HPMFWUPG_SUCCESS;
@@ -2968,6 +3362,101 @@ int HpmfwupgInitiateUpgradeAction(void *intf, struct HpmfwupgInitiateUpgradeActi
    return rc;
 }
 
+/*
+ * HpmfwupgUploadBlockRsp
+ * Checks an Upload Firmware Block response, for HpmfwupgUploadFirmwareBlock
+ * and for the blocks sent in a window with ipmi_cmd_batch.  data[0] is the
+ * PICMG identifier, and a redirect returns the imageOffset and blockLength.
+ */
+static int HpmfwupgUploadBlockRsp(void *intf, struct HpmfwupgUpgradeCtx* pFwupgCtx,
+                                  unsigned char ccode, unsigned char *data,
+                                  int data_len, unsigned int *imageOffset,
+                                  unsigned int *blockLength)
+{
+   int rc = HPMFWUPG_SUCCESS;
+
+   if ( ccode == HPMFWUPG_COMMAND_IN_PROGRESS ||
+        ccode == 0x00 )
+   {
+      /*
+       * We need to check if the response also contains the next upload firmware offset
+       * and the firmware length in its response - These are optional but very vital
+       */
+     if ( data_len > 1 )
+     {
+      /*
+       * If the response data length is greater than 1 it should contain both the
+       * the Section offset and section length. Because we cannot just have
+       * Section offset without section length so the length should be 9
+       */
+       if ( data_len == 9 )
+       {
+          /* data[1] - LSB  data[2]  - data[3] = MSB */
+          *imageOffset = (data[4] << 24) + (data[3] << 16) + (data[2] << 8) + data[1];
+          *blockLength = (data[8] << 24) + (data[7] << 16) + (data[6] << 8) + data[5];
+       }
+       else
+       {
+           /*
+            * The Spec does not say much for this kind of errors where the
+            * firmware returned only offset and length so currently returning it
+            * as 0x82 - Internal CheckSum Error
+            */
+           lprintf(LOG_NOTICE,"Error wrong rsp->datalen %d for Upload Firmware block command\n",data_len);
+           ccode = HPMFWUPG_INT_CHECKSUM_ERROR;
+       }
+     }
+   }
+   /* Long duration command handling */
+   if ( ccode == HPMFWUPG_COMMAND_IN_PROGRESS )
+   {
+      rc = HpmfwupgWaitLongDurationCmd(intf, pFwupgCtx);
+   }
+   else if (ccode != 0x00) 
+   {
+      /*
+       * PATCH --> This validation is to handle retryables errors codes on IPMB bus.
+       *           This will be fixed in the next release of open ipmi and this
+       *           check will have to be removed. (Buggy version = 39)
+       */
+      if ( HPMFWUPG_IS_RETRYABLE(ccode) )
+      {
+         lprintf(LOG_DEBUG,"HPM: [PATCH]Retryable error detected");
+         rc = HPMFWUPG_UPLOAD_RETRY;
+      }
+      /*
+       * If completion code = 0xc7, we will retry with a reduced buffer length.
+       * Do not print error.
+       */
+      else if ( ccode == IPMI_CC_REQ_DATA_INV_LENGTH ||
+                ccode == 0xC8 )  /* request data field too long */
+      {
+         rc = HPMFWUPG_UPLOAD_BLOCK_LENGTH;
+      }
+      else
+      {
+         lprintf(LOG_NOTICE,"Error uploading firmware block, compcode = %x\n",  ccode);
+         rc = HPMFWUPG_ERROR;
+      }
+   }
+   return rc;
+}
+
+/*
+ * HpmfwupgRestartUpload
+ * A probe block or a block in a window failed, and the target may have
+ * taken blocks after it, so abort the upload and initiate it again.
+ */
+static int HpmfwupgRestartUpload(void *intf,
+                                 struct HpmfwupgInitiateUpgradeActionCtx* pInitCmd,
+                                 struct HpmfwupgUpgradeCtx* pFwupgCtx)
+{
+   struct HpmfwupgAbortUpgradeCtx abortCmd;
+
+   HpmfwupgAbortUpgrade(intf, &abortCmd);
+   return HpmfwupgInitiateUpgradeAction(intf, pInitCmd, pFwupgCtx);
+}
+
 int HpmfwupgUploadFirmwareBlock(void *intf, struct HpmfwupgUploadFirmwareBlockCtx* pCtx,
                                 struct HpmfwupgUpgradeCtx* pFwupgCtx, int count
                                ,unsigned int *imageOffset, unsigned int *blockLength )
@@ -2989,69 +3478,8 @@ int HpmfwupgUploadFirmwareBlock(void *intf, struct HpmfwupgUploadFirmwareBlockCt
 
    if ( rsp )
    {
-      if ( rsp->ccode == HPMFWUPG_COMMAND_IN_PROGRESS ||
-           rsp->ccode == 0x00 )
-      {
-         /*
-          * We need to check if the response also contains the next upload firmware offset
-          * and the firmware length in its response - These are optional but very vital
-          */
-        if ( rsp->data_len > 1 )
-        {
-         /*
-          * If the response data length is greater than 1 it should contain both the
-          * the Section offset and section length. Because we cannot just have
-          * Section offset without section length so the length should be 9
-          */
-          if ( rsp->data_len == 9 )
-          {
-             /* rsp->data[1] - LSB  rsp->data[2]  - rsp->data[3] = MSB */
-             *imageOffset = (rsp->data[4] << 24) + (rsp->data[3] << 16) + (rsp->data[2] << 8) + rsp->data[1];
-             *blockLength = (rsp->data[8] << 24) + (rsp->data[7] << 16) + (rsp->data[6] << 8) + rsp->data[5];
-          }
-          else
-          {
-              /*
-               * The Spec does not say much for this kind of errors where the
-               * firmware returned only offset and length so currently returning it
-               * as 0x82 - Internal CheckSum Error
-               */
-              lprintf(LOG_NOTICE,"Error wrong rsp->datalen %d for Upload Firmware block command\n",rsp->data_len);
-              rsp->ccode = HPMFWUPG_INT_CHECKSUM_ERROR;
-          }
-        }
-      }
-      /* Long duration command handling */
-      if ( rsp->ccode == HPMFWUPG_COMMAND_IN_PROGRESS )
-      {
-         rc = HpmfwupgWaitLongDurationCmd(intf, pFwupgCtx);
-      }
-      else if (rsp->ccode != 0x00) 
-      {
-         /*
-          * PATCH --> This validation is to handle retryables errors codes on IPMB bus.
-          *           This will be fixed in the next release of open ipmi and this
-          *           check will have to be removed. (Buggy version = 39)
-          */
-         if ( HPMFWUPG_IS_RETRYABLE(rsp->ccode) )
-         {
-            lprintf(LOG_DEBUG,"HPM: [PATCH]Retryable error detected");
-            rc = HPMFWUPG_UPLOAD_RETRY;
-         }
-         /*
-          * If completion code = 0xc7, we will retry with a reduced buffer length.
-          * Do not print error.
-          */
-         else if ( rsp->ccode == IPMI_CC_REQ_DATA_INV_LENGTH )
-         {
-            rc = HPMFWUPG_UPLOAD_BLOCK_LENGTH;
-         }
-         else
-         {
-            lprintf(LOG_NOTICE,"Error uploading firmware block, compcode = %x\n",  rsp->ccode);
-            rc = HPMFWUPG_ERROR;
-         }
-      }
+      rc = HpmfwupgUploadBlockRsp(intf, pFwupgCtx, rsp->ccode, rsp->data,
+                                  rsp->data_len, imageOffset, blockLength);
    }
    else
    {
@@ -3457,9 +3885,9 @@ struct ipmi_rs * HpmfwupgSendCmd(void *intf, struct ipmi_rq req,
                                  struct HpmfwupgUpgradeCtx* pFwupgCtx )
 {
    struct ipmi_rs * rsp;
-   unsigned int inaccessTimeout = 0, inaccessTimeoutCounter = 0;
-   unsigned int upgradeTimeout  = 0, upgradeTimeoutCounter  = 0;
-   unsigned int  timeoutSec1, timeoutSec2;
+   unsigned int inaccessTimeout = 0;
+   unsigned int upgradeTimeout  = 0;
+   ulong tstart, delay;
    unsigned char retry = 0;
    static struct ipmi_rs fakeRsp;
    int rv, rsp_len;
@@ -3483,11 +3911,15 @@ struct ipmi_rs * HpmfwupgSendCmd(void *intf, struct ipmi_rq req,
       upgradeTimeout  = HPMFWUPG_DEFAULT_UPGRADE_TIMEOUT;
    }
 
-   timeoutSec1 = (uint32_t)time(NULL);
+   tstart = os_msec();
+   delay  = HPMFWUPG_POLL_FIRST_MS;
 
    do
    {
       static unsigned char isValidSize = FALSE;
+      if ( req.msg.netfn == IPMI_NETFN_PICMG &&
+           req.msg.cmd == HPMFWUPG_GET_UPGRADE_STATUS )
+         hpmPoll.polls++;
       rv = ipmi_sendrecv(&req, fakeRsp.data, &rsp_len);
       if( rv < 0)
       {
@@ -3559,9 +3991,9 @@ struct ipmi_rs * HpmfwupgSendCmd(void *intf, struct ipmi_rq req,
                lprintf(LOG_DEBUG,"HPM: try to re-open IOL session");
 
                {
-                  /* force session re-open */
+                  /* force session re-open, after the backoff below */
                   ipmi_close_();
-                  os_usleep(inaccessTimeout,0);
+                  hpmPoll.reconnects++;
 
                   /* Fake timeout to retry command */
                   fakeRsp.ccode = 0xc3;
@@ -3575,15 +4007,9 @@ struct ipmi_rs * HpmfwupgSendCmd(void *intf, struct ipmi_rq req,
      /* Handle inaccessibility timeout (rsp = NULL if IOL) */
      if ( rv < 0 || rv == 0xff || rv == 0xc3 || rv == 0xd3 )
      {
-        if ( inaccessTimeoutCounter < inaccessTimeout )
+        if ( os_msec() - tstart < (ulong)inaccessTimeout * 1000 )
         {
-           timeoutSec2 = (uint32_t)time(NULL);
-           if ( timeoutSec2 > timeoutSec1 )
-           {
-              inaccessTimeoutCounter += timeoutSec2 - timeoutSec1;
-              timeoutSec1 = (uint32_t)time(NULL);
-           }
-           os_usleep(0,100000);
+           HpmfwupgBackoff(&delay, HPMFWUPG_INACCESS_MAX_MS);
            retry = 1;
         }
         else
@@ -3594,16 +4020,9 @@ struct ipmi_rs * HpmfwupgSendCmd(void *intf, struct ipmi_rq req,
      /* Handle node busy timeout */
      else if ( rv == 0xc0 )
      {
-        if ( upgradeTimeoutCounter < upgradeTimeout )
+        if ( os_msec() - tstart < (ulong)upgradeTimeout * 1000 )
         {
-           timeoutSec2 = (uint32_t)time(NULL);
-           if ( timeoutSec2 > timeoutSec1 )
-           {
-              timeoutSec1 = (uint32_t)time(NULL);
-              // upgradeTimeoutCounter += timeoutSec2 - timeoutSec1;
-              upgradeTimeoutCounter += 1;
-           }
-           os_usleep(0,100000);
+           HpmfwupgBackoff(&delay, HPMFWUPG_POLL_MAX_MS);
            retry = 1;
         }
         else
@@ -3651,7 +4070,7 @@ int HpmfwupgWaitLongDurationCmd(void *intf, struct HpmfwupgUpgradeCtx* pFwupgCtx
 {
    int rc = HPMFWUPG_SUCCESS;
    unsigned int upgradeTimeout = 0;
-   unsigned int  timeoutSec1, timeoutSec2;
+   ulong tstart = os_msec();
    struct HpmfwupgGetUpgradeStatusCtx upgStatusCmd;
 
    /*
@@ -3685,23 +4104,28 @@ int HpmfwupgWaitLongDurationCmd(void *intf, struct HpmfwupgUpgradeCtx* pFwupgCtx
 
    if(rc == HPMFWUPG_SUCCESS)
    {
-      /* Poll upgrade status until completion or timeout*/
-      timeoutSec1 = (uint32_t)time(NULL);
-      timeoutSec2 = (uint32_t)time(NULL);
+      /* Poll upgrade status until completion or the deadline */
+      tstart = os_msec();
+      hpmPoll.polls = 0;
+      hpmPoll.reconnects = 0;
       rc = HpmfwupgGetUpgradeStatus(intf, &upgStatusCmd, pFwupgCtx);
    }
 
    while(
          (upgStatusCmd.resp.lastCmdCompCode == HPMFWUPG_COMMAND_IN_PROGRESS ) &&
-         (timeoutSec2 - timeoutSec1 < upgradeTimeout ) &&
+         (os_msec() - tstart < (ulong)upgradeTimeout * 1000 ) &&
          (rc == HPMFWUPG_SUCCESS) 
         )
    {
       /* Must wait at least 1000 ms between status requests */
       os_usleep(0,1000000);
       rc = HpmfwupgGetUpgradeStatus(intf, &upgStatusCmd, pFwupgCtx);
-      //printf("Get Status: %x - %x = %x _ %x [%x]\n", timeoutSec2, timeoutSec1,(timeoutSec2 - timeoutSec1),upgradeTimeout, rc); 
    }
+   hpmPoll.msec = os_msec() - tstart;
+   if ( verbose )
+      printf("Command %x done in %lu ms, %d status polls, %d reconnects\n",
+             upgStatusCmd.resp.cmdInProcess, hpmPoll.msec, hpmPoll.polls,
+             hpmPoll.reconnects);
 
    if ( upgStatusCmd.resp.lastCmdCompCode != 0x00 )
    {
@@ -3749,6 +4173,8 @@ static void HpmfwupgPrintUsage(void)
    lprintf(LOG_NOTICE,"upgrade <file> activate - Upgrade the firmware using a valid HPM.1 image <file>");
    lprintf(LOG_NOTICE,"                          If activate is specified, activate new firmware rigth");
    lprintf(LOG_NOTICE,"                          away");
+   lprintf(LOG_NOTICE,"upgrade <file> window n - Probe the block size, keep up to n (1-%d) in flight",
+           HPMFWUPG_UPLOAD_WINDOW_MAX);
    lprintf(LOG_NOTICE,"activate [norollback]   - Activate the newly uploaded firmware");
    lprintf(LOG_NOTICE,"targetcap               - Get the target upgrade capabilities");
    lprintf(LOG_NOTICE,"compprop <id> <select>  - Get the specified component properties");
@@ -3765,8 +4191,340 @@ static void HpmfwupgPrintUsage(void)
    lprintf(LOG_NOTICE,"                          firmware");
    lprintf(LOG_NOTICE,"rollbackstatus          - Query the rollback status");
    lprintf(LOG_NOTICE,"selftestresult          - Query the self test results\n");
+   lprintf(LOG_NOTICE,"Rollout options for upgrade, to upgrade many nodes at once:");
+   lprintf(LOG_NOTICE," -a <file>  file of BMC nodenames, one per line");
+   lprintf(LOG_NOTICE," -j <n>     upgrade up to n nodes at once (16)");
+   lprintf(LOG_NOTICE," -t <sec>   time allowed for each node (3600)");
+   lprintf(LOG_NOTICE," -r <n>     retries for each node (1)");
+   lprintf(LOG_NOTICE," -c <n>     upgrade the first n nodes first, as canaries (0)");
+   lprintf(LOG_NOTICE," -k <n>     stop the rollout after n nodes failed (0=never)\n");
+}
+
+#if defined(WIN32) || defined(DOS) || defined(EFI)
+static int hpm_rollout(char *imageFilename, int activate, 
+                       int componentId, int option)
+{
+   printf("Options -a, -j, -t, -r, -c and -k are not supported on this OS\n");
+   return(LAN_ERR_NOTSUPPORT);
+}
+#else
+/*
+ * Rollout mode: each node in the -a file is upgraded by a child process,
+ * since the IPMI library keeps one session per process.  The image is
+ * mapped and its MD5 checked once, here, and each child uses the same
+ * mapping.  The first fleet_canary nodes are upgraded first, and the
+ * rest only if they all succeed.  Up to fleet_max children run at once,
+ * each one retries up to fleet_retry times, and each is killed and its
+ * upgrade aborted if it runs past fleet_tmo.  After fleet_stop failed
+ * nodes, no more are started.  The output of each node is shown in file
+ * order, then one summary line per node.
+ */
+#define HPM_NODE_OK      0
+#define HPM_NODE_FAILED  1
+#define HPM_NODE_TIMEOUT 2
+#define HPM_NODE_SKIPPED 3
+typedef struct {
+   char   node[SZGNODE+1];
+   pid_t  pid;
+   pid_t  apid;    /*child sending Abort Firmware Upgrade after a timeout*/
+   ulong  astart;
+   int    fd;      /*read end of the pipe from the child*/
+   char  *out;     /*output collected from the child*/
+   int    nout;
+   int    szout;
+   ulong  start;
+   ulong  msec;
+   char   state;   /*0=waiting, 1=running, 2=done*/
+   char   result;  /*HPM_NODE_* */
+   char   tries;
+} HPM_NODE;
+static HPM_NODE *fleet = NULL;
+static int nfleet = 0;
+static char *node_result[4] = { "ok", "failed", "timeout", "skipped" };
+
+/* fleet_add - add a node from the -a file, called by read_nodes */
+static int fleet_add(char *node)
+{
+   HPM_NODE *pnew;
+   if ((nfleet % 64) == 0) {
+      pnew = realloc(fleet, (nfleet + 64) * sizeof(HPM_NODE));
+      if (pnew == NULL) return(ERR_BAD_PARAM);
+      fleet = pnew;
+   }
+   memset(&fleet[nfleet],0,sizeof(HPM_NODE));
+   strncpy(fleet[nfleet].node,node,SZGNODE);
+   nfleet++;
+   return(0);
+}
+
+static void fleet_append(HPM_NODE *h, char *buf, int len)
+{
+   char *pnew;
+   if (h->nout + len + 1 > h->szout) {
+      pnew = realloc(h->out, h->nout + len + 1024);
+      if (pnew == NULL) return;
+      h->out = pnew;
+      h->szout = h->nout + len + 1024;
+   }
+   memcpy(&h->out[h->nout],buf,len);
+   h->nout += len;
 }
 
+/* hpm_rollout_node - upgrade one node, in the child, with retries */
+static int hpm_rollout_node(char *imageFilename, int activate, 
+                            int componentId, int option, int *ptries)
+{
+   struct HpmfwupgAbortUpgradeCtx abortCmd;
+   int rc, tries;
+
+   for (tries = 1; ; tries++)
+   {
+      rc = HpmfwupgTargetCheck(NULL,0);
+      if (rc == HPMFWUPG_SUCCESS)
+         rc = HpmfwupgUpgrade(NULL, imageFilename, activate, componentId, option);
+      if (rc == HPMFWUPG_SUCCESS) break;
+      /* leave the target ready for the next try, or the next rollout */
+      HpmfwupgAbortUpgrade(NULL, &abortCmd);
+      if (tries > fleet_retry) break;
+      printf("\nRetry %d of %d\n",tries,fleet_retry);
+      ipmi_close_();
+      os_usleep(5,0);
+   }
+   *ptries = tries;
+   return(rc);
+}
+
+static void fleet_start(HPM_NODE *h, char *imageFilename, int activate, 
+                        int componentId, int option)
+{
+   int ret, tries;
+   char msg[80];
+
+   h->state = 2;
+   h->result = HPM_NODE_FAILED;
+   h->pid = node_fork(h->node,NODE_STDOUT | NODE_STDERR | NODE_NULLIN,&h->fd);
+   if (h->pid < 0) {
+      sprintf(msg,"fork error %d\n",errno);
+      fleet_append(h,msg,(int)strlen(msg));
+      return;
+   }
+   if (h->pid == 0) {  /*child*/
+      fleet_child = 1;
+      /* one block at a time, many nodes at once may share a slow link */
+      g_upload_fast = FALSE;
+      g_upload_window = 1;
+      ret = hpm_rollout_node(imageFilename,activate,componentId,option,&tries);
+      ipmi_close_();
+      fflush(stdout);
+      if (tries > 63) tries = 63;
+      /* the exit status has the number of tries above the failed bit */
+      _exit((tries << 1) | (ret == HPMFWUPG_SUCCESS ? 0 : 1));
+   }
+   h->start = os_msec();
+   h->state = 1;
+}
+
+/* fleet_abort - send Abort Firmware Upgrade to a node that timed out */
+static void fleet_abort(HPM_NODE *h)
+{
+   struct HpmfwupgAbortUpgradeCtx abortCmd;
+
+   h->apid = node_fork(h->node,NODE_NULLIN | NODE_NULLOUT,NULL);
+   if (h->apid == 0) {  /*child*/
+      HpmfwupgAbortUpgrade(NULL, &abortCmd);
+      ipmi_close_();
+      _exit(0);
+   }
+   if (h->apid < 0) h->apid = 0;
+   h->astart = os_msec();
+}
+
+static void fleet_finish(HPM_NODE *h, char ftimeout)
+{
+   int status;
+   char msg[80];
+
+   if (ftimeout) {
+      sprintf(msg,"timed out after %d sec, aborting the upgrade\n",fleet_tmo);
+      if (h->nout > 0 && h->out[h->nout-1] != '\n') fleet_append(h,"\n",1);
+      fleet_append(h,msg,(int)strlen(msg));
+   }
+   status = node_reap(h->pid,h->fd,ftimeout);
+   h->state = 2;
+   h->msec = os_msec() - h->start;
+   if (ftimeout) {
+      h->result = HPM_NODE_TIMEOUT;
+      fleet_abort(h);
+   } else if ((status != -1) && WIFEXITED(status)) {
+      h->tries  = (char)(WEXITSTATUS(status) >> 1);
+      h->result = (WEXITSTATUS(status) & 1) ? HPM_NODE_FAILED : HPM_NODE_OK;
+   } else h->result = HPM_NODE_FAILED;
+}
+
+static void fleet_show(HPM_NODE *h)
+{
+   printf("=== %s ===\n",h->node);
+   if (h->nout > 0) {
+      printf("%.*s",h->nout,h->out);
+      if (h->out[h->nout-1] != '\n') printf("\n");
+   }
+   free(h->out);
+   h->out = NULL;
+}
+
+static int hpm_rollout(char *imageFilename, int activate, 
+                       int componentId, int option)
+{
+   struct HpmfwupgUpgradeCtx image;
+   fd_set readfds;
+   struct timeval tv;
+   char buf[1024];
+   HPM_NODE *h;
+   ulong t0, tnow, tleft;
+   int next, nrun, nshow, maxfd, i, n, last, rc, fstop;
+   int nok, nfail, ntmo, nskip;
+
+   rc = read_nodes(hostfile,fleet_add);
+   if (rc != 0) return(rc);
+   if (fleet_max < 1) fleet_max = 1;
+   if (fleet_canary > nfleet) fleet_canary = nfleet;
+
+   /* map the image and check it once, for all of the nodes */
+   rc = HpmfwupgGetBufferFromFile(imageFilename, &image);
+   if (rc == HPMFWUPG_SUCCESS) {
+      printf("Validating firmware image header...");
+      fflush(stdout);
+      rc = HpmfwupgValidateImageIntegrity(&image);
+      if (rc == HPMFWUPG_SUCCESS) {
+         printf("OK\n");
+         rc = HpmfwupgMd5Check();
+      }
+      if (rc != HPMFWUPG_SUCCESS) HpmfwupgFreeBuffer(&image);
+   }
+   if (rc != HPMFWUPG_SUCCESS) {
+      free(fleet);
+      fleet = NULL;
+      return(rc);
+   }
+   sprintf(buf,"\nUpgrade %d nodes from %s, %d at once, %d canary first.\n"
+           "Services may be affected during upgrade. Do you wish to continue? y/n ",
+           nfleet, imageFilename, fleet_max, fleet_canary);
+   if (!HpmGetUserInput(buf)) {
+      HpmfwupgFreeBuffer(&image);
+      free(fleet);
+      fleet = NULL;
+      return(HPMFWUPG_ERROR);
+   }
+   pFleetImage = &image;
+
+   t0 = os_msec();
+   next = nrun = nshow = 0;
+   nfail = 0;
+   fstop = 0;
+   while (nshow < nfleet) {
+      /* canaries first, then the rest only if all of them succeeded */
+      last = (nshow < fleet_canary) ? fleet_canary : nfleet;
+      if (!fstop && (next < nfleet)) {
+         if ((fleet_canary > 0) && (nshow >= fleet_canary)) {
+            for (i = 0; i < fleet_canary; i++) 
+               if (fleet[i].result != HPM_NODE_OK) fstop = 1;
+            if (fstop) printf("%s: canary failed, rollout stopped\n",progname);
+         }
+         if (!fstop && (fleet_stop > 0) && (nfail >= fleet_stop)) {
+            printf("%s: %d nodes failed, rollout stopped\n",progname,nfail);
+            fstop = 1;
+         }
+         if (fstop) {
+            for (i = next; i < nfleet; i++) {   /*do not start the rest*/
+               fleet[i].state  = 2;
+               fleet[i].result = HPM_NODE_SKIPPED;
+            }
+            next = nfleet;
+         }
+      }
+      while ((nrun < fleet_max) && (next < last)) {
+         h = &fleet[next++];
+         fleet_start(h,imageFilename,activate,componentId,option);
+         if (h->state == 1) nrun++;
+         else nfail++;
+      }
+      if (nrun > 0) {
+         /* wait for output, or for the next node time limit */
+         FD_ZERO(&readfds);
+         maxfd = 0;
+         tnow = os_msec();
+         tleft = (ulong)fleet_tmo * 1000;
+         for (i = nshow; i < next; i++) {
+            h = &fleet[i];
+            if (h->state != 1) continue;
+            FD_SET(h->fd,&readfds);
+            if (h->fd > maxfd) maxfd = h->fd;
+            if (tnow - h->start >= (ulong)fleet_tmo * 1000) tleft = 0;
+            else if (h->start + (ulong)fleet_tmo * 1000 - tnow < tleft)
+               tleft = h->start + (ulong)fleet_tmo * 1000 - tnow;
+         }
+         tv.tv_sec  = tleft / 1000;
+         tv.tv_usec = (tleft % 1000) * 1000;
+         n = select(maxfd+1,&readfds,NULL,NULL,&tv);
+         if (n < 0 && errno != EINTR) {
+            printf("select error %d\n",errno);
+            FD_ZERO(&readfds);
+         } else if (n < 0) FD_ZERO(&readfds);
+         tnow = os_msec();
+         for (i = nshow; i < next; i++) {
+            h = &fleet[i];
+            if (h->state != 1) continue;
+            if (FD_ISSET(h->fd,&readfds)) {
+               n = (int)read(h->fd,buf,sizeof(buf));
+               if (n > 0) { fleet_append(h,buf,n); continue; }
+               fleet_finish(h,0); 
+            } else if (tnow - h->start >= (ulong)fleet_tmo * 1000) {
+               fleet_finish(h,1); 
+            } else continue;
+            nrun--;
+            if (h->result != HPM_NODE_OK) nfail++;
+         }
+      }
+      /* show the finished nodes in file order */
+      while ((nshow < next) && (fleet[nshow].state == 2)) {
+         if (fleet[nshow].result != HPM_NODE_SKIPPED) fleet_show(&fleet[nshow]);
+         nshow++;
+      }
+      fflush(stdout);
+   }
+   for (i = 0; i < nfleet; i++) {  /*wait for any abort children, 30 sec*/
+      h = &fleet[i];
+      if (h->apid <= 0) continue;
+      while ((waitpid(h->apid,NULL,WNOHANG) == 0) && 
+             (os_msec() - h->astart < 30000)) 
+         os_usleep(0,100000);
+      if (os_msec() - h->astart >= 30000) node_reap(h->apid,-1,1);
+   }
+
+   /* one line per node: node|batch|result|tries|msec */
+   nok = nfail = ntmo = nskip = 0;
+   printf("node|batch|result|tries|msec\n");
+   for (i = 0; i < nfleet; i++) {
+      h = &fleet[i];
+      printf("%s|%s|%s|%d|%lu\n", h->node, (i < fleet_canary) ? "canary" : "main",
+             node_result[(int)h->result], h->tries, h->msec);
+      if (h->result == HPM_NODE_OK) nok++;
+      else if (h->result == HPM_NODE_TIMEOUT) ntmo++;
+      else if (h->result == HPM_NODE_SKIPPED) nskip++;
+      else nfail++;
+   }
+   printf("%s: %d nodes, %d ok, %d failed, %d timed out, %d skipped, %lu ms\n",
+	  progname, nfleet, nok, nfail, ntmo, nskip, os_msec() - t0);
+   pFleetImage = NULL;
+   HpmfwupgFreeBuffer(&image);
+   free(fleet);
+   fleet = NULL;
+   if (ntmo > 0) return(LAN_ERR_TIMEOUT);
+   if (nfail > 0 || nskip > 0) return(HPMFWUPG_ERROR);
+   return(HPMFWUPG_SUCCESS);
+}
+#endif
+
 int ipmi_hpmfwupg_main(void * intf, int  argc, char ** argv)
 {
    int rc = HPMFWUPG_SUCCESS;
@@ -3856,13 +4614,33 @@ int ipmi_hpmfwupg_main(void * intf, int  argc, char ** argv)
         {
             option |= DEBUG_MODE;
         }
+        /* hpm upgrade <filename> window <n> */
+        if ((strcmp(argv[i],"window") == 0) && (i+1 < argc))
+        {
+            g_upload_window = atoi(argv[i+1]);
+            if (g_upload_window < 1 || g_upload_window > HPMFWUPG_UPLOAD_WINDOW_MAX)
+            {
+                lprintf(LOG_NOTICE,"Upload window must be 1 to %d\n",
+                        HPMFWUPG_UPLOAD_WINDOW_MAX);
+                return  HPMFWUPG_ERROR;
+            }
+            g_upload_fast = TRUE;
+        }
      }
+      if (hostfile != NULL)
+      {
+        /* Upgrade each node in the -a file */
+        rc = hpm_rollout(argv[1],activateFlag,componentId,option);
+      }
+      else
+      {
       rc = HpmfwupgTargetCheck(intf,0);
       if (rc == HPMFWUPG_SUCCESS)
       {
         /* Call the Upgrade function to start the upgrade */
         rc = HpmfwupgUpgrade(intf, argv[1],activateFlag,componentId,option);
       }
+      }
    }
 
    else if ( (argc >= 1) && (strcmp(argv[0], "activate") == 0) )
@@ -3945,8 +4723,16 @@ main(int argc, char **argv)
 	printf("%s ver %s\n", progname,progver);
 	set_loglevel(LOG_NOTICE);
 
-        while ( (c = getopt( argc, argv,"m:z:T:V:J:EYF:P:N:R:U:Z:x?")) != EOF )
+        while ( (c = getopt( argc, argv,"a:c:j:k:m:r:t:z:T:V:J:EYF:P:N:R:U:Z:x?")) != EOF )
 	switch (c) {
+          case 'a': hostfile = optarg;  break;  /* rollout to these nodes */
+          case 'c': fleet_canary = atoi(optarg);  break; /* canary nodes */
+          case 'j': fleet_max = atoi(optarg);  break;  /* nodes at once */
+          case 'k': fleet_stop = atoi(optarg);  break;  /* stop after n failed */
+          case 'r': fleet_retry = atoi(optarg);  break; /* retries per node */
+          case 't': fleet_tmo = atoi(optarg);  /* time limit per node */
+		    if (fleet_tmo <= 0) fleet_tmo = 3600;
+		    break;
           case 'm': /* specific IPMB MC, 3-byte address, e.g. "409600" */
                     g_bus = htoi(&optarg[0]);  /*bus/channel*/
                     g_sa  = htoi(&optarg[2]);  /*device slave address*/
@@ -118,6 +118,7 @@
  * 11/15/07 Andy Cress v2.4  Move custom PEF to #14, add to usage,
  *                           Allow broadcast MAC for -X
  * 12/17/07 Andy Cress v2.5  Add fSetPEFOks & secondary Gateway
+ * 10/19/26 - read the displayed params in bulk with ipmi_cfg_read
  */
 /*M*
  *---------------------------------------------------------------------------
@@ -443,6 +444,8 @@ static ushort vlan_id = 0;	/*max 12 bits used */
 static uchar lan_access = 0x04;	/* -v usu 4=Admin, 3=Operator, 2=User */
 static uchar lan_user = 0x02;	/* -u if specified, default to user 2 */
 static uchar lan_ch_parm = PARM_INIT;	/* -L to set, unused if PARM_INIT */
+static IPMI_CFGSNAP cfgsnap = { 0, 0, NULL };	/* bulk read for display */
+static IPMI_CFGSNAP *psnap = NULL;	/* set while cfgsnap is valid */
 static uchar lan_ch = LAN_CH;	/* default=LAN_CH=1 */
 static uchar max_users = 5;	/* set in GetUser(1); */
 static uchar enabled_users = 0;	/* set in GetUser(1); */
@@ -689,8 +692,8 @@ GetChanAcc (uchar chan, uchar parm, LAN_RECORD * pLanRecord)
   inputData[0] = chan;
   inputData[1] = parm;		/* 0x80 = active, 0x40 = non-volatile */
   responseLength = sizeof (responseData);
-  status = ipmi_cmd (GET_CHANNEL_ACC, inputData, 2, responseData,
-		     &responseLength, &completionCode, fdebug);
+  status = ipmi_cmd_cfg (psnap, GET_CHANNEL_ACC, inputData, 2, responseData,
+			 &responseLength, &completionCode, fdebug);
 
   if (status == ACCESS_OK) {
     if (completionCode) {
@@ -1031,8 +1034,8 @@ GetUser (uchar user_num, uchar chan)
   inputData[0] = chan;		/*lan_ch */
   inputData[1] = user_num;	/* usually = 1 for BMC LAN */
   responseLength = sizeof (responseData);
-  status = ipmi_cmd (GET_USER_ACCESS, inputData, 2, responseData,
-		     &responseLength, &completionCode, fdebug);
+  status = ipmi_cmd_cfg (psnap, GET_USER_ACCESS, inputData, 2, responseData,
+			 &responseLength, &completionCode, fdebug);
   if (status == 0 && completionCode == 0) {
     uchar c;
     if (user_num == 1) {	/*get max_users and enabled_users */
@@ -1056,8 +1059,8 @@ GetUser (uchar user_num, uchar chan)
     c = responseData[3];
     inputData[0] = user_num;	/* usually = 1 for BMC LAN */
     responseLength = sizeof (responseData);
-    status = ipmi_cmd (GET_USER_NAME, inputData, 1, responseData,
-		       &responseLength, &completionCode, fdebug);
+    status = ipmi_cmd_cfg (psnap, GET_USER_NAME, inputData, 1, responseData,
+			   &responseLength, &completionCode, fdebug);
     if (status != 0 || completionCode != 0)
       responseData[0] = 0;
     if (c & 0x10)
@@ -1100,8 +1103,8 @@ GetSerEntry (uchar subfunc, LAN_RECORD * pLanRecord)
     inputData[3] = 1;
   }
 
-  status = ipmi_cmd (GET_SER_CONFIG, inputData, 4, responseData,
-		     &responseLength, &completionCode, fdebug);
+  status = ipmi_cmd_cfg (psnap, GET_SER_CONFIG, inputData, 4, responseData,
+			 &responseLength, &completionCode, fdebug);
 
   if (status == ACCESS_OK) {
     if (completionCode) {
@@ -1148,8 +1151,8 @@ GetLanEntry (uchar subfunc, uchar bset, LAN_RECORD * pLanRecord)
   inputData[2] = bset;		// Set selector 
   inputData[3] = 0;		// Block selector
 
-  status = ipmi_cmd (GET_LAN_CONFIG, inputData, 4, responseData,
-		     &responseLength, &completionCode, fdebug);
+  status = ipmi_cmd_cfg (psnap, GET_LAN_CONFIG, inputData, 4, responseData,
+			 &responseLength, &completionCode, fdebug);
 
   if (status == ACCESS_OK) {
     if (completionCode) {
@@ -1249,8 +1252,8 @@ GetPefEntry (uchar subfunc, ushort rec_id, PEF_RECORD * pPefRecord)
   inputData[1] = (uchar) rec_id;
   inputData[2] = 0;
 
-  status = ipmi_cmd (GET_PEF_CONFIG, inputData, 3, responseData,
-		     &responseLength, &completionCode, fdebug);
+  status = ipmi_cmd_cfg (psnap, GET_PEF_CONFIG, inputData, 3, responseData,
+			 &responseLength, &completionCode, fdebug);
 
   if (status == ACCESS_OK) {
     if (completionCode) {
@@ -4076,6 +4079,68 @@ PefDesc (int idx, uchar stype)
 }
 
 
+/*
+ * prefetch_lan
+ * Read the PEF, LAN, user and serial params that the display below will
+ * ask for in one pipelined batch.  Anything not read here, or that
+ * failed, is sent again by the Get functions.
+ */
+static void
+prefetch_lan (int ndest, int fpef)
+{
+  IPMI_CFGPARM *pp;
+  int idx, ival, i, nd;
+
+  if (!fIPMI10 && fpef) {
+    for (idx = 1; idx <= 4; idx++)
+      ipmi_cfg_add (&cfgsnap, CFG_PEF, 0, (uchar) idx, 0, 0);
+    for (idx = 1; idx <= pefmax; idx++)
+      ipmi_cfg_add (&cfgsnap, CFG_PEF, 0, 6, (uchar) idx, 0);
+    for (idx = 1; idx <= ndest; idx++)
+      ipmi_cfg_add (&cfgsnap, CFG_PEF, 0, 9, (uchar) idx, 0);
+  }
+  for (idx = 0; idx < NLAN; idx++) {
+    ival = lanparams[idx].cmd;
+    if (ival == 8 || ival == 9 || (ival >= 96 && ival <= 98))
+      continue;
+    if (ival >= 102 && ival <= 108 && !fipv6)
+      continue;
+    if (ival >= 20 && ival <= 25 && !fIPMI20)
+      continue;
+    if (ival == 18 || ival == 19 || ival >= 192)
+      continue;
+    ipmi_cfg_add (&cfgsnap, CFG_LAN, lan_ch, (uchar) ival, 0, 0);
+  }
+  ipmi_cfg_add (&cfgsnap, CFG_CHANACC, lan_ch, 0x40, 0, 0);
+  for (i = 1; i <= show_users; i++) {
+    ipmi_cfg_add (&cfgsnap, CFG_USERACC, lan_ch, (uchar) i, 0, 0);
+    ipmi_cfg_add (&cfgsnap, CFG_USERNAME, 0, (uchar) i, 0, 0);
+  }
+  if (fgetser && !fmBMC) {
+    for (idx = 0; idx < NSER; idx++) {
+      ival = serparams[idx].cmd;
+      if (ival == 201)
+	ipmi_cfg_add (&cfgsnap, CFG_CHANACC, ser_ch, 0x40, 0, 0);
+      else
+	ipmi_cfg_add (&cfgsnap, CFG_SER, ser_ch, (uchar) ival, 0,
+		      (uchar) (ival == 10 ? 1 : 0));
+    }
+  }
+  ipmi_cfg_read (&cfgsnap, fdebug);
+
+  /* second pass: the alert destinations, from num dest (param 17) */
+  pp = ipmi_cfg_find (&cfgsnap, CFG_LAN, lan_ch, 17, 0, 0);
+  if (pp != NULL && pp->rv == 0 && pp->cc == 0 && pp->len >= 2) {
+    nd = pp->data[1];
+    for (i = 1; i <= nd && i < 16; i++) {
+      ipmi_cfg_add (&cfgsnap, CFG_LAN, lan_ch, 18, (uchar) i, 0);
+      ipmi_cfg_add (&cfgsnap, CFG_LAN, lan_ch, 19, (uchar) i, 0);
+    }
+    ipmi_cfg_read (&cfgsnap, fdebug);
+  }
+  psnap = &cfgsnap;
+}
+
 #ifdef METACOMMAND
 int i_lan(int argc, char **argv)
 #else
@@ -4098,6 +4163,7 @@ main(int argc, char **argv)
   int idest;
   char mystr[80];
   char fpefok = 1;
+  char fpefcap;
   uchar *pc;
   int sz;
   char *pa;
@@ -4569,6 +4635,7 @@ main(int argc, char **argv)
   }
 
   ret = GetPefCapabilities (&bset);
+  fpefcap = (ret == 0);
   if ((ret == 0) && (bset <= MAXPEF))
     pefmax = bset;
 
@@ -4677,6 +4744,8 @@ main(int argc, char **argv)
       goto do_exit;
     }
   }
+  if (freadonly)		/* display only, so read it all in bulk */
+    prefetch_lan (ndest, fpefcap);
 
   if (!fIPMI10) {
     if (fcanonical) {		/* canonical/simple output */
@@ -6004,6 +6073,8 @@ main(int argc, char **argv)
   }
 
 do_exit:
+  psnap = NULL;
+  ipmi_cfg_free (&cfgsnap);
   ipmi_close_ ();
   if (foptmsg) {
     if (fset_ip != 0)
@@ -31,6 +31,8 @@
 //  07/15/05 ARC - test for ldipmi first, since it hangs KCS if another 
 //                 driver tries to coexist.
 //  07/06/06 ARC - better separate driver implementations, cleaner now
+//  10/19/26 - added ipmi_cmd_batch for a batch of independent commands
+//  10/19/26 - added ipmi_cfg_* bulk config parameter snapshot
  *M*/
 /*----------------------------------------------------------------------*
 The BSD License 
@@ -206,6 +208,7 @@ extern int ipmi_cmd_mv(ushort cmd, uchar *pdata, int sdata, uchar *presp,
 			int *sresp, uchar *pcc, char fdebugcmd);
 extern int ipmi_open_mv(char fdebug);
 extern int ipmi_close_mv(void);
+extern int ipmi_batch_mv(IPMI_BATCH *pb, int n, char fdebugcmd);
 extern int ipmi_open_ld(char fdebug);
 extern int ipmi_close_ld(void);
 extern int ipmi_cmdraw_ld(uchar cmd, uchar netfn, uchar lun, uchar sa, 
@@ -247,6 +250,7 @@ extern int ipmi_cmd_mv(ushort cmd, uchar *pdata, int sdata, uchar *presp,
 			int *sresp, uchar *pcc, char fdebugcmd);
 extern int ipmi_open_mv(char fdebug);
 extern int ipmi_close_mv(void);
+extern int ipmi_batch_mv(IPMI_BATCH *pb, int n, char fdebugcmd);
 #endif
 extern int fd_wait(int fd, int nsec, int usec);
 #endif
@@ -941,6 +945,239 @@ int ipmi_cmdraw(uchar cmd, uchar netfn, uchar sa, uchar bus, uchar lun,
     return(rc);
 }
 
+/* 
+ * ipmi_cmd_batch()
+ * Sends a batch of independent commands.  With the OpenIPMI driver and
+ * with IPMI LAN 1.5 the requests are pipelined and matched by sequence,
+ * with other drivers each one is sent by ipmi_cmdraw in turn.
+ */
+int ipmi_cmd_batch(IPMI_BATCH *pb, int n, char fdebugcmd)
+{
+    int rc = 0;
+    int i;
+
+    fperr = stderr;
+    fpdbg = stdout;
+
+    if (n <= 0) return(0);
+    for (i = 0; i < n; i++) {
+	if (pb[i].sdata > 255) return(LAN_ERR_BADLENGTH);
+	pb[i].cc = 0;
+	pb[i].rv = 0;
+    }
+    if (fDriverTyp == DRV_UNKNOWN) {   /*first time, so find which one */
+        rc = ipmi_open(fdebugcmd);
+	if (fdebugcmd) 
+		fprintf(fpdbg,"Driver type %s, open rc = %d\n",
+			show_driver_type(fDriverTyp),rc);
+        if (rc == ERR_NO_DRV && !fipmi_lan) fprintf(fperr, "%s", msg_no_drv);
+        else if (rc != 0) fprintf(fperr,"ipmi_open error = %d %s\n", rc,decode_rv(rc));
+	if (rc != 0) return(rc);
+    }  /*endif first time*/
+
+#ifndef EFI
+    switch (fDriverTyp)
+    {
+#if defined(LINUX) || defined(BSD) || defined(MACOS) || defined(HPUX)
+	case DRV_MV: 
+	   rc = ipmi_batch_mv(pb, n, fdebugcmd);
+	   break;
+#endif
+	case DRV_LAN: 
+	   rc = ipmi_batch_lan(gnode, pb, n, fdebugcmd);
+	   break;
+	default:    /* one at a time */
+	   for (i = 0; i < n; i++) 
+	      pb[i].rv = ipmi_cmdraw(pb[i].cmd, pb[i].netfn, pb[i].sa, 
+				pb[i].bus, pb[i].lun, pb[i].pdata, pb[i].sdata,
+				pb[i].presp, &pb[i].sresp, &pb[i].cc, fdebugcmd);
+	   return(0);
+    }  /*end switch*/
+    if (rc == 0 && fdebugcmd) {
+       for (i = 0; i < n; i++) 
+          if (pb[i].rv == 0 && pb[i].cc != 0) {
+	     ushort icmd = (pb[i].cmd & 0x00ff) | (pb[i].netfn << 8);
+             fprintf(fpdbg,"ccode %x: %s\n",pb[i].cc,
+			decode_cc(icmd,(int)pb[i].cc));
+	  }
+    }
+#else
+    for (i = 0; i < n; i++) 
+       pb[i].rv = ipmi_cmdraw(pb[i].cmd, pb[i].netfn, pb[i].sa, 
+				pb[i].bus, pb[i].lun, pb[i].pdata, pb[i].sdata,
+				pb[i].presp, &pb[i].sresp, &pb[i].cc, fdebugcmd);
+#endif
+    return(rc);
+}
+
+/* 
+ * ipmi_cfg_*() 
+ * Bulk readout of configuration parameters into an IPMI_CFGSNAP.
+ * The Get requests are queued with ipmi_cfg_add, sent as one 
+ * ipmi_cmd_batch by ipmi_cfg_read, and then looked up by ipmi_cmd_cfg
+ * in place of ipmi_cmd.
+ */
+static ushort cfg_icmd[7] = { 0, GET_LAN_CONFIG, GET_SER_CONFIG, 
+	GET_PEF_CONFIG, GET_USER_ACCESS, GET_USER_NAME, GET_CHANNEL_ACC };
+
+static int cfg_req(IPMI_CFGPARM *pp, uchar *preq)
+{   /* build the request data for this param, returns its length */
+    switch(pp->kind) {
+	case CFG_LAN:
+	case CFG_SER:
+	   preq[0] = pp->chan; preq[1] = pp->parm; 
+	   preq[2] = pp->set;  preq[3] = pp->blk;
+	   return(4);
+	case CFG_PEF:
+	   preq[0] = pp->parm; preq[1] = pp->set; preq[2] = pp->blk;
+	   return(3);
+	case CFG_USERACC:
+	case CFG_CHANACC:
+	   preq[0] = pp->chan; preq[1] = pp->parm;
+	   return(2);
+	case CFG_USERNAME:
+	   preq[0] = pp->parm;
+	   return(1);
+	default: 
+	   return(0);
+    }
+}
+
+int ipmi_cfg_add(IPMI_CFGSNAP *ps, uchar kind, uchar chan, uchar parm,
+		uchar set, uchar blk)
+{
+    IPMI_CFGPARM *pp;
+
+    if (ps == NULL || kind == 0 || kind > CFG_CHANACC) return(LAN_ERR_INVPARAM);
+    if (ipmi_cfg_find(ps,kind,chan,parm,set,blk) != NULL) return(ps->n);
+    if (ps->n >= ps->max) {
+	pp = (IPMI_CFGPARM *)realloc(ps->p,(ps->max + 64)*sizeof(IPMI_CFGPARM));
+	if (pp == NULL) return(LAN_ERR_OTHER);
+	ps->p = pp;
+	ps->max += 64;
+    }
+    pp = &ps->p[ps->n];
+    memset(pp,0,sizeof(IPMI_CFGPARM));
+    pp->kind = kind;
+    pp->chan = chan;
+    pp->parm = parm;
+    pp->set  = set;
+    pp->blk  = blk;
+    pp->rv   = 1;   /*not read yet*/
+    return(ps->n++);
+}
+
+int ipmi_cfg_read(IPMI_CFGSNAP *ps, char fdebugcmd)
+{
+    IPMI_BATCH *pb;
+    uchar *preq;
+    int *pidx;
+    int i, n, rv;
+    IPMI_CFGPARM *pp;
+
+    if (ps == NULL) return(LAN_ERR_INVPARAM);
+    for (n = 0, i = 0; i < ps->n; i++) 
+	if (ps->p[i].rv == 1) n++;
+    if (n == 0) return(0);
+    pb   = (IPMI_BATCH *)malloc(n * sizeof(IPMI_BATCH));
+    preq = (uchar *)malloc(n * 4);
+    pidx = (int *)malloc(n * sizeof(int));
+    if (pb == NULL || preq == NULL || pidx == NULL) {
+	if (pb != NULL) free(pb);
+	if (preq != NULL) free(preq);
+	if (pidx != NULL) free(pidx);
+	return(LAN_ERR_OTHER);
+    }
+    for (n = 0, i = 0; i < ps->n; i++) {
+	pp = &ps->p[i];
+	if (pp->rv != 1) continue;
+	pb[n].cmd   = (uchar)(cfg_icmd[pp->kind] & CMDMASK);
+	pb[n].netfn = (uchar)(cfg_icmd[pp->kind] >> 8);
+	pb[n].sa    = BMC_SA;
+	pb[n].bus   = PUBLIC_BUS;
+	pb[n].lun   = BMC_LUN;
+	pb[n].pdata = &preq[n*4];
+	pb[n].sdata = cfg_req(pp,pb[n].pdata);
+	pb[n].presp = pp->data;
+	pb[n].sresp = sizeof(pp->data);
+	pidx[n] = i;
+	n++;
+    }
+    rv = ipmi_cmd_batch(pb, n, fdebugcmd);
+    for (i = 0; i < n; i++) {
+	pp = &ps->p[pidx[i]];
+	if (rv != 0) { pp->rv = 1; continue; }  /*leave it for ipmi_cmd*/
+	pp->rv = (short)pb[i].rv;
+	pp->cc = pb[i].cc;
+	pp->len = (pb[i].rv == 0) ? (uchar)pb[i].sresp : 0;
+	if (pp->rv == 1) pp->rv = LAN_ERR_OTHER;
+    }
+    if (fdebugcmd) printf("ipmi_cfg_read: %d params, rv = %d\n",n,rv);
+    free(pidx);
+    free(preq);
+    free(pb);
+    return(rv);
+}
+
+IPMI_CFGPARM *ipmi_cfg_find(IPMI_CFGSNAP *ps, uchar kind, uchar chan, 
+		uchar parm, uchar set, uchar blk)
+{
+    IPMI_CFGPARM *pp;
+    int i;
+
+    if (ps == NULL) return(NULL);
+    for (i = 0; i < ps->n; i++) {
+	pp = &ps->p[i];
+	if (pp->kind == kind && pp->chan == chan && pp->parm == parm &&
+	    pp->set == set && pp->blk == blk) return(pp);
+    }
+    return(NULL);
+}
+
+int ipmi_cmd_cfg(IPMI_CFGSNAP *ps, ushort icmd, uchar *pdata, int sdata, 
+		uchar *presp, int *sresp, uchar *pcc, char fdebugcmd)
+{
+    IPMI_CFGPARM *pp = NULL;
+    uchar kind;
+
+    for (kind = CFG_LAN; kind <= CFG_CHANACC; kind++) 
+	if (cfg_icmd[kind] == icmd) break;
+    if ((ps != NULL) && (kind <= CFG_CHANACC) && (pdata != NULL)) {
+	switch(kind) {
+	   case CFG_LAN:
+	   case CFG_SER:
+	      if (sdata >= 4) 
+		 pp = ipmi_cfg_find(ps,kind,pdata[0],pdata[1],pdata[2],pdata[3]);
+	      break;
+	   case CFG_PEF:
+	      if (sdata >= 3) 
+		 pp = ipmi_cfg_find(ps,kind,0,pdata[0],pdata[1],pdata[2]);
+	      break;
+	   case CFG_USERNAME:
+	      if (sdata >= 1) pp = ipmi_cfg_find(ps,kind,0,pdata[0],0,0);
+	      break;
+	   default:
+	      if (sdata >= 2) pp = ipmi_cfg_find(ps,kind,pdata[0],pdata[1],0,0);
+	      break;
+	}
+    }
+    if ((pp == NULL) || (pp->rv == 1) || (pp->rv < 0) || (*sresp < pp->len))
+	return(ipmi_cmd(icmd, pdata, sdata, presp, sresp, pcc, fdebugcmd));
+    memcpy(presp,pp->data,pp->len);
+    *sresp = pp->len;
+    *pcc = pp->cc;
+    return(pp->rv);
+}
+
+void ipmi_cfg_free(IPMI_CFGSNAP *ps)
+{
+    if (ps == NULL) return;
+    if (ps->p != NULL) free(ps->p);
+    ps->p = NULL;
+    ps->n = 0;
+    ps->max = 0;
+}
+
 /* 
  * ipmi_cmd_mc()
  * This uses the mc pointer to route commands via either the SMI or
@@ -412,6 +412,82 @@ int ipmi_cmd(ushort cmd, uchar *pdata,  int sdata, uchar *presp,
 int ipmi_cmdraw(uchar cmd, uchar netfn, uchar sa, uchar bus, uchar lun,
 		uchar *pdata, int sdata, uchar *presp,
 		int *sresp, uchar *pcc, char fdebugcmd);
+/*
+ * IPMI_BATCH
+ * One request/response in a batch for ipmi_cmd_batch.  The fields are
+ * the same as the ipmi_cmdraw parameters, with rv for its return value.
+ */
+typedef struct {
+	uchar cmd;      /* (input): IPMI Command */
+	uchar netfn;    /* (input): IPMI NetFunction */
+	uchar sa;       /* (input): IPMI Slave Address of the MC */
+	uchar bus;      /* (input): BUS of the MC */
+	uchar lun;      /* (input): IPMI LUN */
+	uchar *pdata;   /* (input): pointer to ipmi data */
+	int   sdata;    /* (input): size of ipmi data */
+	uchar *presp;   /* (output): pointer to response data buffer */
+	int   sresp;    /* (input/output): size of buffer, then length of data*/
+	uchar cc;       /* (output): completion code */
+	int   rv;       /* (output): 0 if successful, <0 if error */
+} IPMI_BATCH;
+/*
+ * ipmi_cmd_batch
+ * Sends a batch of independent commands, and returns when all of them
+ * have completed.  The requests are pipelined with the OpenIPMI driver
+ * and with IPMI LAN 1.5, other drivers send them one at a time.
+ * Events that the OpenIPMI driver delivers during a batch are kept
+ * (up to 16) and returned by the next getevent_mv.
+ * IPMI_BATCH *pb (input/output): array of requests
+ * int n          (input): number of requests in the array
+ * char fdebugcmd (input): flag =1 if debug output desired
+ * returns 0 if the batch was sent, <0 if error; check pb[i].rv and
+ * pb[i].cc for the result of each request.
+ */
+int ipmi_cmd_batch(IPMI_BATCH *pb, int n, char fdebugcmd);
+/*
+ * IPMI_CFGSNAP
+ * Snapshot of configuration parameters, read in bulk with ipmi_cfg_read.
+ * Each IPMI_CFGPARM is one Get LAN/Serial/PEF Config, User Access, 
+ * User Name, or Channel Access request, and its saved response.
+ */
+#define CFG_LAN       1   /* Get LAN Config:    chan, parm, set, blk */
+#define CFG_SER       2   /* Get Serial Config: chan, parm, set, blk */
+#define CFG_PEF       3   /* Get PEF Config:    parm, set, blk */
+#define CFG_USERACC   4   /* Get User Access:   chan, user (parm) */
+#define CFG_USERNAME  5   /* Get User Name:     user (parm) */
+#define CFG_CHANACC   6   /* Get Channel Access: chan, 0x40/0x80 (parm) */
+typedef struct {
+	uchar kind;     /* CFG_LAN, etc. */
+	uchar chan;
+	uchar parm;
+	uchar set;
+	uchar blk;
+	uchar cc;       /* completion code */
+	short rv;       /* ipmi_cmd return value, 1 if not read yet */
+	uchar len;      /* response length, incl revision byte */
+	uchar data[72]; /* response data, after the completion code */
+} IPMI_CFGPARM;
+typedef struct {
+	int n;          /* number of params in p */
+	int max;        /* number allocated */
+	IPMI_CFGPARM *p;
+} IPMI_CFGSNAP;
+/* ipmi_cfg_add: queue a param to be read, returns its index or <0 */
+int ipmi_cfg_add(IPMI_CFGSNAP *ps, uchar kind, uchar chan, uchar parm,
+		uchar set, uchar blk);
+/* ipmi_cfg_read: reads all queued params that were not read yet */
+int ipmi_cfg_read(IPMI_CFGSNAP *ps, char fdebugcmd);
+/* ipmi_cfg_find: returns the saved param, or NULL if it was not read */
+IPMI_CFGPARM *ipmi_cfg_find(IPMI_CFGSNAP *ps, uchar kind, uchar chan, 
+		uchar parm, uchar set, uchar blk);
+/*
+ * ipmi_cmd_cfg
+ * Same as ipmi_cmd, but answers from the snapshot if this request has
+ * been read already.  ps may be NULL, which always calls ipmi_cmd.
+ */
+int ipmi_cmd_cfg(IPMI_CFGSNAP *ps, ushort icmd, uchar *pdata, int sdata, 
+		uchar *presp, int *sresp, uchar *pcc, char fdebugcmd);
+void ipmi_cfg_free(IPMI_CFGSNAP *ps);
 /*
  * ipmi_close_
  * Called to close an IPMI session.
@@ -547,6 +623,8 @@ char * strdup_(const char *instr);  /*wrapper for strdup, supports WIN32*/
 int   strlen_(const char *s);
 uchar  htoi(char *inhex);
 void  os_usleep(int s, int u);  
+ulong os_msec(void);   /*millisecond clock for intervals, subs.c*/
+double os_mono(void);  /*monotonic msec clock, sub-msec resolution, subs.c*/
 char *get_iana_str(int mfg);   /*subs.c*/
 int   get_errno(void);   /*subs.c*/
 const char * buf2str(uchar * buf, int len); /*subs.c*/
@@ -556,6 +634,23 @@ void  atoip(uchar *array,char *instr);
 int   get_system_info(uchar parm, char *pbuf, int *szbuf); /*subs.c*/
 int   set_system_info(uchar parm, char *pbuf, int szbuf); /*subs.c*/
 int   ipmi_reserved_user(int vend, int userid);  /*subs.c*/
+int   cursor_open(char *jfile, int nbatch);  /*SEL cursor journal, subs.c*/
+int   cursor_get(char *key, ushort *precid, uint *ptime);
+int   cursor_put(char *key, ushort recid, uint itime);
+void  cursor_sync(void);
+void  cursor_close(void);
+int   evsink_open(char *tag, char *dest, int qsize);  /*event sink, subs.c*/
+int   evsink_put(char *msg);
+void  evsink_stats(ulong *nput, ulong *ndrop, ulong *nbp, int *maxdepth);
+void  evsink_close(void);
+int   read_nodes(char *fname, int (*addnode)(char *node)); /*fleet modes, subs.c*/
+int   node_fork(char *node, int flags, int *pfd);
+int   node_reap(int pid, int fd, char fkill);
+#define NODE_STDIN    0x01  /*node_fork: child stdin from the socketpair*/
+#define NODE_STDOUT   0x02  /*child stdout to the pipe*/
+#define NODE_STDERR   0x04  /*child stderr to the pipe*/
+#define NODE_NULLIN   0x08  /*child stdin from /dev/null*/
+#define NODE_NULLOUT  0x10  /*child stdout and stderr to /dev/null*/
 	
 /* from mem_if.c */
 int get_BiosVersion(char *str);
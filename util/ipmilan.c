@@ -18,6 +18,7 @@
 //                     not working yet.
 //  08/21/07 ARCress - handle Dell 1855 blades that return different authcode
 //  04/17/08 ARCress - check FD_ISSET in fd_wait
+//  10/19/26 - added ipmi_batch_lan to pipeline commands by rqSeq
  *M*/
 /*----------------------------------------------------------------------*
 The BSD License 
@@ -270,6 +271,11 @@ int ipmicmd_lan(char *node, uchar cmd, uchar netfn, uchar lun, uchar sa,
    printf("IPMI LAN is not supported under DOS.\n");
    return(-1);
 }
+int ipmi_batch_lan(char *node, IPMI_BATCH *pb, int n, char fdebugcmd)
+{
+   printf("IPMI LAN is not supported under DOS.\n");
+   return(-1);
+}
 #else
 /* All other OSs can support IPMI LAN */
 
@@ -2002,6 +2008,212 @@ int ipmi_cmdraw_lan(char *node, uchar cmd, uchar netfn, uchar lun, uchar sa,
    return (rc);
 }
 
+#define LAN_BATCH_WINDOW  4   /*max requests outstanding in ipmi_batch_lan*/
+
+/* 
+ * _batch_lan_send
+ * Builds and sends one non-bridged request in the current session, 
+ * using the next session seq_num and rqSeq, and returns the rqSeq in pseq.
+ * This is the normal IPMI packet case from _send_lan_cmd.
+ */
+static int _batch_lan_send(IPMI_BATCH *pb, uchar *pseq)
+{
+    uchar cbuf[SEND_BUF_SZ];
+    uchar iauth[16];
+    IPMI_HDR *phdr;
+    uchar *pdata;
+    int hlen, msglen, clen, sz, j;
+    int fdoauth = 1;
+
+    phdr = &ipmi_hdr;
+    if (phdr->auth_type == IPMI_SESSION_AUTHTYPE_NONE) fdoauth = 0; 
+    else if (pconn->fMsgAuth == 0 && !fauth_type_set) fdoauth = 0;
+    hlen = RQ_HDR_LEN;
+    if (fdoauth == 0) hlen = RQ_HDR_LEN - 16;
+    msglen = 7 + pb->sdata;
+    clen = hlen + msglen;
+    if (clen > sizeof(cbuf) - 1) return(LAN_ERR_TOO_SHORT);
+
+    pdata = &cbuf[hlen];
+    j = 0;
+    pdata[j++] = pb->sa;                          /*[0]=sa*/
+    pdata[j++] = (pb->netfn << 2) + (pb->lun & 0x03); /*[1]=netfn/lun*/
+    pdata[j] = cksum(&pdata[0],j);                /*[2]=cksum1*/
+    j++;
+    pdata[j++] = phdr->swid;                      /*[3]=swid*/
+    pdata[j++] = (phdr->swseq << 2) + phdr->swlun; /*[4]=swseq/lun*/
+    pdata[j++] = pb->cmd;                         /*[5]=cmd*/
+    if (pb->sdata > 0) {
+       memcpy(&pdata[j],pb->pdata,pb->sdata);     /*[6]=data*/
+       j += pb->sdata;
+    }
+    pdata[j] = cksum(&pdata[3],j-3);              /*cksum2*/
+    j++;
+    if (fdoauth) {
+       do_hash(phdr->password, (uchar *)&phdr->sess_id, &cbuf[hlen],msglen, 
+	       phdr->seq_num, phdr->auth_type, iauth);
+       memcpy(phdr->auth_code,iauth,16);
+    }
+    memcpy(&cbuf[0], phdr, hlen);   /* copy header to buffer */
+    if (fdoauth == 0 && phdr->auth_type != IPMI_SESSION_AUTHTYPE_NONE) 
+        ((IPMI_HDR *)&cbuf[0])->auth_type = IPMI_SESSION_AUTHTYPE_NONE;
+    cbuf[hlen-1] = (uchar)msglen;     /* IPMI Message Length = 7 + data */
+
+    *pseq = (phdr->swseq & 0x3f);
+    if (fdebuglan) 
+       fprintf(fpdbg,"ipmi_batch_lan: send cmd=%02x seq=%x rqseq=%x\n",
+		pb->cmd, phdr->seq_num, *pseq);
+    sz = ipmilan_sendto(pconn->sockfd,cbuf,clen,0,
+			(struct sockaddr *)&_destaddr,_destaddr_len);
+    /* increment seqnum - even if error */
+    phdr->seq_num = inc_seq_num( phdr->seq_num );
+    phdr->swseq = (uchar)inc_seq_num(phdr->swseq); 
+    if (sz < 1) {
+       lasterr = get_LastError();
+       if (fdebuglan) show_LastError("ipmilan_sendto",lasterr);
+       return(LAN_ERR_SEND_FAIL); 
+    }
+    return(0);
+}
+
+/* 
+ * ipmi_batch_lan
+ * Pipelines a batch of commands in the open IPMI LAN session.
+ * Up to LAN_BATCH_WINDOW requests are outstanding, each with its own
+ * session seq_num and rqSeq, and each response is matched by rqSeq and cmd.
+ * If a response times out, the outstanding requests are sent again,
+ * and the window drops to one.  Bridged and SOL commands, or any command 
+ * before the session is active, go one at a time via ipmicmd_lan.
+ * Called from ipmi_cmd_batch in ipmicmd.c
+ */
+int ipmi_batch_lan(char *node, IPMI_BATCH *pb, int n, char fdebugcmd)
+{
+   uchar rbuf[RECV_BUF_SZ];
+   int   pend[LAN_BATCH_WINDOW];   /*index of each outstanding request*/
+   int   ptry[LAN_BATCH_WINDOW];
+   uchar pseq[LAN_BATCH_WINDOW];
+   uchar *ppipe;
+   int   npend, window, next;
+   int   rv, rlen, hlen, tolen, i, j, k;
+   uchar seq;
+
+#ifndef TEST_LAN
+   fdebuglan = fdebugcmd;
+#endif
+   if (nodeislocal(node)) return(LAN_ERR_INVPARAM);
+   if (pconn->sockfd == 0) {  /* closed, do re-open */
+      rv = ipmi_open_lan(lanp.node, lanp.port, lanp.user, lanp.pswd, fdebugcmd);
+      if (rv != 0) return(rv);
+   }
+   ppipe = malloc(n);
+   if (ppipe == NULL) return(LAN_ERR_OTHER);
+   /* first send the ones that cannot be pipelined, one at a time */
+   for (i = 0; i < n; i++) {
+      ppipe[i] = 1;
+      if (!pconn->finsession) ppipe[i] = 0;
+      else if (bridgePossible && (pb[i].sa != ipmi_hdr.bmc_addr) &&
+	       (pb[i].sa != SWID_REMOTE) && (pb[i].sa != SWID_SMSOS))
+	 ppipe[i] = 0;
+      else if ((pb[i].cmd == SOL_DATA) && (pb[i].netfn == NETFN_SOL)) 
+	 ppipe[i] = 0;
+      if (ppipe[i] == 0) 
+	 pb[i].rv = ipmicmd_lan(node, pb[i].cmd, pb[i].netfn, pb[i].lun, 
+			pb[i].sa, pb[i].bus, pb[i].pdata, pb[i].sdata, 
+			pb[i].presp, &pb[i].sresp, &pb[i].cc, fdebugcmd);
+      else if (pb[i].sdata > RQ_LEN_MAX) {
+	 pb[i].rv = LAN_ERR_BADLENGTH;
+	 ppipe[i] = 0;
+      }
+   }
+
+   window = LAN_BATCH_WINDOW;
+   npend = 0;
+   next = 0;
+   while (next < n || npend > 0) 
+   {
+      /* fill the window */
+      while ((npend < window) && (next < n)) {
+	 i = next++;
+	 if (ppipe[i] == 0) continue;
+	 pb[i].rv = _batch_lan_send(&pb[i],&seq);
+	 if (pb[i].rv != 0) continue;
+	 pend[npend] = i;
+	 pseq[npend] = seq;
+	 ptry[npend] = 1;
+	 npend++;
+      }
+      if (npend == 0) continue;
+
+      rv = fd_wait(pconn->sockfd, ipmi_timeout,0);
+      if (rv != 0) {   /*timeout, resend what is still outstanding*/
+	 if (fdebuglan) 
+	    fprintf(fpdbg,"ipmi_batch_lan timeout, %d pending\n",npend);
+	 window = 1;
+	 for (k = 0; k < npend; ) {
+	    i = pend[k];
+	    if (ptry[k] < ipmi_try) 
+	       pb[i].rv = _batch_lan_send(&pb[i],&pseq[k]);
+	    else pb[i].rv = LAN_ERR_RECV_FAIL;
+	    if (pb[i].rv != 0) {  /*give up on this one*/
+	       npend--;
+	       pend[k] = pend[npend]; 
+	       pseq[k] = pseq[npend];
+	       ptry[k] = ptry[npend];
+	       continue;
+	    }
+	    ptry[k]++;
+	    k++;
+	 }
+	 continue;
+      }
+      tolen = _destaddr_len;
+      rlen = ipmilan_recvfrom(pconn->sockfd,rbuf,sizeof(rbuf),RECV_MSG_FLAGS,
+				(struct sockaddr *)&_destaddr,&tolen);
+      if (rlen < 0) {
+	 lasterr = get_LastError();
+	 if (fdebuglan) show_LastError("ipmilan_recvfrom",lasterr);
+	 if ((lasterr == econnrefused) || (lasterr == econnreset)) continue;
+	 for (k = 0; k < npend; k++) pb[pend[k]].rv = LAN_ERR_RECV_FAIL;
+	 for ( ; next < n; next++) 
+	    if (ppipe[next]) pb[next].rv = LAN_ERR_RECV_FAIL;
+	 break;
+      }
+      if (rbuf[4] == IPMI_SESSION_AUTHTYPE_NONE) {  /* if AUTH_NONE */
+	 ipmi_hdr.auth_type = IPMI_SESSION_AUTHTYPE_NONE;
+	 hlen = RQ_HDR_LEN - 16;  /*RMCP header + 10*/
+      } else hlen = RQ_HDR_LEN;   /*RMCP header + 26 */
+      if (rlen <= hlen + 6) continue;   /*too short, ignore it*/
+      seq = (rbuf[hlen+4] >> 2);
+      for (k = 0; k < npend; k++) 
+	 if ((pseq[k] == seq) && (pb[pend[k]].cmd == rbuf[hlen+5])) break;
+      if (k >= npend) {  /*late reply to an earlier try, ignore it*/
+	 if (fdebuglan) 
+	    fprintf(fpdbg,"ipmi_batch_lan: stale reply cmd=%02x rqseq=%x\n",
+		    rbuf[hlen+5],seq);
+	 continue;
+      }
+      net2h(&ipmi_hdr.iseq_num,&rbuf[5],4);  /*incoming seq_num from hdr*/
+      pconn->in_seq = ipmi_hdr.iseq_num;
+      i = pend[k];
+      pb[i].cc = rbuf[hlen+6];
+      j = rlen - (hlen + 7) - 1;   /*data, less the cc and cksum*/
+      if (j < 0 || pb[i].cc != 0) j = 0;
+      if (j > pb[i].sresp) j = pb[i].sresp;
+      if (j > 0) memcpy(pb[i].presp,&rbuf[hlen+7],j);
+      pb[i].sresp = j;
+      pb[i].rv = 0;
+      if (fdebuglan) 
+	 fprintf(fpdbg,"ipmi_batch_lan: recv cmd=%02x rqseq=%x cc=%x len=%d\n",
+		 pb[i].cmd, seq, pb[i].cc, j);
+      npend--;
+      pend[k] = pend[npend]; 
+      pseq[k] = pseq[npend];
+      ptry[k] = ptry[npend];
+   }  /*end while*/
+   free(ppipe);
+   return(0);
+}  /*end ipmi_batch_lan()*/
+
 
 SockType  lan_get_fd(void)
 {
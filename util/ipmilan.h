@@ -79,6 +79,7 @@ int ipmi_cmdraw_lan(char *node, uchar cmd, uchar netfn, uchar lun, uchar sa,
 int ipmicmd_lan(char *node, uchar cmd, uchar netfn, uchar lun, uchar sa, 
 		uchar bus, uchar *pdata, int sdata, uchar *presp, int *sresp, 
 		uchar *pcc, char fdebugcmd);
+int ipmi_batch_lan(char *node, IPMI_BATCH *pb, int n, char fdebugcmd);
 int ipmi_cmd_ipmb(uchar cmd, uchar netfn, uchar sa, uchar bus, uchar lun,
                 uchar *pdata, int sdata, uchar *presp,
                 int *sresp, uchar *pcc, char fdebugcmd);
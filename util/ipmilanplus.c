@@ -72,6 +72,8 @@ void lan2_set_sol_data(int insize, int outsize, int port, void *handler,
 { return; }
 SockType lan2_get_fd(void) { return(1); }
 void lanplus_set_recvdelay( int delay ) { return; }
+void lanplus_set_sol_ackdefer( int on ) { return; }
+void lanplus_get_sol_stats( unsigned long *stats, int n ) { return; }
 long lan2_get_latency( void ) { return(1); }
 int lan2_send_break( void *rsp) { return(LAN_ERR_INVPARAM); }
 int lan2_send_ctlaltdel( void *rsp) { return(LAN_ERR_INVPARAM); }
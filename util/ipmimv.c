@@ -20,6 +20,7 @@
 //  08/10/04 ARC - handle alternate device filenames for some 2.6 kernels
 //  03/01/05 ARC - fix /dev/ipmi0 IPMB requests (to other than BMC_SA)
 //  04/12/07 ARC - check for IPMI_ASYNC_EVENT_RECV_TYPE in ipmicmd_mv
+//  10/19/26 - added ipmi_batch_mv to pipeline a batch of commands
  *M*/
 /*----------------------------------------------------------------------*
 The BSD License 
@@ -226,6 +227,19 @@ static int curr_seq = 0;
 static int fdebugmv = 0;
 static struct ipmi_addr rsp_addr;  /*used in getevent_mv, ipmi_rsp_mv*/
 static int rsp_addrlen = 0;        /*used in getevent_mv, ipmi_rsp_mv*/
+#define MV_EVQ_SZ  16   /*events and requests received during a batch*/
+typedef struct {
+    int    recv_type;
+    uchar  netfn;
+    uchar  cmd;
+    uchar  cc;
+    int    len;
+    uchar  data[36];
+    struct ipmi_addr addr;
+    int    addr_len;
+} MV_EVQ;
+static MV_EVQ mv_evq[MV_EVQ_SZ];  /*for getevent_mv, from ipmi_batch_mv*/
+static int mv_nevq = 0;
 
 void ipmi_get_mymc(uchar *bus, uchar *sa, uchar *lun, uchar *type);
 
@@ -309,6 +323,12 @@ int ipmi_open_mv(char fdebugcmd)
     return(0);
 }
 
+/* get_fd_mv - returns the open driver fd, for poll/epoll, or -1 */
+int get_fd_mv(void)
+{
+    return(ipmi_fd);
+}
+
 int ipmi_close_mv(void)
 {
     int rc = 0;
@@ -609,6 +629,124 @@ int ipmi_cmd_mv(ushort cmd, uchar *pdata, int sdata, uchar *presp,
 
     return(rc);
 }  /*end ipmi_cmd_mv*/
+
+/*
+ * ipmi_batch_mv
+ * Sends all of the requests in the batch to the driver first, then
+ * receives the responses, matched by msgid, so the driver can queue 
+ * the next request to the BMC without waiting for the application.
+ */
+int ipmi_batch_mv(IPMI_BATCH *pb, int n, char fdebugcmd)
+{
+    fd_set readfds;
+    struct timeval tv;
+    struct ipmi_req       req;
+    struct ipmi_recv      rsp;
+    struct ipmi_addr      addr;
+    struct ipmi_ipmb_addr             ipmb_addr;
+    struct ipmi_system_interface_addr bmc_addr;
+    uchar  buf[MV_BUFFER_SIZE];
+    int    base, npend, rlen, i, rv;
+
+    rv = ipmi_open_mv(fdebugcmd);
+    if (rv != 0) return(rv);
+
+    base = curr_seq;
+    npend = 0;
+    for (i = 0; i < n; i++) {
+	if (pb[i].sa == BMC_SA) {
+	    bmc_addr.adrtype = IPMI_SYSTEM_INTERFACE_ADDR_TYPE;
+	    bmc_addr.channel = IPMI_BMC_CHANNEL;
+	    bmc_addr.lun = pb[i].lun;
+	    req.addr = (char *) &bmc_addr;
+	    req.addr_len = sizeof(bmc_addr);
+	} else {
+	    ipmb_addr.adrtype = IPMI_IPMB_ADDR_TYPE;
+	    ipmb_addr.channel = pb[i].bus;
+	    ipmb_addr.slave_addr = pb[i].sa;
+	    ipmb_addr.lun = pb[i].lun;
+	    req.addr = (char *) &ipmb_addr;
+	    req.addr_len = sizeof(ipmb_addr);
+	}
+	req.msg.cmd = pb[i].cmd;
+	req.msg.netfn = pb[i].netfn;   
+	req.msgid = base + i;
+	req.msg.data = pb[i].pdata;
+	req.msg.data_len = pb[i].sdata;
+	rv = ioctl(ipmi_fd, IPMICTL_SEND_COMMAND, &req);
+	if (rv == -1) { 
+	    if (fdebugcmd) dbgmsg("mv batch[%d] IPMICTL_SEND_COMMAND errno %d\n",
+				i,errno);
+	    pb[i].rv = LAN_ERR_SEND_FAIL; 
+	} else {
+	    pb[i].rv = -3;   /*pending, until the response*/
+	    npend++;
+	}
+    }
+    curr_seq = base + n;
+    if (fdebugcmd) dbgmsg("mv batch sent %d of %d\n",npend,n);
+
+    while (npend > 0) {
+	FD_ZERO(&readfds);
+	FD_SET(ipmi_fd, &readfds);
+	tv.tv_sec=ipmi_timeout_mv;
+	tv.tv_usec=0;
+	rv = select(ipmi_fd+1, &readfds, NULL, NULL, &tv);
+	if (rv <= 0) {  /* the rest stay at -3 */
+	   if (fdebugmv) 
+              fprintf(fperr,"mv batch select timeout, %d pending, rv = %d\n",
+		  npend,rv);
+	   break;
+	}
+	rsp.addr = (char *) &addr;
+	rsp.addr_len = sizeof(addr);
+	rsp.msg.data = buf;
+	rsp.msg.data_len = sizeof(buf);
+	rv = ioctl(ipmi_fd, IPMICTL_RECEIVE_MSG_TRUNC, &rsp);
+	if (rv == -1 && errno != EMSGSIZE) { 
+	   fprintf(fperr,"mv rcv_trunc errno = %d, len = %d\n",
+			errno, rsp.msg.data_len);
+	   break;
+	}
+	if (rsp.recv_type != IPMI_RESPONSE_RECV_TYPE) {
+	   /* an event or request, keep it for getevent_mv */
+	   if (mv_nevq < MV_EVQ_SZ) {
+	      mv_evq[mv_nevq].recv_type = rsp.recv_type;
+	      mv_evq[mv_nevq].netfn = rsp.msg.netfn;
+	      mv_evq[mv_nevq].cmd = rsp.msg.cmd;
+	      mv_evq[mv_nevq].cc  = (rv == -1) ? 0xC8 : 0;  /*truncated*/
+	      rlen = rsp.msg.data_len;
+	      if (rlen > (int)sizeof(mv_evq[0].data)) rlen = sizeof(mv_evq[0].data);
+	      memcpy(mv_evq[mv_nevq].data,buf,rlen);
+	      mv_evq[mv_nevq].len = rlen;
+	      memcpy(&mv_evq[mv_nevq].addr,&addr,sizeof(addr));
+	      mv_evq[mv_nevq].addr_len = rsp.addr_len;
+	      mv_nevq++;
+	   } else if (fdebugcmd) 
+	      dbgmsg("mv batch dropped recv_type %d, queue full\n",
+			rsp.recv_type);
+	   continue;
+	}
+	i = (int)(rsp.msgid - base);
+	if (i < 0 || i >= n || pb[i].rv != -3) {   /*not from this batch*/
+	   if (fdebugcmd) dbgmsg("mv batch skip msgid %ld\n",rsp.msgid);
+	   continue;
+	}
+	npend--;
+	rlen = rsp.msg.data_len;
+	if (rlen < 1) { pb[i].rv = LAN_ERR_TOO_SHORT; continue; }
+	pb[i].cc = buf[0];
+	rlen -= 1;   /* copy data, except first byte */
+	if (rlen > pb[i].sresp) rlen = pb[i].sresp;
+	if (rlen > 0) memcpy(pb[i].presp,&buf[1],rlen);
+	pb[i].sresp = rlen;
+	pb[i].rv = 0;
+	if (fdebugcmd) 
+	   dbgmsg("mv batch[%d] cmd=%02x netfn=%02x cc=%x rlen=%d\n",
+		i,pb[i].cmd,pb[i].netfn,pb[i].cc,rlen);
+    }
+    return(0);
+}  /*end ipmi_batch_mv*/
 #endif
 
 int setmaint_mv(uchar mode, uchar *cc)
@@ -682,6 +820,23 @@ int getevent_mv(uchar *evt_data, int *evt_len, uchar *cc, int timeout)
 	need_set_events = 0;
     }
 
+    if (mv_nevq > 0) {  /* received during ipmi_batch_mv */
+	rsp.recv_type = mv_evq[0].recv_type;
+	rsp.msg.netfn = mv_evq[0].netfn;
+	rsp.msg.cmd   = mv_evq[0].cmd;
+	rsp.msg.data  = data;
+	rsp.msg.data_len = mv_evq[0].len;
+	memcpy(data,mv_evq[0].data,mv_evq[0].len);
+	memcpy(&addr,&mv_evq[0].addr,sizeof(addr));
+	rsp.addr = (unsigned char *) &addr;
+	rsp.addr_len = mv_evq[0].addr_len;
+	*cc = mv_evq[0].cc;
+	mv_nevq--;
+	memmove(&mv_evq[0],&mv_evq[1],mv_nevq * sizeof(MV_EVQ));
+	rv = 0;
+	goto got_msg;
+    }
+
     /* wait for the mv openipmi driver to provide input to fd */
     if (timeout == 0) 
     {   /*do poll*/
@@ -717,6 +872,7 @@ int getevent_mv(uchar *evt_data, int *evt_len, uchar *cc, int timeout)
         }
         else if (errno == EINTR) { return(EINTR); }
     } else *cc = 0;
+got_msg:
     if (rv == 0) {
         n = rsp.msg.data_len;
 	if (fdebugmv) {
@@ -67,6 +67,8 @@
  * 09/12/05 Andy Cress v1.33 dont check superuser for fipmi_lan
  * 06/29/06 Andy Cress v1.34 added -l option
  * 02/06/08 Andy Cress v2.8  make sure savid for -w is unsigned
+ * 10/19/26 - -w saves its cursor in the sel.jrn journal, keyed by node
+ * 10/19/26 - -w writes via the async event sink, added -g for its dest
  */
 /*M*
 Copyright (c) 2002-2005, Intel Corporation
@@ -172,14 +174,20 @@ static char * progname  = "isel";
 #define IDXFILE   "sel.idx"
 static char idxfile[80] = IDXFILE;
 static char idxfile2[80] = "%ipmiutildir%\\sel.idx";
+#define JRNFILE   "sel.jrn"
+static char jrnfile[80] = JRNFILE;
 #else
 static char idxfile[80]  = "/var/lib/ipmiutil/sel.idx";
 static char idxfile2[80] = "/usr/share/ipmiutil/sel.idx"; /*old location*/
+static char jrnfile[80]  = "/var/lib/ipmiutil/sel.jrn";
 #endif
+static char *jrnkey = "";  /* journal key, the nodename if remote */
 static char fdebug = 0;
 static char fall = 1;
 static char futc      = 0;
 static char fwritesel = 0;
+static char *sinkdest = NULL;  /* -g event sink destination, else syslog */
+static char fsink = 0;         /* =1 if the event sink is running */
 static char fshowraw = 0;
 static char fdecoderaw = 0;
 static char fdecodebin = 0;
@@ -373,23 +381,39 @@ void StartWriting(uint *plasttime, ushort *plastid)
 	uint lastid;
 	int ret = -1;
 	
+	ushort jid;
+	
 	lasttime = 0;
 	lastid = 0;
-	// Open the index file
-	fd = fopen(idxfile,"r");
-	if (fd == NULL) fd = fopen(idxfile2,"r");
-	if (fd != NULL) {
+	// Get the cursor from the journal, else from the old index file
+	if (cursor_open(jrnfile,1) == 0 && 
+	    cursor_get(jrnkey,&jid,&lasttime) == 0) {
+		lastid = jid;
+		if (fdebug) printf("StartWriting: %s savtime=%x, savid=%x\n",
+				jrnfile,lasttime,(ushort)lastid);
+	} else {
+	   fd = fopen(idxfile,"r");
+	   if (fd == NULL) fd = fopen(idxfile2,"r");
+	   if (fd != NULL) {
 		// Read the file, get savtime & savid
 		ret = fscanf(fd,"%x %x",&lasttime,&lastid);
 		fclose(fd);
-	}
-	else printf("StartWriting: cannot open %s\n",idxfile);
-	if (fdebug) printf("StartWriting: idx fd=%p, savtime=%x, savid=%x\n",
+	   }
+	   else printf("StartWriting: cannot open %s\n",idxfile);
+	   if (fdebug) printf("StartWriting: idx fd=%p, savtime=%x, savid=%x\n",
 				fd,lasttime,(ushort)lastid);
+	}
 	*plasttime = lasttime;
 	*plastid = (ushort)lastid;
 
-	ret = OpenSyslog("SEL");
+	/* the records are queued to the sink writer thread, if possible */
+	ret = evsink_open("SEL",sinkdest,0);
+	fsink = (ret == 0);
+	if (!fsink) {  /*write to syslog directly, even if -g failed*/
+	   if (sinkdest != NULL) 
+	      printf("StartWriting: cannot use %s, writing to syslog\n",sinkdest);
+	   ret = OpenSyslog("SEL");
+	}
 	if (fdebug) printf("StartWriting: ret = %d\n",ret);
 	return;
 }
@@ -397,14 +421,28 @@ void StartWriting(uint *plasttime, ushort *plastid)
 void StopWriting(uint lasttime, ushort lastid)
 {
 	FILE *fd;
-	// Rewrite the saved time & record id
-	fd = fopen(idxfile,"w");
-	if (fd != NULL) {
+	// Append the saved time & record id to the journal
+	if (cursor_put(jrnkey,lastid,lasttime) == 0) cursor_close();
+	else {
+	   cursor_close();
+	   // Rewrite the saved time & record id
+	   fd = fopen(idxfile,"w");
+	   if (fd != NULL) {
 		fprintf(fd,"%x %x\n",lasttime,lastid);
 		fclose(fd);
 		}
-	else printf("StopWriting: cannot open %s\n",idxfile);
-	CloseSyslog();
+	   else printf("StopWriting: cannot open %s\n",idxfile);
+	}
+	if (fsink) {
+	   ulong nput, ndrop, nbp;
+	   int maxq;
+	   evsink_close();  /*flush the queued records*/
+	   evsink_stats(&nput,&ndrop,&nbp,&maxq);
+	   if (ndrop > 0 || fdebug) 
+	      printf("StopWriting: %lu records queued, %lu dropped, "
+			"%lu backpressure, max queue %d\n",nput,ndrop,nbp,maxq);
+	   fsink = 0;
+	} else CloseSyslog();
 	return;
 }
 
@@ -547,13 +585,13 @@ void ReadSEL(uchar mytype, char fwriteit)
 		   if (pSelRecord->record_type == 0x02) {
 			if ((pSelRecord->timestamp > savtime) ||
 			    (pSelRecord->record_id > savid)) {
-			   WriteSyslog(output);
+			   if (evsink_put(output) != 0) WriteSyslog(output);
 			   savid = pSelRecord->record_id;
 			   savtime = pSelRecord->timestamp;
 			}
 		   } else {   /* no timestamp */
 			if (pSelRecord->record_id > savid) {
-			   WriteSyslog(output);
+			   if (evsink_put(output) != 0) WriteSyslog(output);
 			   savid = pSelRecord->record_id;
 			}
 		   }
@@ -657,7 +695,7 @@ int i_sel(int argc, char **argv)
    char *vend_param = NULL;
 
    printf("%s version %s\n",progname,progver);
-   while ((c = getopt(argc,argv,"a:b:cdef:h:i:l:m:np:rs:uwvxM:T:V:J:EYF:P:N:U:R:Z:?")) != EOF)
+   while ((c = getopt(argc,argv,"a:b:cdef:g:h:i:l:m:np:rs:uwvxM:T:V:J:EYF:P:N:U:R:Z:?")) != EOF)
       switch(c) {
           case 'a': faddsel = 1; /*undocumented option, to prevent misuse*/
 		addstr = optarg; /*text string, max 13 bytes, no date*/
@@ -676,6 +714,9 @@ int i_sel(int argc, char **argv)
           case 'f': fdecoderaw = 1;    
 		rawfile = optarg;
 		break;
+          case 'g': sinkdest = optarg;  /*file, unix:/path, or syslog*/
+		fwritesel = 1;
+		break;
           case 'l': flastrecs = 1; 
                 nlast = atoi(optarg);
                 break;
@@ -719,13 +760,14 @@ int i_sel(int argc, char **argv)
                 parse_lan_options(c,optarg,fdebug);
                 break;
           default:
-                printf("Usage: %s [-bcdefmnprsuvwx] [-l 5] [-NUPREFTVYZ]\n",
+                printf("Usage: %s [-bcdefgmnprsuvwx] [-l 5] [-NUPREFTVYZ]\n",
                        progname);
 		printf("   -b  interpret Binary file with raw SEL data\n");
 		printf("   -c  Show canonical output with delimiters\n");
 		printf("   -d  Delete, Clears all SEL records\n");
 		printf("   -e  shows Extended sensor description if run locally\n");
 		printf("   -f  interpret File with ascii hex SEL data\n");
+		printf("   -g F Writes new SEL records to file F, unix:/path or syslog\n");
 		printf("   -l5 Show last 5 SEL records (reverse order)\n");
 		printf("   -r  Show uninterpreted raw SEL records in ascii hex\n");
 		printf("   -n  Show nominal/canonical output (same as -c)\n");
@@ -763,6 +805,7 @@ int i_sel(int argc, char **argv)
       if (ipath != NULL) {
 	  if (strlen(ipath)+8 < sizeof(idxfile)) {
 	     sprintf(idxfile,"%s\\%s",ipath,IDXFILE);
+	     sprintf(jrnfile,"%s\\%s",ipath,JRNFILE);
 	  }
       }
    }
@@ -791,6 +834,7 @@ int i_sel(int argc, char **argv)
         strcat(idxfile,node);
         strcat(idxfile2,"-");
         strcat(idxfile2,node);
+        jrnkey = node;
    } 
 #ifdef REMOVABLE
    else { 
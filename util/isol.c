@@ -94,6 +94,10 @@ int i_sol(int argc, char **argv)
 #include <stdarg.h> 
 #include <termios.h>
 #include <unistd.h> 
+#include <sys/time.h>
+#include <pthread.h>
+#include <signal.h>
+#define SOLREC_ASYNC  1
 #if defined(HPUX)
 /* getopt is defined in stdio.h */
 #elif defined(MACOS)
@@ -105,6 +109,9 @@ int i_sol(int argc, char **argv)
 #endif
 #include <string.h>
 #include <time.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 #include "ipmicmd.h"
 #include "ipmilanplus.h"
  
@@ -135,6 +142,7 @@ int i_sol(int argc, char **argv)
 #define MAX_DELL_DATA    46  /*sol_send >= 46 bytes gives error w Dell BMC*/
 #define MAX_KONTRON_DATA 74  /*sol_send >= 75 bytes gives error w Kontron BMC*/
 #define MAX_OTHER_DATA   45  /*use a small sol_send limit of 45 by default */
+#define SOL_OBUF_SZ   16384  /*console output buffer for -b coalescing */
 
 typedef struct {
   int type;
@@ -161,6 +169,8 @@ extern int  lan2_keepalive(int type, SOL_RSP_PKT *rsp);
 extern void lan2_recv_handler( void *rs );
 extern long lan2_get_latency( void );  /*from ipmilanplus.c*/
 extern void lanplus_set_recvdelay( int delay );  /*lib/lanplus/lanplus.c*/
+extern void lanplus_set_sol_ackdefer( int on );  /*lib/lanplus/lanplus.c*/
+extern void lanplus_get_sol_stats( unsigned long *stats, int n );
 extern int  lan2_send_break( SOL_RSP_PKT *rsp );
 
 extern char  fdbglog;    /*see ipmilanplus.c*/
@@ -194,6 +204,9 @@ static char  sol_esc_pending = 0;
 static char  sol_esc_fn[4] = {'.','b','d', '?'}; /* SOL escape functions */
 static char  file_scr[80] = {""};
 static char  file_trc[80] = {""};
+static char  file_rec[80] = {""};
+static char  fRecord       = 0;   /*-O headless recording*/
+static char *rec_from      = NULL; /*-m replay from time*/
 static char  dbglog_name[40] = "isoldbg.log";
 static FILE *fp_scr = NULL;
 static FILE *fp_trc = NULL;
@@ -224,6 +237,22 @@ static uchar  sol15_iseed = 0x01;  /*initial seed count, usu 0 or 1 */
 static uint32 sol15_wseed = 0;     /*32-bit seed value*/
 static long lan2_latency = 0;      /*lan2 latency in msec */
 static long lan2_slow = 100;       /*slow if latency > 100 msec */
+static int  sol_coalesce = 0;      /*-b msec to coalesce SOL i/o, 0=off*/
+static int  sol_wait_ms = 500;     /*select timeout for this pass */
+static uchar sol_obuf[SOL_OBUF_SZ]; /*console output not yet written*/
+static int   sol_olen = 0;
+static ulong sol_ostart = 0;       /*msec when output was first buffered*/
+static uchar sol_ibuf[IPKT_SZ];    /*keystrokes not yet sent*/
+static int   sol_ilen = 0;
+static ulong sol_istart = 0;       /*msec when input was first buffered*/
+static struct {
+   ulong rx_pkts;
+   ulong rx_bytes;
+   ulong tx_pkts;
+   ulong tx_bytes;
+   ulong writes;    /*console writes*/
+   ulong lost;      /*console bytes that could not be written*/
+} solstats = {0,0,0,0,0,0};
 
 extern FILE *fplog;  /*see ipmicmd.c*/
 #ifdef WIN32
@@ -253,12 +282,12 @@ int os_select(int infd, SockType sfd, fd_set *read_fds, fd_set *error_fds)
 
    /* Linux handles both stdin & socket via select() */
    FD_ZERO(read_fds);
-   FD_SET(infd, read_fds);
+   if (infd >= 0) FD_SET(infd, read_fds);  /*no stdin if recording*/
    FD_SET(sfd, read_fds);
    FD_ZERO(error_fds);
    FD_SET(sfd, error_fds);
    tv.tv_sec =  0;
-   tv.tv_usec = wait_time * 1000;  /* 500000 usec, 500 msec, 0.5 sec*/
+   tv.tv_usec = sol_wait_ms * 1000;  /* wait_time, 500 msec by default */
    rv = select((int)(sfd + 1), read_fds, NULL, error_fds, &tv);
    return rv;
 }
@@ -404,6 +433,513 @@ static SockType  sol_get_fd(void)
     return(fd);
 }
 
+#ifndef WIN32
+/*
+ * sol_flush_output
+ * Write the coalesced console output (-b) in one large write.
+ */
+static void sol_flush_output(void)
+{
+    int i, n;
+
+    if (sol_olen == 0) return;
+    fflush(stdout);
+    for (i = 0; i < sol_olen; i += n) {
+       n = write(fileno(stdout), &sol_obuf[i], sol_olen - i);
+       if (n <= 0) break;
+    }
+    if (i < sol_olen) solstats.lost += (sol_olen - i);
+    solstats.writes++;
+    sol_olen = 0;
+    if (fTrace) fflush(fp_trc);
+}
+#endif
+
+/*
+ * SOL recorder (-O)
+ * Records the console output without a terminal, as a log of chunks 
+ * that each carry the time of their first byte.  The chunks are 
+ * compressed with zlib (if HAVE_ZLIB), and each chunk also gets a fixed
+ * size record in the file.idx index, so that -m can find a given time 
+ * with a binary search instead of reading the whole log.
+ * The output is queued in a ring of chunk slots for a writer thread,
+ * so the SOL session never waits on the disk.  If the ring is full, 
+ * the output is dropped and counted in the header of the next chunk.
+ *
+ * Chunk header, little-endian:
+ *   0  magic "iSOL"           20  stream offset of the first byte (8)
+ *   4  chunk number (4)       28  console bytes (4)
+ *   8  time, seconds (8)      32  stored bytes (4)
+ *  16  milliseconds (2)       36  bytes dropped before this chunk (4)
+ *  18  format, 0=raw 1=zlib
+ * Index record: time in seconds (8), milliseconds (2), reserved (2), 
+ *   chunk number (4), file offset of the chunk header (8).
+ */
+#define SOLREC_CHUNK  65536  /*max console bytes per chunk*/
+#define SOLREC_SLOTS  16     /*chunk slots in the ring, 1 MB*/
+#define SOLREC_MSEC   1000   /*max msec of console output per chunk*/
+#define SOLREC_HDR    40     /*chunk header size*/
+#define SOLREC_IDX    24     /*index record size*/
+#define SOLREC_ZMAX   (SOLREC_CHUNK + 1024)  /*max stored bytes*/
+#define SOLREC_MAGIC  "iSOL"
+#define SLOT_FREE   0
+#define SLOT_FILL   1
+#define SLOT_READY  2
+
+static void rec_put(uchar *p, ulong val, int n)
+{
+   int i;
+   for (i = 0; i < n; i++) { p[i] = (uchar)(val & 0xff); val >>= 8; }
+}
+
+static ulong rec_get(uchar *p, int n)
+{
+   ulong val = 0;
+   int i;
+   for (i = n - 1; i >= 0; i--) val = (val << 8) | p[i];
+   return(val);
+}
+
+#ifdef SOLREC_ASYNC
+typedef struct {
+   volatile int state;
+   int    len;
+   ulong  off;      /*stream offset of the first byte*/
+   ulong  lost;     /*bytes dropped before this chunk*/
+   ulong  sec;      /*time of the first byte*/
+   int    msec;
+   ulong  start;    /*os_msec of the first byte*/
+   uchar  data[SOLREC_CHUNK];
+} SOLREC_SLOT;
+static SOLREC_SLOT *rec_q = NULL;
+static ulong  rec_head = 0;     /*slot being filled*/
+static ulong  rec_tail = 0;     /*next slot to write*/
+static ulong  rec_off  = 0;     /*console bytes so far*/
+static ulong  rec_lost = 0;     /*bytes dropped since the last chunk*/
+static long   rec_fpos = 0;     /*file offset of the next chunk*/
+static FILE  *fp_rec = NULL;
+static FILE  *fp_idx = NULL;
+static volatile int rec_run = 0;
+static pthread_t rec_thread;
+static pthread_mutex_t rec_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  rec_cv    = PTHREAD_COND_INITIALIZER;
+#ifdef HAVE_ZLIB
+static uchar rec_zbuf[SOLREC_ZMAX];
+#endif
+static struct {
+   ulong bytes;     /*console bytes queued*/
+   ulong dropped;   /*console bytes dropped, ring full*/
+   ulong chunks;    /*chunks written*/
+   ulong stored;    /*bytes written, with the headers*/
+   ulong errs;      /*write errors*/
+} recstats = {0,0,0,0,0};
+
+/* solrec_write - compress and write one chunk, in the writer thread */
+static void solrec_write(SOLREC_SLOT *q)
+{
+   uchar hdr[SOLREC_HDR];
+   uchar idx[SOLREC_IDX];
+   uchar *pdata;
+   ulong slen;
+   uchar fmt = 0;
+
+   pdata = q->data;
+   slen  = q->len;
+#ifdef HAVE_ZLIB
+   {
+      uLongf zlen = sizeof(rec_zbuf);
+      if (compress2(rec_zbuf,&zlen,q->data,q->len,Z_DEFAULT_COMPRESSION) 
+	  == Z_OK && zlen < (uLongf)q->len) {
+         pdata = rec_zbuf;
+         slen  = zlen;
+         fmt   = 1;
+      }
+   }
+#endif
+   memset(hdr,0,sizeof(hdr));
+   memcpy(hdr,SOLREC_MAGIC,4);
+   rec_put(&hdr[4],recstats.chunks,4);
+   rec_put(&hdr[8],q->sec,8);
+   rec_put(&hdr[16],q->msec,2);
+   hdr[18] = fmt;
+   rec_put(&hdr[20],q->off,8);
+   rec_put(&hdr[28],q->len,4);
+   rec_put(&hdr[32],slen,4);
+   rec_put(&hdr[36],q->lost,4);
+   if ((fwrite(hdr,1,SOLREC_HDR,fp_rec) != SOLREC_HDR) ||
+       (fwrite(pdata,1,slen,fp_rec) != slen) || (fflush(fp_rec) != 0)) {
+      recstats.errs++;   /*do not index a partial chunk*/
+      fseek(fp_rec,0,SEEK_END);
+      rec_fpos = ftell(fp_rec);
+      return;
+   }
+   memset(idx,0,sizeof(idx));
+   rec_put(&idx[0],q->sec,8);
+   rec_put(&idx[8],q->msec,2);
+   rec_put(&idx[12],recstats.chunks,4);
+   rec_put(&idx[16],rec_fpos,8);
+   if (fwrite(idx,1,SOLREC_IDX,fp_idx) != SOLREC_IDX) recstats.errs++;
+   fflush(fp_idx);
+   rec_fpos += SOLREC_HDR + slen;
+   recstats.stored += SOLREC_HDR + slen;
+   recstats.chunks++;
+}
+
+static void *solrec_writer(void *arg)
+{
+   SOLREC_SLOT *q;
+   struct timespec ts;
+   while (1) {
+      q = &rec_q[rec_tail % SOLREC_SLOTS];
+      if (q->state == SLOT_READY) {
+         __sync_synchronize();
+         solrec_write(q);
+         __sync_synchronize();
+         q->state = SLOT_FREE;   /*free for the SOL session again*/
+         rec_tail++;
+         continue;
+      }
+      if (!rec_run) break;   /*stopped and drained*/
+      pthread_mutex_lock(&rec_mutex);
+      clock_gettime(CLOCK_REALTIME,&ts);
+      ts.tv_nsec += 50000000L;  /*50 ms*/
+      if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+      pthread_cond_timedwait(&rec_cv,&rec_mutex,&ts);
+      pthread_mutex_unlock(&rec_mutex);
+   }
+   return(NULL);
+}
+
+/* solrec_ready - pass the slot being filled to the writer */
+static void solrec_ready(SOLREC_SLOT *q)
+{
+   __sync_synchronize();
+   q->state = SLOT_READY;
+   rec_head++;
+   if (pthread_mutex_trylock(&rec_mutex) == 0) {
+      pthread_cond_signal(&rec_cv);
+      pthread_mutex_unlock(&rec_mutex);
+   }
+}
+
+/* solrec_put - queue console output, without blocking */
+static void solrec_put(uchar *pdata, int len)
+{
+   SOLREC_SLOT *q;
+   struct timeval tv;
+   int n;
+
+   while (len > 0) {
+      q = &rec_q[rec_head % SOLREC_SLOTS];
+      if (q->state == SLOT_READY) {  /*ring is full, writer is behind*/
+         rec_lost += len;
+         rec_off  += len;
+         recstats.dropped += len;
+         return;
+      }
+      if (q->state == SLOT_FREE) {  /*start a new chunk*/
+         gettimeofday(&tv,NULL);
+         q->sec   = (ulong)tv.tv_sec;
+         q->msec  = (int)(tv.tv_usec / 1000);
+         q->start = os_msec();
+         q->off   = rec_off;
+         q->lost  = rec_lost;
+         q->len   = 0;
+         rec_lost = 0;
+         q->state = SLOT_FILL;
+      }
+      n = SOLREC_CHUNK - q->len;
+      if (n > len) n = len;
+      memcpy(&q->data[q->len],pdata,n);
+      q->len += n;
+      pdata  += n;
+      len    -= n;
+      rec_off += n;
+      recstats.bytes += n;
+      if (q->len == SOLREC_CHUNK) solrec_ready(q);
+   }
+}
+
+/* solrec_tick - end the current chunk once it is SOLREC_MSEC old */
+static void solrec_tick(void)
+{
+   SOLREC_SLOT *q;
+   if (!rec_run) return;
+   q = &rec_q[rec_head % SOLREC_SLOTS];
+   if ((q->state == SLOT_FILL) && 
+       ((os_msec() - q->start) >= (ulong)SOLREC_MSEC)) 
+      solrec_ready(q);
+}
+
+static void solrec_sig(int sig)
+{
+   sol_done = 1;  /*end the session, see sol_data_loop*/
+}
+
+/* 
+ * solrec_last
+ * Finds the last chunk of an existing recording, so that appended 
+ * chunks continue its chunk numbers and stream offsets.  Uses the last
+ * index record, or walks the chunk headers if the index does not match.
+ */
+static void solrec_last(char *name, char *iname)
+{
+   FILE *fp, *fpi;
+   uchar hdr[SOLREC_HDR];
+   uchar idx[SOLREC_IDX];
+   long pos, last = -1;
+
+   fp = fopen(name,"rb");
+   if (fp == NULL) return;
+   fpi = fopen(iname,"rb");
+   if (fpi != NULL) {
+      if ((fseek(fpi,-SOLREC_IDX,SEEK_END) == 0) &&
+          (fread(idx,1,SOLREC_IDX,fpi) == SOLREC_IDX)) {
+         pos = (long)rec_get(&idx[16],8);
+         if ((fseek(fp,pos,SEEK_SET) == 0) &&
+             (fread(hdr,1,SOLREC_HDR,fp) == SOLREC_HDR) &&
+             (memcmp(hdr,SOLREC_MAGIC,4) == 0) &&
+             (rec_get(&hdr[4],4) == rec_get(&idx[12],4))) last = pos;
+      }
+      fclose(fpi);
+   }
+   if (last < 0) {  /*no index, or it is behind, walk the headers*/
+      pos = 0;
+      fseek(fp,0,SEEK_SET);
+      while ((fread(hdr,1,SOLREC_HDR,fp) == SOLREC_HDR) && 
+             (memcmp(hdr,SOLREC_MAGIC,4) == 0)) {
+         last = pos;
+         pos += SOLREC_HDR + (long)rec_get(&hdr[32],4);
+         if (fseek(fp,pos,SEEK_SET) != 0) break;
+      }
+      if (last >= 0) {
+         fseek(fp,last,SEEK_SET);
+         if (fread(hdr,1,SOLREC_HDR,fp) != SOLREC_HDR) last = -1;
+      }
+   }
+   if (last >= 0) {
+      recstats.chunks = rec_get(&hdr[4],4) + 1;
+      rec_off = rec_get(&hdr[20],8) + rec_get(&hdr[28],4);
+      if (fdebug) printf("%s: appending after chunk %lu at offset %ld\n",
+			 name,recstats.chunks - 1,last);
+   }
+   fclose(fp);
+}
+
+static int solrec_open(char *name)
+{
+   char iname[sizeof(file_rec) + 4];
+   sigset_t all, old;
+   int rv = 0;
+
+   sprintf(iname,"%s.idx",name);
+   solrec_last(name,iname);
+   fp_rec = fopen(name,"ab");
+   if (fp_rec == NULL) return(ERR_FILE_OPEN);
+   fp_idx = fopen(iname,"ab");
+   rec_q = calloc(SOLREC_SLOTS,sizeof(SOLREC_SLOT));
+   if (fp_idx == NULL || rec_q == NULL) {
+      fclose(fp_rec);
+      if (fp_idx != NULL) fclose(fp_idx);
+      return(ERR_FILE_OPEN);
+   }
+   fseek(fp_rec,0,SEEK_END);
+   rec_fpos = ftell(fp_rec);
+   rec_head = rec_tail = 0;
+   rec_run = 1;
+   /* the signals are handled by the main thread */
+   sigfillset(&all);
+   pthread_sigmask(SIG_BLOCK,&all,&old);
+   if (pthread_create(&rec_thread,NULL,solrec_writer,NULL) != 0) {
+      rec_run = 0;
+      rv = -1;
+   }
+   pthread_sigmask(SIG_SETMASK,&old,NULL);
+   if (rv != 0) { fclose(fp_rec); fclose(fp_idx); free(rec_q); }
+   return(rv);
+}
+
+/* solrec_stop - write out the queued chunks and close the recording */
+static void solrec_stop(void)
+{
+   SOLREC_SLOT *q;
+
+   if (!rec_run) return;
+   q = &rec_q[rec_head % SOLREC_SLOTS];
+   if (q->state == SLOT_FILL) solrec_ready(q);
+   rec_run = 0;
+   pthread_mutex_lock(&rec_mutex);
+   pthread_cond_signal(&rec_cv);
+   pthread_mutex_unlock(&rec_mutex);
+   pthread_join(rec_thread,NULL);
+   fclose(fp_rec);
+   fclose(fp_idx);
+   free(rec_q);
+   rec_q = NULL;
+   printm("SOL recorded %lu bytes in %lu chunks, %lu bytes stored, "
+	  "%lu bytes dropped, %lu write errors", recstats.bytes, 
+	  recstats.chunks, recstats.stored, recstats.dropped, recstats.errs);
+}
+#endif
+
+/* 
+ * solrec_time
+ * Converts the -m time, "YYYY-MM-DD HH:MM[:SS]" or "HH:MM[:SS]" local 
+ * time, or 0 for the start.  A time of day is on the day that the 
+ * recording started, or the next day if it is earlier than the start.
+ */
+static int solrec_time(char *str, ulong first, ulong *ptime)
+{
+   struct tm tm;
+   time_t t;
+   int yr, mon, day, hr, min, sec = 0;
+   int n, fdate = 0;
+
+   if (strcmp(str,"0") == 0) { *ptime = 0; return(0); }
+   t = (time_t)first;
+   memcpy(&tm,localtime(&t),sizeof(tm));
+   n = sscanf(str,"%d-%d-%d%*c%d:%d:%d",&yr,&mon,&day,&hr,&min,&sec);
+   if (n >= 5) {
+      tm.tm_year = yr - 1900;
+      tm.tm_mon  = mon - 1;
+      tm.tm_mday = day;
+      fdate = 1;
+   } else {
+      n = sscanf(str,"%d:%d:%d",&hr,&min,&sec);
+      if (n < 2) return(ERR_BAD_PARAM);
+      n += 3;
+   }
+   tm.tm_hour = hr;
+   tm.tm_min  = min;
+   tm.tm_sec  = sec;
+   tm.tm_isdst = -1;
+   t = mktime(&tm);
+   if (t == (time_t)-1) return(ERR_BAD_PARAM);
+   /* HH:MM is the whole minute, HH:MM:SS the second */
+   if (!fdate && ((ulong)t + ((n == 6) ? 1 : 60) <= first))
+      t += 24 * 60 * 60;
+   *ptime = (ulong)t;
+   return(0);
+}
+
+/* 
+ * solrec_replay
+ * Writes the console output recorded by -O to stdout, starting with 
+ * the chunk that covers the -m time.
+ */
+static int solrec_replay(char *name, char *from)
+{
+   FILE *fp, *fpi;
+   char iname[sizeof(file_rec) + 4];
+   char tstr[32];
+   uchar hdr[SOLREC_HDR];
+   uchar idx[SOLREC_IDX];
+   uchar *sbuf, *rbuf, *pdata;
+   ulong target, t, rlen, slen, lost, nchunk = 0;
+   long lo, hi, mid, n, pos = 0;
+   time_t tt;
+   int rv = 0;
+
+   fp = fopen(name,"rb");
+   if (fp == NULL) {
+      printf("Cannot open %s\n",name);
+      return(ERR_FILE_OPEN);
+   }
+   if ((fread(hdr,1,SOLREC_HDR,fp) != SOLREC_HDR) || 
+       (memcmp(hdr,SOLREC_MAGIC,4) != 0)) {
+      printf("%s is not a SOL recording\n",name);
+      fclose(fp);
+      return(ERR_BAD_FORMAT);
+   }
+   if (solrec_time(from,rec_get(&hdr[8],8),&target) != 0) {
+      printf("Invalid time %s, use YYYY-MM-DD HH:MM[:SS] or HH:MM[:SS]\n",
+		from);
+      fclose(fp);
+      return(ERR_BAD_PARAM);
+   }
+   /* a chunk holds up to SOLREC_MSEC of output, so it covers the target
+    * if it starts less than a second before it */
+   sprintf(iname,"%s.idx",name);
+   fpi = fopen(iname,"rb");
+   if (fpi != NULL && target != 0) {  /*else scan from the start*/
+      fseek(fpi,0,SEEK_END);
+      n = ftell(fpi) / SOLREC_IDX;
+      for (lo = 0, hi = n; lo < hi; ) {
+         mid = lo + (hi - lo) / 2;
+         fseek(fpi,mid * SOLREC_IDX,SEEK_SET);
+         if (fread(idx,1,SOLREC_IDX,fpi) != SOLREC_IDX) break;
+         if (rec_get(idx,8) + 1 < target) lo = mid + 1;
+         else hi = mid;
+      }
+      if (lo >= n) pos = -1;  /*nothing at or after the target*/
+      else {
+         fseek(fpi,lo * SOLREC_IDX,SEEK_SET);
+         if (fread(idx,1,SOLREC_IDX,fpi) == SOLREC_IDX) 
+            pos = (long)rec_get(&idx[16],8);
+      }
+      if (fdebug) printf("index %s: %ld chunks, chunk %ld at offset %ld\n",
+			 iname,n,lo,pos);
+   }
+   if (fpi != NULL) fclose(fpi);
+   if (pos < 0) {
+      printf("No console output recorded after %s\n",from);
+      fclose(fp);
+      return(ERR_NOT_FOUND);
+   }
+   sbuf = malloc(SOLREC_ZMAX);
+   rbuf = malloc(SOLREC_CHUNK);
+   if (sbuf == NULL || rbuf == NULL) { fclose(fp); return(-1); }
+   fseek(fp,pos,SEEK_SET);
+   while (fread(hdr,1,SOLREC_HDR,fp) == SOLREC_HDR) {
+      rlen = rec_get(&hdr[28],4);
+      slen = rec_get(&hdr[32],4);
+      if ((memcmp(hdr,SOLREC_MAGIC,4) != 0) || (rlen > SOLREC_CHUNK) || 
+	  (slen > SOLREC_ZMAX)) {
+         printf("\nBad chunk header at offset %ld\n",ftell(fp)-SOLREC_HDR);
+         rv = ERR_BAD_FORMAT;
+         break;
+      }
+      t = rec_get(&hdr[8],8);
+      if (t + 1 < target) {  /*no index, skip to the target*/
+         fseek(fp,slen,SEEK_CUR);
+         continue;
+      }
+      if (fread(sbuf,1,slen,fp) != slen) break;  /*still being written*/
+      if (hdr[18] == 0) pdata = sbuf;
+#ifdef HAVE_ZLIB
+      else if (hdr[18] == 1) {
+         uLongf zlen = SOLREC_CHUNK;
+         if ((uncompress(rbuf,&zlen,sbuf,slen) != Z_OK) || (zlen != rlen)) {
+            printf("\nBad chunk %lu data\n",rec_get(&hdr[4],4));
+            rv = ERR_BAD_FORMAT;
+            break;
+         }
+         pdata = rbuf;
+      }
+#endif
+      else {
+         printf("\nChunk format %d is not supported, need zlib\n",hdr[18]);
+         rv = LAN_ERR_NOTSUPPORT;
+         break;
+      }
+      lost = rec_get(&hdr[36],4);
+      if (nchunk == 0 || lost > 0 || fdebug) {
+         tt = (time_t)t;
+         strftime(tstr,sizeof(tstr),"%Y-%m-%d %H:%M:%S",localtime(&tt));
+         printf("\n[SOL output at %s.%03lu",tstr,rec_get(&hdr[16],2));
+         if (lost > 0) printf(", %lu bytes dropped before this",lost);
+         printf("]\n");
+      }
+      fwrite(pdata,1,rlen,stdout);
+      nchunk++;
+   }
+   fflush(stdout);
+   free(sbuf);
+   free(rbuf);
+   fclose(fp);
+   return(rv);
+}
+
 /*
  * sol_output_handler 
  * This routine is called both in isol.c and ipmilanplus.c/lan2_recv_handler
@@ -433,15 +969,31 @@ void sol_output_handler(SOL_RSP_PKT *rsp)
              dbg_dump("sol_output",pdata,len,1); /*like printlog*/
          }
          CheckTextMode(pdata,len);
-         for (i = 0; i < len; i++) {
+         solstats.rx_pkts++;
+         solstats.rx_bytes += len;
+#ifdef SOLREC_ASYNC
+         if (fRecord) solrec_put(pdata,len);  /*headless, no terminal*/
+         else
+#endif
+         if (sol_coalesce) {  /*written by sol_flush_output*/
+             if (sol_olen + len > SOL_OBUF_SZ) sol_flush_output();
+             if (sol_olen == 0) sol_ostart = os_msec();
+             memcpy(&sol_obuf[sol_olen],pdata,len);
+             sol_olen += len;
+         } else {
+           for (i = 0; i < len; i++) {
 	      c = pdata[i];
 	      /* do special character handling here?  
 	       * CH_CR, 0xb0-0xb3, 0xdb */
               putc(c, stdout);
+           }
+           fflush(stdout);
          }
-         fflush(stdout);
 #endif
-	 if (fTrace) { fwrite(rsp->data,1,rsp->len,fp_trc); fflush(fp_trc); }
+	 if (fTrace) { 
+	    fwrite(rsp->data,1,rsp->len,fp_trc); 
+	    if (!sol_coalesce) fflush(fp_trc);
+	 }
     } else { 
          dbglog("sol_output: rsp.type=%x, rsp.len=%d\n", rsp->type, rsp->len);
     }
@@ -549,11 +1101,57 @@ static void show_esc_help( void )
 		sol_esc_ch, sol_esc_ch);
 }
 
+static int sol_send_payload( uchar *payload, int length)
+{
+   int rv = 0;
+   int t;
+   SOL_RSP_PKT  rs;
+
+   rs.len = 0;
+   /* Send the SOL payload */
+   for (t = 0; t < sol_retries; t++) 
+   {
+         if (t > 0) 
+	    os_usleep(0,(retry_time * 1000)); /*wait between retries 5000 us*/
+         rv = sol_send(payload, length, &rs);
+	 dbglog("sol_send(%d,%d) rv=%d rs.len=%d\n", t,length,rv,rs.len);
+	 if (rv >= 0) {  /* rv ok */
+	    if (rs.len != 0) {   /* have some rsp data, so handle it */
+             if (rs.type == IPMI_PAYLOAD_TYPE_SOL) {
+	       dbglog("output: handler(%d)\n",rs.len);
+               sol_output_handler(&rs);
+	     } else {
+	       dbglog("WARNING: after sol_send, rs.type=%d, not SOL\n",rs.type);
+	     }
+	    } /*endif have rsp data*/
+	    rv = 0;  /*recvd something, so dont retry */
+         }
+	 if (rv == 0) break;
+	 /* else retry again if rv < 0 or rv == 0x02 */
+   } /*end for loop*/
+   if (rv < 0) rv = LAN_ERR_DROPPED;
+   else {
+      solstats.tx_pkts++;
+      solstats.tx_bytes += length;
+   }
+   return(rv);
+}
+
+/* send any keystrokes coalesced by -b */
+static int sol_flush_input( void )
+{
+   int rv = 0;
+   if (sol_ilen > 0) {
+      rv = sol_send_payload(sol_ibuf, sol_ilen);
+      sol_ilen = 0;
+   }
+   return(rv);
+}
+
 int sol_input_handler( uchar *input, int ilen)
 {
    int rv = 0;
    uchar payload[IPKT_SZ]; 
-   SOL_RSP_PKT  rs;
    int i, length, t;
    static uchar lastc = 0;
    char rvend = 0;
@@ -566,7 +1164,6 @@ int sol_input_handler( uchar *input, int ilen)
 
    memset(&payload, 0, sizeof(payload)); 
    length = 0;
-   rs.len = 0;
 
    if ((fdebug > 2) && (ilen > 4)) 
       dbg_dump("sol_input dump:",input,ilen,1);
@@ -598,6 +1195,7 @@ int sol_input_handler( uchar *input, int ilen)
 		break;
 	   case 'b':
 	   case 'B':
+		sol_flush_input();  /*keep order with any held keystrokes*/
 		rv = send_break();
 		fdoinput = 0;
 		break;
@@ -693,28 +1291,16 @@ int sol_input_handler( uchar *input, int ilen)
    }  /*end-for input[ilen] */
 
    if (length > 0) {
-      /* Send the SOL payload */
-      for (t = 0; t < sol_retries; t++) 
-      {
-         if (t > 0) 
-	    os_usleep(0,(retry_time * 1000)); /*wait between retries 5000 us*/
-         rv = sol_send(payload, length, &rs);
-	 dbglog("sol_send(%d,%d) rv=%d rs.len=%d\n", t,length,rv,rs.len);
-	 if (rv >= 0) {  /* rv ok */
-	    if (rs.len != 0) {   /* have some rsp data, so handle it */
-             if (rs.type == IPMI_PAYLOAD_TYPE_SOL) {
-	       dbglog("output: handler(%d)\n",rs.len);
-               sol_output_handler(&rs);
-	     } else {
-	       dbglog("WARNING: after sol_send, rs.type=%d, not SOL\n",rs.type);
-	     }
-	    } /*endif have rsp data*/
-	    rv = 0;  /*recvd something, so dont retry */
+      if (sol_coalesce == 0) rv = sol_send_payload(payload, length);
+      else {  /* hold it until the -b timer, a full packet, or an ACK */
+         if (sol_ilen + length > max_bmc_data) rv = sol_flush_input();
+         if (sol_ilen == 0) sol_istart = os_msec();
+         if ((sol_ilen >= 0) && (sol_ilen + length <= IPKT_SZ)) {
+            memcpy(&sol_ibuf[sol_ilen], payload, length);
+            sol_ilen += length;
          }
-	 if (rv == 0) break;
-	 /* else retry again if rv < 0 or rv == 0x02 */
-      } /*end for loop*/
-      if (rv < 0) rv = LAN_ERR_DROPPED;
+         if ((rv == 0) && (sol_ilen >= max_bmc_data)) rv = sol_flush_input();
+      }
    }
    if (rvend) rv = RV_END;
    return(rv);
@@ -894,6 +1480,21 @@ int send_deactivate_sol(uchar verSOL)
    return(rv);
 }
 
+static void show_sol_stats( void )
+{
+   unsigned long lstats[5] = {0,0,0,0,0};
+
+   if (bSolVer == 2) lanplus_get_sol_stats(lstats,5);
+   printm("SOL received %lu bytes in %lu packets, %lu console writes, "
+	  "%lu bytes not written", solstats.rx_bytes, solstats.rx_pkts, 
+	  solstats.writes, solstats.lost);
+   printm("SOL sent %lu bytes in %lu packets, %lu ACKs sent with data",
+	  solstats.tx_bytes, solstats.tx_pkts, lstats[4]);
+   printm("SOL retransmits received %lu, sequence gaps %lu, "
+	  "bytes resent %lu, bytes dropped %lu",
+	  lstats[0], lstats[1], lstats[2], lstats[3]);
+}
+
 int sol_data_loop( void )
 {
    int istdin;
@@ -916,7 +1517,8 @@ int sol_data_loop( void )
 #else
    long ltime1 = 0;
    long ltime2 = 0;
-   istdin = fileno(stdin);
+   if (fRecord) istdin = -1;  /*headless*/
+   else istdin = fileno(stdin);
 #endif
 
    /* 
@@ -928,6 +1530,19 @@ int sol_data_loop( void )
    szibuf = max_bmc_data;
    szcbuf = max_bmc_data;  
    fd = sol_get_fd();
+#ifdef SOLREC_ASYNC
+   if (fRecord) { /* start the recorder for file_rec */
+      rv = solrec_open(file_rec);
+      if (rv != 0) {
+	  printm("Cannot open %s for recording, rv=%d",file_rec,rv);
+          return(rv);
+      }
+      signal(SIGINT,solrec_sig);
+      signal(SIGTERM,solrec_sig);
+      signal(SIGHUP,SIG_IGN);
+      signal(SIGPIPE,SIG_IGN);
+   }
+#endif
    if (fScript) { /* open file_scr */
       fp_scr = fopen(file_scr,"r");
       if (fp_scr == NULL) {
@@ -944,13 +1559,16 @@ int sol_data_loop( void )
    }
 
    dbglog("stdin = %d, intf->fd = %d\n",istdin,fd);
-   if (sol_esc_len == 1) 
+   if (fRecord) 
+     printf("[SOL session is recording to %s, send SIGTERM to end.]\n",
+		file_rec);
+   else if (sol_esc_len == 1) 
      printf("[SOL session is running, use '%c' to end session.]\n",sol_esc_ch);
    else 
      printf("[SOL session is running, use '%c.' to end, '%c?' for help.]\n",
 		sol_esc_ch, sol_esc_ch);
 
-   tty_setraw(2);
+   if (!fRecord) tty_setraw(2);
    sol_keepalive_reset();
 #ifdef WIN32
    thnd = CreateThread(NULL, 0, &input_thread, NULL, 0, NULL);
@@ -975,10 +1593,31 @@ int sol_data_loop( void )
            rv = sol_keepalive(bKeepAlive);   
 	   /* if keepalive error, try to keep going anyway */
        }
+       sol_wait_ms = wait_time;
+#ifdef SOLREC_ASYNC
+       if (fRecord) solrec_tick();
+#endif
+#ifndef WIN32
+       if (sol_coalesce) {
+           ulong now = os_msec();
+           if (sol_olen > 0 && (now - sol_ostart) >= (ulong)sol_coalesce)
+               sol_flush_output();  /*steady output, do not hold it longer*/
+           if (sol_ilen > 0 && (now - sol_istart) >= (ulong)sol_coalesce) {
+               rv = sol_flush_input();
+               if (rv < 0) { sol_done = 1; break; }
+           }
+           if (sol_olen > 0) sol_wait_ms = 0; /*flush once the socket is idle*/
+           else if (sol_ilen > 0) 
+               sol_wait_ms = sol_coalesce - (int)(now - sol_istart);
+       }
+#endif
        if (fdebug > 2) dbglog("os_select(%d,%d) called\n",istdin,fd);
 
        rv = os_select(istdin,fd, &read_fds, &error_fds);
-       if (rv < 0) { 
+       if (rv < 0 && sol_done) {  /*interrupted by SIGTERM/SIGINT*/
+	   rv = 0;
+	   break;
+       } else if (rv < 0) { 
 	   dbglog("os_select(%d,%d) error %d\n",istdin,fd,rv);
 	   perror("select"); 
            sol_done = 1;
@@ -986,13 +1625,16 @@ int sol_data_loop( void )
 	   if (fdbglog) { 
 	       time((time_t *)&ltime2);
 	       dbglog("select rv = %d sockfd=%x stdin=%x time=%ld\n", rv,
-			FD_ISSET(fd, &read_fds),FD_ISSET(istdin, &read_fds),
+			FD_ISSET(fd, &read_fds),
+			(istdin < 0) ? 0 : FD_ISSET(istdin, &read_fds),
 			(ltime2 - ltime1)); 
 	   } 
 
            if (FD_ISSET(fd, &read_fds)) {
                SOL_RSP_PKT rs;
                rs.len = 0;
+               /* with keystrokes held, their packet carries the ACK */
+               if (sol_ilen > 0 && bSolVer == 2) lanplus_set_sol_ackdefer(1);
                /* receive output from BMC SOL */
                rv = sol_recv(&rs);
 #ifdef WIN32
@@ -1008,6 +1650,10 @@ int sol_data_loop( void )
 		   /*sol_output_handler sets fgotrecv*/
 		   sol_output_handler(&rs);  
                    sol_keepalive_reset();
+                   if (sol_ilen > 0) {
+                      rv = sol_flush_input();
+                      if (rv < 0) sol_done = 1;
+                   }
 		   /* go back to select until there is no more socket data */
 		   continue;  
 	       }
@@ -1017,7 +1663,7 @@ int sol_data_loop( void )
                    dbglog("Error selecting SOL socket\n",rv);
            }  /*endif fd*/
 
-           if (FD_ISSET(istdin, &read_fds)) {
+           if ((istdin >= 0) && FD_ISSET(istdin, &read_fds)) {
                /* input from stdin (user) if not WIN32 */
                memset(ibuf,0,szibuf);
                len = os_read(istdin, ibuf, szibuf);
@@ -1042,6 +1688,9 @@ int sol_data_loop( void )
            }  /*endif stdin*/
 
        }  /*endif select rv > 0 */
+#ifndef WIN32
+       else if (sol_olen > 0) sol_flush_output();  /*rv == 0, socket idle*/
+#endif
        else if (fScript) {   /*rv == 0*/
 	   /* if we sent a script line, but no receive yet, keep waiting*/
 	   if (fsentok && (fgotrecv == 0)) {
@@ -1091,12 +1740,19 @@ int sol_data_loop( void )
        } /*endif fScript*/
    }  /*end while*/
    if (rv == RV_END) rv = 0;
+#ifndef WIN32
+   sol_flush_output();
+#endif
 #ifdef WIN32
    os_usleep(0,5000);   /*wait 5 ms for thread to close itself*/ 
    CloseHandle(thnd);
    console_close();
 #endif
-   tty_setnormal(2);
+   if (!fRecord) tty_setnormal(2);
+#ifdef SOLREC_ASYNC
+   if (fRecord) solrec_stop();
+#endif
+   if (sol_coalesce) show_sol_stats();
    if (fScript) fclose(fp_scr); /* close file_scr */
    if (fTrace) fclose(fp_trc); /* close file_trc */
    return(rv);
@@ -1104,14 +1760,17 @@ int sol_data_loop( void )
 
 static void show_usage(void)
 {
-                printf("Usage: %s [-acdeiolnrsvxz -NUPREFTVY]\n", progname);
+                printf("Usage: %s [-abcdeilmnoOrsvxz -NUPREFTVY]\n", progname);
                 printf(" where -a     activate SOL console session\n");
+                printf("       -b N   Batch keystrokes/output for N msec, ACKs with data\n");
                 printf("       -d     deactivate SOL console session\n");
                 printf("       -c'^'  set escape Char to '^', default='~'\n");
                 printf("       -e     Encryption off for SOL session\n");
                 printf("       -i file  Input script file\n");
                 printf("       -o file  Output trace file\n");
+                printf("       -O file  record console Output to file, without a terminal\n");
                 printf("       -l     Legacy mode for BIOS/DOS CR+LF\n");
+                printf("       -m time  replay the -O recording from time (HH:MM[:SS])\n");
                 printf("       -n 1   Payload instance Number, default=1\n");
                 printf("       -r     Raw termio, no VT-ANSI translation\n");
                 printf("       -s NNN Slow link delay, default=100usec\n");
@@ -1149,9 +1808,14 @@ main(int argc, char **argv)
 
    parse_lan_options('V',"2",0);  /*default to user priv*/
 
-   while ( (c = getopt( argc, argv,"ac:dei:k:ln:o:p:rs:t:u:wv:xzEF:J:N:P:R:T:U:V:YZ:?")) != EOF ) 
+   while ( (c = getopt( argc, argv,"ab:c:dei:k:lm:n:o:p:rs:t:u:wv:xzEF:J:N:O:P:R:T:U:V:YZ:?")) != EOF ) 
       switch(c) {
           case 'a': factivate = 1;   break;    /*activate*/
+          case 'b': i = atoi(optarg);  /*coalesce timer in msec*/
+		    if ((i < 0) || (i > 500)) 
+			printf("Invalid coalesce time %d, ignoring.\n",i);
+		    else sol_coalesce = i;
+		    break;
           case 'd': fdeactivate = 1; break;    /*deactivate*/
           case 'c':     		       /* escape char */
                 if (strncmp(optarg,"0x",2) == 0) 
@@ -1179,6 +1843,9 @@ main(int argc, char **argv)
 		    break;
           case 'o': strncpy(file_trc,optarg,sizeof(file_trc));
 		    fTrace = 1;  break;     /*trace output file*/
+          case 'O': strncpy(file_rec,optarg,sizeof(file_rec)-1);
+		    fRecord = 1;  break;    /*headless recording file*/
+          case 'm': rec_from = optarg; break;  /*replay recording from time*/
           case 'r': fRaw = 1; fCRLF = 0; fUseWinCon = 0;
 			break; /*raw termio, xlate off*/
           case 's': sol_recvdelay = atoi(optarg); break; /*slow recv delay*/
@@ -1213,11 +1880,31 @@ main(int argc, char **argv)
 		goto do_exit;
       }
 
+   if (rec_from != NULL) {  /* replay a recording, no BMC needed */
+      if (fRecord) ret = solrec_replay(file_rec,rec_from);
+      else {
+         printf("Replay (-m) needs the -O recording file\n");
+         ret = ERR_BAD_PARAM;
+      }
+      return(ret);
+   }
    if (is_remote() == 0) {  /* no node specified */
       printf("Serial-Over-Lan Console requires a -N nodename\n");
       ret = ERR_BAD_PARAM;
       goto do_exit;
    }
+#ifdef WIN32
+   if (sol_coalesce) {  /*input is read by a separate thread in Windows*/
+      printf("Coalescing (-b) is not supported in Windows, ignoring.\n");
+      sol_coalesce = 0;
+   }
+#endif
+#ifndef SOLREC_ASYNC
+   if (fRecord) {  /*the recorder needs a writer thread*/
+      printf("Recording (-O) is not supported in Windows, ignoring.\n");
+      fRecord = 0;
+   }
+#endif
    if (fdeactivate && !fprivset) 
       parse_lan_options('V',"4",0); /*deactivate requires admin priv */
 
@@ -30,6 +30,7 @@
  * 04/13/06 Andy Cress - 1.9  fix -t if nsec > 255 
  * 06/22/06 Andy Cress - 1.10 add -a action and -l dontlog options
  * 06/25/08 Andy Cress - 2.13 add -p for pre-timeout action
+ * 10/19/26 - added -w resident mode, resets on a timerfd with pet stats
  */
 /*M*
 Copyright (c) 2006, Intel Corporation
@@ -85,6 +86,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
 #if defined(HPUX)
 /* getopt is defined in stdio.h */
 #elif defined(MACOS)
@@ -93,6 +98,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #else
 #include <getopt.h>
 #endif
+#ifdef LINUX
+#include <sys/timerfd.h>
+#include <sys/mman.h>
+#include <sched.h>
+#include <stdint.h>
+#define WDT_TIMERFD  1
+#endif
+#define WDT_DAEMON   1
 #endif
 #include <string.h>
 #include "ipmicmd.h"
@@ -123,6 +136,26 @@ static uchar  preaction = 0;  /* default is None */
 static uchar  pretime = 0;   /* usually 30 second default pre-timeout */
 static uchar ipmi_maj = 0;
 static uchar ipmi_min = 0;
+#ifdef WDT_DAEMON
+static int    pet_div   = 4;    /* -w resets at 1/4 of the timeout */
+static int    pet_sec   = 0;    /* -i reset interval, 0 = timeout/pet_div */
+static int    rt_prio   = 0;    /* -s SCHED_FIFO priority, 0 = normal */
+static char  *statfile  = NULL; /* -o file for the pet stats */
+static volatile int wdt_done = 0;
+static volatile int wdt_dump = 0;
+static struct {
+   ulong  pets;      /* resets sent */
+   ulong  errs;      /* resets that failed, after the retry */
+   ulong  busy;      /* node busy (0xC0) replies, retried or not */
+   ulong  overruns;  /* timer ticks missed entirely */
+   ulong  near;      /* resets with less than half the countdown left */
+   double lat_max;   /* msec for the reset command */
+   double lat_sum;
+   double late_max;  /* msec the wakeup was behind schedule */
+   double late_sum;
+   double left_min;  /* least countdown left at a reset, in msec */
+} ws = {0,0,0,0,0, 0,0, 0,0, 0};
+#endif
 
 static int reset_wdt(void)
 {
@@ -195,6 +228,188 @@ static int clear_wdt(void)
 	return(ret);
 }  /*end clear_wdt()*/
 
+#ifdef WDT_DAEMON
+/*
+ * Resident mode (-w)
+ * Keeps the driver open and resets the watchdog at a fixed fraction of
+ * the timeout, so that the resets do not depend on starting a process
+ * in time under load.  The memory is locked and the process may run in
+ * the SCHED_FIFO class (-s).  The reset latency, timer lateness, and 
+ * resets with less than half the countdown left (near misses) are 
+ * counted, and written to the -o file every minute, on SIGUSR1, and 
+ * at exit.  SIGTERM or SIGINT disable the watchdog and exit.
+ */
+static void wdt_sig(int sig)
+{
+   if (sig == SIGUSR1) wdt_dump = 1;
+   else wdt_done = 1;
+}
+
+static void wdt_show_stats(FILE *fp)
+{
+   ulong nok;
+
+   nok = ws.pets - ws.errs;
+   fprintf(fp,"Watchdog resets  %c %lu\n",bdelim,ws.pets);
+   fprintf(fp,"Reset errors     %c %lu (%lu busy replies)\n",bdelim,ws.errs,ws.busy);
+   fprintf(fp,"Reset latency ms %c avg %.2f max %.2f\n",bdelim,
+	   (nok ? ws.lat_sum / nok : 0.0), ws.lat_max);
+   fprintf(fp,"Wakeup late ms   %c avg %.2f max %.2f\n",bdelim,
+	   (ws.pets ? ws.late_sum / ws.pets : 0.0), ws.late_max);
+   fprintf(fp,"Ticks missed     %c %lu\n",bdelim,ws.overruns);
+   fprintf(fp,"Near misses      %c %lu\n",bdelim,ws.near);
+   fprintf(fp,"Min countdown ms %c %.0f\n",bdelim,ws.left_min);
+}
+
+static void wdt_write_stats(void)
+{
+   FILE *fp;
+   char tmpname[256];
+
+   if (statfile == NULL) return;
+   if (strlen(statfile) + 5 > sizeof(tmpname)) return;
+   sprintf(tmpname,"%s.tmp",statfile);
+   fp = fopen(tmpname,"w");
+   if (fp == NULL) return;
+   wdt_show_stats(fp);
+   fclose(fp);
+   rename(tmpname,statfile);   /*readers never see a partial file*/
+}
+
+/* wdt_pet - reset the watchdog, retrying once if the BMC is busy */
+static int wdt_pet(int t, double *plast)
+{
+   double t0, t1, left;
+   int ret, i;
+
+   ws.pets++;   /*one reset, even if it takes a retry*/
+   for (i = 0; i < 2; i++) {
+      t0 = os_mono();
+      ret = reset_wdt();
+      t1 = os_mono();
+      if (ret == 0) break;
+      if (ret == 0xC0) ws.busy++;  /*node busy*/
+      if (fdebug) printf("reset_wdt error %d\n",ret);
+      if (i == 0) os_usleep(0,100000);  /*100 msec*/
+   }
+   if (ret != 0) { ws.errs++; return(ret); }
+   ws.lat_sum += t1 - t0;
+   if (t1 - t0 > ws.lat_max) ws.lat_max = t1 - t0;
+   /* countdown left when this reset was sent, from the last good reset */
+   left = (double)t * 1000.0 - (t0 - *plast);
+   if (left < ws.left_min || ws.left_min == 0) ws.left_min = left;
+   if (left < (double)t * 500.0) ws.near++;
+   *plast = t1;
+   return(ret);
+}
+
+static int wdt_daemon(int t)
+{
+   double next, now, last, late, tstat;
+   int ms, ret;
+   struct sigaction sact;
+#ifdef WDT_TIMERFD
+   struct itimerspec its;
+   struct sched_param sp;
+   uint64_t nexp;
+   int tfd;
+#endif
+
+   if (pet_sec > 0) ms = pet_sec * 1000;
+   else ms = (t * 1000) / pet_div;
+   if (ms < 100 || ms >= t * 1000) {
+      printf("Invalid reset interval %d msec for a %d sec timeout\n",ms,t);
+      return(ERR_BAD_PARAM);
+   }
+   /* no SA_RESTART, so that a signal interrupts the wait for the timer */
+   sact.sa_handler = wdt_sig;
+   sact.sa_flags = 0;
+   sigemptyset(&sact.sa_mask);
+   sigaction(SIGTERM, &sact, NULL);
+   sigaction(SIGINT, &sact, NULL);
+   sigaction(SIGUSR1, &sact, NULL);
+   signal(SIGHUP,SIG_IGN);
+#ifdef WDT_TIMERFD
+   /* keep the resets from waiting on page faults or other tasks */
+   if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) 
+      printf("mlockall error %d, memory not locked\n",errno);
+   if (rt_prio > 0) {
+      memset(&sp,0,sizeof(sp));
+      sp.sched_priority = rt_prio;
+      if (sched_setscheduler(0,SCHED_FIFO,&sp) != 0) 
+         printf("sched_setscheduler(FIFO,%d) error %d\n",rt_prio,errno);
+   }
+   tfd = timerfd_create(CLOCK_MONOTONIC,0);
+   if (tfd < 0) {
+      printf("timerfd_create error %d\n",errno);
+      return(-1);
+   }
+   memset(&its,0,sizeof(its));
+   its.it_value.tv_sec  = ms / 1000;
+   its.it_value.tv_nsec = (ms % 1000) * 1000000L;
+   its.it_interval = its.it_value;
+#endif
+   printf("Resetting watchdog timer every %d.%03d sec, %d sec timeout ...\n",
+	  ms / 1000, ms % 1000, t);
+   fflush(stdout);
+   last = os_mono();
+   ret = wdt_pet(t,&last);  /*also starts the countdown*/
+   if (ret != 0) printf("reset_wdt error %d\n",ret);
+   now = last;
+   next = now + ms;
+   tstat = now + 60000;
+#ifdef WDT_TIMERFD
+   timerfd_settime(tfd,0,&its,NULL);
+#endif
+   while (!wdt_done) {
+#ifdef WDT_TIMERFD
+      if (read(tfd,&nexp,sizeof(nexp)) != sizeof(nexp)) {
+         if (errno == EINTR) {
+            if (wdt_dump) { wdt_dump = 0; wdt_write_stats(); }
+            continue;
+         }
+         printf("timerfd read error %d\n",errno);
+         break;
+      }
+      if (nexp > 1) {  /*the ticks were all late, do one reset for them*/
+         ws.overruns += (ulong)(nexp - 1);
+         next += (double)ms * (double)(nexp - 1);
+      }
+#else
+      now = os_mono();
+      if (next > now) os_usleep(0,(long)((next - now) * 1000.0));
+      if (wdt_done) break;
+#endif
+      now = os_mono();
+      late = now - next;
+      if (late > 0) {
+         ws.late_sum += late;
+         if (late > ws.late_max) ws.late_max = late;
+      }
+      next += ms;
+#ifndef WDT_TIMERFD
+      while (next < now) { ws.overruns++; next += ms; }
+#endif
+      ret = wdt_pet(t,&last);
+      if (ret != 0) printf("reset_wdt error %d\n",ret);
+      if (wdt_dump || now >= tstat) {
+         wdt_dump = 0;
+         tstat = now + 60000;
+         wdt_write_stats();
+      }
+   }
+#ifdef WDT_TIMERFD
+   close(tfd);
+#endif
+   printf("Disabling watchdog timer ...\n");
+   ret = clear_wdt();
+   if (ret != 0) printf("clear_wdt error: ret = %x\n",ret);
+   wdt_write_stats();
+   wdt_show_stats(stdout);
+   return(ret);
+}
+#endif
+
 char *usedesc[6] = {"reserved", "BIOS FRB2", "BIOS/POST",
 		    "OS Load", "SMS/OS", "OEM" };
 
@@ -280,6 +495,7 @@ main(int argc, char **argv)
    uchar freadonly = 1;
    uchar freset = 0;
    uchar fdisable = 0;
+   uchar fresident = 0;
    uchar wdtbuf[8];
    uchar devrec[16];
    int t = 0;
@@ -292,7 +508,7 @@ main(int argc, char **argv)
 #endif
    parse_lan_options('V',"4",0);  /*default to admin priv*/
 
-   while ((c = getopt(argc,argv,"cdelra:p:q:t:T:V:J:EYF:P:N:R:U:Z:x?")) != EOF )
+   while ((c = getopt(argc,argv,"cdelrwa:i:o:p:q:s:t:T:V:J:EYF:P:N:R:U:Z:x?")) != EOF )
       switch(c) {
           case 'r': freset  = 1;   break;  /* reset watchdog timer */
           case 'l': fdontlog = 1;  break;  /* dont log the wdt events */
@@ -315,6 +531,12 @@ main(int argc, char **argv)
           case 'e': freadonly = 0; break;      /* enable wdt */
           case 't': t = atoi(optarg); freadonly = 0; break;  /*timeout*/
           case 'x': fdebug = 1;     break;  /* debug messages */
+#ifdef WDT_DAEMON
+          case 'w': fresident = 1; freadonly = 0; break; /* stay resident */
+          case 'i': pet_sec = atoi(optarg); break;  /* reset interval */
+          case 's': rt_prio = atoi(optarg); break;  /* SCHED_FIFO prio */
+          case 'o': statfile = optarg; break;       /* stats file */
+#endif
           case 'N':    /* nodename */
           case 'U':    /* remote username */
           case 'P':    /* remote password */
@@ -329,7 +551,7 @@ main(int argc, char **argv)
                 parse_lan_options(c,optarg,fdebug);
                 break;
 	  default:
-                printf("Usage: %s [-acdelpqrx -t sec -NUPRETVF]\n", progname);
+                printf("Usage: %s [-acdelpqrwx -t sec -NUPRETVF]\n", progname);
                 printf(" where -r      reset watchdog timer\n");
                 printf("       -a N    set watchdog Action (N=0,1,2,3)\n");
                 printf("       -c      canonical output format\n");
@@ -339,6 +561,12 @@ main(int argc, char **argv)
                 printf("       -p N    set watchdog Preaction (N=0,1,2,3)\n");
                 printf("       -q N    set watchdog pretimeout to N sec\n");
                 printf("       -t N    set timeout to N seconds\n");
+#ifdef WDT_DAEMON
+                printf("       -w      stay resident, reset at 1/4 of the timeout\n");
+                printf("       -i N    with -w, reset every N seconds instead\n");
+                printf("       -o file with -w, write the reset stats to file\n");
+                printf("       -s N    with -w, run as SCHED_FIFO priority N\n");
+#endif
                 printf("       -x      show eXtra debug messages\n");
 		print_lan_opt_usage(0);
 		ret = ERR_USAGE;
@@ -408,6 +636,9 @@ main(int argc, char **argv)
       show_wdt(wdtbuf);
 #endif
    }
+#ifdef WDT_DAEMON
+   if (fresident && !fdisable && ret == 0) ret = wdt_daemon(t);
+#endif
 #ifndef EFI
    printf("\n");
 #endif
@@ -9,6 +9,8 @@
  * 07/21/08 ARCress - fixed for 64-bit memory model
  * 08/12/08 ARCress - trim out extra stuff, consolidated
  * 01/09/23 ARCress - try UEFI_MEM_RANGE_BASE  0x6d5a7000 if error
+ * 10/19/26 - read the tables once and cache them, from sysfs if present,
+ *            with indexes by type and of the Memory Devices
  *----------------------------------------------------------------------*/
 /*----------------------------------------------------------------------*
 The BSD License 
@@ -58,6 +60,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #else // Linux or Solaris
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -511,6 +514,135 @@ int  closeSmBios(UCHAR *ptableAddress, ULONG ulSmBiosLen)
 #ifdef WIN32
 extern "C"  {
 #endif
+///////////////////////////////////////////////////////////////////////////////
+// SMBIOS table cache
+//////////////////////////////////////////////////////////////////////////////
+//  The SMBIOS tables are read once per process, from the Linux sysfs 
+//  copy if present, else via getSmBiosTables, and kept in sm_tab.
+//  The first structure of each type, and each Memory Device (type 17),
+//  are indexed so that lookups do not have to walk the tables again.
+//  This matters for ievents, which calls get_MemDesc for each memory 
+//  SEL record.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef DMI_SYSFS
+#define DMI_SYSFS  "/sys/firmware/dmi/tables"
+#endif
+#define SM_MAXMEM  256		//max Memory Devices indexed
+static UCHAR *sm_tab = NULL;	//copy of the SMBIOS structure table
+static int    sm_len = 0;
+static char   sm_loaded = 0;	//=1 if already tried to load
+static int    sm_first[256];	//offset of first structure by type, or -1
+static int    sm_mem[SM_MAXMEM];	//offsets of type 17 Memory Devices
+static UCHAR  sm_memarray[SM_MAXMEM];	//type 16 array index of each device
+static int    sm_nmem = 0;
+
+#ifndef WIN32
+static int sm_read_file(char *fname, UCHAR **pbuf)
+{
+	FILE *fp;
+	UCHAR *buf = NULL;
+	UCHAR *p;
+	int len = 0, sz = 0, n;
+
+	fp = fopen(fname,"rb");
+	if (fp == NULL) return 0;
+	while (1) {  /* sysfs files may not show their size, so grow it */
+		if (len == sz) {
+			sz += 4096;
+			p = (UCHAR *)realloc(buf,sz);
+			if (p == NULL) { len = 0; break; }
+			buf = p;
+		}
+		n = (int)fread(&buf[len],1,sz - len,fp);
+		if (n <= 0) break;
+		len += n;
+	}
+	fclose(fp);
+	if (len == 0) { if (buf != NULL) free(buf); buf = NULL; }
+	*pbuf = buf;
+	return len;
+}
+#endif
+
+//returns the offset after the string area of the structure at i
+static int sm_next(int i)
+{
+	int j;
+	if (i + 4 > sm_len || sm_tab[i+1] < 4) return sm_len;
+	for (j = i + sm_tab[i+1]; j + 1 < sm_len; j++)
+		if (sm_tab[j] == 0x00 && sm_tab[j+1] == 0x00) return(j+2);
+	return sm_len;
+}
+
+//returns string number n of the structure at i, or NULL
+static char *sm_string(int i, int n)
+{
+	int j, end;
+	if (n == 0) return NULL;
+	end = sm_next(i);
+	j = i + sm_tab[i+1];
+	for ( ; n > 1; n--) {
+		while (j < end && sm_tab[j] != 0x00) j++;
+		j++;  //past EOS
+	}
+	if (j >= end - 1 || sm_tab[j] == 0x00) return NULL;
+	return (char *)&sm_tab[j];
+}
+
+static int sm_load(void)
+{
+	UCHAR *tab = NULL;
+	ULONG len = 0;
+	int i, k, narray;
+
+	if (sm_loaded) return (sm_tab == NULL) ? -1 : 0;
+	sm_loaded = 1;
+	for (i = 0; i < 256; i++) sm_first[i] = -1;
+#ifndef WIN32
+	{
+	   UCHAR *ep = NULL;
+	   int eplen;
+	   len = sm_read_file(DMI_SYSFS "/DMI", &sm_tab);
+	   eplen = sm_read_file(DMI_SYSFS "/smbios_entry_point", &ep);
+	   if (len > 0 && eplen >= 9) {  /*save the smbios revision*/
+		if (memcmp(ep,"_SM3_",5) == 0)
+		   s_iTableRev = (ep[7] << NIBBLE_SIZE) | ep[8];
+		else if (memcmp(ep,SMBIOS_STRING,4) == 0)
+		   s_iTableRev = (ep[SMBIOS_MAJOR_REV_OFFSET] << NIBBLE_SIZE) |
+				 ep[SMBIOS_MINOR_REV_OFFSET];
+	   }
+	   if (ep != NULL) free(ep);
+	   if (fsm_debug) printf("sm_load: %s len=%lu\n",DMI_SYSFS,len);
+	}
+#endif
+	if (len == 0) {  /* map it from memory, and keep a copy */
+		len = getSmBiosTables(&tab);
+		if ((len == 0) || (tab == NULL)) return -1;
+		sm_tab = (UCHAR *)malloc(len);
+		if (sm_tab != NULL) memcpy(sm_tab,tab,len);
+		closeSmBios(tab,len);
+		if (sm_tab == NULL) return -1;
+	}
+	sm_len = (int)len;
+
+	/* build the indexes */
+	narray = 0;
+	for (i = 0; i + 4 <= sm_len; i = sm_next(i)) {
+		k = sm_tab[i];
+		if (sm_tab[i+1] < 4) break;   //malformed
+		if (sm_first[k] < 0) sm_first[k] = i;
+		if (k == 127) break;  //end of table record
+		if (k == 16) narray++;  //Memory Array
+		else if (k == 17 && sm_nmem < SM_MAXMEM) {  //Memory Device
+			sm_memarray[sm_nmem] = (UCHAR)(narray ? narray - 1 : 0);
+			sm_mem[sm_nmem++] = i;
+		}
+	}
+	if (fsm_debug) printf("sm_load: len=%d rev=%x arrays=%d dimms=%d\n",
+				sm_len,s_iTableRev,narray,sm_nmem);
+	return 0;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // getSmBiosRev
 //     return the revision of smbios...in bcd format
@@ -532,78 +664,49 @@ int getSmBiosRev()
 //////////////////////////////////////////////////////////////////////////////
 int get_IpmiStruct(UCHAR *iftype, UCHAR *ver, UCHAR *sa, int *base, UCHAR *inc)
 {
-	UCHAR *VirtualAddress;
-	ULONG SMBiosLen = 0;
-	int length, j,  i;
-	UCHAR Type;
-	int rv = -1;
-
-	SMBiosLen = getSmBiosTables( &VirtualAddress);
-	if ((SMBiosLen == 0) || !VirtualAddress) return rv;
-
-	for(i=0; i<(int)SMBiosLen; )
-	{
-		Type = VirtualAddress[i];
-		length = (int)VirtualAddress[i+1];
-
-		if (Type == 127) //end of table record
-			break;
-		else if (Type == 38) //Found the IPMI Device Information record
-		{
-			if (fsm_debug) {
-			    int j;
-			    printf("IPMI record: ");
-			    for (j = i; j < i+length; j++)
-			       printf("%02x ",VirtualAddress[j]);
-			    printf("\n");
-			}
-			/*
-			 * Byte 05h is the IPMI version as X.Y 
-			 * where X is bits 7:4 and Y bits 3:0
-			 *
- 			 *            KCS Iv sa nv base_addr
- 			 * 26 12 01 00 01 20 20 ff a3 0c 00 00 00 00 00 00 00 00
- 			 *         IPMI 2.0 KCS, sa=0x20 Base=0x0ca2, spacing=1
- 			 * 26 12 73 00 01 20 20 ff a9 0c 00 00 00 00 00 00 40 00
- 			 *         IPMI 2.0 KCS, sa=0x20 Base=0x0ca8, spacing=4
- 			 * 26 10 44 00 04 15 84 01 01 04 00 00 00 00 00 00 
- 			 *         IPMI v1.5 SMBus sa=0x42, base=0x0000000401
- 		 	 */
-			*iftype = VirtualAddress[i+4];
-			*ver    = VirtualAddress[i+5];
-			*sa     = VirtualAddress[i+6];
-			j       = VirtualAddress[i+8] + 
-			  	  (VirtualAddress[i+9] << 8) +
-				  (VirtualAddress[i+10] << 16) +
-				  (VirtualAddress[i+11] << 24);
-			/*if odd, then subtract 1 from base addr*/
-			if (j & 0x01) j -= 1;
-			*base = j;  
-			/* detect Register Spacing */
-			*inc = 1;  /*default*/
-			if ((*iftype != 0x04) && (length >= 18)) {
-		           switch(VirtualAddress[i+16] >>6) {
-			    case 0x00: *inc = 1; break;   /* 1-byte bound*/
-			    case 0x01: *inc = 4; break;   /* 4-byte bound*/
-			    case 0x02: *inc = 16; break;  /*16-byte bound*/
-			    default: break;  /**inc = 1; above*/
-			  }
-			}
-			rv = 0;
-			break;
-		}
-		
-		//Skip this record and go to the end of it.
-		for (j = i+length; j < (int)SMBiosLen; j++) {
-			if (VirtualAddress[j] == 0x00 && 
-			    VirtualAddress[j+1] == 0x00) {
-				i = j+2;
-				break;
-			}
-		}
+	UCHAR *rec;
+	int length, j, i;
+
+	if (sm_load() != 0) return -1;
+	i = sm_first[38];  //the IPMI Device Information record
+	if (i < 0 || i + 12 > sm_len) return -1;
+	rec = &sm_tab[i];
+	length = (int)rec[1];
+	if (fsm_debug) {
+	    printf("IPMI record: ");
+	    for (j = 0; j < length; j++) printf("%02x ",rec[j]);
+	    printf("\n");
 	}
-	closeSmBios(VirtualAddress,SMBiosLen);
-	return rv;
+	/*
+	 * Byte 05h is the IPMI version as X.Y 
+	 * where X is bits 7:4 and Y bits 3:0
+	 *
+	 *            KCS Iv sa nv base_addr
+	 * 26 12 01 00 01 20 20 ff a3 0c 00 00 00 00 00 00 00 00
+	 *         IPMI 2.0 KCS, sa=0x20 Base=0x0ca2, spacing=1
+	 * 26 12 73 00 01 20 20 ff a9 0c 00 00 00 00 00 00 40 00
+	 *         IPMI 2.0 KCS, sa=0x20 Base=0x0ca8, spacing=4
+	 * 26 10 44 00 04 15 84 01 01 04 00 00 00 00 00 00 
+	 *         IPMI v1.5 SMBus sa=0x42, base=0x0000000401
+	 */
+	*iftype = rec[4];
+	*ver    = rec[5];
+	*sa     = rec[6];
+	j       = rec[8] + (rec[9] << 8) + (rec[10] << 16) + (rec[11] << 24);
+	/*if odd, then subtract 1 from base addr*/
+	if (j & 0x01) j -= 1;
+	*base = j;  
+	/* detect Register Spacing */
+	*inc = 1;  /*default*/
+	if ((*iftype != 0x04) && (length >= 18)) {
+	   switch(rec[16] >>6) {
+	    case 0x00: *inc = 1; break;   /* 1-byte bound*/
+	    case 0x01: *inc = 4; break;   /* 4-byte bound*/
+	    case 0x02: *inc = 16; break;  /*16-byte bound*/
+	    default: break;  /**inc = 1; above*/
+	  }
+	}
+	return 0;
 } //getIPMI_struct
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -613,109 +716,52 @@ int get_IpmiStruct(UCHAR *iftype, UCHAR *ver, UCHAR *sa, int *base, UCHAR *inc)
 //  Purpose:    find Type 17 record to get the Memory Locator Description
 //  Returns:    0 for success, or -1 if not found.
 //              if success, the desc string will have valid data
+//  Notes:      dimm is the index of the Memory Device in the whole table
 //////////////////////////////////////////////////////////////////////////////
 int get_MemDesc(UCHAR array, UCHAR dimm, char *desc, int *psize)
 {
-	UCHAR *VirtualAddress;
-	ULONG SMBiosLen = 0;
-	int length, j,  i;
-	int iarray, idimm;
-	UCHAR Type;
-	int rv = -1;
-	char dimmstr[32];
-	char bankstr[32];
-
-	SMBiosLen = getSmBiosTables( &VirtualAddress);
-	if ((SMBiosLen == 0) || !VirtualAddress) return rv;
-	if (desc == NULL) return(-1);
-	bankstr[0] = 0;
-	dimmstr[0] = 0;
+	UCHAR *rec;
+	char *dimmstr, *bankstr;
+	int i, j, bank, sz;
 
+	if (desc == NULL) return(-1);
+	if ((sm_load() != 0) || (dimm >= sm_nmem)) {
+		/* fill in a default if error */
+		sprintf(desc,"DIMM(%d)",dimm);
+		return -1;
+	}
 	if (fsm_debug) printf("get_MemDesc(%d,%d)\n",array,dimm);
-	iarray = 0;
-	idimm = 0;
-	for(i=0; i<(int)SMBiosLen; )
-	{
-		Type = VirtualAddress[i];
-		length = (int)VirtualAddress[i+1];
-
-		if (Type == 127) //end of table record
-			break;
-		else if (Type == 16) //Found a Memory Array */
-		{
-		    /* usually only one onboard memory array */
-		    if (array == iarray) ; /*match*/
-		    else iarray++;
-		}
-		else if (Type == 17) //Found a Memory Device */
-		{
-		   int bank, k, n, nStr, nBLoc, sz;
-		   if (dimm == idimm) 
-		   {
-			if (fsm_debug) {
-			      printf("Memory record %d.%d: ",iarray,idimm);
-			      for (j = i; j < (i+length+16); j++) {
-				 if (((j-i) % 16) == 0) printf("\n");
-			         printf("%02x ",VirtualAddress[j]);
-			      }
-			      printf("\n");
-		   	}
-			/*
-			 * Memory Device record
-			 * walk through strings to find Locator
- 		 	 */
-			sz = VirtualAddress[i+12] + (VirtualAddress[i+13] << 8); /*Size*/
-			bank = VirtualAddress[i+15]; /*Set*/
-			nStr = VirtualAddress[i+16]; /*Locator string num*/
-			nBLoc = VirtualAddress[i+17]; /*BankLocator string num*/
-			if (fsm_debug) 
-				printf("bank=%d nStr=%d sz=%x\n",bank,nStr,sz);
-			k = i + length;  /*hdr len (usu 0x1B)*/
-			n = 1;  /* string number index */
-			for (j = k; j < (int)SMBiosLen; j++) {
-			   if (VirtualAddress[j] == 0x00 && 
-			       VirtualAddress[j-1] == 0x00) break;
-			   else if (VirtualAddress[j] == 0x00) {
-			      if (fsm_debug) printf("str[%d] = %s\n",
-						    n,&VirtualAddress[k]);
-			      if (n == nBLoc) { /*bank string*/
-			          strcpy(bankstr,(char *)&VirtualAddress[k]);
-				  break; /*string number*/
-			      }
-			      if (n == nStr) {
-			          strcpy(dimmstr,(char *)&VirtualAddress[k]);
-			      }
-			      n++; k = j + 1; 
-			   }
-			}
-			if ((desc != NULL) && (j < (int)SMBiosLen)) {
-			   sprintf(desc,"%s/%s",bankstr,dimmstr);
-			   rv = 0;
-			} else {  /* have header, but not string */
-			   char b;
-			   if ((idimm % 2) == 0) b = 'A';
-			   else b = 'B';
-			   sprintf(desc,"DIMM%d%c",bank,b);
-			   rv = 0;
-			}
-			*psize = sz;
-			break;
-		   } else idimm++; /*else go to next dimm*/
-		}
-		
-		//Skip this record and go to the end of it.
-		for (j = i+length; j < (int)SMBiosLen; j++) {
-			if (VirtualAddress[j] == 0x00 && 
-			    VirtualAddress[j+1] == 0x00) {
-				i = j+2;
-				break;
-			}
-		}
+	i = sm_mem[dimm];
+	rec = &sm_tab[i];
+	if (fsm_debug) {
+	      printf("Memory record %d.%d: ",sm_memarray[dimm],dimm);
+	      for (j = i; (j < (i+rec[1]+16)) && (j < sm_len); j++) {
+		 if (((j-i) % 16) == 0) printf("\n");
+	         printf("%02x ",sm_tab[j]);
+	      }
+	      printf("\n");
+	}
+	if (rec[1] < 0x12) {  /* have header, but not strings */
+	   char b;
+	   if ((dimm % 2) == 0) b = 'A';
+	   else b = 'B';
+	   sprintf(desc,"DIMM%d%c",(rec[1] > 15) ? rec[15] : 0,b);
+	   *psize = 0;
+	   return 0;
 	}
-	closeSmBios(VirtualAddress,SMBiosLen);
-	/* fill in a default if error */
-	if ((rv != 0) && (desc != NULL)) sprintf(desc,"DIMM(%d)",dimm);
-	return rv;
+	/*
+	 * Memory Device record
+	 * the Locator and BankLocator are string numbers
+	 */
+	sz = rec[12] + (rec[13] << 8); /*Size*/
+	bank = rec[15]; /*Set*/
+	dimmstr = sm_string(i,rec[16]);  /*Locator*/
+	bankstr = sm_string(i,rec[17]);  /*BankLocator*/
+	if (fsm_debug) printf("bank=%d nStr=%d sz=%x\n",bank,rec[16],sz);
+	sprintf(desc,"%.31s/%.31s",(bankstr ? bankstr : ""),
+		(dimmstr ? dimmstr : ""));
+	*psize = sz;
+	return 0;
 } //get_MemDesc
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -728,162 +774,49 @@ int get_MemDesc(UCHAR array, UCHAR dimm, char *desc, int *psize)
 int get_BiosVersion(char *bios_str)
 {
 #define BIOS_VERSION	0x05	//Specifies string number of BIOS Ver string
-	UCHAR *VirtualAddress;
-	ULONG SMBiosLen = 0;
-	int recLength, j,  i, k = 0, str_num;
-	UCHAR recType;
-	int rv = -1;
-
-	SMBiosLen = getSmBiosTables( &VirtualAddress);
-	if ((SMBiosLen == 0) || !VirtualAddress) return rv;
-	i=0; 
-	while (i<(int)SMBiosLen)
-	{
-		recType = VirtualAddress[i];
-		recLength = (int)VirtualAddress[i+1];
-
-		// end of table record, error 
-		if (recType == 127) return -1;
-		else if (recType == 0) 
-		{ 	// BIOS Information (Type 0) record found
-			//Set index j to the end of the formated part of record.
-			j = i + recLength;
-
-			//First grab string number of the BIOS Version string
-			//This non-zero number specifies which string at the end
-			//of the record is the BIOS Version string. 
-			str_num = VirtualAddress[i + BIOS_VERSION];
-
-			//Now skip over strings at the end of the record till we
-			//get to the BIOS Version string 
-			for (str_num--;str_num > 0; str_num--)
-			{
-				//Skipping over one string at a time
-				for (; VirtualAddress[j] != 0x00; j++);
-				j++; //Advance index past EOS.
-			}				
-
-			//Copy the BIOS Version string into buffer from caller.
-			for (; VirtualAddress[j] != 0x00; j++)
-			{
-				bios_str[k++] = VirtualAddress[j];
-			}				
-			bios_str[k] = '\0';
-			rv = 0;
-			break;  /*exit while loop*/
-		} else {
-			//Not a Type 0, so skip to the end of this structure
-			for (j = i+recLength; j < (int)SMBiosLen; j++)
-			{
-				if (VirtualAddress[j] == 0x00 && 
-				    VirtualAddress[j+1] == 0x00)
-				{
-					i = j+2;
-					break;
-				}
-			}
-		}	
-	} /*end while*/
-	closeSmBios(VirtualAddress,SMBiosLen);
-	return rv;
+	char *pstr;
+	int i;
+
+	if (sm_load() != 0) return -1;
+	i = sm_first[0];  // BIOS Information (Type 0) record
+	if (i < 0 || sm_tab[i+1] <= BIOS_VERSION) return -1;
+	pstr = sm_string(i,sm_tab[i + BIOS_VERSION]);
+	if (pstr == NULL) bios_str[0] = '\0';
+	else strcpy(bios_str,pstr);
+	return 0;
 }
 
 int get_ChassisSernum(char *chs_str, char fdbg)
 {
 #define CHASSIS_SERNUM	0x07	//Specifies string number of BIOS Ver string
-	UCHAR *VirtualAddress;
-	ULONG SMBiosLen = 0;
-	int recLength, j,  i, k = 0, str_num;
-	UCHAR recType;
-	int rv = -1;
-
-	SMBiosLen = getSmBiosTables( &VirtualAddress);
-	if ((SMBiosLen == 0) || !VirtualAddress) return rv;
-	i=0; 
-	while (i<(int)SMBiosLen)
-	{
-		recType = VirtualAddress[i];
-		recLength = (int)VirtualAddress[i+1];
-		if (recType == 127) return -1; // end of table record, error 
-		else if (recType == 3) 
-		{ 	// Chassis Information (Type 3) record found
-			j = i + recLength;
-			str_num = VirtualAddress[i + CHASSIS_SERNUM];
-			for (str_num--;str_num > 0; str_num--)
-			{
-				for (; VirtualAddress[j] != 0x00; j++);
-				j++; 
-			}
-			for (; VirtualAddress[j] != 0x00; j++)
-			{ chs_str[k++] = VirtualAddress[j]; }
-			chs_str[k] = '\0';
-			/* also copy Chassis Manuf */
-			j = i + recLength;
-			memcpy(&chs_str[k+1],&VirtualAddress[j],20);
-			rv = 0;
-			break;  /*exit while loop*/
-		} else {
-			//Not a Type 0, so skip to the end of this structure
-			for (j = i+recLength; j < (int)SMBiosLen; j++)
-			{
-				if (VirtualAddress[j] == 0x00 && 
-				    VirtualAddress[j+1] == 0x00)
-				{
-					i = j+2;
-					break;
-				}
-			}
-		}
-	} /*end while*/
-	closeSmBios(VirtualAddress,SMBiosLen);
-	return rv;
+	char *pstr;
+	int i, j, k, n;
+
+	if (sm_load() != 0) return -1;
+	i = sm_first[3];  // Chassis Information (Type 3) record
+	if (i < 0 || sm_tab[i+1] <= CHASSIS_SERNUM) return -1;
+	pstr = sm_string(i,sm_tab[i + CHASSIS_SERNUM]);
+	if (pstr == NULL) chs_str[0] = '\0';
+	else strcpy(chs_str,pstr);
+	k = (int)strlen(chs_str);
+	/* also copy Chassis Manuf */
+	j = i + sm_tab[i+1];
+	n = sm_len - j;
+	if (n > 20) n = 20;
+	memset(&chs_str[k+1],0,20);
+	memcpy(&chs_str[k+1],&sm_tab[j],n);
+	return 0;
 }
 
 int get_SystemGuid(UCHAR *guid)
 {
-	UCHAR *VirtualAddress;
-	ULONG SMBiosLen = 0;
-	int recLength, i, j,  n, k = 0;
-	UCHAR recType;
-	int rv = -1;
-
-	SMBiosLen = getSmBiosTables( &VirtualAddress);
-	if ((SMBiosLen == 0) || !VirtualAddress) return rv;
-	i=0; 
-	while (i<(int)SMBiosLen)
-	{
-		recType = VirtualAddress[i];
-		recLength = (int)VirtualAddress[i+1];
-
-		// end of table record, error 
-		if (recType == 127) return -1;
-		else if (recType == 1) 
-		{ 	// System Board Information (Type 1) record found
-			//Set index j to the end of the formated part of record.
-			j = i + recLength;
-			n  = i + 8;  /*UUID offset 8*/
-			//Copy the UUID string into buffer from caller.
-			for (k = 0; k < 16; k++)
-			{
-				guid[k] = VirtualAddress[n + k];
-			}				
-			rv = 0;
-			break;  /*exit while loop*/
-		} else {
-			//else skip to the end of this structure
-			for (j = i+recLength; j < (int)SMBiosLen; j++)
-			{
-				if (VirtualAddress[j] == 0x00 && 
-				    VirtualAddress[j+1] == 0x00)
-				{
-					i = j+2;
-					break;
-				}
-			}
-		}	
-	} /*end while*/
-	closeSmBios(VirtualAddress,SMBiosLen);
-	return rv;
+	int i;
+
+	if (sm_load() != 0) return -1;
+	i = sm_first[1];  // System Information (Type 1) record
+	if (i < 0 || sm_tab[i+1] < 8+16) return -1;
+	memcpy(guid,&sm_tab[i + 8],16);  /*UUID offset 8*/
+	return 0;
 }
 #ifdef WIN32
 }
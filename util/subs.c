@@ -7,6 +7,9 @@
  * Copyright (c) 2010 Kontron America, Inc.
  *
  * 08/18/11 Andy Cress - created to consolidate subroutines
+ * 10/19/26 - added the SEL cursor journal routines (cursor_*)
+ * 10/19/26 - added the async event sink (evsink_*) for write_syslog
+ * 10/19/26 - added read_nodes, node_fork, node_reap for the fleet modes
  */
 /*M*
 Copyright (c) 2010 Kontron America, Inc.
@@ -40,8 +43,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <time.h>
 #ifdef WIN32
 #include <windows.h>
+#include <io.h>
 // #if !defined(LONG_MAX)
 // # if __WORDSIZE == 64
 // #  define LONG_MAX     9223372036854775807L
@@ -56,6 +61,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <unistd.h>
 #include <syslog.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
+#define EVSINK_ASYNC  1
 #endif
 
 #include "ipmicmd.h"
@@ -599,6 +613,36 @@ void os_usleep(int s, int u)
 #endif
 }
 
+/* os_msec - returns a millisecond clock, for timing intervals */
+ulong os_msec(void)
+{
+#ifdef WIN32
+   return((ulong)GetTickCount());
+#elif defined(DOS)
+   return((ulong)time(NULL) * 1000);
+#elif defined(CLOCK_MONOTONIC)
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC,&ts);
+   return((ulong)ts.tv_sec * 1000 + (ts.tv_nsec / 1000000));
+#else
+   struct timeval tv;
+   gettimeofday(&tv,NULL);
+   return((ulong)tv.tv_sec * 1000 + (tv.tv_usec / 1000));
+#endif
+}
+
+/* os_mono - returns a monotonic clock in msec, with sub-msec resolution */
+double os_mono(void)
+{
+#if defined(CLOCK_MONOTONIC) && !defined(WIN32) && !defined(DOS)
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC,&ts);
+   return((double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0);
+#else
+   return((double)os_msec());
+#endif
+}
+
 #define  SYS_INFO_MAX    64
 
 static int sysinfo_has_len(uchar enc, int vendor)
@@ -853,6 +897,7 @@ void WriteSyslog(char *msgbuf)
 int write_syslog(char *msg)
 {		/* not used in showsel, but used by getevent, hwreset */
    int rv;
+   if (evsink_put(msg) == 0) return(0);  /*queued to the event sink*/
    rv = OpenSyslog("ipmiutil");
    if (rv == 0) {
       WriteSyslog(msg);
@@ -861,4 +906,722 @@ int write_syslog(char *msg)
    return(rv);
 }
 
+/*
+ * Event sink
+ * Queues the decoded event records for a background writer thread,
+ * so that the SEL read loop does not wait on syslog or the disk.
+ * The queue is a bounded lock-free ring (one sequence number per slot),
+ * and the writer drains it in batches to syslog, a file, or a Unix 
+ * datagram socket.  If the queue is full, the record is dropped and
+ * counted, rather than blocking the caller.
+ * Without pthreads (WIN32, DOS), evsink_put returns -1 and the records 
+ * are written directly.
+ */
+#define EVSINK_MSGSZ  256
+#define EVSINK_QSZ    1024   /*default queue slots, a power of 2*/
+#define EVSINK_BATCH  64     /*max records per writer batch*/
+#define SINK_SYSLOG   0
+#define SINK_FILE     1
+#define SINK_UNIX     2
+#ifdef EVSINK_ASYNC
+typedef struct {
+   volatile ulong seq;
+   char msg[EVSINK_MSGSZ];
+} EVSINK_SLOT;
+static EVSINK_SLOT *sink_q = NULL;
+static ulong  sink_mask = 0;
+static volatile ulong sink_head = 0;  /*next slot to put*/
+static ulong  sink_tail = 0;          /*next slot to write*/
+static char   sink_type = SINK_SYSLOG;
+static char   sink_tag[32];
+static char  *sink_path = NULL;
+static FILE  *sink_fp = NULL;
+static int    sink_sock = -1;
+static struct sockaddr_un sink_addr;
+static volatile int sink_run = 0;
+static pthread_t sink_thread;
+static pthread_mutex_t sink_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  sink_cv    = PTHREAD_COND_INITIALIZER;
+#endif
+static volatile ulong sink_nput  = 0;   /*records queued*/
+static volatile ulong sink_ndrop = 0;   /*records dropped, queue full*/
+static volatile ulong sink_nbp   = 0;   /*puts with the queue >3/4 full*/
+static volatile int   sink_maxdepth = 0;
+static ulong  sink_nwrite = 0;          /*records written*/
+static ulong  sink_nerr   = 0;          /*write errors*/
+
+#ifdef EVSINK_ASYNC
+static void sink_write(char *msg)
+{
+   int len;
+   switch(sink_type) {
+   case SINK_FILE:
+      if (fputs(msg,sink_fp) < 0) sink_nerr++;
+      len = strlen_(msg);
+      if (len == 0 || msg[len-1] != '\n') fputc('\n',sink_fp);
+      break;
+   case SINK_UNIX:  /* one datagram per record */
+      len = strlen_(msg);
+      if (sendto(sink_sock,msg,len,0,(struct sockaddr *)&sink_addr,
+		 sizeof(sink_addr)) < 0) sink_nerr++;
+      break;
+   default:
+      WriteSyslog(msg);
+      break;
+   }
+   sink_nwrite++;
+}
+
+/* sink_drain - write up to max queued records, returns the number */
+static int sink_drain(int max)
+{
+   EVSINK_SLOT *q;
+   int n = 0;
+   while (n < max) {
+      q = &sink_q[sink_tail & sink_mask];
+      if (q->seq != sink_tail + 1) break;  /*not filled yet*/
+      __sync_synchronize();
+      sink_write(q->msg);
+      __sync_synchronize();
+      q->seq = sink_tail + sink_mask + 1;  /*free for the next lap*/
+      sink_tail++;
+      n++;
+   }
+   if (n > 0 && sink_type == SINK_FILE) fflush(sink_fp);
+   return(n);
+}
+
+static void *sink_writer(void *arg)
+{
+   struct timespec ts;
+   int n;
+   while (1) {
+      n = sink_drain(EVSINK_BATCH);
+      if (n > 0) continue;
+      if (!sink_run) {   /*stopped, so get any put that raced the stop*/
+         __sync_synchronize();
+         while (sink_drain(EVSINK_BATCH) > 0) ;
+         break;
+      }
+      /* The puts do not take the mutex, so wait with a short timeout
+       * in case a wakeup was missed. */
+      pthread_mutex_lock(&sink_mutex);
+      clock_gettime(CLOCK_REALTIME,&ts);
+      ts.tv_nsec += 50000000L;  /*50 ms*/
+      if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+      pthread_cond_timedwait(&sink_cv,&sink_mutex,&ts);
+      pthread_mutex_unlock(&sink_mutex);
+   }
+   return(NULL);
+}
+#endif
+
+/* 
+ * evsink_open
+ * Starts the event sink writer thread.
+ * dest is NULL or "syslog" for syslog, "unix:/path" for a Unix datagram
+ * socket, or a file pathname.  qsize is the number of queue slots, 
+ * or 0 for the default.
+ */
+int evsink_open(char *tag, char *dest, int qsize)
+{
+#ifdef EVSINK_ASYNC
+   sigset_t all, old;
+   ulong i, sz;
+   int rv = 0;
+
+   if (sink_run) return(0);  /*already open*/
+   if (tag == NULL) tag = "ipmiutil";
+   strncpy(sink_tag,tag,sizeof(sink_tag)-1);
+   if (qsize <= 0) qsize = EVSINK_QSZ;
+   for (sz = 16; sz < (ulong)qsize; sz <<= 1) ;
+   if (dest == NULL || strcmp(dest,"syslog") == 0) {
+      sink_type = SINK_SYSLOG;
+      rv = OpenSyslog(sink_tag);
+   } else if (strncmp(dest,"unix:",5) == 0) {
+      sink_type = SINK_UNIX;
+      sink_path = &dest[5];
+      memset(&sink_addr,0,sizeof(sink_addr));
+      sink_addr.sun_family = AF_UNIX;
+      if (strlen_(sink_path) >= (int)sizeof(sink_addr.sun_path)) 
+         return(ERR_BAD_PARAM);
+      strcpy(sink_addr.sun_path,sink_path);
+      sink_sock = socket(AF_UNIX,SOCK_DGRAM,0);
+      if (sink_sock < 0) rv = ERR_FILE_OPEN;
+   } else {
+      sink_type = SINK_FILE;
+      sink_path = dest;
+      sink_fp = fopen(dest,"a");
+      if (sink_fp == NULL) rv = ERR_FILE_OPEN;
+   }
+   if (rv != 0) {
+      printf("evsink_open: cannot open %s\n",dest);
+      return(rv);
+   }
+   if (sink_q != NULL) free(sink_q);
+   sink_q = calloc(sz,sizeof(EVSINK_SLOT));
+   if (sink_q == NULL) return(-1);
+   for (i = 0; i < sz; i++) sink_q[i].seq = i;
+   sink_mask = sz - 1;
+   sink_head = 0;
+   sink_tail = 0;
+   sink_nput = sink_ndrop = sink_nbp = 0;
+   sink_nwrite = sink_nerr = 0;
+   sink_maxdepth = 0;
+   sink_run = 1;
+   /* the signals are handled by the main thread */
+   sigfillset(&all);
+   pthread_sigmask(SIG_BLOCK,&all,&old);
+   if (pthread_create(&sink_thread,NULL,sink_writer,NULL) != 0) {
+      sink_run = 0;
+      rv = -1;
+   }
+   pthread_sigmask(SIG_SETMASK,&old,NULL);
+   if (fdebug) printf("evsink_open(%s,%d slots) rv=%d\n",
+			(dest ? dest : "syslog"),(int)sz,rv);
+   return(rv);
+#else
+   return(LAN_ERR_NOTSUPPORT);
+#endif
+}
+
+/* 
+ * evsink_put
+ * Queues one record for the sink writer, without blocking.
+ * Returns 0 if queued or dropped, or -1 if the sink is not open,
+ * in which case the caller should write the record itself.
+ */
+int evsink_put(char *msg)
+{
+#ifdef EVSINK_ASYNC
+   EVSINK_SLOT *q;
+   ulong pos;
+   long diff;
+   int depth;
+
+   if (!sink_run || msg == NULL) return(-1);
+   pos = sink_head;
+   while (1) {
+      q = &sink_q[pos & sink_mask];
+      diff = (long)(q->seq - pos);
+      if (diff == 0) {
+         if (__sync_bool_compare_and_swap(&sink_head,pos,pos+1)) break;
+         pos = sink_head;
+      } else if (diff < 0) {  /*full*/
+         __sync_fetch_and_add(&sink_ndrop,1);
+         return(0);
+      } else pos = sink_head;
+   }
+   strncpy(q->msg,msg,EVSINK_MSGSZ-1);
+   q->msg[EVSINK_MSGSZ-1] = 0;
+   __sync_synchronize();
+   q->seq = pos + 1;   /*ready for the writer*/
+   __sync_fetch_and_add(&sink_nput,1);
+   depth = (int)(pos + 1 - sink_tail);
+   if (depth > sink_maxdepth) sink_maxdepth = depth;
+   if (depth > (int)((sink_mask + 1) * 3 / 4)) 
+      __sync_fetch_and_add(&sink_nbp,1);
+   if (depth >= EVSINK_BATCH && pthread_mutex_trylock(&sink_mutex) == 0) {
+      pthread_cond_signal(&sink_cv);
+      pthread_mutex_unlock(&sink_mutex);
+   }
+   return(0);
+#else
+   return(-1);
+#endif
+}
+
+/* evsink_stats - get the sink counters */
+void evsink_stats(ulong *nput, ulong *ndrop, ulong *nbp, int *maxdepth)
+{
+   if (nput != NULL) *nput = sink_nput;
+   if (ndrop != NULL) *ndrop = sink_ndrop;
+   if (nbp != NULL) *nbp = sink_nbp;
+   if (maxdepth != NULL) *maxdepth = sink_maxdepth;
+}
+
+/* evsink_close - flush the queued records and stop the writer */
+void evsink_close(void)
+{
+#ifdef EVSINK_ASYNC
+   if (!sink_run) return;
+   sink_run = 0;
+   pthread_mutex_lock(&sink_mutex);
+   pthread_cond_signal(&sink_cv);
+   pthread_mutex_unlock(&sink_mutex);
+   pthread_join(sink_thread,NULL);
+   if (fdebug) 
+      printf("evsink: %lu queued, %lu written, %lu dropped, %lu errors, "
+		"%lu backpressure, max depth %d\n", sink_nput, sink_nwrite,
+		sink_ndrop, sink_nerr, sink_nbp, sink_maxdepth);
+   switch(sink_type) {
+   case SINK_FILE: fclose(sink_fp); sink_fp = NULL; break;
+   case SINK_UNIX: close(sink_sock); sink_sock = -1; break;
+   default: CloseSyslog(); break;
+   }
+#endif
+}
+
+/*
+ * SEL cursor journal
+ * The saved SEL cursors (last record id and timestamp) are appended 
+ * as one line per update to a journal file, instead of rewriting an 
+ * index file after each event.  Each line has a checksum, so a line 
+ * torn by a crash is ignored, and on recovery the last valid line for 
+ * each key wins.  A key is usually the BMC nodename, so one journal 
+ * can hold the cursors for many BMCs.  The journal is synced to disk 
+ * after every jrn_batch updates (or JRN_SYNCSEC seconds), and is 
+ * compacted to one line per key when it grows past JRN_COMPACT lines.
+ */
+#define JRN_MAXKEYS  256
+#define JRN_KEYSZ    (SZGNODE+1)
+#define JRN_COMPACT  1024   /*compact after this many stale lines*/
+#define JRN_SYNCSEC  5      /*max seconds that an update stays unsynced*/
+typedef struct {
+   char   key[JRN_KEYSZ];
+   ushort recid;
+   uint   itime;
+} JRN_CURSOR;
+static JRN_CURSOR *jrn_tab = NULL;
+static int    jrn_n = 0;        /*number of keys*/
+static int    jrn_nlines = 0;   /*number of lines in the journal now*/
+static int    jrn_batch = 1;    /*sync after this many updates*/
+static int    jrn_unsync = 0;   /*updates not yet synced*/
+static time_t jrn_synctime = 0;
+static FILE  *jrn_fp = NULL;
+static char   jrn_file[256];
+
+static ushort jrn_cksum(char *buf, int len)
+{   /* Fletcher-16 over the text of the line */
+   ushort s1 = 0, s2 = 0;
+   int i;
+   for (i = 0; i < len; i++) {
+      s1 = (s1 + (uchar)buf[i]) % 255;
+      s2 = (s2 + s1) % 255;
+   }
+   return((ushort)((s2 << 8) | s1));
+}
+
+static char *jrn_key(char *key)
+{
+   if (key == NULL || key[0] == 0) return("local");
+   return(key);
+}
+
+static JRN_CURSOR *jrn_find(char *key, int fadd)
+{
+   int i;
+   key = jrn_key(key);
+   for (i = 0; i < jrn_n; i++)
+      if (strncmp(jrn_tab[i].key,key,JRN_KEYSZ-1) == 0) return(&jrn_tab[i]);
+   if (!fadd || jrn_n >= JRN_MAXKEYS) return(NULL);
+   memset(&jrn_tab[jrn_n],0,sizeof(JRN_CURSOR));
+   strncpy(jrn_tab[jrn_n].key,key,JRN_KEYSZ-1);
+   return(&jrn_tab[jrn_n++]);
+}
+
+static int jrn_format(char *buf, int sz, JRN_CURSOR *c)
+{
+   int len;
+   len = snprintf(buf,sz,"%s %04x %08x",c->key,c->recid,c->itime);
+   len += snprintf(&buf[len],sz-len," %04x\n",jrn_cksum(buf,len));
+   return(len);
+}
+
+/* jrn_parse - returns 0 if the line is complete and its checksum is ok */
+static int jrn_parse(char *line, JRN_CURSOR *c)
+{
+   char *p;
+   uint r, t, ck;
+   int len;
+   len = strlen_(line);
+   if (len < 2 || line[len-1] != '\n') return(-1);  /*torn*/
+   p = strrchr(line,' ');
+   if (p == NULL) return(-1);
+   if (sscanf(p," %x",&ck) != 1) return(-1);
+   if (ck != jrn_cksum(line,(int)(p - line))) return(-1);
+   *p = 0;
+   p = strrchr(line,' ');
+   if (p == NULL || sscanf(p," %x",&t) != 1) return(-1);
+   *p = 0;
+   p = strrchr(line,' ');
+   if (p == NULL || sscanf(p," %x",&r) != 1) return(-1);
+   *p = 0;
+   if ((p - line) >= JRN_KEYSZ) return(-1);
+   strcpy(c->key,line);
+   c->recid = (ushort)r;
+   c->itime = t;
+   return(0);
+}
+
+/* jrn_sync - flush to disk, returns 0 if all the writes made it */
+static int jrn_sync(FILE *fp)
+{
+   int rv;
+   rv = fflush(fp);
+   if (rv == 0 && ferror(fp)) rv = -1;
+#ifdef WIN32
+   if (rv == 0) rv = _commit(_fileno(fp));
+#elif defined(DOS)
+   ;
+#else
+   if (rv == 0) rv = fsync(fileno(fp));
+#endif
+   return(rv);
+}
+
+/* jrn_syncdir - make a rename in the journal directory durable */
+static void jrn_syncdir(void)
+{
+#if !defined(WIN32) && !defined(DOS)
+   char dir[sizeof(jrn_file)];
+   char *p;
+   int fd;
+
+   strcpy(dir,jrn_file);
+   p = strrchr(dir,'/');
+   if (p == NULL) strcpy(dir,".");
+   else if (p == dir) p[1] = 0;
+   else *p = 0;
+   fd = open(dir,O_RDONLY);
+   if (fd < 0) return;
+   fsync(fd);
+   close(fd);
+#endif
+}
+
+#if !defined(WIN32) && !defined(DOS)
+static int jrn_setlk(FILE *fp)
+{
+   struct flock fl;
+   memset(&fl,0,sizeof(fl));
+   fl.l_type = F_WRLCK;
+   fl.l_whence = SEEK_SET;
+   return(fcntl(fileno(fp),F_SETLK,&fl));
+}
+
+/* jrn_lock - only one process may append to a journal at a time */
+static int jrn_lock(FILE *fp)
+{
+   struct stat st1, st2;
+   if (jrn_setlk(fp) < 0) return(-1);
+   /* make sure it was not replaced by a compaction meanwhile */
+   if (fstat(fileno(fp),&st1) < 0 || stat(jrn_file,&st2) < 0) return(-1);
+   if (st1.st_ino != st2.st_ino || st1.st_dev != st2.st_dev) return(-1);
+   return(0);
+}
+#endif
+
+/*
+ * jrn_compact - rewrite the journal with one line per key, and make 
+ * the new file jrn_fp.  The new file is locked before it is renamed over
+ * the journal, and the old one stays locked until then, so that no other
+ * process can claim the journal in between.  If any write fails, the
+ * old journal is kept.
+ */
+static int jrn_compact(void)
+{
+   char tmpfile[sizeof(jrn_file)+4];
+   char line[JRN_KEYSZ+24];
+   FILE *fp;
+   int i, len;
+   int rv = 0;
+
+   snprintf(tmpfile,sizeof(tmpfile),"%s.tmp",jrn_file);
+   fp = fopen(tmpfile,"w");
+   if (fp == NULL) return(ERR_FILE_OPEN);
+#if !defined(WIN32) && !defined(DOS)
+   if (jrn_setlk(fp) < 0) rv = ERR_FILE_OPEN;
+#endif
+   for (i = 0; (rv == 0) && (i < jrn_n); i++) {
+      len = jrn_format(line,sizeof(line),&jrn_tab[i]);
+      if (fwrite(line,1,len,fp) != (size_t)len) rv = ERR_FILE_OPEN;
+   }
+   if (rv == 0 && jrn_sync(fp) != 0) rv = ERR_FILE_OPEN;
+#ifdef WIN32
+   if (rv == 0) {  /*rename will not replace it, nor remove it if open*/
+      if (jrn_fp != NULL) { fclose(jrn_fp); jrn_fp = NULL; }
+      remove(jrn_file);
+   }
+#endif
+   if (rv == 0 && rename(tmpfile,jrn_file) != 0) rv = ERR_FILE_OPEN;
+   if (rv != 0) {
+      fclose(fp);
+      remove(tmpfile);
+      return(rv);
+   }
+   jrn_syncdir();
+   if (jrn_fp != NULL) fclose(jrn_fp);  /*drops the lock on the old file*/
+   jrn_fp = fp;
+   if (fdebug) printf("cursor journal %s compacted, %d -> %d lines\n",
+			jrn_file,jrn_nlines,jrn_n);
+   jrn_nlines = jrn_n;
+   return(0);
+}
+
+static int jrn_reopen(void)
+{
+   jrn_fp = fopen(jrn_file,"a");
+   if (jrn_fp == NULL) return(ERR_FILE_OPEN);
+#if !defined(WIN32) && !defined(DOS)
+   if (jrn_lock(jrn_fp) != 0) {
+      printf("cursor journal %s is in use by another process\n",jrn_file);
+      fclose(jrn_fp);
+      jrn_fp = NULL;
+      return(ERR_FILE_OPEN);
+   }
+#endif
+   return(0);
+}
+
+/* 
+ * cursor_open
+ * Opens the journal file, and recovers the last valid cursor for
+ * each key from it.  nbatch is the number of updates between syncs.
+ * Returns 0 if ok, or < 0 if the journal cannot be used, in which
+ * case the caller should fall back to its index file.
+ */
+int cursor_open(char *jfile, int nbatch)
+{
+   char line[JRN_KEYSZ+64];
+   JRN_CURSOR c, *pc;
+   FILE *fp;
+   char ftorn = 0;
+   int rv;
+
+   if (jrn_fp != NULL) return(0);  /*already open*/
+   if (jfile == NULL || strlen_(jfile) >= (int)sizeof(jrn_file)) 
+      return(ERR_BAD_PARAM);
+   strcpy(jrn_file,jfile);
+   if (jrn_tab == NULL) {
+      jrn_tab = calloc(JRN_MAXKEYS,sizeof(JRN_CURSOR));
+      if (jrn_tab == NULL) return(-1);
+   }
+   jrn_n = 0;
+   jrn_nlines = 0;
+   jrn_batch = (nbatch > 0) ? nbatch : 1;
+   fp = fopen(jrn_file,"r");
+   if (fp != NULL) {
+      while (fgets(line,sizeof(line),fp) != NULL) {
+         jrn_nlines++;
+         if (jrn_parse(line,&c) != 0) { ftorn = 1; continue; }
+         pc = jrn_find(c.key,1);
+         if (pc == NULL) continue;
+         pc->recid = c.recid;
+         pc->itime = c.itime;
+      }
+      fclose(fp);
+   }
+   if (fdebug) printf("cursor journal %s: %d lines, %d keys, torn=%d\n",
+			jrn_file,jrn_nlines,jrn_n,ftorn);
+   /* Claim the journal before any rewrite, so that a second process 
+    * does not compact over the first one. */
+   rv = jrn_reopen();
+   if (rv != 0) return(rv);
+   /* A torn last line must not be appended to, so rewrite it clean. */
+   if (ftorn || (jrn_nlines > jrn_n + JRN_COMPACT)) {
+      rv = jrn_compact();
+      if (jrn_fp == NULL) rv = jrn_reopen();
+      else if (ftorn && rv != 0) {  /*cannot append after a torn line*/
+         fclose(jrn_fp);
+         jrn_fp = NULL;
+      } else rv = 0;  /*keep using the old one*/
+   }
+   jrn_unsync = 0;
+   jrn_synctime = time(NULL);
+   return(rv);
+}
+
+/* cursor_get - returns 0 and the saved cursor, or ERR_NOT_FOUND */
+int cursor_get(char *key, ushort *precid, uint *ptime)
+{
+   JRN_CURSOR *pc;
+   if (jrn_fp == NULL) return(ERR_NOT_FOUND);
+   pc = jrn_find(key,0);
+   if (pc == NULL) return(ERR_NOT_FOUND);
+   *precid = pc->recid;
+   *ptime  = pc->itime;
+   return(0);
+}
+
+/* cursor_put - append a new cursor for this key to the journal */
+int cursor_put(char *key, ushort recid, uint itime)
+{
+   char line[JRN_KEYSZ+24];
+   JRN_CURSOR *pc;
+   time_t now;
+   int len;
+
+   if (jrn_fp == NULL) return(ERR_FILE_OPEN);
+   pc = jrn_find(key,1);
+   if (pc == NULL) return(ERR_BAD_PARAM);  /*too many keys*/
+   if (pc->recid == recid && pc->itime == itime && jrn_nlines > 0) 
+      return(0);  /*unchanged*/
+   pc->recid = recid;
+   pc->itime = itime;
+   len = jrn_format(line,sizeof(line),pc);
+   if (fwrite(line,1,len,jrn_fp) != (size_t)len) return(ERR_FILE_OPEN);
+   jrn_nlines++;
+   jrn_unsync++;
+   now = time(NULL);
+   if (jrn_unsync >= jrn_batch || (now - jrn_synctime) >= JRN_SYNCSEC) 
+      cursor_sync();
+   if (jrn_nlines > jrn_n + JRN_COMPACT) {
+      if (jrn_compact() != 0 && fdebug)   /*else keep the old one*/
+         printf("cursor journal %s compact error\n",jrn_file);
+      if (jrn_fp == NULL) return(jrn_reopen());
+   }
+   return(0);
+}
+
+/* cursor_sync - make sure the updates so far are on disk */
+void cursor_sync(void)
+{
+   if (jrn_fp == NULL) return;
+   if (jrn_unsync > 0) jrn_sync(jrn_fp);
+   jrn_unsync = 0;
+   jrn_synctime = time(NULL);
+}
+
+void cursor_close(void)
+{
+   if (jrn_fp == NULL) return;
+   cursor_sync();
+   fclose(jrn_fp);
+   jrn_fp = NULL;
+}
+
+/*
+ * read_nodes
+ * Read a file of BMC nodenames, one per line, for the fleet modes, and
+ * call addnode for each one.  Blank lines and '#' comments are skipped, 
+ * as is anything after the nodename.  A line too long for a nodename
+ * is an error, rather than being split into bogus nodes.
+ * Returns 0 if ok, or an error if there are no nodes.
+ */
+int read_nodes(char *fname, int (*addnode)(char *node))
+{
+   FILE *fp;
+   char line[SZGNODE+2];
+   char *p;
+   int rv = 0;
+   int n = 0;
+   int lineno = 0;
+
+   fp = fopen(fname,"r");
+   if (fp == NULL) {
+      printf("cannot open %s\n",fname);
+      return(ERR_FILE_OPEN);
+   }
+   while ((rv == 0) && fgets(line,sizeof(line),fp)) {
+      lineno++;
+      p = line;
+      while (*p == ' ' || *p == '\t') p++;
+      if ((strchr(line,'\n') == NULL) && !feof(fp)) {
+         if (p[0] == '#') {   /*skip the rest of a long comment*/
+            while (fgets(line,sizeof(line),fp) && !strchr(line,'\n')) ;
+            continue;
+         }
+         printf("%s line %d: too long, nodenames are up to %d chars\n",
+                fname,lineno,SZGNODE);
+         rv = ERR_BAD_FORMAT;
+         break;
+      }
+      p[strcspn(p," \t\r\n")] = 0;
+      if (p[0] == 0 || p[0] == '#') continue;
+      rv = addnode(p);
+      if (rv == 0) n++;
+   }
+   fclose(fp);
+   if (rv == 0 && n == 0) {
+      printf("no BMC nodenames in %s\n",fname);
+      rv = ERR_BAD_PARAM;
+   }
+   return(rv);
+}
+
+#if !defined(WIN32) && !defined(DOS) && !defined(EFI)
+/*
+ * node_fork
+ * Fork a child to talk to one node, since the IPMI library keeps one
+ * session per process.  If pfd is not NULL, a pipe (or a socketpair, 
+ * with NODE_STDIN) is opened to the child, and the flags say which of 
+ * the child's stdin/stdout/stderr use it.  The child's end is closed
+ * if it was dup'd, else it is returned in *pfd for the child to use.
+ * In the child, the node is set with parse_lan_options, and 0 is 
+ * returned.  In the parent, *pfd is the parent's end, and the pid is
+ * returned, or -1 with errno set on an error.
+ */
+int node_fork(char *node, int flags, int *pfd)
+{
+   int fds[2];
+   int pid, fd, rv;
+
+   if (pfd != NULL) {
+      if (flags & NODE_STDIN) rv = socketpair(AF_UNIX,SOCK_STREAM,0,fds);
+      else rv = pipe(fds);
+      if (rv != 0) return(-1);
+   }
+   fflush(NULL);
+   pid = fork();
+   if (pid < 0) {
+      if (pfd != NULL) {
+         rv = errno;
+         close(fds[0]);
+         close(fds[1]);
+         errno = rv;
+      }
+      return(-1);
+   }
+   if (pid > 0) {  /*parent*/
+      if (pfd != NULL) {
+         close(fds[1]);
+         *pfd = fds[0];
+      }
+      return(pid);
+   }
+   /* child */
+   if (flags & (NODE_NULLIN | NODE_NULLOUT)) {
+      fd = open("/dev/null",O_RDWR);
+      if (fd >= 0) {
+         if (flags & NODE_NULLIN) dup2(fd,0);
+         if (flags & NODE_NULLOUT) { dup2(fd,1); dup2(fd,2); }
+         close(fd);
+      }
+   }
+   if (pfd != NULL) {
+      close(fds[0]);
+      fd = fds[1];
+      if (flags & NODE_STDIN)  dup2(fd,0);
+      if (flags & NODE_STDOUT) dup2(fd,1);
+      if (flags & NODE_STDERR) dup2(fd,2);
+      if (flags & (NODE_STDIN | NODE_STDOUT | NODE_STDERR)) {
+         close(fd);
+         fd = -1;
+      }
+      *pfd = fd;
+   }
+   parse_lan_options('N',node,fdebug);
+   return(0);
+}
+
+/*
+ * node_reap
+ * Wait for a node child to exit, killing it first if fkill, and close
+ * the parent's end of its pipe (if fd >= 0).
+ * Returns the wait status of the child, or -1 on an error.
+ */
+int node_reap(int pid, int fd, char fkill)
+{
+   int status = 0;
+
+   if (fkill) kill(pid,SIGKILL);
+   if (fd >= 0) close(fd);
+   while (waitpid(pid,&status,0) < 0) {
+      if (errno != EINTR) return(-1);
+   }
+   return(status);
+}
+#endif
+
 /* end subs.c */